@@ -0,0 +1,532 @@
+#include "BoundingVolumeHierarchy.h"
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+
+// Items per parallelFor chunk in the build passes
+static const size_t BUILD_GRAIN_SIZE = 4096;
+
+// Below this many instances the build runs on the calling thread only
+static const size_t PARALLEL_BUILD_MIN = 16384;
+
+/**
+ * Spread the low 10 bits of v so there are two zero bits between each
+ */
+static uint32_t expandBits(uint32_t v)
+{
+    v = (v * 0x00010001u) & 0xFF0000FFu;
+    v = (v * 0x00000101u) & 0x0F00F00Fu;
+    v = (v * 0x00000011u) & 0xC30C30C3u;
+    v = (v * 0x00000005u) & 0x49249249u;
+    return v;
+}
+
+/**
+ * 30-bit Morton code of a point inside the unit cube
+ */
+static uint32_t getMortonCode(const glm::vec3& unit)
+{
+    glm::vec3 scaled = glm::clamp(unit * 1024.0f, glm::vec3(0.0f), glm::vec3(1023.0f));
+    return (expandBits((uint32_t)scaled.x) << 2) | (expandBits((uint32_t)scaled.y) << 1) | expandBits((uint32_t)scaled.z);
+}
+
+/**
+ * Sort chunks on the pool, then merge neighbouring runs until one is left
+ */
+static void parallelSort(ThreadPool* threadPool, std::vector<uint64_t>& keys)
+{
+    size_t count = keys.size();
+    size_t chunkCount = threadPool ? threadPool->getThreadCount() + 1 : 1;
+    if (chunkCount == 1 || count < PARALLEL_BUILD_MIN)
+    {
+        std::sort(keys.begin(), keys.end());
+        return;
+    }
+
+    size_t chunkSize = (count + chunkCount - 1) / chunkCount;
+    threadPool->parallelFor(count, chunkSize, [&keys](size_t begin, size_t end) {
+        std::sort(keys.begin() + begin, keys.begin() + end);
+    });
+    for (size_t width = chunkSize; width < count; width *= 2)
+    {
+        threadPool->parallelFor(count, width * 2, [&keys, width](size_t begin, size_t end) {
+            size_t middle = std::min(begin + width, end);
+            std::inplace_merge(keys.begin() + begin, keys.begin() + middle, keys.begin() + end);
+        });
+    }
+}
+
+BoundingVolumeHierarchy::BoundingVolumeHierarchy(ThreadPool* threadPool)
+    : threadPool(threadPool),
+    treeInstanceCount(0),
+    pendingInstanceCount(0),
+    rebuildCount(0)
+{
+}
+
+BoundingVolumeHierarchy::~BoundingVolumeHierarchy()
+{
+    if (pendingBuild.valid())
+        pendingBuild.wait();
+}
+
+float BoundingVolumeHierarchy::getSurfaceArea(const glm::vec3& boxMin, const glm::vec3& boxMax)
+{
+    glm::vec3 size = glm::max(boxMax - boxMin, glm::vec3(0.0f));
+    return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+}
+
+void BoundingVolumeHierarchy::build(ThreadPool* threadPool, const std::vector<glm::vec3>& boxMin,
+    const std::vector<glm::vec3>& boxMax, size_t count, Tree& outTree)
+{
+    outTree.nodes.clear();
+    outTree.leafOfInstance.assign(count, -1);
+    outTree.builtArea = outTree.area = 0.0f;
+    if (count == 0)
+        return;
+
+    ThreadPool* pool = count >= PARALLEL_BUILD_MIN ? threadPool : nullptr;
+    auto parallelFor = [pool](size_t items, const std::function<void(size_t, size_t)>& body) {
+        if (pool)
+            pool->parallelFor(items, BUILD_GRAIN_SIZE, body);
+        else
+            body(0, items);
+    };
+
+    // ===== Morton codes of the box centers =====
+    glm::vec3 sceneMin(std::numeric_limits<float>::max());
+    glm::vec3 sceneMax(-std::numeric_limits<float>::max());
+    for (size_t i = 0; i < count; i++)
+    {
+        glm::vec3 center = (boxMin[i] + boxMax[i]) * 0.5f;
+        sceneMin = glm::min(sceneMin, center);
+        sceneMax = glm::max(sceneMax, center);
+    }
+    glm::vec3 sceneScale = 1.0f / glm::max(sceneMax - sceneMin, glm::vec3(1e-6f));
+
+    // The instance index in the low bits keeps every key unique
+    std::vector<uint64_t> keys(count);
+    parallelFor(count, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++)
+        {
+            glm::vec3 center = (boxMin[i] + boxMax[i]) * 0.5f;
+            keys[i] = ((uint64_t)getMortonCode((center - sceneMin) * sceneScale) << 32) | (uint64_t)i;
+        }
+    });
+    parallelSort(pool, keys);
+
+    // ===== Nodes: internal [0, count - 1), leaves [count - 1, 2 * count - 1) =====
+    const int internalCount = (int)count - 1;
+    outTree.nodes.resize(2 * count - 1);
+    std::vector<BvhNode>& nodes = outTree.nodes;
+
+    parallelFor(count, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++)
+        {
+            unsigned int instance = (unsigned int)(keys[i] & 0xFFFFFFFFu);
+            BvhNode& leaf = nodes[internalCount + i];
+            leaf.boundsMin = boxMin[instance];
+            leaf.boundsMax = boxMax[instance];
+            leaf.left = -1;
+            leaf.right = (int)instance;
+            outTree.leafOfInstance[instance] = internalCount + (int)i;
+        }
+    });
+    nodes[0].parent = -1;
+
+    // Common prefix length of two sorted keys, -1 outside the range
+    auto prefix = [&keys, count](int a, int b) {
+        if (b < 0 || b >= (int)count)
+            return -1;
+        return std::countl_zero(keys[a] ^ keys[b]);
+    };
+
+    // Karras: each internal node finds its key range and split independently
+    parallelFor((size_t)internalCount, [&](size_t begin, size_t end) {
+        for (int i = (int)begin; i < (int)end; i++)
+        {
+            int direction = prefix(i, i + 1) > prefix(i, i - 1) ? 1 : -1;
+            int minimumPrefix = prefix(i, i - direction);
+
+            int lengthBound = 2;
+            while (prefix(i, i + lengthBound * direction) > minimumPrefix)
+                lengthBound *= 2;
+            int length = 0;
+            for (int step = lengthBound / 2; step >= 1; step /= 2)
+            {
+                if (prefix(i, i + (length + step) * direction) > minimumPrefix)
+                    length += step;
+            }
+            int j = i + length * direction;
+
+            int nodePrefix = prefix(i, j);
+            int split = 0;
+            for (int step = (length + 1) / 2; ; step = (step + 1) / 2)
+            {
+                if (prefix(i, i + (split + step) * direction) > nodePrefix)
+                    split += step;
+                if (step == 1)
+                    break;
+            }
+            int gamma = i + split * direction + std::min(direction, 0);
+
+            BvhNode& node = nodes[i];
+            node.left = std::min(i, j) == gamma ? internalCount + gamma : gamma;
+            node.right = std::max(i, j) == gamma + 1 ? internalCount + gamma + 1 : gamma + 1;
+            nodes[node.left].parent = i;
+            nodes[node.right].parent = i;
+        }
+    });
+
+    // ===== Bounds bottom-up: the second child to arrive computes its parent =====
+    std::vector<std::atomic<int>> arrivals(internalCount);
+    parallelFor(count, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++)
+        {
+            int node = nodes[internalCount + i].parent;
+            while (node >= 0 && arrivals[node].fetch_add(1, std::memory_order_acq_rel) == 1)
+            {
+                const BvhNode& left = nodes[nodes[node].left];
+                const BvhNode& right = nodes[nodes[node].right];
+                nodes[node].boundsMin = glm::min(left.boundsMin, right.boundsMin);
+                nodes[node].boundsMax = glm::max(left.boundsMax, right.boundsMax);
+                node = nodes[node].parent;
+            }
+        }
+    });
+
+    for (int i = 0; i < internalCount; i++)
+        outTree.area += getSurfaceArea(nodes[i].boundsMin, nodes[i].boundsMax);
+    outTree.builtArea = outTree.area;
+}
+
+void BoundingVolumeHierarchy::clear()
+{
+    if (pendingBuild.valid())
+        pendingBuild.wait();
+    pendingBuild = std::future<void>();
+    pendingTree.reset();
+    movedDuringBuild.clear();
+
+    instanceMin.clear();
+    instanceMax.clear();
+    tree = Tree();
+    treeInstanceCount = 0;
+    dirtyLeaves.clear();
+}
+
+unsigned int BoundingVolumeHierarchy::add(const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+{
+    instanceMin.push_back(boundsMin);
+    instanceMax.push_back(boundsMax);
+    return (unsigned int)(instanceMin.size() - 1);
+}
+
+void BoundingVolumeHierarchy::update(unsigned int instance, const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+{
+    instanceMin[instance] = boundsMin;
+    instanceMax[instance] = boundsMax;
+
+    if (instance < treeInstanceCount)
+    {
+        int leaf = tree.leafOfInstance[instance];
+        tree.nodes[leaf].boundsMin = boundsMin;
+        tree.nodes[leaf].boundsMax = boundsMax;
+        dirtyLeaves.push_back(leaf);
+    }
+    if (pendingBuild.valid())
+        movedDuringBuild.push_back(instance);
+}
+
+void BoundingVolumeHierarchy::refit()
+{
+    for (int leaf : dirtyLeaves)
+    {
+        // Stop at the first ancestor whose box does not change
+        int node = tree.nodes[leaf].parent;
+        while (node >= 0)
+        {
+            BvhNode& parent = tree.nodes[node];
+            const BvhNode& left = tree.nodes[parent.left];
+            const BvhNode& right = tree.nodes[parent.right];
+            glm::vec3 boundsMin = glm::min(left.boundsMin, right.boundsMin);
+            glm::vec3 boundsMax = glm::max(left.boundsMax, right.boundsMax);
+            if (boundsMin == parent.boundsMin && boundsMax == parent.boundsMax)
+                break;
+
+            tree.area += getSurfaceArea(boundsMin, boundsMax) - getSurfaceArea(parent.boundsMin, parent.boundsMax);
+            parent.boundsMin = boundsMin;
+            parent.boundsMax = boundsMax;
+            node = parent.parent;
+        }
+    }
+    dirtyLeaves.clear();
+
+    if (!pendingBuild.valid() && tree.builtArea > 0.0f && tree.area > tree.builtArea * REBUILD_AREA_RATIO)
+        startRebuild();
+}
+
+void BoundingVolumeHierarchy::startRebuild()
+{
+    if (!threadPool)
+    {
+        rebuild();
+        return;
+    }
+
+    auto snapshotMin = std::make_shared<std::vector<glm::vec3>>(instanceMin);
+    auto snapshotMax = std::make_shared<std::vector<glm::vec3>>(instanceMax);
+    pendingTree = std::make_unique<Tree>();
+    pendingInstanceCount = instanceMin.size();
+    movedDuringBuild.clear();
+
+    Tree* target = pendingTree.get();
+    ThreadPool* pool = threadPool;
+    size_t count = pendingInstanceCount;
+    pendingBuild = threadPool->submit([pool, snapshotMin, snapshotMax, count, target]() {
+        build(pool, *snapshotMin, *snapshotMax, count, *target);
+    });
+}
+
+void BoundingVolumeHierarchy::poll(bool wait)
+{
+    // Instances added since the last build
+    if (!pendingBuild.valid() && instanceMin.size() > treeInstanceCount)
+        startRebuild();
+
+    if (!pendingBuild.valid())
+        return;
+    if (!wait && pendingBuild.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+        return;
+
+    pendingBuild.get();
+    tree = std::move(*pendingTree);
+    pendingTree.reset();
+    treeInstanceCount = pendingInstanceCount;
+    rebuildCount++;
+
+    // Moves that happened after the snapshot was taken
+    dirtyLeaves.clear();
+    for (unsigned int instance : movedDuringBuild)
+    {
+        if (instance >= treeInstanceCount)
+            continue;
+        int leaf = tree.leafOfInstance[instance];
+        tree.nodes[leaf].boundsMin = instanceMin[instance];
+        tree.nodes[leaf].boundsMax = instanceMax[instance];
+        dirtyLeaves.push_back(leaf);
+    }
+    movedDuringBuild.clear();
+    refit();
+}
+
+void BoundingVolumeHierarchy::rebuild()
+{
+    if (pendingBuild.valid())
+        poll(true);
+    build(threadPool, instanceMin, instanceMax, instanceMin.size(), tree);
+    treeInstanceCount = instanceMin.size();
+    dirtyLeaves.clear();
+    rebuildCount++;
+}
+
+template<typename Visit>
+void BoundingVolumeHierarchy::visitSubtree(int node, Visit&& visit) const
+{
+    // Depth is bounded by the 64-bit key length (every level extends the common prefix)
+    int stack[128];
+    int stackSize = 0;
+    stack[stackSize++] = node;
+    while (stackSize > 0)
+    {
+        const BvhNode& current = tree.nodes[stack[--stackSize]];
+        if (current.left < 0)
+        {
+            visit((unsigned int)current.right);
+            continue;
+        }
+        stack[stackSize++] = current.left;
+        stack[stackSize++] = current.right;
+    }
+}
+
+void BoundingVolumeHierarchy::queryFrustum(const Frustum& frustum, std::vector<unsigned int>& outInstances) const
+{
+    outInstances.clear();
+
+    std::vector<int> stack;
+    if (tree.getRoot() >= 0)
+        stack.push_back(tree.getRoot());
+    while (!stack.empty())
+    {
+        int index = stack.back();
+        stack.pop_back();
+        const BvhNode& node = tree.nodes[index];
+
+        // Outside one plane: skip; inside all planes: take the subtree untested
+        bool inside = true;
+        bool outside = false;
+        for (const glm::vec4& plane : frustum.planes)
+        {
+            glm::vec3 normal(plane);
+            glm::vec3 furthest(plane.x >= 0.0f ? node.boundsMax.x : node.boundsMin.x,
+                plane.y >= 0.0f ? node.boundsMax.y : node.boundsMin.y,
+                plane.z >= 0.0f ? node.boundsMax.z : node.boundsMin.z);
+            glm::vec3 nearest(plane.x >= 0.0f ? node.boundsMin.x : node.boundsMax.x,
+                plane.y >= 0.0f ? node.boundsMin.y : node.boundsMax.y,
+                plane.z >= 0.0f ? node.boundsMin.z : node.boundsMax.z);
+            if (glm::dot(normal, furthest) + plane.w < 0.0f)
+            {
+                outside = true;
+                break;
+            }
+            if (glm::dot(normal, nearest) + plane.w < 0.0f)
+                inside = false;
+        }
+
+        if (outside)
+            continue;
+        if (inside || node.left < 0)
+        {
+            visitSubtree(index, [&outInstances](unsigned int instance) { outInstances.push_back(instance); });
+            continue;
+        }
+        stack.push_back(node.left);
+        stack.push_back(node.right);
+    }
+
+    // Not in the tree yet
+    for (size_t i = treeInstanceCount; i < instanceMin.size(); i++)
+    {
+        if (frustum.intersectsBox(instanceMin[i], instanceMax[i]))
+            outInstances.push_back((unsigned int)i);
+    }
+}
+
+/**
+ * Slab test, distance to the box along the ray (or -1 if missed)
+ */
+static float intersectRayBox(const glm::vec3& origin, const glm::vec3& inverseDirection,
+    const glm::vec3& boxMin, const glm::vec3& boxMax, float maxDistance)
+{
+    glm::vec3 t0 = (boxMin - origin) * inverseDirection;
+    glm::vec3 t1 = (boxMax - origin) * inverseDirection;
+    glm::vec3 tNear = glm::min(t0, t1);
+    glm::vec3 tFar = glm::max(t0, t1);
+    float enter = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, 0.0f));
+    float exit = std::min(std::min(tFar.x, tFar.y), std::min(tFar.z, maxDistance));
+    return enter <= exit ? enter : -1.0f;
+}
+
+int BoundingVolumeHierarchy::queryRay(const glm::vec3& origin, const glm::vec3& direction, float maxDistance,
+    float& outDistance) const
+{
+    glm::vec3 inverseDirection = 1.0f / direction;
+    int hit = -1;
+    float closest = maxDistance;
+
+    std::vector<int> stack;
+    if (tree.getRoot() >= 0 && intersectRayBox(origin, inverseDirection, tree.nodes[0].boundsMin,
+        tree.nodes[0].boundsMax, closest) >= 0.0f)
+        stack.push_back(tree.getRoot());
+    while (!stack.empty())
+    {
+        const BvhNode& node = tree.nodes[stack.back()];
+        stack.pop_back();
+
+        if (node.left < 0)
+        {
+            float distance = intersectRayBox(origin, inverseDirection, node.boundsMin, node.boundsMax, closest);
+            if (distance >= 0.0f && distance < closest)
+            {
+                closest = distance;
+                hit = node.right;
+            }
+            continue;
+        }
+
+        // Visit the nearer child first so the farther one is more likely to be skipped
+        const BvhNode& left = tree.nodes[node.left];
+        const BvhNode& right = tree.nodes[node.right];
+        float leftDistance = intersectRayBox(origin, inverseDirection, left.boundsMin, left.boundsMax, closest);
+        float rightDistance = intersectRayBox(origin, inverseDirection, right.boundsMin, right.boundsMax, closest);
+        if (leftDistance >= 0.0f && rightDistance >= 0.0f)
+        {
+            bool leftFirst = leftDistance <= rightDistance;
+            stack.push_back(leftFirst ? node.right : node.left);
+            stack.push_back(leftFirst ? node.left : node.right);
+        }
+        else if (leftDistance >= 0.0f)
+            stack.push_back(node.left);
+        else if (rightDistance >= 0.0f)
+            stack.push_back(node.right);
+    }
+
+    for (size_t i = treeInstanceCount; i < instanceMin.size(); i++)
+    {
+        float distance = intersectRayBox(origin, inverseDirection, instanceMin[i], instanceMax[i], closest);
+        if (distance >= 0.0f && distance < closest)
+        {
+            closest = distance;
+            hit = (int)i;
+        }
+    }
+
+    outDistance = closest;
+    return hit;
+}
+
+/**
+ * True if the box is within radius of the center
+ */
+static bool intersectSphereBox(const glm::vec3& center, float radiusSquared, const glm::vec3& boxMin,
+    const glm::vec3& boxMax)
+{
+    glm::vec3 offset = glm::clamp(center, boxMin, boxMax) - center;
+    return glm::dot(offset, offset) <= radiusSquared;
+}
+
+void BoundingVolumeHierarchy::querySphere(const glm::vec3& center, float radius,
+    std::vector<unsigned int>& outInstances) const
+{
+    outInstances.clear();
+    float radiusSquared = radius * radius;
+
+    std::vector<int> stack;
+    if (tree.getRoot() >= 0)
+        stack.push_back(tree.getRoot());
+    while (!stack.empty())
+    {
+        const BvhNode& node = tree.nodes[stack.back()];
+        stack.pop_back();
+        if (!intersectSphereBox(center, radiusSquared, node.boundsMin, node.boundsMax))
+            continue;
+
+        if (node.left < 0)
+            outInstances.push_back((unsigned int)node.right);
+        else
+        {
+            stack.push_back(node.left);
+            stack.push_back(node.right);
+        }
+    }
+
+    for (size_t i = treeInstanceCount; i < instanceMin.size(); i++)
+    {
+        if (intersectSphereBox(center, radiusSquared, instanceMin[i], instanceMax[i]))
+            outInstances.push_back((unsigned int)i);
+    }
+}
+
+void BoundingVolumeHierarchy::printStats() const
+{
+    float quality = tree.builtArea > 0.0f ? tree.area / tree.builtArea : 1.0f;
+    std::cout << "BVH: " << instanceMin.size() << " instances (" << (instanceMin.size() - treeInstanceCount)
+        << " not yet in the tree), " << tree.nodes.size() << " nodes, area " << quality << "x of last build (rebuild at "
+        << REBUILD_AREA_RATIO << "x), " << rebuildCount << " rebuilds" << (isRebuilding() ? ", rebuilding" : "")
+        << std::endl;
+}
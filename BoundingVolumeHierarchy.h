@@ -0,0 +1,165 @@
+#pragma once
+#include <future>
+#include <memory>
+#include <vector>
+#include <glm/glm.hpp>
+#include "Frustum.h"
+#include "ThreadPool.h"
+
+/**
+ * @struct BvhNode
+ * @brief Box of a subtree; leaves hold exactly one instance
+ */
+struct BvhNode
+{
+    glm::vec3 boundsMin;
+    int left;               // Child node, -1 for leaves
+    glm::vec3 boundsMax;
+    int right;              // Child node, or the instance index for leaves
+    int parent;             // -1 for the root
+};
+
+/**
+ * @class BoundingVolumeHierarchy
+ * @brief Dynamic BVH over instance boxes for frustum, ray and sphere queries
+ *
+ * Built as a linear BVH (Karras 2012): instance centers are sorted by 30-bit
+ * Morton code and every internal node is found independently from the sorted
+ * codes, so both the sort and the node pass run on the thread pool.
+ *
+ * - update() moves one instance: its leaf box is replaced and refit() grows or
+ *   shrinks only the ancestors of moved leaves.
+ * - Refitting keeps queries correct but loosens the tree. When the summed
+ *   surface area of the internal nodes exceeds REBUILD_AREA_RATIO times its
+ *   value after the last build, a rebuild starts on a worker thread. The old
+ *   tree keeps answering queries until the new one is swapped in by poll();
+ *   instances moved meanwhile are refit into the new tree.
+ * - Instances added since the last build are tested linearly until the
+ *   rebuild started by the next poll() has finished.
+ *
+ * Not thread-safe: add/update/refit/poll/query from one thread only.
+ */
+class BoundingVolumeHierarchy
+{
+public:
+    // Rebuild once refitting has grown the internal node area by this factor
+    static constexpr float REBUILD_AREA_RATIO = 1.5f;
+
+private:
+    struct Tree
+    {
+        std::vector<BvhNode> nodes;     // Internal nodes [0, n-1), leaves [n-1, 2n-1)
+        std::vector<int> leafOfInstance;
+        float builtArea = 0.0f;
+        float area = 0.0f;
+
+        int getRoot() const { return nodes.empty() ? -1 : 0; }
+    };
+
+    ThreadPool* threadPool;
+
+    // Current box of every instance
+    std::vector<glm::vec3> instanceMin;
+    std::vector<glm::vec3> instanceMax;
+
+    Tree tree;
+    size_t treeInstanceCount;               // Instances [0, treeInstanceCount) are in the tree
+    std::vector<int> dirtyLeaves;
+
+    // Background rebuild
+    std::future<void> pendingBuild;
+    std::unique_ptr<Tree> pendingTree;
+    size_t pendingInstanceCount;
+    std::vector<unsigned int> movedDuringBuild;
+    size_t rebuildCount;
+
+    /**
+     * Build a tree over the first count boxes
+     */
+    static void build(ThreadPool* threadPool, const std::vector<glm::vec3>& boxMin,
+        const std::vector<glm::vec3>& boxMax, size_t count, Tree& outTree);
+
+    static float getSurfaceArea(const glm::vec3& boxMin, const glm::vec3& boxMax);
+
+    /**
+     * Snapshot the boxes and build a new tree on a worker thread
+     */
+    void startRebuild();
+
+    /**
+     * Visit every instance below a node
+     */
+    template<typename Visit>
+    void visitSubtree(int node, Visit&& visit) const;
+
+public:
+    /**
+     * @param threadPool Pool for parallel and background builds (nullptr = build on the calling thread)
+     */
+    explicit BoundingVolumeHierarchy(ThreadPool* threadPool = nullptr);
+    ~BoundingVolumeHierarchy();
+
+    BoundingVolumeHierarchy(const BoundingVolumeHierarchy&) = delete;
+    BoundingVolumeHierarchy& operator=(const BoundingVolumeHierarchy&) = delete;
+
+    /**
+     * Drop every instance (waits for a running rebuild)
+     */
+    void clear();
+
+    /**
+     * Add an instance, its index is the number of instances added before it
+     */
+    unsigned int add(const glm::vec3& boundsMin, const glm::vec3& boundsMax);
+
+    /**
+     * Move an instance (takes effect in queries after refit())
+     */
+    void update(unsigned int instance, const glm::vec3& boundsMin, const glm::vec3& boundsMax);
+
+    /**
+     * Refit the ancestors of moved instances, starting a rebuild if the tree degraded
+     */
+    void refit();
+
+    /**
+     * Swap in a finished background rebuild, or start one if instances were added
+     * Call once per frame; without a thread pool the rebuild runs right here
+     * @param wait Block until a running rebuild finishes
+     */
+    void poll(bool wait = false);
+
+    /**
+     * Build the whole tree now on the calling thread (and the pool)
+     */
+    void rebuild();
+
+    /**
+     * Instances whose box intersects the frustum (subtrees fully inside are not tested further)
+     */
+    void queryFrustum(const Frustum& frustum, std::vector<unsigned int>& outInstances) const;
+
+    /**
+     * Nearest instance box hit by a ray
+     * @param origin Ray origin
+     * @param direction Ray direction (need not be normalized, distances are in its units)
+     * @param maxDistance Ignore hits further than this
+     * @param outDistance Distance to the hit
+     * @return Instance index, or -1 if nothing was hit
+     */
+    int queryRay(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, float& outDistance) const;
+
+    /**
+     * Instances whose box intersects a sphere
+     */
+    void querySphere(const glm::vec3& center, float radius, std::vector<unsigned int>& outInstances) const;
+
+    size_t getInstanceCount() const { return instanceMin.size(); }
+    size_t getNodeCount() const { return tree.nodes.size(); }
+    bool isRebuilding() const { return pendingBuild.valid(); }
+
+    /**
+     * Print node count, tree quality and rebuild count
+     */
+    void printStats() const;
+};
@@ -0,0 +1,118 @@
+#include "BuddyAllocator.h"
+#include <cassert>
+
+BuddyAllocator::BuddyAllocator(size_t capacity, size_t minBlockSize)
+{
+    reset(capacity, minBlockSize);
+}
+
+void BuddyAllocator::reset(size_t capacity, size_t minBlockSize)
+{
+    // Buddies are found by flipping the block size bit of the offset
+    assert((minBlockSize & (minBlockSize - 1)) == 0 && "minBlockSize must be a power of two");
+    this->minBlockSize = (minBlockSize > 0) ? minBlockSize : 1;
+    maxOrder = 0;
+    while (getBlockSize(maxOrder) < capacity)
+        maxOrder++;
+
+    freeBlocks.assign(maxOrder + 1, std::set<size_t>());
+    freeBlocks[maxOrder].insert(0);
+    allocated.clear();
+    usedElements = 0;
+}
+
+int BuddyAllocator::getOrder(size_t elements) const
+{
+    int order = 0;
+    while (getBlockSize(order) < elements)
+        order++;
+    return order;
+}
+
+bool BuddyAllocator::allocate(size_t elements, size_t& outOffset)
+{
+    if (elements == 0)
+        elements = 1;
+
+    int order = getOrder(elements);
+    if (order > maxOrder)
+        return false;
+
+    // Smallest free block that fits
+    int found = order;
+    while (found <= maxOrder && freeBlocks[found].empty())
+        found++;
+    if (found > maxOrder)
+        return false;
+
+    // Lowest offset first keeps live data packed towards the start
+    size_t offset = *freeBlocks[found].begin();
+    freeBlocks[found].erase(freeBlocks[found].begin());
+
+    // Split down to the requested order, the upper halves become free
+    while (found > order)
+    {
+        found--;
+        freeBlocks[found].insert(offset + getBlockSize(found));
+    }
+
+    allocated[offset] = { order, elements };
+    usedElements += elements;
+    outOffset = offset;
+    return true;
+}
+
+void BuddyAllocator::free(size_t offset)
+{
+    auto found = allocated.find(offset);
+    if (found == allocated.end())
+        return;
+
+    int order = found->second.order;
+    usedElements -= found->second.elements;
+    allocated.erase(found);
+
+    // Merge with the buddy while it is free
+    while (order < maxOrder)
+    {
+        size_t buddy = offset ^ getBlockSize(order);
+        auto buddyFree = freeBlocks[order].find(buddy);
+        if (buddyFree == freeBlocks[order].end())
+            break;
+
+        freeBlocks[order].erase(buddyFree);
+        offset = (offset < buddy) ? offset : buddy;
+        order++;
+    }
+    freeBlocks[order].insert(offset);
+}
+
+void BuddyAllocator::grow()
+{
+    // The old range becomes the lower buddy of the new root
+    size_t oldCapacity = getCapacity();
+    freeBlocks.push_back(std::set<size_t>());
+
+    if (freeBlocks[maxOrder].count(0) != 0)
+    {
+        // Nothing allocated: the whole new range is one free block
+        freeBlocks[maxOrder].erase(0);
+        maxOrder++;
+        freeBlocks[maxOrder].insert(0);
+    }
+    else
+    {
+        freeBlocks[maxOrder].insert(oldCapacity);
+        maxOrder++;
+    }
+}
+
+size_t BuddyAllocator::getLargestFreeBlock() const
+{
+    for (int order = maxOrder; order >= 0; order--)
+    {
+        if (!freeBlocks[order].empty())
+            return getBlockSize(order);
+    }
+    return 0;
+}
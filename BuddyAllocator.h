@@ -0,0 +1,77 @@
+#pragma once
+#include <cstddef>
+#include <set>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @class BuddyAllocator
+ * @brief Power-of-two block suballocator for ranges inside a GPU buffer
+ *
+ * Hands out offsets (in elements, not bytes) into a range of getCapacity()
+ * elements. Requests are rounded up to a power of two of at least the minimum
+ * block size; freed blocks merge with their buddy whenever it is free too.
+ * The allocator only does bookkeeping, it never touches GL.
+ */
+class BuddyAllocator
+{
+private:
+    struct Block
+    {
+        int order;
+        size_t elements;    // Requested size (not rounded)
+    };
+
+    size_t minBlockSize;
+    int maxOrder;                                   // Capacity = minBlockSize << maxOrder
+    std::vector<std::set<size_t>> freeBlocks;       // Free block offsets per order
+    std::unordered_map<size_t, Block> allocated;    // Live blocks by offset
+    size_t usedElements;
+
+    /**
+     * Smallest order whose block holds the given number of elements
+     */
+    int getOrder(size_t elements) const;
+
+    size_t getBlockSize(int order) const { return minBlockSize << order; }
+
+public:
+    /**
+     * Constructor
+     * @param capacity Elements managed (rounded up to minBlockSize times a power of two)
+     * @param minBlockSize Smallest block handed out (power of two)
+     */
+    BuddyAllocator(size_t capacity = 0, size_t minBlockSize = 64);
+
+    /**
+     * Forget all allocations and manage a new range
+     */
+    void reset(size_t capacity, size_t minBlockSize);
+
+    /**
+     * Allocate a block
+     * @param elements Size of the request
+     * @param outOffset Offset of the block
+     * @return False if no free block is large enough (see grow())
+     */
+    bool allocate(size_t elements, size_t& outOffset);
+
+    /**
+     * Free a block returned by allocate() and merge it with free buddies
+     */
+    void free(size_t offset);
+
+    /**
+     * Double the managed range; existing offsets stay valid
+     */
+    void grow();
+
+    size_t getCapacity() const { return getBlockSize(maxOrder); }
+    size_t getUsed() const { return usedElements; }
+    size_t getAllocationCount() const { return allocated.size(); }
+
+    /**
+     * Size of the largest free block
+     */
+    size_t getLargestFreeBlock() const;
+};
@@ -23,7 +23,31 @@
  * - A/D: Strafe left/right
  * - Arrow Keys: Rotate camera view
  * - Space: Spawn model in front of camera (3 second cooldown)
+ * - I: Cycle draw path (individual / instanced / multi-draw indirect / GPU-culled / occlusion queries)
+ * - O: Toggle occlusion culling of the GPU-culled draw path
+ * - C: Toggle CPU frustum culling of the other draw paths
+ * - X: Toggle software occlusion culling after CPU frustum culling
+ * - V: Toggle vertex pulling from a storage buffer in the multi-draw indirect path
+ * - Z: Toggle the depth-only pre-pass of the multi-draw indirect path
+ * - B: Toggle static batching of spawned (static) models into pre-transformed cell buffers
+ * - N: Toggle dynamic batching of small meshes in the individual draw path
+ * - H: Toggle HLOD proxies for distant clusters of static models (when static batching is off)
+ * - M: Toggle octahedral impostors for distant models
+ * - L: Toggle clustered forward lighting of the point lights
+ * - F: Toggle deferred shading (packed G-buffer, one clustered lighting pass)
+ * - K: Toggle cascaded sun shadows
+ * - J: Toggle the static caster cache of the shadow cascades
+ * - P: Pick the model under the screen center (BVH ray query)
+ * - G: Print GL state calls issued/elided in the last frame, stream buffer stalls and mesh memory
  * - ESC: Exit application
+ *
+ * Options:
+ * - --texture-quality=full|half|quarter: Downscale textures on load
+ * - --max-texture-size=N: Cap texture width/height at N texels
+ * - --depth-prepass: Start with the depth-only pre-pass enabled
+ * - --lights=N: Number of point lights scattered over the scene (default 256)
+ * - --bench-instancing: Print frame time vs. instance count and exit
+ * - --bench-culling: Print CPU frustum culling throughput (flat SIMD and BVH) and exit
  */
 
 #include <iostream>
@@ -32,6 +56,13 @@
 #include <sstream>
 #include <vector>
 #include <chrono>
+#include <cstdlib>
+#include <cmath>
+#include <functional>
+#include <iomanip>
+#include <map>
+#include <random>
+#include <tuple>
 
  // GLM (mathematics library)
 #include <glm/glm.hpp>
@@ -49,6 +80,31 @@
 // Custom classes
 #include "Model3D.h"
 #include "Camera.h"
+#include "TexturePacker.h"
+#include "TextureLoader.h"
+#include "ThreadPool.h"
+#include "GLResources.h"
+#include "GLStateCache.h"
+#include "ShaderProgram.h"
+#include "UniformBuffers.h"
+#include "StreamBuffer.h"
+#include "MeshRegistry.h"
+#include "IndirectDraw.h"
+#include "GpuCulling.h"
+#include "Frustum.h"
+#include "FrustumCuller.h"
+#include "BoundingVolumeHierarchy.h"
+#include "SoftwareOcclusion.h"
+#include "OcclusionQueries.h"
+#include "RenderQueue.h"
+#include "StaticBatching.h"
+#include "DynamicBatching.h"
+#include "HierarchicalLod.h"
+#include "Impostors.h"
+#include "ClusteredLighting.h"
+#include "DeferredShading.h"
+#include "ShadowMaps.h"
+#include "SceneFramebuffer.h"
 
 using namespace std;
 
@@ -56,167 +112,1052 @@ using namespace std;
 const float WINDOW_WIDTH = 1280.0f;
 const float WINDOW_HEIGHT = 720.0f;
 const string WINDOW_TITLE = "GDGRAP1 - Programming Challenge 1 - Barundia";
+const glm::vec3 CLEAR_COLOR = glm::vec3(0.1f, 0.1f, 0.15f);
 
 // ===== FILE PATHS =====
 const string SHADER_VERT_PATH = "Shaders/sample.vert";
 const string SHADER_FRAG_PATH = "Shaders/sample.frag";
+const string SHADER_INDIRECT_VERT_PATH = "Shaders/indirect.vert";
+const string SHADER_CULLED_VERT_PATH = "Shaders/culled.vert";
+const string SHADER_PULLED_VERT_PATH = "Shaders/pulled.vert";
+const string SHADER_DEPTH_PREPASS_VERT_PATH = "Shaders/depth_prepass.vert";
+const string SHADER_DEPTH_PREPASS_FRAG_PATH = "Shaders/depth_prepass.frag";
+const string SHADER_STATIC_VERT_PATH = "Shaders/static.vert";
 const string MODEL_PATH = "3D/mccree.obj";
 const string MODEL_MTL_DIR = "3D/";
+const string TEXTURE_PATH = "3D/ayaya.png";
 
 // ===== GLOBAL VARIABLES =====
 Camera* g_camera = nullptr;
 vector<Model3D> g_spawnedModels;
-GLuint g_shaderProgram = 0;
+ShaderProgram g_shaderProgram;
+MeshRegistry g_meshRegistry;
+MeshHandle g_modelMesh = INVALID_MESH;
+TexturePacker g_texturePacker;
+ThreadPool* g_threadPool = nullptr;
+
+// Uniform buffers: camera/time once per frame, per-draw data from a ring
+FrameUniformBuffer g_frameUniforms;
+UniformRing g_drawUniformRing;
+vector<size_t> g_drawUniformOffsets;
+
+// Persistently mapped per-frame instance data
+StreamBuffer g_instanceStream;
+
+// Uniform handles of g_shaderProgram, resolved once after linking
+// (camera and per-draw data live in uniform blocks, see UniformBuffers.h)
+struct SceneUniforms
+{
+    ShaderProgram::UniformHandle tex0;
+    ShaderProgram::UniformHandle useInstancing;
+};
+SceneUniforms g_sceneUniforms;
+
+// Texture quality (--texture-quality=full|half|quarter, --max-texture-size=N)
+TextureQualitySettings g_textureQuality;
+
+// Draw path (cycle with I)
+enum class DrawMode
+{
+    Individual,         // One draw call per model
+    Instanced,          // One instanced draw call per mesh and texture array
+    MultiDrawIndirect,  // One multi-draw per texture array (needs OpenGL 4.6)
+    GpuCulled,          // Frustum/occlusion culled in compute, then multi-draw indirect (needs OpenGL 4.3)
+    OcclusionQueries    // One draw call per model, skipped by hardware occlusion queries
+};
+const int DRAW_MODE_COUNT = 5;
+DrawMode g_drawMode = DrawMode::GpuCulled;
+
+// Instanced drawing
+// Spawned models are grouped by mesh and by the texture array of their material
+struct InstanceBatch
+{
+    MeshHandle mesh;
+    GLuint arrayTexture;
+    vector<InstanceData> instances;
+};
+vector<InstanceBatch> g_instanceBatches;
+
+// Multi-draw indirect (program reads instances from a storage buffer)
+ShaderProgram g_indirectProgram;
+IndirectBatcher g_indirectBatcher;
+bool g_indirectSupported = false;
+
+// Vertex pulling for multi-draw indirect (program fetches packed vertices from a storage buffer, toggle with V)
+ShaderProgram g_pulledProgram;
+bool g_vertexPullingSupported = false;
+bool g_vertexPulling = false;
+
+// Depth-only pre-pass of the multi-draw path (--depth-prepass, toggle with Z); the main pass then tests GL_EQUAL
+ShaderProgram g_depthPrepassProgram;
+bool g_depthPrepassSupported = false;
+bool g_depthPrepass = false;
+
+// Reverse-Z infinite projection with a [0, 1] clip depth range (OpenGL 4.5 glClipControl)
+// Frames are then drawn into a float depth buffer and blitted to the window
+bool g_reverseZ = false;
+GLenum g_depthTestFunc = GL_LESS;   // Passes nearer fragments: GL_GREATER with reverse-Z
+SceneFramebuffer g_sceneFramebuffer;
+
+// GPU-driven culling (program reads the visible instance index as an attribute)
+ShaderProgram g_culledProgram;
+GpuCuller g_gpuCuller;
+bool g_gpuCullingSupported = false;
+
+// Sorted submission of individual draws (created after the thread pool)
+RenderQueue* g_renderQueue = nullptr;
+const unsigned int SCENE_PROGRAM_ID = 0;    // Render queue id of g_shaderProgram
+
+// Hardware occlusion queries with conditional rendering (individual draws)
+OcclusionQueries g_occlusionQueries;
+bool g_occlusionQueriesSupported = false;
+vector<unsigned int> g_queryCandidates;
+vector<glm::vec3> g_queryBoundsMin;
+vector<glm::vec3> g_queryBoundsMax;
+
+// CPU frustum culling of the other draw paths (toggle with C)
+// Culling keeps one slot per spawned model; lists derived from them carry each model's spawned index
+FrustumCuller g_frustumCuller;
+vector<unsigned int> g_visibleIndices;          // Indices into g_spawnedModels
+vector<Model3D> g_visibleModels;
+vector<unsigned int> g_spawnedIndices;          // 0, 1, 2, ...: the spawned models' own indices
+vector<unsigned char> g_cullListMembers;        // Per spawned model: 1 if it is in the list being culled
+bool g_cpuCulling = true;
+
+// Spatial index over the spawned models (frustum culling, picking, proximity)
+BoundingVolumeHierarchy* g_instanceBvh = nullptr;
+const size_t BVH_CULL_MIN_MODELS = 4096;    // Fewer models are culled faster by the flat SIMD sweep
+const float PICK_DISTANCE = 1000.0f;
+const float SPAWN_PROXIMITY_RADIUS = 3.0f;
+
+// Occlusion culling of the frustum-culled models against a CPU-rasterized depth buffer (toggle with X)
+SoftwareOcclusion* g_softwareOcclusion = nullptr;
+bool g_softwareOcclusionCulling = true;
+
+// Static models merged into pre-transformed batches per grid cell and texture array (toggle with B)
+StaticBatcher* g_staticBatcher = nullptr;
+ShaderProgram g_staticProgram;
+bool g_staticBatchingSupported = false;
+bool g_staticBatching = false;
+vector<Model3D> g_dynamicModels;        // Spawned models that are not static, in spawn order
+vector<unsigned int> g_dynamicModelIndices;
+size_t g_dynamicModelsScanned = 0;
+
+// Small meshes merged per frame into streamed draws of the individual path (toggle with N, uses g_staticProgram)
+DynamicBatcher* g_dynamicBatcher = nullptr;
+bool g_dynamicBatching = false;
+vector<Model3D> g_unbatchedInstanced;   // Repeated small meshes, handed to the instanced path
+vector<Model3D> g_unbatchedIndividual;  // Large meshes, drawn one at a time
+
+// Simplified proxies drawn in place of distant clusters of static models (toggle with H, uses g_staticProgram)
+HierarchicalLod* g_hierarchicalLod = nullptr;
+bool g_hlod = false;
+vector<Model3D> g_hlodNearModels;       // Spawned models not replaced by a proxy this frame
+vector<unsigned int> g_hlodNearIndices;
+
+// Octahedral impostors drawn in place of distant models, baked at load time (toggle with M)
+ImpostorRenderer g_impostorRenderer;
+bool g_impostorsSupported = false;
+bool g_impostors = false;
+vector<Model3D> g_impostorNearModels;   // Models still drawn as meshes this frame
+vector<unsigned int> g_impostorNearIndices;
+
+// Point lights binned into a cluster grid of the view frustum every frame (toggle with L, --lights=N)
+ClusteredLighting* g_clusteredLighting = nullptr;
+bool g_lighting = true;
+int g_lightCount = 256;
+
+// Deferred shading: the draw paths fill a packed G-buffer, lit in one clustered pass (toggle with F)
+DeferredRenderer g_deferredRenderer;
+bool g_deferredSupported = false;
+bool g_deferred = false;
+
+// Sun shadows in cascades fitted to the camera, static casters cached per cascade (toggle with K, cache with J)
+CascadedShadowMaps* g_shadowMaps = nullptr;
+bool g_shadowsSupported = false;
+const glm::vec3 SUN_DIRECTION = glm::vec3(0.4f, 1.0f, 0.3f);  // Toward the sun
+const glm::vec3 SUN_COLOR = glm::vec3(1.0f, 0.95f, 0.85f) * 0.6f;
+
+// Print GL state cache counters after the current frame (G)
+bool g_printStateStats = false;
+
+// Benchmarks (--bench-instancing, --bench-culling)
+bool g_benchInstancing = false;
+bool g_benchCulling = false;
 
 // Timing for spawn cooldown
 auto g_lastSpawnTime = chrono::high_resolution_clock::now();
 const float SPAWN_COOLDOWN = 3.0f;  // 3 seconds between spawns
 
-// ===== SHADER LOADING UTILITIES =====
+// ===== MODEL LOADING =====
 
 /**
- * Load shader source code from file
- * @param filepath Path to shader file
- * @return Shader source as string, empty if failed
+ * Load 3D model from OBJ file using tinyobjloader
+ * Automatically loads associated .mtl material file if referenced
+ * All shapes are merged into one mesh
+ * @param filepath Path to .obj file
+ * @param outVertices Output vector for vertices (position, normal, UV)
+ * @param outIndices Output vector for face indices
+ * @return True if loading successful, false otherwise
  */
-string loadShaderFromFile(const string& filepath)
+bool loadOBJModel(const string& filepath, vector<MeshVertex>& outVertices, vector<unsigned int>& outIndices)
 {
-    fstream file(filepath);
-    if (!file.is_open())
+    tinyobj::attrib_t attributes;
+    vector<tinyobj::shape_t> shapes;
+    vector<tinyobj::material_t> materials;
+    string error;
+
+    // Load OBJ file with material directory specified
+    bool success = tinyobj::LoadObj(
+        &attributes,
+        &shapes,
+        &materials,
+        &error,
+        filepath.c_str(),
+        MODEL_MTL_DIR.c_str()
+    );
+
+    if (!success)
+    {
+        cerr << "ERROR: Failed to load OBJ file: " << error << endl;
+        return false;
+    }
+
+    if (shapes.empty())
     {
-        cerr << "ERROR: Could not open shader file: " << filepath << endl;
-        return "";
+        cerr << "ERROR: OBJ file contains no shapes" << endl;
+        return false;
+    }
+
+    // Each distinct position/normal/UV combination becomes one vertex
+    map<tuple<int, int, int>, unsigned int> uniqueVertices;
+    for (const auto& shape : shapes)
+    {
+        for (const auto& index : shape.mesh.indices)
+        {
+            auto key = make_tuple(index.vertex_index, index.normal_index, index.texcoord_index);
+            auto found = uniqueVertices.find(key);
+            if (found != uniqueVertices.end())
+            {
+                outIndices.push_back(found->second);
+                continue;
+            }
+
+            MeshVertex vertex;
+            vertex.position = glm::vec3(attributes.vertices[3 * index.vertex_index + 0],
+                attributes.vertices[3 * index.vertex_index + 1],
+                attributes.vertices[3 * index.vertex_index + 2]);
+            vertex.normal = glm::vec3(0.0f, 1.0f, 0.0f);
+            if (index.normal_index >= 0)
+            {
+                vertex.normal = glm::vec3(attributes.normals[3 * index.normal_index + 0],
+                    attributes.normals[3 * index.normal_index + 1],
+                    attributes.normals[3 * index.normal_index + 2]);
+            }
+            vertex.texCoord = glm::vec2(0.0f, 0.0f);
+            if (index.texcoord_index >= 0)
+            {
+                vertex.texCoord = glm::vec2(attributes.texcoords[2 * index.texcoord_index + 0],
+                    attributes.texcoords[2 * index.texcoord_index + 1]);
+            }
+
+            unsigned int newIndex = (unsigned int)outVertices.size();
+            uniqueVertices[key] = newIndex;
+            outVertices.push_back(vertex);
+            outIndices.push_back(newIndex);
+        }
     }
 
-    stringstream buffer;
-    buffer << file.rdbuf();
-    return buffer.str();
+    cout << "Model loaded successfully:" << endl;
+    cout << "  - Vertices: " << outVertices.size() << endl;
+    cout << "  - Indices: " << outIndices.size() << endl;
+
+    return true;
 }
 
+// ===== LIGHTS =====
+
 /**
- * Compile and link vertex and fragment shaders into a program
- * @param vertPath Path to vertex shader file
- * @param fragPath Path to fragment shader file
- * @return OpenGL shader program ID, or 0 if failed
+ * Scatter point lights of random color and range over the area models are spawned in
+ * A fixed seed keeps the scene the same from run to run
+ * @param count Number of lights
  */
-GLuint loadAndCompileShaders(const string& vertPath, const string& fragPath)
+void createSceneLights(int count)
 {
-    // Load shader source code
-    string vertString = loadShaderFromFile(vertPath);
-    string fragString = loadShaderFromFile(fragPath);
+    mt19937 random(1234);
+    uniform_real_distribution<float> horizontal(-50.0f, 50.0f);
+    uniform_real_distribution<float> depth(-100.0f, 10.0f);
+    uniform_real_distribution<float> height(0.5f, 4.0f);
+    uniform_real_distribution<float> radius(3.0f, 8.0f);
+    uniform_real_distribution<float> channel(0.2f, 1.0f);
+    for (int i = 0; i < count; i++)
+    {
+        PointLight light;
+        light.position = glm::vec3(horizontal(random), height(random), depth(random));
+        light.radius = radius(random);
+        light.color = glm::vec3(channel(random), channel(random), channel(random));
+        light.intensity = 1.5f;
+        g_clusteredLighting->addLight(light);
+    }
+}
+
+// ===== MODEL DRAWING =====
 
-    if (vertString.empty() || fragString.empty())
+/**
+ * Start a frame of streamed data (waits only if the GPU is frames behind)
+ */
+void beginStreamingFrame()
+{
+    g_drawUniformRing.beginFrame();
+    g_instanceStream.beginFrame();
+    g_indirectBatcher.beginFrame();
+    g_dynamicBatcher->beginFrame();
+    g_clusteredLighting->beginFrame();
+    if (g_shadowsSupported)
+        g_shadowMaps->beginFrame();
+    if (g_impostorsSupported)
+        g_impostorRenderer.beginFrame();
+    if (g_gpuCullingSupported)
+        g_gpuCuller.beginFrame();
+}
+
+/**
+ * Fence this frame's streamed data (call after its draws are submitted)
+ */
+void endStreamingFrame()
+{
+    g_drawUniformRing.endFrame();
+    g_instanceStream.endFrame();
+    g_indirectBatcher.endFrame();
+    g_dynamicBatcher->endFrame();
+    g_clusteredLighting->endFrame();
+    if (g_shadowsSupported)
+        g_shadowMaps->endFrame();
+    if (g_impostorsSupported)
+        g_impostorRenderer.endFrame();
+    if (g_gpuCullingSupported)
+        g_gpuCuller.endFrame();
+}
+
+/**
+ * Upload the per-frame uniform block (camera and time)
+ * Shared by every program through UNIFORM_BINDING_FRAME
+ * @param seconds Time since start
+ * @param deltaSeconds Time since the previous frame
+ */
+void updateFrameUniforms(float seconds, float deltaSeconds)
+{
+    FrameUniforms frame;
+    frame.view = g_camera->getViewMatrix();
+    frame.projection = g_camera->getProjectionMatrix();
+    frame.viewProjection = frame.projection * frame.view;
+    frame.cameraPosition = glm::vec4(g_camera->getPosition(), 1.0f);
+    frame.time = glm::vec4(seconds, deltaSeconds, 0.0f, 0.0f);
+    g_frameUniforms.update(frame);
+}
+
+/**
+ * Bin the point lights into this frame's clusters (the shaders go unlit when lighting is off)
+ * @param framebufferWidth Framebuffer width in pixels
+ * @param framebufferHeight Framebuffer height in pixels
+ */
+void updateLighting(int framebufferWidth, int framebufferHeight)
+{
+    g_clusteredLighting->update(g_camera->getViewMatrix(), g_camera->getProjectionMatrix(), g_camera->getNearPlane(),
+        g_camera->getFarPlane(), framebufferWidth, framebufferHeight, g_lighting);
+}
+
+/**
+ * Write every model's transform and material into the mapped uniform ring
+ * Offsets are kept in g_drawUniformOffsets for drawModelIndividually()
+ * @param models Models about to be drawn one at a time
+ */
+void writeDrawUniforms(const vector<Model3D>& models)
+{
+    size_t blockSize = g_drawUniformRing.getAllocationSize(sizeof(DrawUniforms));
+    g_drawUniformRing.reserve(blockSize * models.size());
+    g_drawUniformOffsets.resize(models.size());
+
+    for (size_t i = 0; i < models.size(); i++)
+    {
+        DrawUniforms* draw = nullptr;
+        g_drawUniformOffsets[i] = g_drawUniformRing.allocate(sizeof(DrawUniforms), (void**)&draw);
+        draw->transform = models[i].getTransformMatrix();
+        draw->uvRect = glm::vec4(0.0f, 0.0f, 1.0f, 1.0f);
+        draw->texLayer = 0.0f;
+
+        if (models[i].getMaterial() < (int)g_texturePacker.getPackedCount())
+        {
+            const PackedTexture& material = g_texturePacker.getPacked(models[i].getMaterial());
+            draw->uvRect = material.uvRect;
+            draw->texLayer = material.layer;
+        }
+    }
+}
+
+/**
+ * Draw one model whose uniforms writeDrawUniforms() has written
+ * Texture binds only reach the driver when the packed array changes
+ * @param models Models passed to writeDrawUniforms()
+ * @param index Model to draw
+ */
+void drawModelIndividually(const vector<Model3D>& models, size_t index)
+{
+    if (models[index].getMaterial() < (int)g_texturePacker.getPackedCount())
     {
-        cerr << "ERROR: Failed to load shader files" << endl;
-        return 0;
+        const PackedTexture& material = g_texturePacker.getPacked(models[index].getMaterial());
+        GLStateCache::bindTexture(0, GL_TEXTURE_2D_ARRAY, material.arrayTexture);
     }
 
-    const char* vertChar = vertString.c_str();
-    const char* fragChar = fragString.c_str();
+    g_drawUniformRing.bindRange(UNIFORM_BINDING_DRAW, g_drawUniformOffsets[index], sizeof(DrawUniforms));
+    models[index].draw(g_meshRegistry);
+}
 
-    // Compile vertex shader
-    GLuint vertexShader = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vertexShader, 1, &vertChar, NULL);
-    glCompileShader(vertexShader);
+/**
+ * Draw models one at a time (one draw call per model)
+ * Every model's transform and material are written straight into the mapped
+ * uniform ring. The draws are then sorted by the render queue (material, mesh,
+ * then front to back) and each only binds its range of the ring, plus the
+ * texture array when the material changes.
+ * @param models Models to draw
+ */
+void drawModelsIndividually(const vector<Model3D>& models)
+{
+    writeDrawUniforms(models);
+
+    glm::vec3 cameraPosition = g_camera->getPosition();
+    glm::vec3 cameraFront = g_camera->getFront();
+    float farPlane = g_camera->getFarPlane();
+    g_renderQueue->clear();
+    g_renderQueue->reserve(models.size());
+    for (size_t i = 0; i < models.size(); i++)
+    {
+        if (!g_meshRegistry.isValid(models[i].getMesh()))
+            continue;
+
+        // Material 0 = unpacked (no texture bind)
+        int material = models[i].getMaterial();
+        unsigned int materialId = (material >= 0 && material < (int)g_texturePacker.getPackedCount()) ? material + 1 : 0;
+        float depth = glm::dot(models[i].getPosition() - cameraPosition, cameraFront) / farPlane;
+        g_renderQueue->add(RenderQueue::makeKey(RenderQueue::PASS_OPAQUE, SCENE_PROGRAM_ID, materialId,
+            (unsigned int)models[i].getMesh(), depth), (uint32_t)i);
+    }
+    g_renderQueue->sort();
 
-    // Check vertex shader for compilation errors
-    int success;
-    char infoLog[512];
-    glGetShaderiv(vertexShader, GL_COMPILE_STATUS, &success);
-    if (!success)
+    const vector<uint64_t>& keys = g_renderQueue->getKeys();
+    const vector<uint32_t>& items = g_renderQueue->getItems();
+    for (size_t k = 0; k < items.size(); k++)
     {
-        glGetShaderInfoLog(vertexShader, 512, NULL, infoLog);
-        cerr << "ERROR: Vertex shader compilation failed:\n" << infoLog << endl;
+        const Model3D& model = models[items[k]];
+        unsigned int materialId = RenderQueue::getMaterial(keys[k]);
+        if (materialId != 0 && (k == 0 || materialId != RenderQueue::getMaterial(keys[k - 1])))
+        {
+            const PackedTexture& material = g_texturePacker.getPacked(model.getMaterial());
+            GLStateCache::bindTexture(0, GL_TEXTURE_2D_ARRAY, material.arrayTexture);
+        }
+
+        g_drawUniformRing.bindRange(UNIFORM_BINDING_DRAW, g_drawUniformOffsets[items[k]], sizeof(DrawUniforms));
+        model.draw(g_meshRegistry);
     }
+}
 
-    // Compile fragment shader
-    GLuint fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fragmentShader, 1, &fragChar, NULL);
-    glCompileShader(fragmentShader);
+/**
+ * Draw models with one instanced draw call per texture array
+ * Transforms and materials are packed into the shared instance buffer
+ * @param models Models to draw
+ */
+void drawModelsInstanced(const vector<Model3D>& models)
+{
+    // Instanced draws ignore DrawData, but the active block still needs backing storage
+    void* unusedDrawData = nullptr;
+    size_t unusedOffset = g_drawUniformRing.allocate(sizeof(DrawUniforms), &unusedDrawData);
+    g_drawUniformRing.bindRange(UNIFORM_BINDING_DRAW, unusedOffset, sizeof(DrawUniforms));
 
-    // Check fragment shader for compilation errors
-    glGetShaderiv(fragmentShader, GL_COMPILE_STATUS, &success);
-    if (!success)
+    for (auto& batch : g_instanceBatches)
+        batch.instances.clear();
+
+    for (const auto& model : models)
     {
-        glGetShaderInfoLog(fragmentShader, 512, NULL, infoLog);
-        cerr << "ERROR: Fragment shader compilation failed:\n" << infoLog << endl;
+        PackedTexture material;
+        if (model.getMaterial() < (int)g_texturePacker.getPackedCount())
+            material = g_texturePacker.getPacked(model.getMaterial());
+
+        // Few texture arrays exist, a linear search is enough
+        InstanceBatch* batch = nullptr;
+        for (auto& existing : g_instanceBatches)
+        {
+            if (existing.mesh == model.getMesh() && existing.arrayTexture == material.arrayTexture)
+            {
+                batch = &existing;
+                break;
+            }
+        }
+        if (!batch)
+        {
+            g_instanceBatches.push_back({ model.getMesh(), material.arrayTexture, {} });
+            batch = &g_instanceBatches.back();
+        }
+
+        InstanceData instance;
+        instance.transform = model.getTransformMatrix();
+        instance.uvRect = material.uvRect;
+        instance.layer = material.layer;
+        batch->instances.push_back(instance);
     }
 
-    // Link shader program
-    GLuint shaderProgram = glCreateProgram();
-    glAttachShader(shaderProgram, vertexShader);
-    glAttachShader(shaderProgram, fragmentShader);
-    glLinkProgram(shaderProgram);
+    for (const auto& batch : g_instanceBatches)
+    {
+        if (batch.instances.empty())
+            continue;
 
-    // Check linking errors
-    glGetProgramiv(shaderProgram, GL_LINK_STATUS, &success);
-    if (!success)
+        GLStateCache::bindTexture(0, GL_TEXTURE_2D_ARRAY, batch.arrayTexture);
+        Model3D::drawInstanced(g_meshRegistry, batch.mesh, g_instanceStream,
+            batch.instances.data(), (GLsizei)batch.instances.size());
+    }
+}
+
+/**
+ * Draw models with one glMultiDrawElementsIndirect per texture array
+ * Every mesh becomes one indirect command; the program matching input must be bound
+ * @param models Models to draw
+ * @param input Vertex input of the bound program
+ */
+void drawModelsIndirect(const vector<Model3D>& models, IndirectBatcher::VertexInput input)
+{
+    g_indirectBatcher.clear();
+    for (const auto& model : models)
     {
-        glGetProgramInfoLog(shaderProgram, 512, NULL, infoLog);
-        cerr << "ERROR: Shader program linking failed:\n" << infoLog << endl;
+        PackedTexture material;
+        if (model.getMaterial() < (int)g_texturePacker.getPackedCount())
+            material = g_texturePacker.getPacked(model.getMaterial());
+
+        InstanceData instance;
+        instance.transform = model.getTransformMatrix();
+        instance.uvRect = material.uvRect;
+        instance.layer = material.layer;
+        g_indirectBatcher.add(model.getMesh(), material.arrayTexture, instance);
     }
+    g_indirectBatcher.submit(g_meshRegistry, input);
+}
 
-    // Delete shader objects (program has them compiled now)
-    glDeleteShader(vertexShader);
-    glDeleteShader(fragmentShader);
+/**
+ * Draw models with multi-draw indirect after a depth-only pre-pass
+ * The pre-pass reads only the position stream; the main pass redraws the same
+ * commands with GL_EQUAL and depth writes off, so each pixel is shaded once.
+ * Vertex pulling is not used here: its quantized positions would not
+ * reproduce the pre-pass depth exactly.
+ * @param models Models to draw
+ */
+void drawModelsIndirectPrepassed(const vector<Model3D>& models)
+{
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    g_depthPrepassProgram.bind();
+    drawModelsIndirect(models, IndirectBatcher::VERTEX_POSITIONS);
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+
+    GLStateCache::depthFunc(GL_EQUAL);
+    GLStateCache::depthMask(false);
+    g_indirectProgram.bind();
+    g_indirectBatcher.redraw(g_meshRegistry, IndirectBatcher::VERTEX_ATTRIBUTES);
+    GLStateCache::depthFunc(g_depthTestFunc);
+    GLStateCache::depthMask(true);
+}
 
-    cout << "Shaders compiled and linked successfully" << endl;
-    return shaderProgram;
+/**
+ * Draw models culled on the GPU against the frustum and last frame's depth
+ * Every model is uploaded with its bounding sphere; which ones are drawn is
+ * decided by compute shaders and never read back
+ * @param models Models to draw
+ */
+void drawModelsCulled(const vector<Model3D>& models)
+{
+    g_gpuCuller.clear();
+    for (const auto& model : models)
+    {
+        if (!g_meshRegistry.isValid(model.getMesh()))
+            continue;
+
+        PackedTexture material;
+        if (model.getMaterial() < (int)g_texturePacker.getPackedCount())
+            material = g_texturePacker.getPacked(model.getMaterial());
+
+        InstanceData instance;
+        instance.transform = model.getTransformMatrix();
+        instance.uvRect = material.uvRect;
+        instance.layer = material.layer;
+        glm::vec4 sphere = transformBoundingSphere(g_meshRegistry.getMesh(model.getMesh()), instance.transform);
+        g_gpuCuller.add(model.getMesh(), material.arrayTexture, instance, sphere);
+    }
+
+    glm::mat4 viewProjection = g_camera->getProjectionMatrix() * g_camera->getViewMatrix();
+    g_gpuCuller.submit(g_meshRegistry, g_culledProgram, viewProjection);
 }
 
-// ===== MODEL LOADING =====
+/**
+ * Draw models one at a time, merging small meshes first
+ * Small meshes are transformed into one streamed draw per texture array,
+ * unless they repeat often enough to be instanced; large ones are drawn
+ * individually
+ * @param models Models to draw
+ */
+void drawModelsDynamicBatched(const vector<Model3D>& models)
+{
+    g_staticProgram.bind();
+    g_dynamicBatcher->draw(models, g_meshRegistry, g_texturePacker, g_unbatchedInstanced, g_unbatchedIndividual);
+
+    g_shaderProgram.setInt(g_sceneUniforms.tex0, 0);
+    if (!g_unbatchedInstanced.empty())
+    {
+        g_shaderProgram.setBool(g_sceneUniforms.useInstancing, true);
+        g_shaderProgram.bind();
+        drawModelsInstanced(g_unbatchedInstanced);
+    }
+    if (!g_unbatchedIndividual.empty())
+    {
+        g_shaderProgram.setBool(g_sceneUniforms.useInstancing, false);
+        g_shaderProgram.bind();
+        drawModelsIndividually(g_unbatchedIndividual);
+    }
+}
 
 /**
- * Load 3D model from OBJ file using tinyobjloader
- * Automatically loads associated .mtl material file if referenced
- * @param filepath Path to .obj file
- * @param outVertices Output vector for vertex positions (as floats)
- * @param outIndices Output vector for face indices
- * @return True if loading successful, false otherwise
+ * Draw models with the given draw path, binding the program it uses
+ * GPU culling falls back to multi-draw indirect, which falls back to instancing
+ * @param models Models to draw
+ * @param mode Draw path
  */
-bool loadOBJModel(const string& filepath, vector<float>& outVertices, vector<unsigned int>& outIndices)
+void drawModels(const vector<Model3D>& models, DrawMode mode)
 {
-    tinyobj::attrib_t attributes;
-    vector<tinyobj::shape_t> shapes;
-    vector<tinyobj::material_t> materials;
-    string error;
+    if (mode == DrawMode::GpuCulled && g_gpuCullingSupported)
+    {
+        drawModelsCulled(models);
+        return;
+    }
+    if ((mode == DrawMode::MultiDrawIndirect || mode == DrawMode::GpuCulled) && g_indirectSupported)
+    {
+        if (g_depthPrepass && g_depthPrepassSupported)
+        {
+            drawModelsIndirectPrepassed(models);
+            return;
+        }
+        if (g_vertexPulling)
+        {
+            g_pulledProgram.bind();
+            drawModelsIndirect(models, IndirectBatcher::VERTEX_PULLED);
+        }
+        else
+        {
+            g_indirectProgram.bind();
+            drawModelsIndirect(models, IndirectBatcher::VERTEX_ATTRIBUTES);
+        }
+        return;
+    }
 
-    // Load OBJ file with material directory specified
-    bool success = tinyobj::LoadObj(
-        &attributes,
-        &shapes,
-        &materials,
-        &error,
-        filepath.c_str(),
-        MODEL_MTL_DIR.c_str()
-    );
+    if (mode == DrawMode::Individual && g_dynamicBatching)
+    {
+        drawModelsDynamicBatched(models);
+        return;
+    }
 
-    if (!success)
+    // Materials sample texture unit 0
+    bool instanced = (mode != DrawMode::Individual && mode != DrawMode::OcclusionQueries);
+    g_shaderProgram.setInt(g_sceneUniforms.tex0, 0);
+    g_shaderProgram.setBool(g_sceneUniforms.useInstancing, instanced);
+
+    // Use the shader program and upload only the uniforms that changed
+    g_shaderProgram.bind();
+
+    if (instanced)
+        drawModelsInstanced(models);
+    else
+        drawModelsIndividually(models);
+}
+
+/**
+ * Add newly spawned models to the BVH, refit moved ones and swap in finished rebuilds
+ */
+void updateInstanceBvh()
+{
+    for (size_t i = g_instanceBvh->getInstanceCount(); i < g_spawnedModels.size(); i++)
     {
-        cerr << "ERROR: Failed to load OBJ file: " << error << endl;
-        return false;
+        glm::vec3 boundsMin(0.0f), boundsMax(0.0f);
+        if (g_meshRegistry.isValid(g_spawnedModels[i].getMesh()))
+        {
+            transformBoundingBox(g_meshRegistry.getMesh(g_spawnedModels[i].getMesh()),
+                g_spawnedModels[i].getTransformMatrix(), boundsMin, boundsMax);
+        }
+        g_instanceBvh->add(boundsMin, boundsMax);
     }
+    g_instanceBvh->refit();
+    g_instanceBvh->poll();
+}
 
-    if (shapes.empty())
+/**
+ * Index in g_spawnedModels of every model of a drawn list
+ * @param models g_spawnedModels or one of the lists derived from it
+ */
+const vector<unsigned int>& getSpawnedIndices(const vector<Model3D>& models)
+{
+    if (&models == &g_dynamicModels)
+        return g_dynamicModelIndices;
+    if (&models == &g_hlodNearModels)
+        return g_hlodNearIndices;
+    if (&models == &g_impostorNearModels)
+        return g_impostorNearIndices;
+
+    for (size_t i = g_spawnedIndices.size(); i < g_spawnedModels.size(); i++)
+        g_spawnedIndices.push_back((unsigned int)i);
+    return g_spawnedIndices;
+}
+
+/**
+ * Frustum-cull a list of spawned models on the CPU before drawing them
+ * The spawned models are culled as a whole, so the bounds stay valid however
+ * the list was derived: large scenes query the BVH, small ones are swept by
+ * the flat SIMD culler, which tests 8 (AVX2) or 4 (SSE) instances per
+ * iteration. Survivors outside the list are dropped, the rest are tested
+ * against the nearest ones rasterized in software.
+ * @param models g_spawnedModels or a list derived from it (see getSpawnedIndices())
+ * @return The visible models, or models itself when CPU culling is off
+ *         (g_visibleIndices then holds their indices in g_spawnedModels)
+ */
+const vector<Model3D>& cullModels(const vector<Model3D>& models)
+{
+    if (!g_cpuCulling)
+        return models;
+
+    glm::mat4 viewProjection = g_camera->getProjectionMatrix() * g_camera->getViewMatrix();
+    Frustum frustum = Frustum::fromMatrix(viewProjection, g_reverseZ);
+    if (g_spawnedModels.size() >= BVH_CULL_MIN_MODELS)
     {
-        cerr << "ERROR: OBJ file contains no shapes" << endl;
-        return false;
+        g_instanceBvh->queryFrustum(frustum, g_visibleIndices);
     }
+    else
+    {
+        g_frustumCuller.update(g_spawnedModels, g_meshRegistry);
+        g_frustumCuller.cull(frustum, g_visibleIndices);
+    }
+
+    // Keep the members of the list: batches, proxies and impostors draw the others
+    if (&models != &g_spawnedModels)
+    {
+        g_cullListMembers.assign(g_spawnedModels.size(), 0);
+        for (unsigned int index : getSpawnedIndices(models))
+            g_cullListMembers[index] = 1;
 
-    // Extract vertex positions directly as floats
-    outVertices = attributes.vertices;
+        size_t kept = 0;
+        for (unsigned int index : g_visibleIndices)
+        {
+            if (g_cullListMembers[index])
+                g_visibleIndices[kept++] = index;
+        }
+        g_visibleIndices.resize(kept);
+    }
 
-    // Extract face indices from first shape
-    for (size_t i = 0; i < shapes[0].mesh.indices.size(); i++)
+    if (g_softwareOcclusionCulling)
     {
-        outIndices.push_back(shapes[0].mesh.indices[i].vertex_index);
+        g_softwareOcclusion->cull(g_spawnedModels, g_meshRegistry, viewProjection, g_camera->getPosition(),
+            g_visibleIndices);
     }
 
-    cout << "Model loaded successfully:" << endl;
-    cout << "  - Vertices: " << (outVertices.size() / 3) << endl;
-    cout << "  - Indices: " << outIndices.size() << endl;
+    g_visibleModels.clear();
+    for (unsigned int index : g_visibleIndices)
+        g_visibleModels.push_back(g_spawnedModels[index]);
+    return g_visibleModels;
+}
 
-    return true;
+/**
+ * Merge newly spawned static models into their batches and draw the batches in view
+ * Static models cost nothing per frame after this; the rest still go through the draw path
+ * @return The spawned models that are not static
+ */
+const vector<Model3D>& drawStaticBatches()
+{
+    g_staticBatcher->update(g_spawnedModels, g_meshRegistry, g_texturePacker);
+    for (; g_dynamicModelsScanned < g_spawnedModels.size(); g_dynamicModelsScanned++)
+    {
+        if (!g_spawnedModels[g_dynamicModelsScanned].isStatic())
+        {
+            g_dynamicModels.push_back(g_spawnedModels[g_dynamicModelsScanned]);
+            g_dynamicModelIndices.push_back((unsigned int)g_dynamicModelsScanned);
+        }
+    }
+
+    g_staticProgram.bind();
+    g_staticBatcher->draw(Frustum::fromMatrix(g_camera->getProjectionMatrix() * g_camera->getViewMatrix(), g_reverseZ));
+    return g_dynamicModels;
+}
+
+/**
+ * Draw the proxies of distant static clusters, building new ones in the background
+ * @return The spawned models no proxy replaced, for the draw path
+ */
+const vector<Model3D>& drawHlodProxies()
+{
+    g_hierarchicalLod->update(g_spawnedModels, g_meshRegistry, g_texturePacker);
+
+    g_staticProgram.bind();
+    Frustum frustum = Frustum::fromMatrix(g_camera->getProjectionMatrix() * g_camera->getViewMatrix(), g_reverseZ);
+    g_hierarchicalLod->draw(frustum, g_camera->getPosition(), g_spawnedModels, g_hlodNearModels, g_hlodNearIndices);
+    return g_hlodNearModels;
+}
+
+/**
+ * Draw distant models as impostors, crossfading with their mesh at the start of the range
+ * @param models Models to draw (g_spawnedModels or a list derived from it)
+ * @return The models still drawn as meshes, for the draw path
+ */
+const vector<Model3D>& drawImpostors(const vector<Model3D>& models)
+{
+    Frustum frustum = Frustum::fromMatrix(g_camera->getProjectionMatrix() * g_camera->getViewMatrix(), g_reverseZ);
+    g_impostorRenderer.draw(models, g_meshRegistry, g_texturePacker, frustum, g_camera->getPosition(),
+        g_impostorNearModels, g_impostorNearIndices);
+
+    // Positions in models become indices into g_spawnedModels
+    const vector<unsigned int>& spawnedIndices = getSpawnedIndices(models);
+    for (unsigned int& index : g_impostorNearIndices)
+        index = spawnedIndices[index];
+    return g_impostorNearModels;
+}
+
+/**
+ * Draw models one at a time, letting the GPU skip those hidden behind others
+ * After CPU culling every model is drawn under its own occlusion query (see
+ * OcclusionQueries); models visible last frame skip most queries
+ * @param models g_spawnedModels or a list derived from it (their spawned indices identify their queries)
+ */
+void drawModelsQueried(const vector<Model3D>& models)
+{
+    const vector<unsigned int>& spawnedIndices = getSpawnedIndices(models);
+    const vector<Model3D>& candidates = cullModels(models);
+    g_queryCandidates.resize(candidates.size());
+    g_queryBoundsMin.resize(candidates.size());
+    g_queryBoundsMax.resize(candidates.size());
+    for (size_t i = 0; i < candidates.size(); i++)
+    {
+        g_queryCandidates[i] = g_cpuCulling ? g_visibleIndices[i] : spawnedIndices[i];
+        g_queryBoundsMin[i] = g_queryBoundsMax[i] = candidates[i].getPosition();
+        if (g_meshRegistry.isValid(candidates[i].getMesh()))
+            transformBoundingBox(g_meshRegistry.getMesh(candidates[i].getMesh()), candidates[i].getTransformMatrix(),
+                g_queryBoundsMin[i], g_queryBoundsMax[i]);
+    }
+
+    g_shaderProgram.setInt(g_sceneUniforms.tex0, 0);
+    g_shaderProgram.setBool(g_sceneUniforms.useInstancing, false);
+    g_shaderProgram.bind();
+
+    writeDrawUniforms(candidates);
+    g_occlusionQueries.render(g_queryCandidates, g_queryBoundsMin, g_queryBoundsMax, g_camera->getPosition(),
+        [&](size_t index) { drawModelIndividually(candidates, index); });
+}
+
+/**
+ * Display name of a draw path
+ */
+const char* getDrawModeName(DrawMode mode)
+{
+    switch (mode)
+    {
+    case DrawMode::Individual: return "individual";
+    case DrawMode::Instanced: return "instanced";
+    case DrawMode::MultiDrawIndirect: return "multi-draw indirect";
+    case DrawMode::GpuCulled: return "GPU-culled";
+    default: return "occlusion queries";
+    }
+}
+
+// ===== BENCHMARKS =====
+
+/**
+ * Measure the average frame time of a draw function
+ * Each frame is finished (glFinish) so GPU time is included
+ * @param window GLFW window to present to
+ * @param frames Number of measured frames
+ * @param drawFrame Draw calls for one frame
+ * @return Average frame time in milliseconds
+ */
+double measureFrameTime(GLFWwindow* window, int frames, const function<void()>& drawFrame)
+{
+    // Same target as the render loop: the float depth scene framebuffer with reverse-Z
+    int framebufferWidth, framebufferHeight;
+    glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+    bool offscreen = g_reverseZ && g_sceneFramebuffer.resize(framebufferWidth, framebufferHeight);
+
+    // Warm up (buffer growth, driver shader variants)
+    for (int i = 0; i < 2; i++)
+    {
+        beginStreamingFrame();
+        if (offscreen)
+            g_sceneFramebuffer.bind();
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        drawFrame();
+        if (offscreen)
+            g_sceneFramebuffer.present();
+        endStreamingFrame();
+        glfwSwapBuffers(window);
+    }
+    glFinish();
+
+    auto start = chrono::high_resolution_clock::now();
+    for (int i = 0; i < frames; i++)
+    {
+        beginStreamingFrame();
+        if (offscreen)
+            g_sceneFramebuffer.bind();
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        drawFrame();
+        if (offscreen)
+            g_sceneFramebuffer.present();
+        endStreamingFrame();
+        glfwSwapBuffers(window);
+        glfwPollEvents();
+        glFinish();
+    }
+    auto end = chrono::high_resolution_clock::now();
+
+    return chrono::duration<double, milli>(end - start).count() / frames;
+}
+
+/**
+ * Benchmark per-model drawing against instanced and multi-draw indirect drawing
+ * Prints frame time for 1 to 1M instances laid out in a cube grid
+ * @param window GLFW window to render into
+ */
+void runInstancingBenchmark(GLFWwindow* window)
+{
+    const size_t INSTANCE_COUNTS[] = { 1, 10, 100, 1000, 10000, 100000, 1000000 };
+    const size_t MAX_INDIVIDUAL_DRAWS = 100000;  // Per-model frames take seconds beyond this
+    const int BENCH_FRAMES = 20;
+
+    // Measure frame time, not vsync
+    glfwSwapInterval(0);
+
+    updateFrameUniforms((float)glfwGetTime(), 0.0f);
+
+    cout << "\n===== Instancing benchmark (" << BENCH_FRAMES << " frames each) =====" << endl;
+    cout << setw(10) << "Instances" << setw(18) << "Per-model (ms)" << setw(18) << "Instanced (ms)"
+        << setw(12) << "Speedup" << setw(12) << "MDI (ms)" << endl;
+
+    for (size_t count : INSTANCE_COUNTS)
+    {
+        // Cube grid of small models in front of the camera
+        vector<Model3D> models(count);
+        int side = (int)ceil(cbrt((double)count));
+        for (size_t i = 0; i < count; i++)
+        {
+            int x = (int)(i % side);
+            int y = (int)((i / side) % side);
+            int z = (int)(i / ((size_t)side * side));
+            models[i].setPosition(glm::vec3(x - side * 0.5f, y - side * 0.5f, -5.0f - z));
+            models[i].setScale(glm::vec3(0.25f));
+            models[i].setMesh(g_modelMesh);
+        }
+
+        double individualMs = -1.0;
+        if (count <= MAX_INDIVIDUAL_DRAWS)
+        {
+            individualMs = measureFrameTime(window, BENCH_FRAMES, [&]() {
+                drawModels(models, DrawMode::Individual);
+            });
+        }
+
+        double instancedMs = measureFrameTime(window, BENCH_FRAMES, [&]() {
+            drawModels(models, DrawMode::Instanced);
+        });
+
+        double indirectMs = -1.0;
+        if (g_indirectSupported)
+        {
+            indirectMs = measureFrameTime(window, BENCH_FRAMES, [&]() {
+                drawModels(models, DrawMode::MultiDrawIndirect);
+            });
+        }
+
+        cout << setw(10) << count << fixed << setprecision(3);
+        if (individualMs >= 0.0)
+            cout << setw(18) << individualMs << setw(18) << instancedMs << setw(11) << (individualMs / instancedMs) << "x";
+        else
+            cout << setw(18) << "-" << setw(18) << instancedMs << setw(12) << "-";
+        if (indirectMs >= 0.0)
+            cout << setw(12) << indirectMs;
+        else
+            cout << setw(12) << "-";
+        cout << endl;
+    }
+
+    cout << "==========================================\n" << endl;
+    glfwSwapInterval(1);
+}
+
+/**
+ * Benchmark SIMD frustum culling against the scalar reference and the BVH
+ * Prints instances culled per millisecond on one core for 1K to 1M instances
+ * laid out in a cube grid around the camera, and the (parallel) BVH build time
+ */
+void runCullingBenchmark()
+{
+    const size_t INSTANCE_COUNTS[] = { 1000, 10000, 100000, 1000000 };
+    const int BENCH_REPEATS = 20;
+
+    Frustum frustum = Frustum::fromMatrix(g_camera->getProjectionMatrix() * g_camera->getViewMatrix(), g_reverseZ);
+    FrustumCuller culler;
+    BoundingVolumeHierarchy bvh(g_threadPool);
+    vector<unsigned int> visible;
+
+    cout << "\n===== Culling benchmark (" << BENCH_REPEATS << " repeats, 1 core, "
+        << FrustumCuller::getSimdPathName() << ") =====" << endl;
+    cout << setw(10) << "Instances" << setw(10) << "Visible" << setw(20) << "Scalar (inst/ms)"
+        << setw(20) << "SIMD (inst/ms)" << setw(12) << "Speedup" << setw(18) << "BVH build (ms)"
+        << setw(18) << "BVH (inst/ms)" << endl;
+
+    for (size_t count : INSTANCE_COUNTS)
+    {
+        // Cube grid centered on the camera, so part of it is behind and beside the view
+        vector<Model3D> models(count);
+        int side = (int)ceil(cbrt((double)count));
+        glm::vec3 center = g_camera->getPosition();
+        for (size_t i = 0; i < count; i++)
+        {
+            int x = (int)(i % side);
+            int y = (int)((i / side) % side);
+            int z = (int)(i / ((size_t)side * side));
+            models[i].setPosition(center + glm::vec3(x - side * 0.5f, y - side * 0.5f, z - side * 0.5f) * 2.0f);
+            models[i].setScale(glm::vec3(0.25f));
+            models[i].setMesh(g_modelMesh);
+        }
+        culler.rebuild(models, g_meshRegistry);
+
+        bvh.clear();
+        const MeshInfo& mesh = g_meshRegistry.getMesh(g_modelMesh);
+        for (const Model3D& model : models)
+        {
+            glm::vec3 boundsMin, boundsMax;
+            transformBoundingBox(mesh, model.getTransformMatrix(), boundsMin, boundsMax);
+            bvh.add(boundsMin, boundsMax);
+        }
+        auto buildStart = chrono::high_resolution_clock::now();
+        bvh.rebuild();
+        double buildMs = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - buildStart).count();
+
+        auto measure = [&](const function<void()>& cull) {
+            auto start = chrono::high_resolution_clock::now();
+            for (int i = 0; i < BENCH_REPEATS; i++)
+                cull();
+            auto end = chrono::high_resolution_clock::now();
+            return chrono::duration<double, milli>(end - start).count() / BENCH_REPEATS;
+        };
+
+        double scalarMs = measure([&]() { culler.cullScalar(frustum, visible); });
+        double bvhMs = measure([&]() { bvh.queryFrustum(frustum, visible); });
+        double simdMs = measure([&]() { culler.cull(frustum, visible); });
+
+        cout << setw(10) << count << setw(10) << visible.size() << fixed << setprecision(0)
+            << setw(20) << (count / scalarMs) << setw(20) << (count / simdMs)
+            << setprecision(2) << setw(11) << (scalarMs / simdMs) << "x" << setw(18) << buildMs
+            << setprecision(0) << setw(18) << (count / bvhMs) << endl;
+    }
+
+    cout << "==========================================\n" << endl;
 }
 
 // ===== WINDOW MANAGEMENT =====
@@ -237,11 +1178,22 @@ GLFWwindow* createWindow(float width, float height, const string& title)
         return nullptr;
     }
 
-    // Create window
-    GLFWwindow* window = glfwCreateWindow((int)width, (int)height, title.c_str(), NULL, NULL);
+    // Create window with a core profile context, newest version first
+    // (4.4 is the minimum: persistently mapped buffers need glBufferStorage)
+    const int CONTEXT_VERSIONS[][2] = { { 4, 6 }, { 4, 5 }, { 4, 4 } };
+    GLFWwindow* window = nullptr;
+    for (const auto& version : CONTEXT_VERSIONS)
+    {
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, version[0]);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, version[1]);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+        window = glfwCreateWindow((int)width, (int)height, title.c_str(), NULL, NULL);
+        if (window)
+            break;
+    }
     if (!window)
     {
-        cerr << "ERROR: Window creation failed" << endl;
+        cerr << "ERROR: Window creation failed (OpenGL 4.4 core or newer required)" << endl;
         glfwTerminate();
         return nullptr;
     }
@@ -256,7 +1208,12 @@ GLFWwindow* createWindow(float width, float height, const string& title)
         return nullptr;
     }
 
-    cout << "Window created and OpenGL initialized successfully" << endl;
+    cout << "Window created and OpenGL initialized successfully (" << glGetString(GL_VERSION) << ")" << endl;
+
+    // Direct state access with OpenGL 4.5, bind-to-edit on 4.4
+    GLResources::initialize();
+    if (!GLResources::hasDirectStateAccess())
+        cout << "Direct state access unavailable (needs OpenGL 4.5), resources are edited through bindings" << endl;
     return window;
 }
 
@@ -313,30 +1270,225 @@ void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods
             newModel.setPosition(spawnPos);
             newModel.setScale(glm::vec3(1.0f, 1.0f, 1.0f));
             newModel.setRotation(glm::vec3(0.0f, 0.0f, 0.0f));
+            newModel.setMesh(g_modelMesh);
+
+            // Spawned models never move, so they may be merged into static batches
+            newModel.setStatic(true);
 
-            // Add to spawned models list (no need to initialize mesh - uses static)
+            // Add to spawned models list (the mesh is shared through the registry)
             g_spawnedModels.push_back(newModel);
             g_lastSpawnTime = currentTime;
 
             cout << "Model spawned at (" << spawnPos.x << ", " << spawnPos.y << ", " << spawnPos.z << ")" << endl;
             cout << "Total models: " << g_spawnedModels.size() << endl;
+
+            // Proximity check through the BVH (the new model is added next frame)
+            vector<unsigned int> nearby;
+            g_instanceBvh->querySphere(spawnPos, SPAWN_PROXIMITY_RADIUS, nearby);
+            cout << "Models within " << SPAWN_PROXIMITY_RADIUS << " units: " << nearby.size() << endl;
         }
     }
 
+    // ===== DRAW PATH (I) =====
+    if (key == GLFW_KEY_I && action == GLFW_PRESS)
+    {
+        g_drawMode = (DrawMode)(((int)g_drawMode + 1) % DRAW_MODE_COUNT);
+        cout << "Draw path: " << getDrawModeName(g_drawMode) << endl;
+    }
+
+    // ===== CPU FRUSTUM CULLING (C) =====
+    if (key == GLFW_KEY_C && action == GLFW_PRESS)
+    {
+        g_cpuCulling = !g_cpuCulling;
+        cout << "CPU frustum culling: " << (g_cpuCulling ? "on" : "off") << endl;
+    }
+
+    // ===== TOGGLE SOFTWARE OCCLUSION CULLING (X) =====
+    if (key == GLFW_KEY_X && action == GLFW_PRESS)
+    {
+        g_softwareOcclusionCulling = !g_softwareOcclusionCulling;
+        cout << "Software occlusion culling: " << (g_softwareOcclusionCulling ? "on" : "off") << endl;
+    }
+
+    // ===== TOGGLE VERTEX PULLING (V) =====
+    if (key == GLFW_KEY_V && action == GLFW_PRESS && g_vertexPullingSupported)
+    {
+        g_vertexPulling = !g_vertexPulling;
+        cout << "Vertex pulling (multi-draw indirect): " << (g_vertexPulling ? "on" : "off") << endl;
+    }
+
+    // ===== TOGGLE DEPTH PRE-PASS (Z) =====
+    if (key == GLFW_KEY_Z && action == GLFW_PRESS && g_depthPrepassSupported)
+    {
+        g_depthPrepass = !g_depthPrepass;
+        cout << "Depth pre-pass (multi-draw indirect): " << (g_depthPrepass ? "on" : "off") << endl;
+    }
+
+    // ===== TOGGLE STATIC BATCHING (B) =====
+    if (key == GLFW_KEY_B && action == GLFW_PRESS && g_staticBatchingSupported)
+    {
+        g_staticBatching = !g_staticBatching;
+
+        // Models leave or rejoin the drawn list, their last query results are out of date
+        g_occlusionQueries.clear();
+        cout << "Static batching: " << (g_staticBatching ? "on" : "off") << endl;
+    }
+
+    // ===== TOGGLE HLOD (H) =====
+    if (key == GLFW_KEY_H && action == GLFW_PRESS && g_staticBatchingSupported)
+    {
+        g_hlod = !g_hlod;
+
+        // Models leave or rejoin the drawn list, their last query results are out of date
+        g_occlusionQueries.clear();
+        cout << "HLOD proxies: " << (g_hlod ? "on" : "off")
+            << (g_staticBatching ? " (inactive while static batching is on)" : "") << endl;
+    }
+
+    // ===== TOGGLE IMPOSTORS (M) =====
+    if (key == GLFW_KEY_M && action == GLFW_PRESS && g_impostorsSupported)
+    {
+        g_impostors = !g_impostors;
+
+        // Models leave or rejoin the drawn list, their last query results are out of date
+        g_occlusionQueries.clear();
+        cout << "Impostors: " << (g_impostors ? "on" : "off") << endl;
+    }
+
+    // ===== TOGGLE CLUSTERED LIGHTING (L) =====
+    if (key == GLFW_KEY_L && action == GLFW_PRESS)
+    {
+        g_lighting = !g_lighting;
+        cout << "Clustered lighting: " << (g_lighting ? "on" : "off") << " ("
+            << g_clusteredLighting->getLightCount() << " lights)" << endl;
+    }
+
+    // ===== TOGGLE DEFERRED SHADING (F) =====
+    if (key == GLFW_KEY_F && action == GLFW_PRESS && g_deferredSupported)
+    {
+        g_deferred = !g_deferred;
+        cout << "Shading: " << (g_deferred ? "deferred" : "forward") << endl;
+    }
+
+    // ===== TOGGLE SHADOWS (K) =====
+    if (key == GLFW_KEY_K && action == GLFW_PRESS && g_shadowsSupported)
+    {
+        g_shadowMaps->setEnabled(!g_shadowMaps->isEnabled());
+        cout << "Sun shadows: " << (g_shadowMaps->isEnabled() ? "on" : "off") << endl;
+    }
+
+    // ===== TOGGLE STATIC SHADOW CACHE (J) =====
+    if (key == GLFW_KEY_J && action == GLFW_PRESS && g_shadowsSupported)
+    {
+        g_shadowMaps->setCacheEnabled(!g_shadowMaps->isCacheEnabled());
+        cout << "Static shadow cache: " << (g_shadowMaps->isCacheEnabled() ? "on" : "off (every caster, every frame)")
+            << endl;
+    }
+
+    // ===== TOGGLE DYNAMIC BATCHING (N) =====
+    if (key == GLFW_KEY_N && action == GLFW_PRESS && g_staticBatchingSupported)
+    {
+        g_dynamicBatching = !g_dynamicBatching;
+        cout << "Dynamic batching (individual draws): " << (g_dynamicBatching ? "on" : "off") << endl;
+    }
+
+    // ===== PICK (P) =====
+    if (key == GLFW_KEY_P && action == GLFW_PRESS)
+    {
+        float distance = 0.0f;
+        int picked = g_instanceBvh->queryRay(g_camera->getPosition(), g_camera->getFront(), PICK_DISTANCE, distance);
+        if (picked >= 0)
+            cout << "Picked model " << picked << " at distance " << distance << endl;
+        else
+            cout << "No model under the screen center" << endl;
+    }
+
+    // ===== OCCLUSION CULLING (O) =====
+    if (key == GLFW_KEY_O && action == GLFW_PRESS && g_gpuCullingSupported)
+    {
+        g_gpuCuller.setOcclusionEnabled(!g_gpuCuller.isOcclusionEnabled());
+        cout << "Occlusion culling: " << (g_gpuCuller.isOcclusionEnabled() ? "on" : "off") << endl;
+    }
+
+    // ===== STATE CACHE COUNTERS (G) =====
+    if (key == GLFW_KEY_G && action == GLFW_PRESS)
+        g_printStateStats = true;
+
     // ===== EXIT (ESC) =====
     if (key == GLFW_KEY_ESCAPE)
         glfwSetWindowShouldClose(window, GLFW_TRUE);
 }
 
+// ===== COMMAND LINE =====
+
+/**
+ * Parse command line options
+ * @param argc Argument count
+ * @param argv Argument values
+ */
+void parseArguments(int argc, char** argv)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+
+        if (arg.rfind("--texture-quality=", 0) == 0)
+        {
+            string tier = arg.substr(string("--texture-quality=").size());
+            if (!TextureLoader::parseQuality(tier, g_textureQuality.tier))
+                cerr << "WARNING: Unknown texture quality '" << tier << "', using full" << endl;
+        }
+        else if (arg.rfind("--max-texture-size=", 0) == 0)
+        {
+            int size = atoi(arg.substr(string("--max-texture-size=").size()).c_str());
+            if (size > 0)
+                g_textureQuality.maxDimension = size;
+        }
+        else if (arg == "--depth-prepass")
+        {
+            g_depthPrepass = true;
+        }
+        else if (arg.rfind("--lights=", 0) == 0)
+        {
+            int count = atoi(arg.substr(string("--lights=").size()).c_str());
+            if (count >= 0)
+                g_lightCount = count;
+        }
+        else if (arg == "--bench-instancing")
+        {
+            g_benchInstancing = true;
+        }
+        else if (arg == "--bench-culling")
+        {
+            g_benchCulling = true;
+        }
+        else
+        {
+            cerr << "WARNING: Unknown argument: " << arg << endl;
+        }
+    }
+}
+
 // ===== MAIN PROGRAM =====
 
-int main(void)
+int main(int argc, char** argv)
 {
     cout << "========================================" << endl;
     cout << "GDGRAP1 Programming Challenge 1" << endl;
     cout << "3D Model Viewer with FPS Camera" << endl;
     cout << "========================================" << endl << endl;
 
+    parseArguments(argc, argv);
+    g_threadPool = new ThreadPool();
+    g_instanceBvh = new BoundingVolumeHierarchy(g_threadPool);
+    g_softwareOcclusion = new SoftwareOcclusion(g_threadPool);
+    g_renderQueue = new RenderQueue(g_threadPool);
+    g_staticBatcher = new StaticBatcher(g_threadPool);
+    g_dynamicBatcher = new DynamicBatcher(g_threadPool);
+    g_hierarchicalLod = new HierarchicalLod(g_threadPool);
+    g_clusteredLighting = new ClusteredLighting(g_threadPool);
+    g_shadowMaps = new CascadedShadowMaps(g_threadPool);
+
     // Create window and initialize OpenGL
     cout << "Initializing window..." << endl;
     GLFWwindow* window = createWindow(WINDOW_WIDTH, WINDOW_HEIGHT, WINDOW_TITLE);
@@ -354,17 +1506,68 @@ int main(void)
 
     // Load shaders
     cout << "Loading shaders..." << endl;
-    g_shaderProgram = loadAndCompileShaders(SHADER_VERT_PATH, SHADER_FRAG_PATH);
-    if (g_shaderProgram == 0)
+    if (!g_shaderProgram.loadFromFiles(SHADER_VERT_PATH, SHADER_FRAG_PATH))
     {
         cerr << "FATAL ERROR: Failed to load shaders" << endl;
         glfwTerminate();
         return -1;
     }
 
+    // Resolve uniform handles once instead of looking names up every frame
+    g_sceneUniforms.tex0 = g_shaderProgram.getUniform("tex0");
+    g_sceneUniforms.useInstancing = g_shaderProgram.getUniform("useInstancing");
+
+    // Uniform blocks use fixed binding points shared by every program
+    bindStandardUniformBlocks(g_shaderProgram);
+    g_frameUniforms.create();
+    g_drawUniformRing.create(64 * 1024);
+    g_instanceStream.create("instances", 1024 * sizeof(InstanceData));
+    g_dynamicBatcher->create(64 * 1024);
+
+    // Point lights for clustered forward shading (storage buffers are core in OpenGL 4.3)
+    g_clusteredLighting->create((size_t)g_lightCount);
+    createSceneLights(g_lightCount);
+
+    // Multi-draw indirect needs gl_BaseInstance (GLSL 4.60)
+    g_indirectSupported = GLAD_GL_VERSION_4_6 &&
+        g_indirectProgram.loadFromFiles(SHADER_INDIRECT_VERT_PATH, SHADER_FRAG_PATH);
+    if (g_indirectSupported)
+    {
+        bindStandardUniformBlocks(g_indirectProgram);
+        g_indirectProgram.setInt(g_indirectProgram.getUniform("tex0"), 0);
+        g_indirectBatcher.create(1024, 64);
+    }
+    else
+    {
+        cout << "Multi-draw indirect unavailable (needs OpenGL 4.6), using instancing" << endl;
+    }
+
+    // Vertex pulling replaces the VAO layout of the multi-draw path with storage buffer reads
+    g_vertexPullingSupported = g_indirectSupported &&
+        g_pulledProgram.loadFromFiles(SHADER_PULLED_VERT_PATH, SHADER_FRAG_PATH);
+    if (g_vertexPullingSupported)
+    {
+        bindStandardUniformBlocks(g_pulledProgram);
+        g_pulledProgram.setInt(g_pulledProgram.getUniform("tex0"), 0);
+    }
+
+    // The depth pre-pass redraws the multi-draw commands, position stream only
+    g_depthPrepassSupported = g_indirectSupported &&
+        g_depthPrepassProgram.loadFromFiles(SHADER_DEPTH_PREPASS_VERT_PATH, SHADER_DEPTH_PREPASS_FRAG_PATH);
+    if (g_depthPrepassSupported)
+        bindStandardUniformBlocks(g_depthPrepassProgram);
+
+    // Static batches carry world-space vertices with their material baked in
+    g_staticBatchingSupported = g_staticProgram.loadFromFiles(SHADER_STATIC_VERT_PATH, SHADER_FRAG_PATH);
+    if (g_staticBatchingSupported)
+    {
+        bindStandardUniformBlocks(g_staticProgram);
+        g_staticProgram.setInt(g_staticProgram.getUniform("tex0"), 0);
+    }
+
     // Load 3D model
     cout << "Loading 3D model..." << endl;
-    vector<float> modelVertices;
+    vector<MeshVertex> modelVertices;
     vector<unsigned int> modelIndices;
     if (!loadOBJModel(MODEL_PATH, modelVertices, modelIndices))
     {
@@ -373,14 +1576,113 @@ int main(void)
         return -1;
     }
 
-    // Initialize the shared mesh (call once before creating any models)
-    cout << "Initializing shared mesh..." << endl;
-    Model3D::initializeSharedMesh(modelVertices.data(), modelVertices.size() / 3,
-        modelIndices.data(), modelIndices.size());
+    // Register the mesh in the shared vertex/index buffers
+    cout << "Registering mesh..." << endl;
+    g_meshRegistry.create();
+    Model3D::initializeInstancing(g_meshRegistry);
+    g_modelMesh = g_meshRegistry.addMesh(MODEL_PATH, modelVertices, modelIndices);
+
+    // Its triangles also occlude in the software rasterizer
+    vector<glm::vec3> modelPositions;
+    modelPositions.reserve(modelVertices.size());
+    for (const MeshVertex& vertex : modelVertices)
+        modelPositions.push_back(vertex.position);
+    g_softwareOcclusion->setOccluderMesh(g_modelMesh, modelPositions, modelIndices);
+
+    // Static instances are merged from the CPU-side copy of the mesh
+    g_staticBatcher->setSourceMesh(g_modelMesh, modelVertices, modelIndices);
+    g_dynamicBatcher->setSourceMesh(g_modelMesh, modelVertices, modelIndices);
+    g_hierarchicalLod->setSourceMesh(g_modelMesh, modelVertices, modelIndices);
+
+    // GPU culling needs compute shaders (OpenGL 4.3); the culler adds its attribute to the registry's VAO
+    g_gpuCullingSupported = GLAD_GL_VERSION_4_3 &&
+        g_culledProgram.loadFromFiles(SHADER_CULLED_VERT_PATH, SHADER_FRAG_PATH) &&
+        g_gpuCuller.create(g_meshRegistry);
+    if (g_gpuCullingSupported)
+    {
+        bindStandardUniformBlocks(g_culledProgram);
+        g_culledProgram.setInt(g_culledProgram.getUniform("tex0"), 0);
+        if (!g_gpuCuller.hasIndirectCount())
+            cout << "Indirect count unavailable (needs OpenGL 4.6), GPU culling draws uncompacted commands" << endl;
+    }
+    else
+    {
+        g_culledProgram.destroy();
+        g_drawMode = DrawMode::MultiDrawIndirect;
+        cout << "GPU culling unavailable (needs OpenGL 4.3 compute shaders)" << endl;
+    }
+
+    // Occlusion queries and conditional rendering are core in OpenGL 3.3
+    g_occlusionQueriesSupported = g_occlusionQueries.create();
+    if (!g_occlusionQueriesSupported)
+        cout << "Occlusion queries unavailable, that draw path draws individually" << endl;
+
+    // Decode and downscale textures on worker threads, then pack them
+    // into texture arrays / atlases
+    cout << "Loading textures (" << TextureLoader::getQualityName(g_textureQuality.tier) << " quality)..." << endl;
+    TextureLoader textureLoader(*g_threadPool, g_textureQuality);
+    textureLoader.queue(TEXTURE_PATH);
+    for (TextureImage& image : textureLoader.finish())
+        g_texturePacker.addTexture(std::move(image));
+
+    cout << "Packing textures..." << endl;
+    g_texturePacker.build();
+    cout << "  - Texture batches: " << g_texturePacker.getArrayTextureCount() << endl;
+    textureLoader.printMemoryReport(g_texturePacker);
 
     // Enable depth testing for 3D rendering
-    glEnable(GL_DEPTH_TEST);
-    glClearColor(0.1f, 0.1f, 0.15f, 1.0f);
+    // Reverse-Z pairs far depths with the dense end of a float depth buffer; the window's 24-bit
+    // fixed-point depth would gain nothing, so it needs the float scene framebuffer. Without
+    // glClipControl the [-1, 1] depth range would lose the precision again, so 4.4 keeps standard depth
+    int framebufferWidth, framebufferHeight;
+    glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+    g_reverseZ = GLAD_GL_VERSION_4_5 && g_sceneFramebuffer.resize(framebufferWidth, framebufferHeight);
+    if (g_reverseZ)
+    {
+        glClipControl(GL_LOWER_LEFT, GL_ZERO_TO_ONE);
+        glClearDepth(0.0);
+        g_depthTestFunc = GL_GREATER;
+    }
+    else
+    {
+        cout << "Reverse-Z unavailable (needs OpenGL 4.5 glClipControl and a float depth framebuffer), "
+            << "using standard depth" << endl;
+    }
+    g_camera->setReverseZ(g_reverseZ);
+    g_gpuCuller.setReverseZ(g_reverseZ);
+    g_softwareOcclusion->setReverseZ(g_reverseZ);
+    GLStateCache::enable(GL_DEPTH_TEST);
+    GLStateCache::depthFunc(g_depthTestFunc);
+    glClearColor(CLEAR_COLOR.x, CLEAR_COLOR.y, CLEAR_COLOR.z, 1.0f);
+
+    // Impostors are baked once the materials are packed and the depth convention is set
+    g_impostorsSupported = g_impostorRenderer.create();
+    if (g_impostorsSupported)
+    {
+        g_impostorRenderer.setReverseZ(g_reverseZ);
+        g_impostorsSupported = g_impostorRenderer.bake(g_modelMesh, 0, g_meshRegistry, g_texturePacker);
+    }
+    if (!g_impostorsSupported)
+        cout << "Impostors unavailable (programs or bake framebuffer failed)" << endl;
+
+    // Deferred shading lights the G-buffer with the clusters of the forward path
+    g_deferredSupported = g_deferredRenderer.create();
+    if (g_deferredSupported)
+        g_deferredRenderer.setReverseZ(g_reverseZ);
+    else
+        cout << "Deferred shading unavailable (program failed to load)" << endl;
+
+    // The sun only lights the scene when its cascades can be rendered
+    g_shadowsSupported = g_shadowMaps->create();
+    if (g_shadowsSupported)
+    {
+        g_shadowMaps->setReverseZ(g_reverseZ);
+        g_shadowMaps->setSun(SUN_DIRECTION, SUN_COLOR);
+    }
+    else
+    {
+        cout << "Shadow maps unavailable (caster program or framebuffer failed), no sun" << endl;
+    }
 
     // Spawn initial model
     cout << "Spawning initial model..." << endl;
@@ -388,6 +1690,7 @@ int main(void)
     initialModel.setPosition(glm::vec3(0.0f, 0.0f, -5.0f));
     initialModel.setScale(glm::vec3(1.0f, 1.0f, 1.0f));
     initialModel.setRotation(glm::vec3(0.0f, 0.0f, 0.0f));
+    initialModel.setMesh(g_modelMesh);
     g_spawnedModels.push_back(initialModel);
 
     cout << "\n========================================" << endl;
@@ -396,35 +1699,148 @@ int main(void)
     cout << "  A/D     - Strafe left/right" << endl;
     cout << "  Arrows  - Rotate camera view" << endl;
     cout << "  Space   - Spawn model (3s cooldown)" << endl;
+    cout << "  I       - Cycle draw path (individual / instanced / MDI / GPU-culled / occlusion queries)" << endl;
+    cout << "  O       - Toggle GPU occlusion culling" << endl;
+    cout << "  C       - Toggle CPU frustum culling" << endl;
+    cout << "  X       - Toggle software occlusion culling" << endl;
+    cout << "  V       - Toggle vertex pulling (MDI)" << endl;
+    cout << "  Z       - Toggle depth pre-pass (MDI)" << endl;
+    cout << "  B       - Toggle static batching" << endl;
+    cout << "  N       - Toggle dynamic batching (individual)" << endl;
+    cout << "  H       - Toggle HLOD proxies" << endl;
+    cout << "  M       - Toggle impostors" << endl;
+    cout << "  L       - Toggle clustered lighting" << endl;
+    cout << "  F       - Toggle deferred shading" << endl;
+    cout << "  K       - Toggle sun shadows" << endl;
+    cout << "  J       - Toggle static shadow cache" << endl;
+    cout << "  P       - Pick model under the screen center" << endl;
+    cout << "  G       - Print GL state / stream buffer counters" << endl;
     cout << "  ESC     - Exit application" << endl;
     cout << "========================================\n" << endl;
 
+    // Benchmarks replace the interactive session
+    if (g_benchInstancing)
+    {
+        runInstancingBenchmark(window);
+        glfwSetWindowShouldClose(window, GLFW_TRUE);
+    }
+    if (g_benchCulling)
+    {
+        runCullingBenchmark();
+        glfwSetWindowShouldClose(window, GLFW_TRUE);
+    }
+
     // ===== MAIN RENDER LOOP =====
+    float lastFrameTime = (float)glfwGetTime();
     while (!glfwWindowShouldClose(window))
     {
+        // Count state calls per frame
+        GLStateCache::resetStats();
+
+        // Take the next region of every stream buffer
+        beginStreamingFrame();
+
+        // Shadow cascades first, they render into their own framebuffer
+        if (g_shadowsSupported)
+            g_shadowMaps->update(g_spawnedModels, g_meshRegistry, *g_camera);
+
+        // With reverse-Z the frame is drawn into the float depth scene framebuffer, else into the window's
+        glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+        bool offscreenFrame = g_reverseZ && g_sceneFramebuffer.resize(framebufferWidth, framebufferHeight);
+        GLuint sceneFramebuffer = offscreenFrame ? g_sceneFramebuffer.getFramebuffer() : 0;
+
+        // Deferred frames draw into the G-buffer; the lighting pass overwrites every pixel of the scene framebuffer
+        bool deferredFrame = g_deferred && g_deferredRenderer.beginGeometryPass(framebufferWidth, framebufferHeight);
+
         // Clear color and depth buffers
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        if (!deferredFrame)
+        {
+            glBindFramebuffer(GL_FRAMEBUFFER, sceneFramebuffer);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        }
 
-        // Use the shader program
-        glUseProgram(g_shaderProgram);
+        // Calculate view and projection matrices from camera,
+        // uploaded once for every program that reads FrameData
+        float currentTime = (float)glfwGetTime();
+        updateFrameUniforms(currentTime, currentTime - lastFrameTime);
+        lastFrameTime = currentTime;
+
+        // Lights are binned against this frame's camera before anything is shaded
+        g_clusteredLighting->setGBufferOutput(deferredFrame);
+        updateLighting(framebufferWidth, framebufferHeight);
+
+        // Keep the spatial index in step with the spawned models
+        updateInstanceBvh();
+
+        // Static batches or distant HLOD proxies first, then impostors, then the remaining models through the draw path
+        const vector<Model3D>& unbatchedModels = g_staticBatching ? drawStaticBatches() :
+            g_hlod ? drawHlodProxies() : g_spawnedModels;
+        const vector<Model3D>& sceneModels = g_impostors ? drawImpostors(unbatchedModels) : unbatchedModels;
+
+        // Draw all spawned models (the GPU-culled path culls them itself)
+        if (g_drawMode == DrawMode::GpuCulled && g_gpuCullingSupported)
+            drawModels(sceneModels, g_drawMode);
+        else if (g_drawMode == DrawMode::OcclusionQueries && g_occlusionQueriesSupported)
+            drawModelsQueried(sceneModels);
+        else
+            drawModels(cullModels(sceneModels), g_drawMode);
+
+        // Light the G-buffer into the scene framebuffer, depth included
+        if (deferredFrame)
+        {
+            g_deferredRenderer.shade(g_camera->getProjectionMatrix() * g_camera->getViewMatrix(), CLEAR_COLOR,
+                sceneFramebuffer);
+        }
 
-        // Get uniform locations
-        GLint transformLoc = glGetUniformLocation(g_shaderProgram, "transform");
-        GLint viewLoc = glGetUniformLocation(g_shaderProgram, "view");
-        GLint projLoc = glGetUniformLocation(g_shaderProgram, "projection");
+        // Depth pyramid for next frame's occlusion test, from this frame's finished depth buffer
+        if (g_drawMode == DrawMode::GpuCulled && g_gpuCullingSupported && g_gpuCuller.isOcclusionEnabled())
+        {
+            g_gpuCuller.buildDepthPyramid(g_camera->getProjectionMatrix() * g_camera->getViewMatrix(),
+                framebufferWidth, framebufferHeight);
+        }
 
-        // Calculate and set view matrix from camera
-        glm::mat4 view = g_camera->getViewMatrix();
-        glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
+        // Only the color reaches the window, after everything that reads the frame's depth
+        if (offscreenFrame)
+            g_sceneFramebuffer.present();
 
-        // Calculate and set perspective projection matrix
-        glm::mat4 projection = g_camera->getProjectionMatrix();
-        glUniformMatrix4fv(projLoc, 1, GL_FALSE, glm::value_ptr(projection));
+        // Fence this frame's streamed data
+        endStreamingFrame();
 
-        // Draw all spawned models
-        for (auto& model : g_spawnedModels)
+        if (g_printStateStats)
         {
-            model.draw(g_shaderProgram, transformLoc);
+            GLStateCache::printStats();
+            g_drawUniformRing.getStream().printStats();
+            g_instanceStream.printStats();
+            g_meshRegistry.printStats();
+            g_instanceBvh->printStats();
+            if (g_cpuCulling)
+                cout << "CPU frustum culling (" << FrustumCuller::getSimdPathName() << "): " << g_visibleIndices.size()
+                    << " / " << g_frustumCuller.getCount() << " models visible" << endl;
+            if (g_cpuCulling && g_softwareOcclusionCulling)
+                g_softwareOcclusion->printStats();
+            if (g_indirectSupported)
+                g_indirectBatcher.printStats();
+            if (g_gpuCullingSupported)
+                g_gpuCuller.printStats();
+            if (g_drawMode == DrawMode::OcclusionQueries && g_occlusionQueriesSupported)
+                g_occlusionQueries.printStats();
+            if (g_drawMode == DrawMode::Individual)
+                g_renderQueue->printStats();
+            if (g_staticBatching)
+                g_staticBatcher->printStats();
+            if (g_drawMode == DrawMode::Individual && g_dynamicBatching)
+                g_dynamicBatcher->printStats();
+            if (g_hlod && !g_staticBatching)
+                g_hierarchicalLod->printStats();
+            if (g_impostors)
+                g_impostorRenderer.printStats();
+            if (g_lighting)
+                g_clusteredLighting->printStats();
+            if (g_deferred)
+                g_deferredRenderer.printStats();
+            if (g_shadowsSupported && g_shadowMaps->isEnabled())
+                g_shadowMaps->printStats();
+            g_printStateStats = false;
         }
 
         // Swap front and back buffers
@@ -437,15 +1853,53 @@ int main(void)
     // ===== CLEANUP =====
     cout << "\nCleaning up..." << endl;
 
-    // Clean up shared mesh resources
-    Model3D::cleanupSharedMesh();
+    // Clean up meshes and instancing resources
+    Model3D::cleanupInstancing();
+    g_meshRegistry.destroy();
+
+    // Delete packed textures
+    g_texturePacker.cleanup();
 
     // Delete shader program
-    glDeleteProgram(g_shaderProgram);
+    g_shaderProgram.destroy();
+    g_indirectProgram.destroy();
+    g_pulledProgram.destroy();
+    g_depthPrepassProgram.destroy();
+    g_staticProgram.destroy();
+    g_staticBatcher->destroy();
+    g_dynamicBatcher->destroy();
+    g_hierarchicalLod->destroy();
+    g_indirectBatcher.destroy();
+    g_culledProgram.destroy();
+    g_gpuCuller.destroy();
+    g_occlusionQueries.destroy();
+    g_impostorRenderer.destroy();
+    g_clusteredLighting->destroy();
+    g_deferredRenderer.destroy();
+    g_shadowMaps->destroy();
+    g_sceneFramebuffer.destroy();
+
+    // Delete uniform buffers
+    g_frameUniforms.destroy();
+    g_drawUniformRing.destroy();
+    g_instanceStream.destroy();
 
     // Clean up camera
     delete g_camera;
 
+    // Waits for a background rebuild, so before the workers stop
+    delete g_renderQueue;
+    delete g_staticBatcher;
+    delete g_dynamicBatcher;
+    delete g_hierarchicalLod;
+    delete g_clusteredLighting;
+    delete g_shadowMaps;
+    delete g_softwareOcclusion;
+    delete g_instanceBvh;
+
+    // Stop worker threads
+    delete g_threadPool;
+
     // Terminate GLFW
     glfwTerminate();
 
@@ -15,7 +15,8 @@ Camera::Camera(const glm::vec3& pos, const glm::vec3& worldUp) :
 	fov(60.0f),
 	aspect(WINDOW_WIDTH / WINDOW_HEIGHT),
 	nearPlane(0.01f),
-	farPlane(100.0f)
+	farPlane(100.0f),
+	reverseZ(false)
 {
 	updateCameraVectors();
 }
@@ -85,5 +86,16 @@ glm::mat4 Camera::getViewMatrix() const
 
 glm::mat4 Camera::getProjectionMatrix() const
 {
-	return glm::perspective(glm::radians(fov), aspect, nearPlane, farPlane);
+	if (!reverseZ)
+		return glm::perspective(glm::radians(fov), aspect, nearPlane, farPlane);
+
+	// Infinite far plane, depth = near / distance: 1 at the near plane, 0 at infinity
+	// (clip z is taken as-is, so the context must use glClipControl(GL_LOWER_LEFT, GL_ZERO_TO_ONE))
+	float focal = 1.0f / std::tan(glm::radians(fov) * 0.5f);
+	glm::mat4 projection(0.0f);
+	projection[0][0] = focal / aspect;
+	projection[1][1] = focal;
+	projection[2][3] = -1.0f;
+	projection[3][2] = nearPlane;
+	return projection;
 }
\ No newline at end of file
@@ -35,6 +35,7 @@ private:
     float aspect;
     float nearPlane;
     float farPlane;
+    bool reverseZ;      // Reverse-Z infinite projection (depth 1 = near, 0 = infinitely far)
 
     /**
      * Recalculate camera vectors based on pitch and yaw
@@ -97,6 +98,36 @@ public:
      */
     glm::vec3 getFront() const { return front; }
 
+    /**
+     * Get near clip plane distance
+     * @return Distance to the near plane
+     */
+    float getNearPlane() const { return nearPlane; }
+
+    /**
+     * Get far clip plane distance
+     * The reverse-Z projection has no far plane; this stays the depth range used for sorting
+     * @return Distance to the far plane
+     */
+    float getFarPlane() const { return farPlane; }
+
+    /**
+     * Get vertical field of view
+     * @return FOV in degrees
+     */
+    float getFOV() const { return fov; }
+
+    /**
+     * Get aspect ratio
+     * @return Width / Height
+     */
+    float getAspectRatio() const { return aspect; }
+
+    /**
+     * True if getProjectionMatrix() is a reverse-Z infinite projection
+     */
+    bool isReverseZ() const { return reverseZ; }
+
     /**
      * Get view matrix
      * @return 4x4 view matrix
@@ -105,6 +136,8 @@ public:
 
     /**
      * Get projection matrix
+     * Standard OpenGL perspective, or reverse-Z with an infinite far plane
+     * for a [0, 1] clip depth range (see setReverseZ)
      * @return 4x4 projection matrix
      */
     glm::mat4 getProjectionMatrix() const;
@@ -139,4 +172,12 @@ public:
      * @param aspectRatio Width / Height
      */
     void setAspectRatio(float aspectRatio) { aspect = aspectRatio; }
+
+    /**
+     * Switch to a reverse-Z infinite projection
+     * Requires glClipControl(GL_LOWER_LEFT, GL_ZERO_TO_ONE), a depth clear of 0
+     * and GL_GREATER depth testing
+     * @param enabled True for reverse-Z
+     */
+    void setReverseZ(bool enabled) { reverseZ = enabled; }
 };
\ No newline at end of file
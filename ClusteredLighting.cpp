@@ -0,0 +1,377 @@
+#include "ClusteredLighting.h"
+#include "GLResources.h"
+#include "GLStateCache.h"
+#include "Simd.h"
+#include "UniformBuffers.h"
+#include <algorithm>
+#include <chrono>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+static_assert(sizeof(PointLight) == 32, "PointLight must match the std430 struct in Shaders/sample.frag");
+
+static const unsigned int TILE_COUNT = ClusteredLighting::TILES_X * ClusteredLighting::TILES_Y;
+
+// Padding of the view-space arrays, the widest SIMD path
+static const size_t LIGHT_LANES = 8;
+
+ClusteredLighting::ClusteredLighting(ThreadPool* threadPool)
+    : threadPool(threadPool),
+    tanHalfFovX(1.0f),
+    tanHalfFovY(1.0f),
+    slices(SLICES),
+    uniformBuffer(0),
+    storageAlignment(16),
+    gbufferOutput(false),
+    lastIndexCount(0),
+    lastOccupiedClusters(0),
+    lastMaxClusterLights(0),
+    lastBinMilliseconds(0.0)
+{
+    for (unsigned int s = 0; s < SLICES; s++)
+        sliceNear[s] = sliceFar[s] = 0.0f;
+}
+
+void ClusteredLighting::create(size_t lightCapacity)
+{
+    glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &storageAlignment);
+
+    // Lights, one (offset, count) pair per cluster and about 4 clusters per light
+    size_t clusterBytes = CLUSTER_COUNT * sizeof(glm::uvec2);
+    clusterStream.create("light clusters", lightCapacity * (sizeof(PointLight) + 4 * sizeof(unsigned int)) +
+        clusterBytes + 3 * (size_t)storageAlignment);
+
+    // Bound once like FrameData, every program using Shaders/sample.frag reads it; unlit until update()
+    LightingUniforms unlit = {};
+    unlit.clusterGrid = glm::uvec4(TILES_X, TILES_Y, SLICES, 0u);
+    uniformBuffer = GLResources::createBuffer(sizeof(LightingUniforms), &unlit, GL_DYNAMIC_STORAGE_BIT);
+    GLStateCache::bindBufferRange(GL_UNIFORM_BUFFER, UNIFORM_BINDING_LIGHTING, uniformBuffer, 0, 0);
+}
+
+void ClusteredLighting::binSlice(unsigned int slice)
+{
+    SliceBins& bins = slices[slice];
+    bins.binned.clear();
+    bins.rectangles.clear();
+
+    // View x / depth to tiles: depth * tan(fov / 2) spans half the screen
+    const float nearDepth = sliceNear[slice];
+    const float farDepth = sliceFar[slice];
+    const float scaleX = 0.5f * TILES_X / tanHalfFovX;
+    const float scaleY = 0.5f * TILES_Y / tanHalfFovY;
+    const float centerX = 0.5f * TILES_X;
+    const float centerY = 0.5f * TILES_Y;
+    const size_t count = viewX.size();
+
+    // Per light: overlap the slice's depth range, clamp its depth interval to it, then the
+    // extremes of x / depth over the clamped view-space box give the tile rectangle
+#if GRAP1_AVX2
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 sliceNearV = _mm256_set1_ps(nearDepth);
+    const __m256 sliceFarV = _mm256_set1_ps(farDepth);
+    const __m256 scaleXV = _mm256_set1_ps(scaleX);
+    const __m256 scaleYV = _mm256_set1_ps(scaleY);
+    const __m256 centerXV = _mm256_set1_ps(centerX);
+    const __m256 centerYV = _mm256_set1_ps(centerY);
+    const __m256 tilesXV = _mm256_set1_ps((float)TILES_X);
+    const __m256 tilesYV = _mm256_set1_ps((float)TILES_Y);
+    const __m256 lastXV = _mm256_set1_ps((float)(TILES_X - 1));
+    const __m256 lastYV = _mm256_set1_ps((float)(TILES_Y - 1));
+    alignas(32) int tileMinX[8], tileMaxX[8], tileMinY[8], tileMaxY[8];
+    for (size_t i = 0; i < count; i += 8)
+    {
+        __m256 x = _mm256_loadu_ps(viewX.data() + i);
+        __m256 y = _mm256_loadu_ps(viewY.data() + i);
+        __m256 depth = _mm256_loadu_ps(viewDepth.data() + i);
+        __m256 radius = _mm256_loadu_ps(viewRadius.data() + i);
+
+        __m256 depthMin = _mm256_sub_ps(depth, radius);
+        __m256 depthMax = _mm256_add_ps(depth, radius);
+        __m256 inside = _mm256_and_ps(_mm256_cmp_ps(depthMax, sliceNearV, _CMP_GE_OQ),
+            _mm256_cmp_ps(depthMin, sliceFarV, _CMP_LE_OQ));
+        if (_mm256_movemask_ps(inside) == 0)
+            continue;
+
+        __m256 inverseNear = _mm256_div_ps(one, _mm256_max_ps(depthMin, sliceNearV));
+        __m256 inverseFar = _mm256_div_ps(one, _mm256_min_ps(depthMax, sliceFarV));
+        __m256 xLow = _mm256_sub_ps(x, radius);
+        __m256 xHigh = _mm256_add_ps(x, radius);
+        __m256 yLow = _mm256_sub_ps(y, radius);
+        __m256 yHigh = _mm256_add_ps(y, radius);
+        __m256 minX = _mm256_add_ps(_mm256_mul_ps(_mm256_min_ps(_mm256_mul_ps(xLow, inverseNear),
+            _mm256_mul_ps(xLow, inverseFar)), scaleXV), centerXV);
+        __m256 maxX = _mm256_add_ps(_mm256_mul_ps(_mm256_max_ps(_mm256_mul_ps(xHigh, inverseNear),
+            _mm256_mul_ps(xHigh, inverseFar)), scaleXV), centerXV);
+        __m256 minY = _mm256_add_ps(_mm256_mul_ps(_mm256_min_ps(_mm256_mul_ps(yLow, inverseNear),
+            _mm256_mul_ps(yLow, inverseFar)), scaleYV), centerYV);
+        __m256 maxY = _mm256_add_ps(_mm256_mul_ps(_mm256_max_ps(_mm256_mul_ps(yHigh, inverseNear),
+            _mm256_mul_ps(yHigh, inverseFar)), scaleYV), centerYV);
+
+        // Off-screen rectangles
+        inside = _mm256_and_ps(inside, _mm256_and_ps(
+            _mm256_and_ps(_mm256_cmp_ps(maxX, zero, _CMP_GE_OQ), _mm256_cmp_ps(minX, tilesXV, _CMP_LT_OQ)),
+            _mm256_and_ps(_mm256_cmp_ps(maxY, zero, _CMP_GE_OQ), _mm256_cmp_ps(minY, tilesYV, _CMP_LT_OQ))));
+        int mask = _mm256_movemask_ps(inside);
+        if (mask == 0)
+            continue;
+
+        // Clamped to the grid, truncation is floor
+        _mm256_store_si256((__m256i*)tileMinX, _mm256_cvttps_epi32(_mm256_max_ps(_mm256_min_ps(minX, lastXV), zero)));
+        _mm256_store_si256((__m256i*)tileMaxX, _mm256_cvttps_epi32(_mm256_max_ps(_mm256_min_ps(maxX, lastXV), zero)));
+        _mm256_store_si256((__m256i*)tileMinY, _mm256_cvttps_epi32(_mm256_max_ps(_mm256_min_ps(minY, lastYV), zero)));
+        _mm256_store_si256((__m256i*)tileMaxY, _mm256_cvttps_epi32(_mm256_max_ps(_mm256_min_ps(maxY, lastYV), zero)));
+        for (int lane = 0; lane < 8; lane++)
+        {
+            if ((mask >> lane) & 1)
+            {
+                bins.binned.push_back((unsigned int)(i + lane));
+                bins.rectangles.push_back(glm::uvec4(tileMinX[lane], tileMaxX[lane], tileMinY[lane], tileMaxY[lane]));
+            }
+        }
+    }
+#elif GRAP1_SSE2
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 sliceNearV = _mm_set1_ps(nearDepth);
+    const __m128 sliceFarV = _mm_set1_ps(farDepth);
+    const __m128 scaleXV = _mm_set1_ps(scaleX);
+    const __m128 scaleYV = _mm_set1_ps(scaleY);
+    const __m128 centerXV = _mm_set1_ps(centerX);
+    const __m128 centerYV = _mm_set1_ps(centerY);
+    const __m128 tilesXV = _mm_set1_ps((float)TILES_X);
+    const __m128 tilesYV = _mm_set1_ps((float)TILES_Y);
+    const __m128 lastXV = _mm_set1_ps((float)(TILES_X - 1));
+    const __m128 lastYV = _mm_set1_ps((float)(TILES_Y - 1));
+    alignas(16) int tileMinX[4], tileMaxX[4], tileMinY[4], tileMaxY[4];
+    for (size_t i = 0; i < count; i += 4)
+    {
+        __m128 x = _mm_loadu_ps(viewX.data() + i);
+        __m128 y = _mm_loadu_ps(viewY.data() + i);
+        __m128 depth = _mm_loadu_ps(viewDepth.data() + i);
+        __m128 radius = _mm_loadu_ps(viewRadius.data() + i);
+
+        __m128 depthMin = _mm_sub_ps(depth, radius);
+        __m128 depthMax = _mm_add_ps(depth, radius);
+        __m128 inside = _mm_and_ps(_mm_cmpge_ps(depthMax, sliceNearV), _mm_cmple_ps(depthMin, sliceFarV));
+        if (_mm_movemask_ps(inside) == 0)
+            continue;
+
+        __m128 inverseNear = _mm_div_ps(one, _mm_max_ps(depthMin, sliceNearV));
+        __m128 inverseFar = _mm_div_ps(one, _mm_min_ps(depthMax, sliceFarV));
+        __m128 xLow = _mm_sub_ps(x, radius);
+        __m128 xHigh = _mm_add_ps(x, radius);
+        __m128 yLow = _mm_sub_ps(y, radius);
+        __m128 yHigh = _mm_add_ps(y, radius);
+        __m128 minX = _mm_add_ps(_mm_mul_ps(_mm_min_ps(_mm_mul_ps(xLow, inverseNear),
+            _mm_mul_ps(xLow, inverseFar)), scaleXV), centerXV);
+        __m128 maxX = _mm_add_ps(_mm_mul_ps(_mm_max_ps(_mm_mul_ps(xHigh, inverseNear),
+            _mm_mul_ps(xHigh, inverseFar)), scaleXV), centerXV);
+        __m128 minY = _mm_add_ps(_mm_mul_ps(_mm_min_ps(_mm_mul_ps(yLow, inverseNear),
+            _mm_mul_ps(yLow, inverseFar)), scaleYV), centerYV);
+        __m128 maxY = _mm_add_ps(_mm_mul_ps(_mm_max_ps(_mm_mul_ps(yHigh, inverseNear),
+            _mm_mul_ps(yHigh, inverseFar)), scaleYV), centerYV);
+
+        inside = _mm_and_ps(inside, _mm_and_ps(
+            _mm_and_ps(_mm_cmpge_ps(maxX, zero), _mm_cmplt_ps(minX, tilesXV)),
+            _mm_and_ps(_mm_cmpge_ps(maxY, zero), _mm_cmplt_ps(minY, tilesYV))));
+        int mask = _mm_movemask_ps(inside);
+        if (mask == 0)
+            continue;
+
+        _mm_store_si128((__m128i*)tileMinX, _mm_cvttps_epi32(_mm_max_ps(_mm_min_ps(minX, lastXV), zero)));
+        _mm_store_si128((__m128i*)tileMaxX, _mm_cvttps_epi32(_mm_max_ps(_mm_min_ps(maxX, lastXV), zero)));
+        _mm_store_si128((__m128i*)tileMinY, _mm_cvttps_epi32(_mm_max_ps(_mm_min_ps(minY, lastYV), zero)));
+        _mm_store_si128((__m128i*)tileMaxY, _mm_cvttps_epi32(_mm_max_ps(_mm_min_ps(maxY, lastYV), zero)));
+        for (int lane = 0; lane < 4; lane++)
+        {
+            if ((mask >> lane) & 1)
+            {
+                bins.binned.push_back((unsigned int)(i + lane));
+                bins.rectangles.push_back(glm::uvec4(tileMinX[lane], tileMaxX[lane], tileMinY[lane], tileMaxY[lane]));
+            }
+        }
+    }
+#else
+    for (size_t i = 0; i < count; i++)
+    {
+        float depthMin = viewDepth[i] - viewRadius[i];
+        float depthMax = viewDepth[i] + viewRadius[i];
+        if (depthMax < nearDepth || depthMin > farDepth)
+            continue;
+
+        float inverseNear = 1.0f / std::max(depthMin, nearDepth);
+        float inverseFar = 1.0f / std::min(depthMax, farDepth);
+        float xLow = viewX[i] - viewRadius[i];
+        float xHigh = viewX[i] + viewRadius[i];
+        float yLow = viewY[i] - viewRadius[i];
+        float yHigh = viewY[i] + viewRadius[i];
+        float minX = std::min(xLow * inverseNear, xLow * inverseFar) * scaleX + centerX;
+        float maxX = std::max(xHigh * inverseNear, xHigh * inverseFar) * scaleX + centerX;
+        float minY = std::min(yLow * inverseNear, yLow * inverseFar) * scaleY + centerY;
+        float maxY = std::max(yHigh * inverseNear, yHigh * inverseFar) * scaleY + centerY;
+        if (maxX < 0.0f || minX >= (float)TILES_X || maxY < 0.0f || minY >= (float)TILES_Y)
+            continue;
+
+        bins.binned.push_back((unsigned int)i);
+        bins.rectangles.push_back(glm::uvec4(
+            (unsigned int)std::max(std::min(minX, (float)(TILES_X - 1)), 0.0f),
+            (unsigned int)std::max(std::min(maxX, (float)(TILES_X - 1)), 0.0f),
+            (unsigned int)std::max(std::min(minY, (float)(TILES_Y - 1)), 0.0f),
+            (unsigned int)std::max(std::min(maxY, (float)(TILES_Y - 1)), 0.0f)));
+    }
+#endif
+
+    // Count per tile, then fill; lights stay in index order within a tile
+    bins.tileOffsets.assign(TILE_COUNT + 1, 0);
+    for (const glm::uvec4& rectangle : bins.rectangles)
+    {
+        for (unsigned int tileY = rectangle.z; tileY <= rectangle.w; tileY++)
+        {
+            for (unsigned int tileX = rectangle.x; tileX <= rectangle.y; tileX++)
+                bins.tileOffsets[tileY * TILES_X + tileX + 1]++;
+        }
+    }
+    for (unsigned int tile = 0; tile < TILE_COUNT; tile++)
+        bins.tileOffsets[tile + 1] += bins.tileOffsets[tile];
+
+    bins.indices.resize(bins.tileOffsets[TILE_COUNT]);
+    std::vector<unsigned int> cursors(bins.tileOffsets.begin(), bins.tileOffsets.end() - 1);
+    for (size_t i = 0; i < bins.binned.size(); i++)
+    {
+        const glm::uvec4& rectangle = bins.rectangles[i];
+        for (unsigned int tileY = rectangle.z; tileY <= rectangle.w; tileY++)
+        {
+            for (unsigned int tileX = rectangle.x; tileX <= rectangle.y; tileX++)
+                bins.indices[cursors[tileY * TILES_X + tileX]++] = bins.binned[i];
+        }
+    }
+}
+
+void ClusteredLighting::update(const glm::mat4& view, const glm::mat4& projection, float nearPlane, float farPlane,
+    int viewportWidth, int viewportHeight, bool enabled)
+{
+    float logScale = (float)(SLICES - 1) / std::log(std::max(farPlane, 2.0f * SLICE_NEAR) / SLICE_NEAR);
+
+    LightingUniforms uniforms;
+    uniforms.clusterGrid = glm::uvec4(TILES_X, TILES_Y, SLICES, enabled ? (unsigned int)lights.size() : 0u);
+    uniforms.clusterDepth = glm::vec4(SLICE_NEAR, logScale, 0.0f, 0.0f);
+    uniforms.clusterScreen = glm::vec4((float)TILES_X / (float)std::max(viewportWidth, 1),
+        (float)TILES_Y / (float)std::max(viewportHeight, 1), 0.0f, 0.0f);
+    uniforms.lighting = glm::vec4(AMBIENT, enabled ? 1.0f : 0.0f, gbufferOutput ? 1.0f : 0.0f, 0.0f);
+    GLResources::updateBuffer(uniformBuffer, 0, sizeof(LightingUniforms), &uniforms);
+
+    // Unlit shaders never read the storage buffers
+    if (!enabled)
+        return;
+
+    auto start = std::chrono::high_resolution_clock::now();
+
+    // Same slicing as Shaders/sample.frag: slice 0 up to SLICE_NEAR, then logarithmic
+    tanHalfFovX = 1.0f / projection[0][0];
+    tanHalfFovY = 1.0f / projection[1][1];
+    sliceNear[0] = nearPlane;
+    sliceFar[0] = SLICE_NEAR;
+    for (unsigned int s = 1; s < SLICES; s++)
+    {
+        sliceNear[s] = SLICE_NEAR * std::exp((float)(s - 1) / logScale);
+        sliceFar[s] = SLICE_NEAR * std::exp((float)s / logScale);
+    }
+    sliceFar[SLICES - 1] = FLT_MAX;
+
+    // Padding lanes lie behind the camera, so they never overlap a slice
+    size_t padded = (lights.size() + LIGHT_LANES - 1) / LIGHT_LANES * LIGHT_LANES;
+    viewX.assign(padded, 0.0f);
+    viewY.assign(padded, 0.0f);
+    viewDepth.assign(padded, -FLT_MAX);
+    viewRadius.assign(padded, 0.0f);
+    for (size_t i = 0; i < lights.size(); i++)
+    {
+        glm::vec4 position = view * glm::vec4(lights[i].position, 1.0f);
+        viewX[i] = position.x;
+        viewY[i] = position.y;
+        viewDepth[i] = -position.z;
+        viewRadius[i] = lights[i].radius;
+    }
+
+    auto bin = [this](size_t begin, size_t end) {
+        for (size_t s = begin; s < end; s++)
+            binSlice((unsigned int)s);
+    };
+    if (threadPool)
+        threadPool->parallelFor(SLICES, 1, bin);
+    else
+        bin(0, SLICES);
+
+    size_t indexCount = 0;
+    for (const SliceBins& bins : slices)
+        indexCount += bins.indices.size();
+
+    // Empty arrays still get one element, a bound range must not be empty
+    size_t alignment = (size_t)storageAlignment;
+    size_t lightBytes = std::max(lights.size(), (size_t)1) * sizeof(PointLight);
+    size_t clusterBytes = CLUSTER_COUNT * sizeof(glm::uvec2);
+    size_t indexBytes = std::max(indexCount, (size_t)1) * sizeof(unsigned int);
+
+    // Reserved up front: growing between the allocations would unmap the earlier ones
+    clusterStream.reserve(lightBytes + clusterBytes + indexBytes + 3 * alignment);
+    size_t lightOffset = 0;
+    size_t clusterOffset = 0;
+    size_t indexOffset = 0;
+    void* lightData = clusterStream.allocate(lightBytes, alignment, lightOffset);
+    glm::uvec2* clusters = (glm::uvec2*)clusterStream.allocate(clusterBytes, alignment, clusterOffset);
+    unsigned int* indices = (unsigned int*)clusterStream.allocate(indexBytes, alignment, indexOffset);
+
+    if (!lights.empty())
+        std::memcpy(lightData, lights.data(), lights.size() * sizeof(PointLight));
+
+    // Cluster (tile x, tile y, slice) is at (slice * TILES_Y + y) * TILES_X + x
+    lastOccupiedClusters = lastMaxClusterLights = 0;
+    unsigned int sliceBase = 0;
+    for (unsigned int s = 0; s < SLICES; s++)
+    {
+        const SliceBins& bins = slices[s];
+        for (unsigned int tile = 0; tile < TILE_COUNT; tile++)
+        {
+            unsigned int count = bins.tileOffsets[tile + 1] - bins.tileOffsets[tile];
+            clusters[s * TILE_COUNT + tile] = glm::uvec2(sliceBase + bins.tileOffsets[tile], count);
+            lastOccupiedClusters += count > 0 ? 1 : 0;
+            lastMaxClusterLights = std::max(lastMaxClusterLights, (size_t)count);
+        }
+        if (!bins.indices.empty())
+            std::memcpy(indices + sliceBase, bins.indices.data(), bins.indices.size() * sizeof(unsigned int));
+        sliceBase += (unsigned int)bins.indices.size();
+    }
+    lastIndexCount = indexCount;
+
+    GLuint buffer = clusterStream.getBuffer();
+    GLStateCache::bindBufferRange(GL_SHADER_STORAGE_BUFFER, STORAGE_BINDING_LIGHTS, buffer,
+        (GLintptr)lightOffset, (GLsizeiptr)lightBytes);
+    GLStateCache::bindBufferRange(GL_SHADER_STORAGE_BUFFER, STORAGE_BINDING_LIGHT_CLUSTERS, buffer,
+        (GLintptr)clusterOffset, (GLsizeiptr)clusterBytes);
+    GLStateCache::bindBufferRange(GL_SHADER_STORAGE_BUFFER, STORAGE_BINDING_LIGHT_INDICES, buffer,
+        (GLintptr)indexOffset, (GLsizeiptr)indexBytes);
+
+    auto end = std::chrono::high_resolution_clock::now();
+    lastBinMilliseconds = std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+void ClusteredLighting::printStats() const
+{
+    std::cout << "Clustered lighting: " << lights.size() << " lights, " << lastOccupiedClusters << " / "
+        << CLUSTER_COUNT << " clusters lit, " << lastIndexCount << " light indices (max " << lastMaxClusterLights
+        << " per cluster), binned in " << lastBinMilliseconds << " ms" << std::endl;
+    clusterStream.printStats();
+}
+
+void ClusteredLighting::destroy()
+{
+    clusterStream.destroy();
+    if (uniformBuffer != 0)
+    {
+        GLStateCache::deleteBuffers(1, &uniformBuffer);
+        uniformBuffer = 0;
+    }
+}
@@ -0,0 +1,153 @@
+#pragma once
+#include <vector>
+#include <glm/glm.hpp>
+#include <glad/gl.h>
+#include "StreamBuffer.h"
+#include "ThreadPool.h"
+
+/**
+ * @struct PointLight
+ * @brief Point light with a finite range (std430 layout of Shaders/sample.frag, 32 bytes)
+ */
+struct PointLight
+{
+    glm::vec3 position;     // World space
+    float radius;           // No contribution beyond this distance
+    glm::vec3 color;
+    float intensity;
+};
+
+/**
+ * @struct LightingUniforms
+ * @brief std140 layout of the "LightingData" block
+ */
+struct LightingUniforms
+{
+    glm::uvec4 clusterGrid;     // x, y = screen tiles, z = depth slices, w = light count
+    glm::vec4 clusterDepth;     // x = near edge of slice 1, y = slices per log unit of depth
+    glm::vec4 clusterScreen;    // xy = tiles per pixel
+    glm::vec4 lighting;         // x = ambient, y = 1 if lighting is enabled, z = 1 for G-buffer output
+};
+
+/**
+ * @class ClusteredLighting
+ * @brief Bins point lights into a depth-sliced cluster grid of the view frustum (clustered forward shading)
+ *
+ * The view frustum is split into TILES_X x TILES_Y screen tiles and SLICES
+ * depth slices. Slice 0 ends at SLICE_NEAR; the others are spaced
+ * logarithmically up to the camera's far plane, and the last one reaches to
+ * infinity. Every frame, update() assigns the lights to the clusters their
+ * sphere overlaps:
+ * - the lights are moved to view space into SIMD-friendly arrays
+ * - each slice is one task on the thread pool; it tests the lights against
+ *   its depth range and projects their view-space bounds to a tile rectangle,
+ *   4 (SSE) or 8 (AVX2) lights at a time, then fills its tiles' index lists
+ * - the lights, one (offset, count) pair per cluster and the packed index
+ *   lists are streamed to three storage buffers
+ *
+ * Shaders/sample.frag finds its cluster from gl_FragCoord and its view depth
+ * and only loops over that cluster's lights, so the cost per pixel follows the
+ * lights actually nearby rather than the number of lights in the scene.
+ */
+class ClusteredLighting
+{
+public:
+    static const unsigned int TILES_X = 16;
+    static const unsigned int TILES_Y = 9;
+    static const unsigned int SLICES = 24;
+    static const unsigned int CLUSTER_COUNT = TILES_X * TILES_Y * SLICES;
+
+    // Far edge of slice 0; closer slices would be thinner than anything in the scene
+    static constexpr float SLICE_NEAR = 1.0f;
+
+    // Light every surface receives; the unlit scene corresponds to 1
+    static constexpr float AMBIENT = 0.3f;
+
+private:
+    // Index lists of one depth slice, filled by its task
+    struct SliceBins
+    {
+        std::vector<unsigned int> tileOffsets;  // TILES_X * TILES_Y + 1, into indices
+        std::vector<unsigned int> indices;
+        std::vector<unsigned int> binned;       // Lights overlapping the slice
+        std::vector<glm::uvec4> rectangles;     // Their tile rectangle: min x, max x, min y, max y
+    };
+
+    ThreadPool* threadPool;
+    std::vector<PointLight> lights;
+
+    // View-space lights, padded to a multiple of 8 with lights that overlap nothing
+    std::vector<float> viewX;
+    std::vector<float> viewY;
+    std::vector<float> viewDepth;
+    std::vector<float> viewRadius;
+
+    float sliceNear[SLICES];
+    float sliceFar[SLICES];
+    float tanHalfFovX;
+    float tanHalfFovY;
+    std::vector<SliceBins> slices;
+
+    GLuint uniformBuffer;
+    StreamBuffer clusterStream;
+    GLint storageAlignment;
+    bool gbufferOutput;
+
+    size_t lastIndexCount;
+    size_t lastOccupiedClusters;
+    size_t lastMaxClusterLights;
+    double lastBinMilliseconds;
+
+    /**
+     * Bin every light into the tiles of one depth slice (runs on a worker)
+     */
+    void binSlice(unsigned int slice);
+
+public:
+    /**
+     * @param threadPool Pool the slices are binned on (nullptr = calling thread)
+     */
+    explicit ClusteredLighting(ThreadPool* threadPool = nullptr);
+
+    ClusteredLighting(const ClusteredLighting&) = delete;
+    ClusteredLighting& operator=(const ClusteredLighting&) = delete;
+
+    /**
+     * Create the uniform buffer (bound to UNIFORM_BINDING_LIGHTING) and the cluster stream
+     * @param lightCapacity Lights the stream is first sized for
+     */
+    void create(size_t lightCapacity);
+
+    void addLight(const PointLight& light) { lights.push_back(light); }
+    void clearLights() { lights.clear(); }
+    size_t getLightCount() const { return lights.size(); }
+
+    /**
+     * Make the shaders write the deferred G-buffer instead of lit color (see DeferredRenderer)
+     * Applies from the next update()
+     */
+    void setGBufferOutput(bool enabled) { gbufferOutput = enabled; }
+
+    void beginFrame() { clusterStream.beginFrame(); }
+    void endFrame() { clusterStream.endFrame(); }
+
+    /**
+     * Bin the lights for this frame's camera and upload the clusters
+     * @param view Camera view matrix
+     * @param projection Camera projection (standard or reverse-Z, only its field of view is used)
+     * @param nearPlane Camera near plane
+     * @param farPlane Camera far plane; the last slice extends beyond it
+     * @param viewportWidth Framebuffer width in pixels
+     * @param viewportHeight Framebuffer height in pixels
+     * @param enabled False skips the binning and switches the shaders to unlit
+     */
+    void update(const glm::mat4& view, const glm::mat4& projection, float nearPlane, float farPlane,
+        int viewportWidth, int viewportHeight, bool enabled);
+
+    /**
+     * Print light count, cluster occupancy and binning time of the last frame
+     */
+    void printStats() const;
+
+    void destroy();
+};
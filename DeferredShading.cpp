@@ -0,0 +1,160 @@
+#include "DeferredShading.h"
+#include "GLResources.h"
+#include "GLStateCache.h"
+#include "UniformBuffers.h"
+#include <iostream>
+
+static const char* DEFERRED_SHADING_VERT_PATH = "Shaders/deferred_shading.vert";
+static const char* DEFERRED_SHADING_FRAG_PATH = "Shaders/deferred_shading.frag";
+
+// Texture units of the G-buffer while shading
+static const GLuint ALBEDO_UNIT = 0;
+static const GLuint NORMAL_UNIT = 1;
+static const GLuint DEPTH_UNIT = 2;
+
+DeferredRenderer::DeferredRenderer()
+    : shadingInverseViewProjection(ShaderProgram::INVALID_UNIFORM),
+    shadingClearColor(ShaderProgram::INVALID_UNIFORM),
+    shadingReverseZ(ShaderProgram::INVALID_UNIFORM),
+    framebuffer(0),
+    albedoTarget(0),
+    normalTarget(0),
+    depthTarget(0),
+    emptyVertexArray(0),
+    width(0),
+    height(0),
+    reverseZ(false)
+{
+}
+
+bool DeferredRenderer::create()
+{
+    if (!shadingProgram.loadFromFiles(DEFERRED_SHADING_VERT_PATH, DEFERRED_SHADING_FRAG_PATH))
+        return false;
+
+    bindStandardUniformBlocks(shadingProgram);
+    shadingInverseViewProjection = shadingProgram.getUniform("inverseViewProjection");
+    shadingClearColor = shadingProgram.getUniform("clearColor");
+    shadingReverseZ = shadingProgram.getUniform("reverseZ");
+    shadingProgram.setInt(shadingProgram.getUniform("albedoRoughness"), (int)ALBEDO_UNIT);
+    shadingProgram.setInt(shadingProgram.getUniform("normalMetalness"), (int)NORMAL_UNIT);
+    shadingProgram.setInt(shadingProgram.getUniform("depthBuffer"), (int)DEPTH_UNIT);
+    shadingProgram.setBool(shadingReverseZ, reverseZ);
+
+    emptyVertexArray = GLResources::createVertexArray();
+    return true;
+}
+
+void DeferredRenderer::setReverseZ(bool enabled)
+{
+    reverseZ = enabled;
+    shadingProgram.setBool(shadingReverseZ, reverseZ);
+
+    // The depth format follows the convention
+    destroyTargets();
+}
+
+bool DeferredRenderer::createTargets(int targetWidth, int targetHeight)
+{
+    destroyTargets();
+    width = targetWidth;
+    height = targetHeight;
+
+    // Float depth keeps the precision reverse-Z gives; fixed point is as good for standard depth
+    albedoTarget = GLResources::createTexture(GL_TEXTURE_2D, 1, GL_RGBA8, width, height);
+    normalTarget = GLResources::createTexture(GL_TEXTURE_2D, 1, GL_RGB10_A2, width, height);
+    depthTarget = GLResources::createTexture(GL_TEXTURE_2D, 1,
+        reverseZ ? GL_DEPTH_COMPONENT32F : GL_DEPTH_COMPONENT24, width, height);
+    for (GLuint target : { albedoTarget, normalTarget, depthTarget })
+    {
+        GLResources::setTextureParameter(target, GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        GLResources::setTextureParameter(target, GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    }
+
+    glGenFramebuffers(1, &framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, albedoTarget, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, normalTarget, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTarget, 0);
+    const GLenum drawBuffers[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+    glDrawBuffers(2, drawBuffers);
+
+    bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    if (!complete)
+    {
+        std::cerr << "ERROR: G-buffer framebuffer incomplete" << std::endl;
+        destroyTargets();
+    }
+    return complete;
+}
+
+void DeferredRenderer::destroyTargets()
+{
+    if (framebuffer != 0)
+        glDeleteFramebuffers(1, &framebuffer);
+    GLuint targets[] = { albedoTarget, normalTarget, depthTarget };
+    for (GLuint& target : targets)
+    {
+        if (target != 0)
+            GLStateCache::deleteTextures(1, &target);
+    }
+    framebuffer = albedoTarget = normalTarget = depthTarget = 0;
+    width = height = 0;
+}
+
+bool DeferredRenderer::beginGeometryPass(int framebufferWidth, int framebufferHeight)
+{
+    if (framebufferWidth <= 0 || framebufferHeight <= 0)
+        return false;
+    if ((framebufferWidth != width || framebufferHeight != height) &&
+        !createTargets(framebufferWidth, framebufferHeight))
+        return false;
+
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+
+    // Every covered pixel overwrites both color targets; the rest are never read
+    const GLenum colorTargets[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+    glInvalidateFramebuffer(GL_FRAMEBUFFER, 2, colorTargets);
+    glClear(GL_DEPTH_BUFFER_BIT);
+    return true;
+}
+
+void DeferredRenderer::shade(const glm::mat4& viewProjection, const glm::vec3& clearColor, GLuint outputFramebuffer)
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, outputFramebuffer);
+
+    GLStateCache::bindTexture(ALBEDO_UNIT, GL_TEXTURE_2D, albedoTarget);
+    GLStateCache::bindTexture(NORMAL_UNIT, GL_TEXTURE_2D, normalTarget);
+    GLStateCache::bindTexture(DEPTH_UNIT, GL_TEXTURE_2D, depthTarget);
+
+    shadingProgram.setMat4(shadingInverseViewProjection, glm::inverse(viewProjection));
+    shadingProgram.setVec3(shadingClearColor, clearColor);
+    shadingProgram.bind();
+
+    // Every pixel is written, depth included, whatever the output framebuffer held
+    GLenum callerDepthFunc = GLStateCache::getDepthFunc();
+    GLStateCache::depthFunc(GL_ALWAYS);
+    GLStateCache::bindVertexArray(emptyVertexArray);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    GLStateCache::depthFunc(callerDepthFunc);
+}
+
+void DeferredRenderer::printStats() const
+{
+    // RGBA8 + RGB10_A2 + 32- or 24-bit depth (stored in 4 bytes either way)
+    const size_t bytesPerPixel = 4 + 4 + 4;
+    size_t bytes = (size_t)width * (size_t)height * bytesPerPixel;
+    std::cout << "Deferred shading: G-buffer " << width << " x " << height << ", " << bytesPerPixel
+        << " bytes per pixel (" << (bytes / (1024 * 1024)) << " MB), depth "
+        << (reverseZ ? "32F" : "24") << std::endl;
+}
+
+void DeferredRenderer::destroy()
+{
+    destroyTargets();
+    shadingProgram.destroy();
+    if (emptyVertexArray != 0)
+        GLStateCache::deleteVertexArrays(1, &emptyVertexArray);
+    emptyVertexArray = 0;
+}
@@ -0,0 +1,95 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <glad/gl.h>
+#include "ShaderProgram.h"
+
+/**
+ * @class DeferredRenderer
+ * @brief Deferred shading path: a packed G-buffer, then one clustered lighting pass over the screen
+ *
+ * The geometry pass renders the scene with the regular draw paths into an
+ * offscreen framebuffer; Shaders/sample.frag switches to G-buffer output when
+ * ClusteredLighting::setGBufferOutput() is on. Two color targets and depth,
+ * 12 bytes per pixel:
+ * - GL_RGBA8: albedo, roughness
+ * - GL_RGB10_A2: octahedral normal (2 x 10 bits), metalness, lit flag
+ *   (0 = ambient only, written by impostors)
+ * - depth (32-bit float with reverse-Z, 24-bit otherwise); positions are
+ *   reconstructed from it, so none are stored
+ *
+ * Color targets are invalidated instead of cleared: background pixels are
+ * recognized by their cleared depth. shade() then draws one fullscreen
+ * triangle into the scene's framebuffer that reads each G-buffer texel once,
+ * finds its cluster in the grid of ClusteredLighting and evaluates only that
+ * cluster's lights. Shading cost follows covered pixels times nearby lights,
+ * independent of how many objects were drawn. The pass also writes depth, so
+ * the scene's framebuffer ends up as the forward path leaves it (the GPU
+ * culler's depth pyramid reads it).
+ */
+class DeferredRenderer
+{
+private:
+    ShaderProgram shadingProgram;
+    ShaderProgram::UniformHandle shadingInverseViewProjection;
+    ShaderProgram::UniformHandle shadingClearColor;
+    ShaderProgram::UniformHandle shadingReverseZ;
+
+    GLuint framebuffer;
+    GLuint albedoTarget;        // GL_RGBA8
+    GLuint normalTarget;        // GL_RGB10_A2
+    GLuint depthTarget;
+    GLuint emptyVertexArray;    // The fullscreen triangle is generated from gl_VertexID
+    int width;
+    int height;
+    bool reverseZ;
+
+    /**
+     * (Re)create the targets at the framebuffer size
+     * @return False if the framebuffer is incomplete
+     */
+    bool createTargets(int targetWidth, int targetHeight);
+
+    void destroyTargets();
+
+public:
+    DeferredRenderer();
+
+    DeferredRenderer(const DeferredRenderer&) = delete;
+    DeferredRenderer& operator=(const DeferredRenderer&) = delete;
+
+    /**
+     * Load the shading program
+     * @return False if it failed to load
+     */
+    bool create();
+
+    /**
+     * Match the depth convention of the scene (see Camera::setReverseZ)
+     * The targets are recreated with the matching depth format
+     */
+    void setReverseZ(bool enabled);
+
+    /**
+     * Bind the G-buffer for the scene's draws and clear its depth
+     * @param framebufferWidth Width of the framebuffer the result is shaded into
+     * @param framebufferHeight Its height
+     * @return False if the G-buffer could not be created (the scene's framebuffer stays bound)
+     */
+    bool beginGeometryPass(int framebufferWidth, int framebufferHeight);
+
+    /**
+     * Shade the G-buffer into the scene's framebuffer (color and depth)
+     * Reads the lights and clusters bound by ClusteredLighting::update()
+     * @param viewProjection Camera matrix the G-buffer was rendered with
+     * @param clearColor Color of pixels no geometry covered
+     * @param outputFramebuffer Framebuffer left bound: the default one, or SceneFramebuffer with reverse-Z
+     */
+    void shade(const glm::mat4& viewProjection, const glm::vec3& clearColor, GLuint outputFramebuffer);
+
+    /**
+     * Print the G-buffer size and its memory
+     */
+    void printStats() const;
+
+    void destroy();
+};
@@ -0,0 +1,237 @@
+#include "DynamicBatching.h"
+#include "GLResources.h"
+#include "GLStateCache.h"
+#include "Simd.h"
+#include <chrono>
+#include <iostream>
+
+// Vertex buffer binding of the streamed vertices
+static const GLuint DYNAMIC_VERTEX_BINDING = 0;
+
+// Instances transformed per worker task
+static const size_t TRANSFORM_GRAIN = 64;
+
+DynamicBatcher::DynamicBatcher(ThreadPool* threadPool)
+    : threadPool(threadPool),
+    vertexArray(0),
+    lastBatchedCount(0),
+    lastInstancedCount(0),
+    lastIndividualCount(0),
+    lastDrawCalls(0),
+    lastVertexCount(0),
+    lastTransformMilliseconds(0.0)
+{
+}
+
+void DynamicBatcher::create(size_t verticesPerFrame)
+{
+    vertexStream.create("dynamic batch vertices", verticesPerFrame * sizeof(StaticVertex));
+    indexStream.create("dynamic batch indices", verticesPerFrame * 2 * sizeof(unsigned int));
+
+    vertexArray = GLResources::createVertexArray();
+    StaticBatcher::setVertexAttributes(vertexArray, DYNAMIC_VERTEX_BINDING);
+}
+
+void DynamicBatcher::setSourceMesh(MeshHandle mesh, const std::vector<MeshVertex>& vertices,
+    const std::vector<unsigned int>& indices)
+{
+    if (vertices.size() > SMALL_MESH_VERTEX_LIMIT)
+        return;
+
+    SourceMesh& source = sourceMeshes[mesh];
+    source.vertices = vertices;
+    source.indices = indices;
+}
+
+void DynamicBatcher::beginFrame()
+{
+    vertexStream.beginFrame();
+    indexStream.beginFrame();
+}
+
+void DynamicBatcher::endFrame()
+{
+    vertexStream.endFrame();
+    indexStream.endFrame();
+}
+
+void DynamicBatcher::writeVertices(const SourceMesh& source, const glm::mat4& transform,
+    const PackedTexture& material, StaticVertex* target)
+{
+#if GRAP1_SSE2
+    const __m128 column0 = _mm_loadu_ps(&transform[0][0]);
+    const __m128 column1 = _mm_loadu_ps(&transform[1][0]);
+    const __m128 column2 = _mm_loadu_ps(&transform[2][0]);
+    const __m128 column3 = _mm_loadu_ps(&transform[3][0]);
+#endif
+    // Inverse transpose keeps normals perpendicular under non-uniform scale
+    const glm::mat3 normalTransform = glm::transpose(glm::inverse(glm::mat3(transform)));
+
+    // Fields are written in order, the mapping is write-combined
+    for (size_t i = 0; i < source.vertices.size(); i++)
+    {
+        const MeshVertex& vertex = source.vertices[i];
+        StaticVertex& output = target[i];
+#if GRAP1_SSE2
+        __m128 position = _mm_add_ps(
+            _mm_add_ps(_mm_mul_ps(column0, _mm_set1_ps(vertex.position.x)),
+                _mm_mul_ps(column1, _mm_set1_ps(vertex.position.y))),
+            _mm_add_ps(_mm_mul_ps(column2, _mm_set1_ps(vertex.position.z)), column3));
+        // The fourth lane lands on texCoord.x, which is written next
+        _mm_storeu_ps(&output.position.x, position);
+#else
+        output.position = glm::vec3(transform * glm::vec4(vertex.position, 1.0f));
+#endif
+        output.texCoord = vertex.texCoord;
+        output.uvRect = material.uvRect;
+        output.layer = material.layer;
+        output.normal = StaticBatcher::encodeNormal(glm::normalize(normalTransform * vertex.normal));
+    }
+}
+
+void DynamicBatcher::draw(const std::vector<Model3D>& models, const MeshRegistry& meshes,
+    const TexturePacker& textures, std::vector<Model3D>& outInstanced, std::vector<Model3D>& outIndividual)
+{
+    outInstanced.clear();
+    outIndividual.clear();
+    for (Group& group : groups)
+        group.members.clear();
+    lastBatchedCount = lastDrawCalls = lastVertexCount = 0;
+
+    visibleCounts.clear();
+    for (const Model3D& model : models)
+    {
+        if (sourceMeshes.find(model.getMesh()) != sourceMeshes.end())
+            visibleCounts[model.getMesh()]++;
+    }
+
+    // Split the models; merged ones get their place in this frame's vertex allocation
+    unsigned int vertexCount = 0;
+    for (size_t i = 0; i < models.size(); i++)
+    {
+        const Model3D& model = models[i];
+        auto source = sourceMeshes.find(model.getMesh());
+        if (!meshes.isValid(model.getMesh()) || source == sourceMeshes.end())
+        {
+            outIndividual.push_back(model);
+            continue;
+        }
+        if (visibleCounts[model.getMesh()] >= INSTANCING_MIN_REPEATS)
+        {
+            outInstanced.push_back(model);
+            continue;
+        }
+
+        GLuint arrayTexture = 0;
+        if (model.getMaterial() < (int)textures.getPackedCount())
+            arrayTexture = textures.getPacked(model.getMaterial()).arrayTexture;
+
+        // Few texture arrays exist, a linear search is enough
+        Group* group = nullptr;
+        for (Group& existing : groups)
+        {
+            if (existing.arrayTexture == arrayTexture)
+            {
+                group = &existing;
+                break;
+            }
+        }
+        if (!group)
+        {
+            groups.push_back({ arrayTexture, {}, 0, 0 });
+            group = &groups.back();
+        }
+
+        group->members.push_back({ (unsigned int)i, vertexCount, 0 });
+        vertexCount += (unsigned int)source->second.vertices.size();
+    }
+    lastInstancedCount = outInstanced.size();
+    lastIndividualCount = outIndividual.size();
+    if (vertexCount == 0)
+        return;
+
+    // Each group's indices are contiguous so it draws with a single call
+    unsigned int indexCount = 0;
+    flatMembers.clear();
+    for (Group& group : groups)
+    {
+        group.firstIndex = indexCount;
+        for (Member& member : group.members)
+        {
+            member.firstIndex = indexCount;
+            indexCount += (unsigned int)sourceMeshes.at(models[member.model].getMesh()).indices.size();
+            flatMembers.push_back(&member);
+        }
+        group.indexCount = indexCount - group.firstIndex;
+    }
+
+    // One allocation per stream: growing would unmap anything allocated earlier this frame
+    size_t vertexOffset = 0;
+    size_t indexOffset = 0;
+    StaticVertex* vertices = (StaticVertex*)vertexStream.allocate(vertexCount * sizeof(StaticVertex),
+        sizeof(StaticVertex), vertexOffset);
+    unsigned int* indices = (unsigned int*)indexStream.allocate(indexCount * sizeof(unsigned int),
+        sizeof(unsigned int), indexOffset);
+
+    auto start = std::chrono::high_resolution_clock::now();
+    auto transform = [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++)
+        {
+            const Member& member = *flatMembers[i];
+            const Model3D& model = models[member.model];
+            const SourceMesh& source = sourceMeshes.at(model.getMesh());
+
+            PackedTexture material;
+            if (model.getMaterial() < (int)textures.getPackedCount())
+                material = textures.getPacked(model.getMaterial());
+
+            writeVertices(source, model.getTransformMatrix(), material, vertices + member.firstVertex);
+            for (size_t j = 0; j < source.indices.size(); j++)
+                indices[member.firstIndex + j] = member.firstVertex + source.indices[j];
+        }
+    };
+    if (threadPool)
+        threadPool->parallelFor(flatMembers.size(), TRANSFORM_GRAIN, transform);
+    else
+        transform(0, flatMembers.size());
+    auto end = std::chrono::high_resolution_clock::now();
+    lastTransformMilliseconds = std::chrono::duration<double, std::milli>(end - start).count();
+
+    // The stream may have been replaced by a larger one, so the bindings are set every frame
+    GLResources::setVertexBuffer(vertexArray, DYNAMIC_VERTEX_BINDING, vertexStream.getBuffer(),
+        (GLintptr)vertexOffset, sizeof(StaticVertex));
+    GLResources::setElementBuffer(vertexArray, indexStream.getBuffer());
+    GLStateCache::bindVertexArray(vertexArray);
+    for (const Group& group : groups)
+    {
+        if (group.members.empty())
+            continue;
+
+        GLStateCache::bindTexture(0, GL_TEXTURE_2D_ARRAY, group.arrayTexture);
+        glDrawElements(GL_TRIANGLES, (GLsizei)group.indexCount, GL_UNSIGNED_INT,
+            (const void*)(indexOffset + group.firstIndex * sizeof(unsigned int)));
+        lastDrawCalls++;
+    }
+    lastBatchedCount = flatMembers.size();
+    lastVertexCount = vertexCount;
+}
+
+void DynamicBatcher::printStats() const
+{
+    std::cout << "Dynamic batching: " << lastBatchedCount << " models merged into " << lastDrawCalls
+        << " draws (" << lastVertexCount << " vertices, " << lastTransformMilliseconds << " ms), "
+        << lastInstancedCount << " instanced, " << lastIndividualCount << " individual" << std::endl;
+    vertexStream.printStats();
+    indexStream.printStats();
+}
+
+void DynamicBatcher::destroy()
+{
+    vertexStream.destroy();
+    indexStream.destroy();
+    if (vertexArray != 0)
+        GLStateCache::deleteVertexArrays(1, &vertexArray);
+    vertexArray = 0;
+    sourceMeshes.clear();
+    groups.clear();
+}
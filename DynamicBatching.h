@@ -0,0 +1,130 @@
+#pragma once
+#include <unordered_map>
+#include <vector>
+#include <glm/glm.hpp>
+#include <glad/gl.h>
+#include "MeshRegistry.h"
+#include "Model3D.h"
+#include "StaticBatching.h"
+#include "StreamBuffer.h"
+#include "TexturePacker.h"
+#include "ThreadPool.h"
+
+/**
+ * @class DynamicBatcher
+ * @brief Merges visible instances of small meshes into one streamed draw per texture array
+ *
+ * Props with a few dozen triangles cost as much CPU per draw call as a full
+ * character. Every frame, draw() sorts the visible models into three kinds:
+ * - meshes above SMALL_MESH_VERTEX_LIMIT vertices, or without CPU-side
+ *   geometry, are left to the individual draw path
+ * - small meshes seen at least INSTANCING_MIN_REPEATS times are left to the
+ *   instanced path, which draws them without copying any vertices
+ * - the remaining small instances are transformed to world space on the
+ *   thread pool (SSE where available) straight into a persistently mapped
+ *   StreamBuffer, with their material written per vertex (StaticVertex)
+ *
+ * The merged vertices are then drawn with one glDrawElements per texture
+ * array through the static batch program (Shaders/static.vert).
+ */
+class DynamicBatcher
+{
+public:
+    // Meshes with more vertices are cheaper to draw on their own than to copy each frame
+    static const size_t SMALL_MESH_VERTEX_LIMIT = 512;
+
+    // Visible instances of one mesh from which instancing beats copying
+    static const size_t INSTANCING_MIN_REPEATS = 16;
+
+private:
+    struct SourceMesh
+    {
+        std::vector<MeshVertex> vertices;
+        std::vector<unsigned int> indices;
+    };
+
+    struct Member
+    {
+        unsigned int model;         // Index into the models given to draw()
+        unsigned int firstVertex;   // In this frame's vertex allocation
+        unsigned int firstIndex;    // In this frame's index allocation
+    };
+
+    struct Group
+    {
+        GLuint arrayTexture;
+        std::vector<Member> members;
+        unsigned int firstIndex;
+        unsigned int indexCount;
+    };
+
+    ThreadPool* threadPool;
+    std::unordered_map<MeshHandle, SourceMesh> sourceMeshes;
+    std::unordered_map<MeshHandle, size_t> visibleCounts;     // Reset every frame
+    std::vector<Group> groups;
+    std::vector<const Member*> flatMembers;
+
+    StreamBuffer vertexStream;
+    StreamBuffer indexStream;
+    GLuint vertexArray;
+
+    size_t lastBatchedCount;
+    size_t lastInstancedCount;
+    size_t lastIndividualCount;
+    size_t lastDrawCalls;
+    size_t lastVertexCount;
+    double lastTransformMilliseconds;
+
+    /**
+     * Transform one instance's vertices into the mapped vertex stream
+     */
+    static void writeVertices(const SourceMesh& source, const glm::mat4& transform, const PackedTexture& material,
+        StaticVertex* target);
+
+public:
+    /**
+     * @param threadPool Pool for the vertex transforms (nullptr = calling thread only)
+     */
+    explicit DynamicBatcher(ThreadPool* threadPool = nullptr);
+
+    DynamicBatcher(const DynamicBatcher&) = delete;
+    DynamicBatcher& operator=(const DynamicBatcher&) = delete;
+
+    /**
+     * Create the vertex and index streams and the vertex array reading them
+     * @param verticesPerFrame Initial capacity of one frame (grows when exceeded)
+     */
+    void create(size_t verticesPerFrame);
+
+    /**
+     * Register the CPU-side geometry of a mesh so its instances can be merged
+     * Meshes above SMALL_MESH_VERTEX_LIMIT vertices are ignored
+     * @param mesh Registry handle the instances use
+     * @param vertices Object-space vertices
+     * @param indices Triangle list
+     */
+    void setSourceMesh(MeshHandle mesh, const std::vector<MeshVertex>& vertices,
+        const std::vector<unsigned int>& indices);
+
+    void beginFrame();
+    void endFrame();
+
+    /**
+     * Merge and draw the small-mesh models, handing the others back
+     * A program reading StaticVertex attributes (Shaders/static.vert) must be bound
+     * @param models Visible models
+     * @param meshes Registry the models' meshes live in
+     * @param textures Packed materials
+     * @param outInstanced Receives models whose mesh repeats enough to instance
+     * @param outIndividual Receives models too large (or unknown) to merge
+     */
+    void draw(const std::vector<Model3D>& models, const MeshRegistry& meshes, const TexturePacker& textures,
+        std::vector<Model3D>& outInstanced, std::vector<Model3D>& outIndividual);
+
+    /**
+     * Print how the last frame's models were split and the merged draws it took
+     */
+    void printStats() const;
+
+    void destroy();
+};
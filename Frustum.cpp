@@ -0,0 +1,57 @@
+#include "Frustum.h"
+
+Frustum Frustum::fromMatrix(const glm::mat4& viewProjection, bool reverseZ)
+{
+    // Rows of the matrix (GLM is column-major)
+    glm::vec4 rows[4];
+    for (int i = 0; i < 4; i++)
+        rows[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+
+    Frustum frustum;
+    frustum.planes[0] = rows[3] + rows[0];  // Left
+    frustum.planes[1] = rows[3] - rows[0];  // Right
+    frustum.planes[2] = rows[3] + rows[1];  // Bottom
+    frustum.planes[3] = rows[3] - rows[1];  // Top
+    if (reverseZ)
+    {
+        frustum.planes[4] = rows[3] - rows[2];  // Near: z <= w
+        frustum.planes[5] = rows[2];            // Far: z >= 0
+    }
+    else
+    {
+        frustum.planes[4] = rows[3] + rows[2];  // Near
+        frustum.planes[5] = rows[3] - rows[2];  // Far
+    }
+
+    for (glm::vec4& plane : frustum.planes)
+    {
+        // An infinite far plane has no normal and excludes nothing
+        float length = glm::length(glm::vec3(plane));
+        plane = length > 1e-6f ? plane / length : glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+    }
+    return frustum;
+}
+
+bool Frustum::intersectsSphere(const glm::vec3& center, float radius) const
+{
+    for (const glm::vec4& plane : planes)
+    {
+        if (glm::dot(glm::vec3(plane), center) + plane.w < -radius)
+            return false;
+    }
+    return true;
+}
+
+bool Frustum::intersectsBox(const glm::vec3& boxMin, const glm::vec3& boxMax) const
+{
+    for (const glm::vec4& plane : planes)
+    {
+        // Corner furthest along the plane normal
+        glm::vec3 positive(plane.x >= 0.0f ? boxMax.x : boxMin.x,
+            plane.y >= 0.0f ? boxMax.y : boxMin.y,
+            plane.z >= 0.0f ? boxMax.z : boxMin.z);
+        if (glm::dot(glm::vec3(plane), positive) + plane.w < 0.0f)
+            return false;
+    }
+    return true;
+}
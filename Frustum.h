@@ -0,0 +1,34 @@
+#pragma once
+#include <glm/glm.hpp>
+
+/**
+ * @struct Frustum
+ * @brief Six inward-facing planes of a view frustum
+ *
+ * Each plane is stored as (normal.xyz, distance) with a unit normal, so
+ * dot(normal, point) + distance is the signed distance of a point.
+ * Plane order: left, right, bottom, top, near, far. An infinite far plane
+ * is stored as (0, 0, 0, 1), which every point passes.
+ */
+struct Frustum
+{
+    glm::vec4 planes[6];
+
+    /**
+     * Extract the planes from a projection * view matrix (Gribb/Hartmann)
+     * @param viewProjection Camera projection * view matrix
+     * @param reverseZ Clip depth is in [0, w] with w at the near plane (reverse-Z with
+     *                 glClipControl) instead of OpenGL's [-w, w]
+     */
+    static Frustum fromMatrix(const glm::mat4& viewProjection, bool reverseZ = false);
+
+    /**
+     * True if the sphere is at least partly inside
+     */
+    bool intersectsSphere(const glm::vec3& center, float radius) const;
+
+    /**
+     * True if the axis-aligned box is at least partly inside (conservative)
+     */
+    bool intersectsBox(const glm::vec3& boxMin, const glm::vec3& boxMax) const;
+};
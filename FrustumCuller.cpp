@@ -0,0 +1,209 @@
+#include "FrustumCuller.h"
+#include "Simd.h"
+#include <limits>
+
+void FrustumCuller::clear()
+{
+    for (std::vector<float>* array : { &centerX, &centerY, &centerZ, &radius,
+        &minX, &minY, &minZ, &maxX, &maxY, &maxZ })
+        array->clear();
+}
+
+void FrustumCuller::reserve(size_t count)
+{
+    for (std::vector<float>* array : { &centerX, &centerY, &centerZ, &radius,
+        &minX, &minY, &minZ, &maxX, &maxY, &maxZ })
+        array->reserve(count);
+}
+
+void FrustumCuller::add(const glm::vec4& sphere, const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+{
+    centerX.push_back(sphere.x);
+    centerY.push_back(sphere.y);
+    centerZ.push_back(sphere.z);
+    radius.push_back(sphere.w);
+    minX.push_back(boundsMin.x);
+    minY.push_back(boundsMin.y);
+    minZ.push_back(boundsMin.z);
+    maxX.push_back(boundsMax.x);
+    maxY.push_back(boundsMax.y);
+    maxZ.push_back(boundsMax.z);
+}
+
+void FrustumCuller::update(const std::vector<Model3D>& models, const MeshRegistry& meshes)
+{
+    if (models.size() < getCount())
+        clear();
+
+    reserve(models.size());
+    for (size_t i = getCount(); i < models.size(); i++)
+    {
+        if (!meshes.isValid(models[i].getMesh()))
+        {
+            // A radius of -infinity fails every plane
+            add(glm::vec4(0.0f, 0.0f, 0.0f, -std::numeric_limits<float>::infinity()), glm::vec3(0.0f), glm::vec3(0.0f));
+            continue;
+        }
+
+        const MeshInfo& mesh = meshes.getMesh(models[i].getMesh());
+        glm::mat4 transform = models[i].getTransformMatrix();
+        glm::vec3 boundsMin, boundsMax;
+        transformBoundingBox(mesh, transform, boundsMin, boundsMax);
+        add(transformBoundingSphere(mesh, transform), boundsMin, boundsMax);
+    }
+}
+
+void FrustumCuller::rebuild(const std::vector<Model3D>& models, const MeshRegistry& meshes)
+{
+    clear();
+    update(models, meshes);
+}
+
+size_t FrustumCuller::cullScalar(const Frustum& frustum, std::vector<unsigned int>& outVisible) const
+{
+    size_t count = getCount();
+    outVisible.resize(count);
+
+    size_t visible = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        if (frustum.intersectsSphere(glm::vec3(centerX[i], centerY[i], centerZ[i]), radius[i]) &&
+            frustum.intersectsBox(glm::vec3(minX[i], minY[i], minZ[i]), glm::vec3(maxX[i], maxY[i], maxZ[i])))
+            outVisible[visible++] = (unsigned int)i;
+    }
+
+    outVisible.resize(visible);
+    return visible;
+}
+
+size_t FrustumCuller::cull(const Frustum& frustum, std::vector<unsigned int>& outVisible) const
+{
+    size_t count = getCount();
+    outVisible.resize(count);
+    unsigned int* out = outVisible.data();
+    size_t visible = 0;
+    size_t i = 0;
+
+    // Per plane, the box corner furthest along the normal comes from the min or the max arrays
+    const float* cornerX[6];
+    const float* cornerY[6];
+    const float* cornerZ[6];
+    for (int p = 0; p < 6; p++)
+    {
+        cornerX[p] = frustum.planes[p].x >= 0.0f ? maxX.data() : minX.data();
+        cornerY[p] = frustum.planes[p].y >= 0.0f ? maxY.data() : minY.data();
+        cornerZ[p] = frustum.planes[p].z >= 0.0f ? maxZ.data() : minZ.data();
+    }
+
+#if GRAP1_AVX2
+    __m256 planeX[6], planeY[6], planeZ[6], planeW[6];
+    for (int p = 0; p < 6; p++)
+    {
+        planeX[p] = _mm256_set1_ps(frustum.planes[p].x);
+        planeY[p] = _mm256_set1_ps(frustum.planes[p].y);
+        planeZ[p] = _mm256_set1_ps(frustum.planes[p].z);
+        planeW[p] = _mm256_set1_ps(frustum.planes[p].w);
+    }
+
+    const __m256 zero = _mm256_setzero_ps();
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256 x = _mm256_loadu_ps(centerX.data() + i);
+        __m256 y = _mm256_loadu_ps(centerY.data() + i);
+        __m256 z = _mm256_loadu_ps(centerZ.data() + i);
+        __m256 negativeRadius = _mm256_sub_ps(zero, _mm256_loadu_ps(radius.data() + i));
+
+        __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        for (int p = 0; p < 6; p++)
+        {
+            // Sphere: signed distance of the center >= -radius
+            __m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(planeX[p], x),
+                _mm256_mul_ps(planeY[p], y)), _mm256_mul_ps(planeZ[p], z)), planeW[p]);
+            inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, negativeRadius, _CMP_GE_OQ));
+
+            // Box: the furthest corner is on the inner side
+            __m256 corner = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(
+                _mm256_mul_ps(planeX[p], _mm256_loadu_ps(cornerX[p] + i)),
+                _mm256_mul_ps(planeY[p], _mm256_loadu_ps(cornerY[p] + i))),
+                _mm256_mul_ps(planeZ[p], _mm256_loadu_ps(cornerZ[p] + i))), planeW[p]);
+            inside = _mm256_and_ps(inside, _mm256_cmp_ps(corner, zero, _CMP_GE_OQ));
+        }
+
+        // Branchless compaction: always write, only advance for visible lanes
+        int mask = _mm256_movemask_ps(inside);
+        for (int lane = 0; lane < 8; lane++)
+        {
+            out[visible] = (unsigned int)(i + lane);
+            visible += (mask >> lane) & 1;
+        }
+    }
+#elif GRAP1_SSE2
+    __m128 planeX[6], planeY[6], planeZ[6], planeW[6];
+    for (int p = 0; p < 6; p++)
+    {
+        planeX[p] = _mm_set1_ps(frustum.planes[p].x);
+        planeY[p] = _mm_set1_ps(frustum.planes[p].y);
+        planeZ[p] = _mm_set1_ps(frustum.planes[p].z);
+        planeW[p] = _mm_set1_ps(frustum.planes[p].w);
+    }
+
+    const __m128 zero = _mm_setzero_ps();
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128 x = _mm_loadu_ps(centerX.data() + i);
+        __m128 y = _mm_loadu_ps(centerY.data() + i);
+        __m128 z = _mm_loadu_ps(centerZ.data() + i);
+        __m128 negativeRadius = _mm_sub_ps(zero, _mm_loadu_ps(radius.data() + i));
+
+        __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for (int p = 0; p < 6; p++)
+        {
+            __m128 distance = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(planeX[p], x),
+                _mm_mul_ps(planeY[p], y)), _mm_mul_ps(planeZ[p], z)), planeW[p]);
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, negativeRadius));
+
+            __m128 corner = _mm_add_ps(_mm_add_ps(_mm_add_ps(
+                _mm_mul_ps(planeX[p], _mm_loadu_ps(cornerX[p] + i)),
+                _mm_mul_ps(planeY[p], _mm_loadu_ps(cornerY[p] + i))),
+                _mm_mul_ps(planeZ[p], _mm_loadu_ps(cornerZ[p] + i))), planeW[p]);
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(corner, zero));
+        }
+
+        int mask = _mm_movemask_ps(inside);
+        for (int lane = 0; lane < 4; lane++)
+        {
+            out[visible] = (unsigned int)(i + lane);
+            visible += (mask >> lane) & 1;
+        }
+    }
+#endif
+
+    // Remaining instances one at a time
+    for (; i < count; i++)
+    {
+        bool inside = true;
+        for (int p = 0; p < 6 && inside; p++)
+        {
+            const glm::vec4& plane = frustum.planes[p];
+            float distance = plane.x * centerX[i] + plane.y * centerY[i] + plane.z * centerZ[i] + plane.w;
+            float corner = plane.x * cornerX[p][i] + plane.y * cornerY[p][i] + plane.z * cornerZ[p][i] + plane.w;
+            inside = distance >= -radius[i] && corner >= 0.0f;
+        }
+        out[visible] = (unsigned int)i;
+        visible += inside ? 1 : 0;
+    }
+
+    outVisible.resize(visible);
+    return visible;
+}
+
+const char* FrustumCuller::getSimdPathName()
+{
+#if GRAP1_AVX2
+    return "AVX2";
+#elif GRAP1_SSE2
+    return "SSE";
+#else
+    return "scalar";
+#endif
+}
@@ -0,0 +1,225 @@
+#include "GLResources.h"
+#include "GLStateCache.h"
+#include <algorithm>
+
+bool GLResources::s_directStateAccess = false;
+
+void GLResources::initialize()
+{
+    s_directStateAccess = GLAD_GL_VERSION_4_5 != 0;
+}
+
+// ===== Buffers =====
+
+GLuint GLResources::createBuffer(GLsizeiptr size, const void* data, GLbitfield flags)
+{
+    GLuint buffer = 0;
+    if (s_directStateAccess)
+    {
+        glCreateBuffers(1, &buffer);
+        glNamedBufferStorage(buffer, size, data, flags);
+        return buffer;
+    }
+
+    glGenBuffers(1, &buffer);
+    GLStateCache::bindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+    glBufferStorage(GL_COPY_WRITE_BUFFER, size, data, flags);
+    return buffer;
+}
+
+void GLResources::updateBuffer(GLuint buffer, GLintptr offset, GLsizeiptr size, const void* data)
+{
+    if (s_directStateAccess)
+    {
+        glNamedBufferSubData(buffer, offset, size, data);
+        return;
+    }
+
+    GLStateCache::bindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, offset, size, data);
+}
+
+void GLResources::copyBuffer(GLuint source, GLuint target, GLintptr sourceOffset, GLintptr targetOffset,
+    GLsizeiptr size)
+{
+    if (s_directStateAccess)
+    {
+        glCopyNamedBufferSubData(source, target, sourceOffset, targetOffset, size);
+        return;
+    }
+
+    GLStateCache::bindBuffer(GL_COPY_READ_BUFFER, source);
+    GLStateCache::bindBuffer(GL_COPY_WRITE_BUFFER, target);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, sourceOffset, targetOffset, size);
+}
+
+void* GLResources::mapBuffer(GLuint buffer, GLintptr offset, GLsizeiptr length, GLbitfield access)
+{
+    if (s_directStateAccess)
+        return glMapNamedBufferRange(buffer, offset, length, access);
+
+    GLStateCache::bindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+    return glMapBufferRange(GL_COPY_WRITE_BUFFER, offset, length, access);
+}
+
+GLboolean GLResources::unmapBuffer(GLuint buffer)
+{
+    if (s_directStateAccess)
+        return glUnmapNamedBuffer(buffer);
+
+    GLStateCache::bindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+    return glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+}
+
+// ===== Vertex arrays =====
+
+GLuint GLResources::createVertexArray()
+{
+    GLuint vertexArray = 0;
+    if (s_directStateAccess)
+        glCreateVertexArrays(1, &vertexArray);
+    else
+        glGenVertexArrays(1, &vertexArray);
+    return vertexArray;
+}
+
+void GLResources::setAttribute(GLuint vertexArray, GLuint location, GLint size, GLenum type, GLuint relativeOffset,
+    GLuint binding)
+{
+    if (s_directStateAccess)
+    {
+        glVertexArrayAttribFormat(vertexArray, location, size, type, GL_FALSE, relativeOffset);
+        glVertexArrayAttribBinding(vertexArray, location, binding);
+        glEnableVertexArrayAttrib(vertexArray, location);
+        return;
+    }
+
+    GLStateCache::bindVertexArray(vertexArray);
+    glVertexAttribFormat(location, size, type, GL_FALSE, relativeOffset);
+    glVertexAttribBinding(location, binding);
+    glEnableVertexAttribArray(location);
+}
+
+void GLResources::setIntegerAttribute(GLuint vertexArray, GLuint location, GLint size, GLenum type,
+    GLuint relativeOffset, GLuint binding)
+{
+    if (s_directStateAccess)
+    {
+        glVertexArrayAttribIFormat(vertexArray, location, size, type, relativeOffset);
+        glVertexArrayAttribBinding(vertexArray, location, binding);
+        glEnableVertexArrayAttrib(vertexArray, location);
+        return;
+    }
+
+    GLStateCache::bindVertexArray(vertexArray);
+    glVertexAttribIFormat(location, size, type, relativeOffset);
+    glVertexAttribBinding(location, binding);
+    glEnableVertexAttribArray(location);
+}
+
+void GLResources::setVertexBuffer(GLuint vertexArray, GLuint binding, GLuint buffer, GLintptr offset, GLsizei stride)
+{
+    if (s_directStateAccess)
+    {
+        glVertexArrayVertexBuffer(vertexArray, binding, buffer, offset, stride);
+        return;
+    }
+
+    GLStateCache::bindVertexArray(vertexArray);
+    glBindVertexBuffer(binding, buffer, offset, stride);
+}
+
+void GLResources::setBindingDivisor(GLuint vertexArray, GLuint binding, GLuint divisor)
+{
+    if (s_directStateAccess)
+    {
+        glVertexArrayBindingDivisor(vertexArray, binding, divisor);
+        return;
+    }
+
+    GLStateCache::bindVertexArray(vertexArray);
+    glVertexBindingDivisor(binding, divisor);
+}
+
+void GLResources::setElementBuffer(GLuint vertexArray, GLuint buffer)
+{
+    // The cache shadows the bound VAO's element buffer, so that one is changed through it
+    if (s_directStateAccess && vertexArray != GLStateCache::getVertexArray())
+    {
+        glVertexArrayElementBuffer(vertexArray, buffer);
+        return;
+    }
+
+    GLStateCache::bindVertexArray(vertexArray);
+    GLStateCache::bindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffer);
+}
+
+// ===== Textures =====
+
+GLuint GLResources::createTexture(GLenum target, GLsizei levels, GLenum internalFormat, GLsizei width,
+    GLsizei height, GLsizei layers)
+{
+    GLuint texture = 0;
+    if (s_directStateAccess)
+    {
+        glCreateTextures(target, 1, &texture);
+        if (target == GL_TEXTURE_2D_ARRAY)
+            glTextureStorage3D(texture, levels, internalFormat, width, height, layers);
+        else
+            glTextureStorage2D(texture, levels, internalFormat, width, height);
+        return texture;
+    }
+
+    glGenTextures(1, &texture);
+    GLStateCache::bindTexture(EDIT_TEXTURE_UNIT, target, texture);
+    if (target == GL_TEXTURE_2D_ARRAY)
+        glTexStorage3D(target, levels, internalFormat, width, height, layers);
+    else
+        glTexStorage2D(target, levels, internalFormat, width, height);
+    return texture;
+}
+
+void GLResources::uploadTextureLayers(GLuint texture, GLint level, GLint firstLayer, GLsizei width, GLsizei height,
+    GLsizei layerCount, GLenum format, GLenum type, const void* pixels)
+{
+    if (s_directStateAccess)
+    {
+        glTextureSubImage3D(texture, level, 0, 0, firstLayer, width, height, layerCount, format, type, pixels);
+        return;
+    }
+
+    GLStateCache::bindTexture(EDIT_TEXTURE_UNIT, GL_TEXTURE_2D_ARRAY, texture);
+    glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, firstLayer, width, height, layerCount, format, type, pixels);
+}
+
+void GLResources::setTextureParameter(GLuint texture, GLenum target, GLenum name, GLint value)
+{
+    if (s_directStateAccess)
+    {
+        glTextureParameteri(texture, name, value);
+        return;
+    }
+
+    GLStateCache::bindTexture(EDIT_TEXTURE_UNIT, target, texture);
+    glTexParameteri(target, name, value);
+}
+
+void GLResources::generateMipmap(GLuint texture, GLenum target)
+{
+    if (s_directStateAccess)
+    {
+        glGenerateTextureMipmap(texture);
+        return;
+    }
+
+    GLStateCache::bindTexture(EDIT_TEXTURE_UNIT, target, texture);
+    glGenerateMipmap(target);
+}
+
+GLsizei GLResources::getMipLevelCount(GLsizei width, GLsizei height)
+{
+    GLsizei levels = 1;
+    for (GLsizei size = std::max(width, height); size > 1; size /= 2)
+        levels++;
+    return levels;
+}
@@ -0,0 +1,110 @@
+#pragma once
+#include <glad/gl.h>
+
+/**
+ * @class GLResources
+ * @brief Creates and edits buffers, vertex arrays and textures without binding them
+ *
+ * With OpenGL 4.5 every call maps to direct state access (glCreateBuffers,
+ * glNamedBufferStorage, glVertexArrayAttribFormat, glTextureStorage3D, ...),
+ * so creating or filling a resource never touches the bindings draws rely on.
+ * On 4.4 contexts the same calls bind through GLStateCache to
+ * GL_COPY_WRITE_BUFFER, the edited VAO or EDIT_TEXTURE_UNIT, so the cache stays
+ * truthful either way.
+ *
+ * Storage is always immutable (glBufferStorage / glTexStorage*): its size and
+ * format are fixed at creation, which lets the driver place it once. Buffers
+ * without GL_DYNAMIC_STORAGE_BIT or mapping flags can only be written by the
+ * GPU, e.g. through copyBuffer() from a staging buffer, and are the best
+ * candidates for video memory.
+ */
+class GLResources
+{
+public:
+    // Texture unit used to edit textures without direct state access
+    static const GLuint EDIT_TEXTURE_UNIT = 31;
+
+private:
+    static bool s_directStateAccess;
+
+public:
+    /**
+     * Pick the code path for the current context (call once after loading OpenGL)
+     */
+    static void initialize();
+
+    static bool hasDirectStateAccess() { return s_directStateAccess; }
+
+    // ===== Buffers =====
+    /**
+     * Create a buffer with immutable storage
+     * @param size Size in bytes
+     * @param data Initial contents, or nullptr
+     * @param flags glBufferStorage flags (0 = written by the GPU only)
+     */
+    static GLuint createBuffer(GLsizeiptr size, const void* data, GLbitfield flags);
+
+    /**
+     * Write part of a buffer created with GL_DYNAMIC_STORAGE_BIT
+     */
+    static void updateBuffer(GLuint buffer, GLintptr offset, GLsizeiptr size, const void* data);
+
+    /**
+     * GPU-side copy between two buffers
+     */
+    static void copyBuffer(GLuint source, GLuint target, GLintptr sourceOffset, GLintptr targetOffset, GLsizeiptr size);
+
+    /**
+     * Map a range of a buffer created with matching mapping flags
+     */
+    static void* mapBuffer(GLuint buffer, GLintptr offset, GLsizeiptr length, GLbitfield access);
+
+    /**
+     * Release the mapping of a buffer, false when its contents were corrupted while mapped
+     */
+    static GLboolean unmapBuffer(GLuint buffer);
+
+    // ===== Vertex arrays =====
+    static GLuint createVertexArray();
+
+    /**
+     * Define and enable a float attribute read from a vertex buffer binding
+     */
+    static void setAttribute(GLuint vertexArray, GLuint location, GLint size, GLenum type, GLuint relativeOffset,
+        GLuint binding);
+
+    /**
+     * Define and enable an integer attribute read from a vertex buffer binding
+     */
+    static void setIntegerAttribute(GLuint vertexArray, GLuint location, GLint size, GLenum type,
+        GLuint relativeOffset, GLuint binding);
+
+    static void setVertexBuffer(GLuint vertexArray, GLuint binding, GLuint buffer, GLintptr offset, GLsizei stride);
+    static void setBindingDivisor(GLuint vertexArray, GLuint binding, GLuint divisor);
+    static void setElementBuffer(GLuint vertexArray, GLuint buffer);
+
+    // ===== Textures =====
+    /**
+     * Create a 2D or 2D array texture with immutable storage
+     * @param target GL_TEXTURE_2D or GL_TEXTURE_2D_ARRAY
+     * @param levels Mip level count
+     * @param internalFormat Sized format, e.g. GL_RGBA8
+     * @param layers Array layers (ignored for GL_TEXTURE_2D)
+     */
+    static GLuint createTexture(GLenum target, GLsizei levels, GLenum internalFormat, GLsizei width, GLsizei height,
+        GLsizei layers = 1);
+
+    /**
+     * Upload a region of one level of an array texture
+     */
+    static void uploadTextureLayers(GLuint texture, GLint level, GLint firstLayer, GLsizei width, GLsizei height,
+        GLsizei layerCount, GLenum format, GLenum type, const void* pixels);
+
+    static void setTextureParameter(GLuint texture, GLenum target, GLenum name, GLint value);
+    static void generateMipmap(GLuint texture, GLenum target);
+
+    /**
+     * Number of mip levels of a full chain down to 1x1
+     */
+    static GLsizei getMipLevelCount(GLsizei width, GLsizei height);
+};
@@ -0,0 +1,410 @@
+#include "GLStateCache.h"
+#include <iomanip>
+#include <iostream>
+
+// Marks shadowed state as unknown so the next call is always issued
+static const GLuint UNKNOWN = 0xFFFFFFFFu;
+
+static const GLenum BUFFER_TARGETS[] = {
+    GL_ARRAY_BUFFER, GL_ELEMENT_ARRAY_BUFFER, GL_UNIFORM_BUFFER, GL_SHADER_STORAGE_BUFFER,
+    GL_DRAW_INDIRECT_BUFFER, GL_DISPATCH_INDIRECT_BUFFER, GL_PARAMETER_BUFFER, GL_COPY_READ_BUFFER,
+    GL_COPY_WRITE_BUFFER, GL_PIXEL_PACK_BUFFER, GL_PIXEL_UNPACK_BUFFER, GL_QUERY_BUFFER, GL_TEXTURE_BUFFER
+};
+
+static const GLenum TEXTURE_TARGETS[] = {
+    GL_TEXTURE_2D, GL_TEXTURE_2D_ARRAY, GL_TEXTURE_CUBE_MAP, GL_TEXTURE_3D, GL_TEXTURE_2D_MULTISAMPLE
+};
+
+static const GLenum CAPABILITIES[] = {
+    GL_DEPTH_TEST, GL_BLEND, GL_CULL_FACE, GL_SCISSOR_TEST, GL_STENCIL_TEST, GL_RASTERIZER_DISCARD
+};
+
+static const char* CALL_NAMES[] = {
+    "Program", "VertexArray", "Buffer", "ActiveTexture", "Texture", "Sampler", "Capability", "Depth", "Blend"
+};
+
+// Initialize static members (defaults of a freshly created context)
+GLuint GLStateCache::s_program = 0;
+GLuint GLStateCache::s_vertexArray = 0;
+GLuint GLStateCache::s_buffers[BUFFER_TARGET_COUNT] = {};
+GLuint GLStateCache::s_indexedBuffers[2][MAX_INDEXED_BINDINGS] = {};
+GLintptr GLStateCache::s_indexedOffsets[2][MAX_INDEXED_BINDINGS] = {};
+GLsizeiptr GLStateCache::s_indexedSizes[2][MAX_INDEXED_BINDINGS] = {};
+GLuint GLStateCache::s_activeUnit = 0;
+GLuint GLStateCache::s_textures[MAX_TEXTURE_UNITS][TEXTURE_TARGET_COUNT] = {};
+GLuint GLStateCache::s_samplers[MAX_TEXTURE_UNITS] = {};
+GLint GLStateCache::s_capabilities[CAPABILITY_COUNT] = {};
+GLenum GLStateCache::s_depthFunc = GL_LESS;
+GLint GLStateCache::s_depthMask = 1;
+GLenum GLStateCache::s_blendSrc = GL_ONE;
+GLenum GLStateCache::s_blendDst = GL_ZERO;
+unsigned long long GLStateCache::s_issued[CALL_COUNT] = {};
+unsigned long long GLStateCache::s_elided[CALL_COUNT] = {};
+
+bool GLStateCache::changed(Call call, bool differs)
+{
+    if (differs)
+        s_issued[call]++;
+    else
+        s_elided[call]++;
+    return differs;
+}
+
+int GLStateCache::getBufferIndex(GLenum target)
+{
+    for (int i = 0; i < BUFFER_TARGET_COUNT; i++)
+    {
+        if (BUFFER_TARGETS[i] == target)
+            return i;
+    }
+    return -1;
+}
+
+int GLStateCache::getIndexedTargetIndex(GLenum target)
+{
+    if (target == GL_UNIFORM_BUFFER)
+        return 0;
+    if (target == GL_SHADER_STORAGE_BUFFER)
+        return 1;
+    return -1;
+}
+
+int GLStateCache::getTextureIndex(GLenum target)
+{
+    for (int i = 0; i < TEXTURE_TARGET_COUNT; i++)
+    {
+        if (TEXTURE_TARGETS[i] == target)
+            return i;
+    }
+    return -1;
+}
+
+int GLStateCache::getCapabilityIndex(GLenum cap)
+{
+    for (int i = 0; i < CAPABILITY_COUNT; i++)
+    {
+        if (CAPABILITIES[i] == cap)
+            return i;
+    }
+    return -1;
+}
+
+// ===== Program / vertex array =====
+
+void GLStateCache::useProgram(GLuint program)
+{
+    if (changed(CALL_PROGRAM, s_program != program))
+    {
+        glUseProgram(program);
+        s_program = program;
+    }
+}
+
+void GLStateCache::bindVertexArray(GLuint vertexArray)
+{
+    if (changed(CALL_VERTEX_ARRAY, s_vertexArray != vertexArray))
+    {
+        glBindVertexArray(vertexArray);
+        s_vertexArray = vertexArray;
+
+        // The element buffer binding belongs to the VAO
+        s_buffers[getBufferIndex(GL_ELEMENT_ARRAY_BUFFER)] = UNKNOWN;
+    }
+}
+
+// ===== Buffers =====
+
+void GLStateCache::bindBuffer(GLenum target, GLuint buffer)
+{
+    int index = getBufferIndex(target);
+    if (index < 0)
+    {
+        changed(CALL_BUFFER, true);
+        glBindBuffer(target, buffer);
+        return;
+    }
+
+    if (changed(CALL_BUFFER, s_buffers[index] != buffer))
+    {
+        glBindBuffer(target, buffer);
+        s_buffers[index] = buffer;
+    }
+}
+
+void GLStateCache::bindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size)
+{
+    int targetIndex = getIndexedTargetIndex(target);
+    bool tracked = targetIndex >= 0 && index < (GLuint)MAX_INDEXED_BINDINGS;
+    bool differs = !tracked ||
+        s_indexedBuffers[targetIndex][index] != buffer ||
+        s_indexedOffsets[targetIndex][index] != offset ||
+        s_indexedSizes[targetIndex][index] != size;
+
+    if (changed(CALL_BUFFER, differs))
+    {
+        if (size == 0)
+            glBindBufferBase(target, index, buffer);
+        else
+            glBindBufferRange(target, index, buffer, offset, size);
+
+        if (tracked)
+        {
+            s_indexedBuffers[targetIndex][index] = buffer;
+            s_indexedOffsets[targetIndex][index] = offset;
+            s_indexedSizes[targetIndex][index] = size;
+        }
+
+        // Indexed binds also replace the generic binding
+        int generic = getBufferIndex(target);
+        if (generic >= 0)
+            s_buffers[generic] = buffer;
+    }
+}
+
+// ===== Textures / samplers =====
+
+void GLStateCache::activeTexture(GLuint unit)
+{
+    if (changed(CALL_ACTIVE_TEXTURE, s_activeUnit != unit))
+    {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        s_activeUnit = unit;
+    }
+}
+
+void GLStateCache::bindTexture(GLuint unit, GLenum target, GLuint texture)
+{
+    int index = getTextureIndex(target);
+    if (unit >= (GLuint)MAX_TEXTURE_UNITS || index < 0)
+    {
+        activeTexture(unit);
+        changed(CALL_TEXTURE, true);
+        glBindTexture(target, texture);
+        return;
+    }
+
+    if (changed(CALL_TEXTURE, s_textures[unit][index] != texture))
+    {
+        activeTexture(unit);
+        glBindTexture(target, texture);
+        s_textures[unit][index] = texture;
+    }
+}
+
+void GLStateCache::bindSampler(GLuint unit, GLuint sampler)
+{
+    if (unit >= (GLuint)MAX_TEXTURE_UNITS)
+    {
+        changed(CALL_SAMPLER, true);
+        glBindSampler(unit, sampler);
+        return;
+    }
+
+    if (changed(CALL_SAMPLER, s_samplers[unit] != sampler))
+    {
+        glBindSampler(unit, sampler);
+        s_samplers[unit] = sampler;
+    }
+}
+
+// ===== Fixed-function state =====
+
+void GLStateCache::enable(GLenum cap)
+{
+    int index = getCapabilityIndex(cap);
+    if (changed(CALL_CAPABILITY, index < 0 || s_capabilities[index] != 1))
+    {
+        glEnable(cap);
+        if (index >= 0)
+            s_capabilities[index] = 1;
+    }
+}
+
+void GLStateCache::disable(GLenum cap)
+{
+    int index = getCapabilityIndex(cap);
+    if (changed(CALL_CAPABILITY, index < 0 || s_capabilities[index] != 0))
+    {
+        glDisable(cap);
+        if (index >= 0)
+            s_capabilities[index] = 0;
+    }
+}
+
+bool GLStateCache::isEnabled(GLenum cap)
+{
+    int index = getCapabilityIndex(cap);
+    if (index >= 0 && s_capabilities[index] >= 0)
+        return s_capabilities[index] == 1;
+
+    bool enabled = glIsEnabled(cap) == GL_TRUE;
+    if (index >= 0)
+        s_capabilities[index] = enabled ? 1 : 0;
+    return enabled;
+}
+
+void GLStateCache::depthFunc(GLenum func)
+{
+    if (changed(CALL_DEPTH, s_depthFunc != func))
+    {
+        glDepthFunc(func);
+        s_depthFunc = func;
+    }
+}
+
+void GLStateCache::depthMask(bool write)
+{
+    GLint mask = write ? 1 : 0;
+    if (changed(CALL_DEPTH, s_depthMask != mask))
+    {
+        glDepthMask(write ? GL_TRUE : GL_FALSE);
+        s_depthMask = mask;
+    }
+}
+
+void GLStateCache::blendFunc(GLenum src, GLenum dst)
+{
+    if (changed(CALL_BLEND, s_blendSrc != src || s_blendDst != dst))
+    {
+        glBlendFunc(src, dst);
+        s_blendSrc = src;
+        s_blendDst = dst;
+    }
+}
+
+// ===== Object deletion =====
+// Deleting a bound object resets that binding to 0 in GL, and the name may be
+// handed out again, so the shadow has to follow
+
+void GLStateCache::deleteProgram(GLuint program)
+{
+    if (program == 0)
+        return;
+    if (s_program == program)
+        s_program = UNKNOWN;
+    glDeleteProgram(program);
+}
+
+void GLStateCache::deleteVertexArrays(GLsizei count, const GLuint* vertexArrays)
+{
+    for (GLsizei i = 0; i < count; i++)
+    {
+        if (vertexArrays[i] != 0 && s_vertexArray == vertexArrays[i])
+        {
+            s_vertexArray = UNKNOWN;
+            s_buffers[getBufferIndex(GL_ELEMENT_ARRAY_BUFFER)] = UNKNOWN;
+        }
+    }
+    glDeleteVertexArrays(count, vertexArrays);
+}
+
+void GLStateCache::deleteBuffers(GLsizei count, const GLuint* buffers)
+{
+    for (GLsizei i = 0; i < count; i++)
+    {
+        for (GLuint& bound : s_buffers)
+        {
+            if (buffers[i] != 0 && bound == buffers[i])
+                bound = UNKNOWN;
+        }
+        for (auto& target : s_indexedBuffers)
+        {
+            for (GLuint& bound : target)
+            {
+                if (buffers[i] != 0 && bound == buffers[i])
+                    bound = UNKNOWN;
+            }
+        }
+    }
+    glDeleteBuffers(count, buffers);
+}
+
+void GLStateCache::deleteTextures(GLsizei count, const GLuint* textures)
+{
+    for (GLsizei i = 0; i < count; i++)
+    {
+        for (auto& unit : s_textures)
+        {
+            for (GLuint& bound : unit)
+            {
+                if (textures[i] != 0 && bound == textures[i])
+                    bound = UNKNOWN;
+            }
+        }
+    }
+    glDeleteTextures(count, textures);
+}
+
+void GLStateCache::deleteSamplers(GLsizei count, const GLuint* samplers)
+{
+    for (GLsizei i = 0; i < count; i++)
+    {
+        for (GLuint& bound : s_samplers)
+        {
+            if (samplers[i] != 0 && bound == samplers[i])
+                bound = UNKNOWN;
+        }
+    }
+    glDeleteSamplers(count, samplers);
+}
+
+void GLStateCache::invalidate()
+{
+    s_program = UNKNOWN;
+    s_vertexArray = UNKNOWN;
+    s_activeUnit = UNKNOWN;
+    s_depthFunc = UNKNOWN;
+    s_depthMask = -1;
+    s_blendSrc = UNKNOWN;
+    s_blendDst = UNKNOWN;
+
+    for (GLuint& buffer : s_buffers)
+        buffer = UNKNOWN;
+    for (auto& target : s_indexedBuffers)
+    {
+        for (GLuint& buffer : target)
+            buffer = UNKNOWN;
+    }
+    for (auto& unit : s_textures)
+    {
+        for (GLuint& texture : unit)
+            texture = UNKNOWN;
+    }
+    for (GLuint& sampler : s_samplers)
+        sampler = UNKNOWN;
+    for (GLint& capability : s_capabilities)
+        capability = -1;
+}
+
+// ===== Counters =====
+
+void GLStateCache::printStats()
+{
+    unsigned long long totalIssued = 0;
+    unsigned long long totalElided = 0;
+
+    std::cout << "GL state calls (issued / elided):" << std::endl;
+    for (int i = 0; i < CALL_COUNT; i++)
+    {
+        std::cout << "  - " << std::left << std::setw(14) << CALL_NAMES[i] << std::right
+            << std::setw(10) << s_issued[i] << " / " << s_elided[i] << std::endl;
+        totalIssued += s_issued[i];
+        totalElided += s_elided[i];
+    }
+
+    unsigned long long total = totalIssued + totalElided;
+    std::cout << "  - " << std::left << std::setw(14) << "Total" << std::right
+        << std::setw(10) << totalIssued << " / " << totalElided;
+    if (total > 0)
+        std::cout << " (" << std::fixed << std::setprecision(1) << (100.0 * totalElided / total) << "% elided)";
+    std::cout << std::endl;
+}
+
+void GLStateCache::resetStats()
+{
+    for (int i = 0; i < CALL_COUNT; i++)
+    {
+        s_issued[i] = 0;
+        s_elided[i] = 0;
+    }
+}
@@ -0,0 +1,142 @@
+#pragma once
+#include <glad/gl.h>
+
+/**
+ * @class GLStateCache
+ * @brief Shadows OpenGL binding/pipeline state and skips redundant calls
+ *
+ * Tracks:
+ * - Current program and vertex array
+ * - Buffer bindings per target (GL_ELEMENT_ARRAY_BUFFER is forgotten on VAO change,
+ *   since it is stored in the VAO)
+ * - Indexed uniform / shader storage buffer ranges per binding point
+ * - Active texture unit, texture per unit/target and sampler per unit
+ * - Depth test/func/mask, blending and other enable caps
+ *
+ * All code that changes this state must go through the cache (or call invalidate()
+ * afterwards). Deleting objects through the cache keeps recycled names from being
+ * mistaken for still-bound ones.
+ */
+class GLStateCache
+{
+public:
+    /**
+     * Categories for the issued/elided counters
+     */
+    enum Call
+    {
+        CALL_PROGRAM = 0,
+        CALL_VERTEX_ARRAY,
+        CALL_BUFFER,
+        CALL_ACTIVE_TEXTURE,
+        CALL_TEXTURE,
+        CALL_SAMPLER,
+        CALL_CAPABILITY,
+        CALL_DEPTH,
+        CALL_BLEND,
+        CALL_COUNT
+    };
+
+    static const int MAX_TEXTURE_UNITS = 32;
+    static const int MAX_INDEXED_BINDINGS = 16;
+
+private:
+    static const int BUFFER_TARGET_COUNT = 13;
+    static const int TEXTURE_TARGET_COUNT = 5;
+    static const int CAPABILITY_COUNT = 6;
+
+    static GLuint s_program;
+    static GLuint s_vertexArray;
+    static GLuint s_buffers[BUFFER_TARGET_COUNT];
+    static GLuint s_indexedBuffers[2][MAX_INDEXED_BINDINGS];
+    static GLintptr s_indexedOffsets[2][MAX_INDEXED_BINDINGS];
+    static GLsizeiptr s_indexedSizes[2][MAX_INDEXED_BINDINGS];
+    static GLuint s_activeUnit;
+    static GLuint s_textures[MAX_TEXTURE_UNITS][TEXTURE_TARGET_COUNT];
+    static GLuint s_samplers[MAX_TEXTURE_UNITS];
+    static GLint s_capabilities[CAPABILITY_COUNT];
+    static GLenum s_depthFunc;
+    static GLint s_depthMask;
+    static GLenum s_blendSrc;
+    static GLenum s_blendDst;
+
+    static unsigned long long s_issued[CALL_COUNT];
+    static unsigned long long s_elided[CALL_COUNT];
+
+    /**
+     * Count a call and report whether it has to reach the driver
+     */
+    static bool changed(Call call, bool differs);
+
+    static int getBufferIndex(GLenum target);
+    static int getIndexedTargetIndex(GLenum target);
+    static int getTextureIndex(GLenum target);
+    static int getCapabilityIndex(GLenum cap);
+
+public:
+    // ===== Program / vertex array =====
+    static void useProgram(GLuint program);
+    static void bindVertexArray(GLuint vertexArray);
+    static GLuint getProgram() { return s_program; }
+    static GLuint getVertexArray() { return s_vertexArray; }
+
+    // ===== Buffers =====
+    static void bindBuffer(GLenum target, GLuint buffer);
+
+    /**
+     * Bind a buffer range to an indexed binding point (uniform or shader storage)
+     * Also updates the generic binding of the target, as GL does
+     * @param size Bytes to bind (0 = whole buffer, as glBindBufferBase)
+     */
+    static void bindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size);
+
+    // ===== Textures / samplers =====
+    /**
+     * Select the active texture unit
+     * @param unit Unit index (0-based, not GL_TEXTUREi)
+     */
+    static void activeTexture(GLuint unit);
+
+    /**
+     * Bind a texture to a unit (switches the active unit only if needed)
+     */
+    static void bindTexture(GLuint unit, GLenum target, GLuint texture);
+    static void bindSampler(GLuint unit, GLuint sampler);
+
+    // ===== Fixed-function state =====
+    static void enable(GLenum cap);
+    static void disable(GLenum cap);
+
+    /**
+     * Whether a capability is enabled, from the shadowed state when it is known
+     * (queries the driver once after invalidate() or for uncached capabilities)
+     */
+    static bool isEnabled(GLenum cap);
+    static void depthFunc(GLenum func);
+    static GLenum getDepthFunc() { return s_depthFunc; }
+    static void depthMask(bool write);
+    static void blendFunc(GLenum src, GLenum dst);
+
+    // ===== Object deletion =====
+    static void deleteProgram(GLuint program);
+    static void deleteVertexArrays(GLsizei count, const GLuint* vertexArrays);
+    static void deleteBuffers(GLsizei count, const GLuint* buffers);
+    static void deleteTextures(GLsizei count, const GLuint* textures);
+    static void deleteSamplers(GLsizei count, const GLuint* samplers);
+
+    /**
+     * Forget all shadowed state; the next call of each kind is always issued
+     * Use after code that talks to OpenGL directly
+     */
+    static void invalidate();
+
+    // ===== Counters =====
+    static unsigned long long getIssued(Call call) { return s_issued[call]; }
+    static unsigned long long getElided(Call call) { return s_elided[call]; }
+
+    /**
+     * Print issued vs. elided calls per category since the last reset
+     */
+    static void printStats();
+    static void resetStats();
+};
@@ -0,0 +1,432 @@
+#include "GpuCulling.h"
+#include "Frustum.h"
+#include "GLResources.h"
+#include "GLStateCache.h"
+#include "UniformBuffers.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+static const char* CULL_COMP_PATH = "Shaders/cull.comp";
+static const char* CULL_COMPACT_COMP_PATH = "Shaders/cull_compact.comp";
+static const char* DEPTH_PYRAMID_COMP_PATH = "Shaders/depth_pyramid.comp";
+
+// Local sizes of the compute shaders
+static const GLuint CULL_GROUP_SIZE = 64;
+static const GLuint PYRAMID_GROUP_SIZE = 8;
+
+// Texture unit the depth pyramid is sampled from during culling
+static const GLuint PYRAMID_TEXTURE_UNIT = 1;
+
+static_assert(sizeof(GpuInstance) == 128, "GpuInstance must match the std430 layout in cull.comp");
+static_assert(sizeof(CullCommand) == 28, "CullCommand must match the std430 layout in cull.comp");
+
+GpuCuller::GpuCuller()
+    : cullFrustumPlanes(ShaderProgram::INVALID_UNIFORM),
+    cullInstanceCount(ShaderProgram::INVALID_UNIFORM),
+    cullUseOcclusion(ShaderProgram::INVALID_UNIFORM),
+    cullPreviousViewProjection(ShaderProgram::INVALID_UNIFORM),
+    cullPyramidSize(ShaderProgram::INVALID_UNIFORM),
+    cullPyramidLevels(ShaderProgram::INVALID_UNIFORM),
+    cullDepthPyramid(ShaderProgram::INVALID_UNIFORM),
+    cullReverseZ(ShaderProgram::INVALID_UNIFORM),
+    compactCommandCount(ShaderProgram::INVALID_UNIFORM),
+    pyramidFromDepth(ShaderProgram::INVALID_UNIFORM),
+    pyramidDepthTexture(ShaderProgram::INVALID_UNIFORM),
+    pyramidReverseZ(ShaderProgram::INVALID_UNIFORM),
+    visibleBuffer(0),
+    visibleCapacity(0),
+    drawCommandBuffer(0),
+    drawCommandCapacity(0),
+    drawCountBuffer(0),
+    drawCountCapacity(0),
+    depthTexture(0),
+    depthPyramid(0),
+    pyramidSampler(0),
+    pyramidWidth(0),
+    pyramidHeight(0),
+    pyramidLevels(0),
+    pyramidValid(false),
+    pyramidViewProjection(1.0f),
+    indirectCount(false),
+    occlusionEnabled(true),
+    reverseZ(false),
+    storageAlignment(16),
+    lastCommandOffset(0),
+    lastInstanceCount(0)
+{
+}
+
+bool GpuCuller::create(const MeshRegistry& meshes)
+{
+    // Compute shaders and storage buffers are core since 4.3
+    if (!GLAD_GL_VERSION_4_3)
+        return false;
+
+    if (!cullProgram.loadStages({ { GL_COMPUTE_SHADER, CULL_COMP_PATH } }) ||
+        !pyramidProgram.loadStages({ { GL_COMPUTE_SHADER, DEPTH_PYRAMID_COMP_PATH } }))
+    {
+        destroy();
+        return false;
+    }
+
+    // Compaction is only useful when the draw count can come from a buffer
+    indirectCount = GLAD_GL_VERSION_4_6 && compactProgram.loadStages({ { GL_COMPUTE_SHADER, CULL_COMPACT_COMP_PATH } });
+
+    cullFrustumPlanes = cullProgram.getUniform("frustumPlanes");
+    cullInstanceCount = cullProgram.getUniform("instanceCount");
+    cullUseOcclusion = cullProgram.getUniform("useOcclusion");
+    cullPreviousViewProjection = cullProgram.getUniform("previousViewProjection");
+    cullPyramidSize = cullProgram.getUniform("pyramidSize");
+    cullPyramidLevels = cullProgram.getUniform("pyramidLevels");
+    cullDepthPyramid = cullProgram.getUniform("depthPyramid");
+    cullProgram.setInt(cullDepthPyramid, (int)PYRAMID_TEXTURE_UNIT);
+    cullReverseZ = cullProgram.getUniform("reverseZ");
+    compactCommandCount = compactProgram.getUniform("commandCount");
+    pyramidFromDepth = pyramidProgram.getUniform("fromDepth");
+    pyramidDepthTexture = pyramidProgram.getUniform("depthTexture");
+    pyramidProgram.setInt(pyramidDepthTexture, 0);
+    pyramidReverseZ = pyramidProgram.getUniform("reverseZ");
+
+    glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &storageAlignment);
+    instanceStream.create("culled instances", 1024 * sizeof(GpuInstance));
+    commandStream.create("culled commands", 64 * sizeof(CullCommand));
+
+    glGenSamplers(1, &pyramidSampler);
+    glSamplerParameteri(pyramidSampler, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+    glSamplerParameteri(pyramidSampler, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glSamplerParameteri(pyramidSampler, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glSamplerParameteri(pyramidSampler, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    // The visible index arrives as an instanced attribute; it is only enabled while drawing culled instances
+    ensureCapacity(visibleBuffer, visibleCapacity, 1024, sizeof(GLuint));
+    GLuint vertexArray = meshes.getVertexArray();
+    GLResources::setIntegerAttribute(vertexArray, VISIBLE_INDEX_LOCATION, 1, GL_UNSIGNED_INT, 0, VISIBLE_INDEX_BINDING);
+    GLResources::setBindingDivisor(vertexArray, VISIBLE_INDEX_BINDING, 1);
+    GLResources::setVertexBuffer(vertexArray, VISIBLE_INDEX_BINDING, visibleBuffer, 0, sizeof(GLuint));
+    return true;
+}
+
+bool GpuCuller::ensureCapacity(GLuint& buffer, size_t& capacity, size_t required, size_t elementSize)
+{
+    if (buffer != 0 && required <= capacity)
+        return false;
+
+    // Contents are rewritten every frame, so nothing is copied
+    capacity = std::max(required, capacity * 2);
+    if (buffer != 0)
+        GLStateCache::deleteBuffers(1, &buffer);
+    buffer = GLResources::createBuffer((GLsizeiptr)(capacity * elementSize), nullptr, 0);
+    return true;
+}
+
+void GpuCuller::beginFrame()
+{
+    instanceStream.beginFrame();
+    commandStream.beginFrame();
+}
+
+void GpuCuller::endFrame()
+{
+    instanceStream.endFrame();
+    commandStream.endFrame();
+}
+
+void GpuCuller::clear()
+{
+    pending.clear();
+    for (Batch& batch : batches)
+        batch.instanceCount = 0;
+}
+
+void GpuCuller::add(MeshHandle mesh, GLuint arrayTexture, const InstanceData& instance, const glm::vec4& boundingSphere)
+{
+    unsigned long long key = ((unsigned long long)arrayTexture << 32) | (unsigned int)mesh;
+    auto found = batchLookup.find(key);
+    if (found == batchLookup.end())
+    {
+        found = batchLookup.emplace(key, batches.size()).first;
+        batches.push_back({ arrayTexture, mesh, 0, 0 });
+    }
+    batches[found->second].instanceCount++;
+
+    GpuInstance gpuInstance;
+    gpuInstance.draw = instance;
+    gpuInstance.boundingSphere = boundingSphere;
+    gpuInstance.commandIndex = (GLuint)found->second;
+    pending.push_back(gpuInstance);
+}
+
+void GpuCuller::submit(const MeshRegistry& meshes, ShaderProgram& renderProgram, const glm::mat4& viewProjection)
+{
+    lastInstanceCount = 0;
+
+    // One command per non-empty batch, grouped by texture array
+    batchOrder.clear();
+    for (size_t i = 0; i < batches.size(); i++)
+    {
+        if (batches[i].instanceCount > 0 && meshes.isValid(batches[i].mesh))
+            batchOrder.push_back(i);
+    }
+    if (batchOrder.empty())
+        return;
+
+    std::sort(batchOrder.begin(), batchOrder.end(), [this](size_t a, size_t b) {
+        if (batches[a].arrayTexture != batches[b].arrayTexture)
+            return batches[a].arrayTexture < batches[b].arrayTexture;
+        return batches[a].mesh < batches[b].mesh;
+    });
+
+    // Command templates: every instance slot reserved, none visible yet
+    size_t commandOffset = 0;
+    CullCommand* commands = (CullCommand*)commandStream.allocate(batchOrder.size() * sizeof(CullCommand),
+        (size_t)storageAlignment, commandOffset);
+
+    groups.clear();
+    GLuint baseInstance = 0;
+    for (size_t i = 0; i < batchOrder.size(); i++)
+    {
+        Batch& batch = batches[batchOrder[i]];
+        const MeshInfo& mesh = meshes.getMesh(batch.mesh);
+        batch.command = (GLuint)i;
+
+        if (groups.empty() || groups.back().arrayTexture != batch.arrayTexture)
+            groups.push_back({ batch.arrayTexture, (GLuint)i, 0 });
+        groups.back().commandCount++;
+
+        CullCommand& command = commands[i];
+        command.draw.count = (GLuint)mesh.indexCount;
+        command.draw.instanceCount = 0;
+        command.draw.firstIndex = mesh.firstIndex;
+        command.draw.baseVertex = mesh.baseVertex;
+        command.draw.baseInstance = baseInstance;
+        command.group = (GLuint)(groups.size() - 1);
+        command.groupFirst = groups.back().firstCommand;
+        baseInstance += batch.instanceCount;
+    }
+
+    // Instances, with their batch replaced by the command index (invalid meshes are dropped)
+    size_t instanceOffset = 0;
+    GpuInstance* instances = (GpuInstance*)instanceStream.allocate((size_t)baseInstance * sizeof(GpuInstance),
+        (size_t)storageAlignment, instanceOffset);
+    size_t instanceCount = 0;
+    for (const GpuInstance& instance : pending)
+    {
+        const Batch& batch = batches[instance.commandIndex];
+        if (!meshes.isValid(batch.mesh))
+            continue;
+        GpuInstance& written = instances[instanceCount++];
+        written = instance;
+        written.commandIndex = batch.command;
+    }
+
+    if (ensureCapacity(visibleBuffer, visibleCapacity, instanceCount, sizeof(GLuint)))
+        GLResources::setVertexBuffer(meshes.getVertexArray(), VISIBLE_INDEX_BINDING, visibleBuffer, 0, sizeof(GLuint));
+
+    GLsizeiptr instanceBytes = (GLsizeiptr)(instanceCount * sizeof(GpuInstance));
+    GLsizeiptr commandBytes = (GLsizeiptr)(batchOrder.size() * sizeof(CullCommand));
+    GLStateCache::bindBufferRange(GL_SHADER_STORAGE_BUFFER, STORAGE_BINDING_CULL_INSTANCES, instanceStream.getBuffer(),
+        (GLintptr)instanceOffset, instanceBytes);
+    GLStateCache::bindBufferRange(GL_SHADER_STORAGE_BUFFER, STORAGE_BINDING_CULL_COMMANDS, commandStream.getBuffer(),
+        (GLintptr)commandOffset, commandBytes);
+    GLStateCache::bindBufferRange(GL_SHADER_STORAGE_BUFFER, STORAGE_BINDING_VISIBLE, visibleBuffer,
+        0, (GLsizeiptr)(visibleCapacity * sizeof(GLuint)));
+
+    // ===== Cull pass =====
+    Frustum frustum = Frustum::fromMatrix(viewProjection, reverseZ);
+    bool useOcclusion = occlusionEnabled && pyramidValid;
+    cullProgram.setVec4Array(cullFrustumPlanes, frustum.planes, 6);
+    cullProgram.setInt(cullInstanceCount, (int)instanceCount);
+    cullProgram.setBool(cullUseOcclusion, useOcclusion);
+    if (useOcclusion)
+    {
+        cullProgram.setMat4(cullPreviousViewProjection, pyramidViewProjection);
+        cullProgram.setVec2(cullPyramidSize, glm::vec2((float)pyramidWidth, (float)pyramidHeight));
+        cullProgram.setInt(cullPyramidLevels, pyramidLevels);
+        cullProgram.setBool(cullReverseZ, reverseZ);
+        GLStateCache::bindTexture(PYRAMID_TEXTURE_UNIT, GL_TEXTURE_2D, depthPyramid);
+        GLStateCache::bindSampler(PYRAMID_TEXTURE_UNIT, pyramidSampler);
+    }
+    cullProgram.bind();
+    glDispatchCompute((GLuint)((instanceCount + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE), 1, 1);
+
+    // ===== Compaction and draw =====
+    if (indirectCount)
+    {
+        ensureCapacity(drawCommandBuffer, drawCommandCapacity, batchOrder.size(), sizeof(CullCommand));
+        ensureCapacity(drawCountBuffer, drawCountCapacity, groups.size(), sizeof(GLuint));
+
+        GLStateCache::bindBuffer(GL_COPY_WRITE_BUFFER, drawCountBuffer);
+        glClearBufferSubData(GL_COPY_WRITE_BUFFER, GL_R32UI, 0, (GLsizeiptr)(groups.size() * sizeof(GLuint)),
+            GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+        GLStateCache::bindBufferRange(GL_SHADER_STORAGE_BUFFER, STORAGE_BINDING_DRAW_COMMANDS, drawCommandBuffer,
+            0, (GLsizeiptr)(drawCommandCapacity * sizeof(CullCommand)));
+        GLStateCache::bindBufferRange(GL_SHADER_STORAGE_BUFFER, STORAGE_BINDING_DRAW_COUNTS, drawCountBuffer,
+            0, (GLsizeiptr)(drawCountCapacity * sizeof(GLuint)));
+
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+        compactProgram.setInt(compactCommandCount, (int)batchOrder.size());
+        compactProgram.bind();
+        glDispatchCompute((GLuint)((batchOrder.size() + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE), 1, 1);
+        glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+
+        GLStateCache::bindBuffer(GL_DRAW_INDIRECT_BUFFER, drawCommandBuffer);
+        GLStateCache::bindBuffer(GL_PARAMETER_BUFFER, drawCountBuffer);
+    }
+    else
+    {
+        // Draw the templates the cull pass filled in, empty commands draw nothing
+        glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+        GLStateCache::bindBuffer(GL_DRAW_INDIRECT_BUFFER, commandStream.getBuffer());
+    }
+
+    renderProgram.bind();
+    meshes.bind();
+    glEnableVertexAttribArray(VISIBLE_INDEX_LOCATION);
+    for (size_t i = 0; i < groups.size(); i++)
+    {
+        const Group& group = groups[i];
+        GLStateCache::bindTexture(0, GL_TEXTURE_2D_ARRAY, group.arrayTexture);
+        if (indirectCount)
+        {
+            glMultiDrawElementsIndirectCount(GL_TRIANGLES, GL_UNSIGNED_INT,
+                (const void*)(group.firstCommand * sizeof(CullCommand)), (GLintptr)(i * sizeof(GLuint)),
+                (GLsizei)group.commandCount, sizeof(CullCommand));
+        }
+        else
+        {
+            glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT,
+                (const void*)(commandOffset + group.firstCommand * sizeof(CullCommand)),
+                (GLsizei)group.commandCount, sizeof(CullCommand));
+        }
+    }
+    glDisableVertexAttribArray(VISIBLE_INDEX_LOCATION);
+
+    lastCommandOffset = commandOffset;
+    lastInstanceCount = instanceCount;
+
+    // The pyramid only describes the frame it was built after
+    pyramidValid = false;
+}
+
+void GpuCuller::createPyramid(int width, int height)
+{
+    if (depthTexture != 0)
+        GLStateCache::deleteTextures(1, &depthTexture);
+    if (depthPyramid != 0)
+        GLStateCache::deleteTextures(1, &depthPyramid);
+
+    pyramidWidth = width;
+    pyramidHeight = height;
+    pyramidLevels = (int)std::floor(std::log2((float)std::max(width, height))) + 1;
+    pyramidValid = false;
+
+    // Copy target for the scene's depth
+    depthTexture = GLResources::createTexture(GL_TEXTURE_2D, 1, GL_DEPTH_COMPONENT32F, width, height);
+    GLResources::setTextureParameter(depthTexture, GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    GLResources::setTextureParameter(depthTexture, GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    // Level 0 is full resolution, each further level keeps the farthest depth of 2x2 texels
+    // (the maximum, or the minimum with reverse-Z)
+    depthPyramid = GLResources::createTexture(GL_TEXTURE_2D, pyramidLevels, GL_R32F, width, height);
+}
+
+void GpuCuller::buildDepthPyramid(const glm::mat4& viewProjection, int width, int height)
+{
+    if (width <= 0 || height <= 0)
+        return;
+    if (width != pyramidWidth || height != pyramidHeight)
+        createPyramid(width, height);
+
+    // Depth of the scene (the bound read framebuffer) into a texture
+    GLStateCache::bindTexture(0, GL_TEXTURE_2D, depthTexture);
+    glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 0, 0, width, height);
+
+    pyramidProgram.setBool(pyramidReverseZ, reverseZ);
+    pyramidProgram.bind();
+    int levelWidth = width;
+    int levelHeight = height;
+    for (int level = 0; level < pyramidLevels; level++)
+    {
+        pyramidProgram.setBool(pyramidFromDepth, level == 0);
+        pyramidProgram.apply();
+        if (level > 0)
+            glBindImageTexture(0, depthPyramid, level - 1, GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+        glBindImageTexture(1, depthPyramid, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+
+        glDispatchCompute((GLuint)((levelWidth + PYRAMID_GROUP_SIZE - 1) / PYRAMID_GROUP_SIZE),
+            (GLuint)((levelHeight + PYRAMID_GROUP_SIZE - 1) / PYRAMID_GROUP_SIZE), 1);
+        glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+
+        levelWidth = std::max(1, levelWidth / 2);
+        levelHeight = std::max(1, levelHeight / 2);
+    }
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+
+    pyramidViewProjection = viewProjection;
+    pyramidValid = true;
+}
+
+void GpuCuller::setOcclusionEnabled(bool enabled)
+{
+    occlusionEnabled = enabled;
+}
+
+void GpuCuller::setReverseZ(bool enabled)
+{
+    // A pyramid built with the other convention cannot be tested against
+    if (reverseZ != enabled)
+        pyramidValid = false;
+    reverseZ = enabled;
+}
+
+void GpuCuller::printStats()
+{
+    // Sum what the cull pass left in last frame's commands (waits for the GPU)
+    size_t visible = 0;
+    if (lastInstanceCount > 0)
+    {
+        std::vector<CullCommand> commands(batchOrder.size());
+        glFinish();
+        GLStateCache::bindBuffer(GL_COPY_READ_BUFFER, commandStream.getBuffer());
+        glGetBufferSubData(GL_COPY_READ_BUFFER, (GLintptr)lastCommandOffset,
+            (GLsizeiptr)(commands.size() * sizeof(CullCommand)), commands.data());
+        for (const CullCommand& command : commands)
+            visible += command.draw.instanceCount;
+    }
+
+    std::cout << "GPU culling: " << visible << " / " << lastInstanceCount << " instances visible, "
+        << batchOrder.size() << " commands in " << groups.size() << " groups, occlusion "
+        << (occlusionEnabled ? "on" : "off") << ", "
+        << (indirectCount ? "indirect count" : "multi-draw indirect fallback") << std::endl;
+    instanceStream.printStats();
+    commandStream.printStats();
+}
+
+void GpuCuller::destroy()
+{
+    cullProgram.destroy();
+    compactProgram.destroy();
+    pyramidProgram.destroy();
+    instanceStream.destroy();
+    commandStream.destroy();
+
+    GLuint buffers[] = { visibleBuffer, drawCommandBuffer, drawCountBuffer };
+    GLStateCache::deleteBuffers(3, buffers);
+    visibleBuffer = drawCommandBuffer = drawCountBuffer = 0;
+    visibleCapacity = drawCommandCapacity = drawCountCapacity = 0;
+
+    GLuint textures[] = { depthTexture, depthPyramid };
+    GLStateCache::deleteTextures(2, textures);
+    depthTexture = depthPyramid = 0;
+    if (pyramidSampler != 0)
+        GLStateCache::deleteSamplers(1, &pyramidSampler);
+    pyramidSampler = 0;
+    pyramidWidth = pyramidHeight = pyramidLevels = 0;
+    pyramidValid = false;
+
+    pending.clear();
+    batches.clear();
+    batchLookup.clear();
+    groups.clear();
+}
@@ -0,0 +1,204 @@
+#pragma once
+#include <unordered_map>
+#include <vector>
+#include <glm/glm.hpp>
+#include <glad/gl.h>
+#include "IndirectDraw.h"
+#include "MeshRegistry.h"
+#include "Model3D.h"
+#include "ShaderProgram.h"
+#include "StreamBuffer.h"
+
+/**
+ * @struct GpuInstance
+ * @brief Per-instance data read by the culling compute shader (std430, 128 bytes)
+ */
+struct GpuInstance
+{
+    InstanceData draw;
+    glm::vec4 boundingSphere;   // World space: xyz = center, w = radius
+    GLuint commandIndex;        // Command whose instance count this instance adds to
+    GLuint padding[3];
+};
+
+/**
+ * @struct CullCommand
+ * @brief Indirect command plus the texture group it is drawn in
+ *
+ * Draws use a stride of sizeof(CullCommand), GL only reads the first 20 bytes.
+ */
+struct CullCommand
+{
+    DrawElementsIndirectCommand draw;
+    GLuint group;               // Index into the per-group draw counts
+    GLuint groupFirst;          // First compacted command slot of the group
+};
+
+/**
+ * @class GpuCuller
+ * @brief Frustum and Hi-Z occlusion culling in compute, drawn with indirect count
+ *
+ * Each frame the CPU writes every instance (transform, material, bounding
+ * sphere) and one command per (texture array, mesh) batch with an instance
+ * count of zero. A compute pass tests each instance against the frustum and
+ * against the previous frame's depth pyramid; survivors atomically bump their
+ * command's instance count and write their index into the visible list.
+ * A second pass compacts non-empty commands per texture group and writes the
+ * group's draw count, consumed by glMultiDrawElementsIndirectCount.
+ *
+ * The vertex shader receives visible[baseInstance + gl_InstanceID] through an
+ * instanced vertex attribute, so it needs neither gl_BaseInstance nor
+ * gl_DrawID. Without OpenGL 4.6 (e.g. Mesa llvmpipe) compaction is skipped and
+ * the uncompacted commands are drawn with glMultiDrawElementsIndirect, empty
+ * commands simply draw nothing. The CPU never reads visibility back.
+ */
+class GpuCuller
+{
+public:
+    // Vertex buffer binding / attribute location of the visible instance index
+    static const GLuint VISIBLE_INDEX_BINDING = 4;
+    static const GLuint VISIBLE_INDEX_LOCATION = 9;
+
+private:
+    struct Batch
+    {
+        GLuint arrayTexture;
+        MeshHandle mesh;
+        GLuint instanceCount;
+        GLuint command;
+    };
+
+    struct Group
+    {
+        GLuint arrayTexture;
+        GLuint firstCommand;
+        GLuint commandCount;
+    };
+
+    // Compute programs and their uniforms
+    ShaderProgram cullProgram;
+    ShaderProgram compactProgram;
+    ShaderProgram pyramidProgram;
+    ShaderProgram::UniformHandle cullFrustumPlanes;
+    ShaderProgram::UniformHandle cullInstanceCount;
+    ShaderProgram::UniformHandle cullUseOcclusion;
+    ShaderProgram::UniformHandle cullPreviousViewProjection;
+    ShaderProgram::UniformHandle cullPyramidSize;
+    ShaderProgram::UniformHandle cullPyramidLevels;
+    ShaderProgram::UniformHandle cullDepthPyramid;
+    ShaderProgram::UniformHandle cullReverseZ;
+    ShaderProgram::UniformHandle compactCommandCount;
+    ShaderProgram::UniformHandle pyramidFromDepth;
+    ShaderProgram::UniformHandle pyramidDepthTexture;
+    ShaderProgram::UniformHandle pyramidReverseZ;
+
+    // Instances queued this frame (commandIndex holds the batch until submit)
+    std::vector<GpuInstance> pending;
+    std::vector<Batch> batches;
+    std::unordered_map<unsigned long long, size_t> batchLookup;
+    std::vector<size_t> batchOrder;
+    std::vector<Group> groups;
+
+    // CPU-written, persistently mapped
+    StreamBuffer instanceStream;
+    StreamBuffer commandStream;
+
+    // GPU-only
+    GLuint visibleBuffer;
+    size_t visibleCapacity;
+    GLuint drawCommandBuffer;
+    size_t drawCommandCapacity;
+    GLuint drawCountBuffer;
+    size_t drawCountCapacity;
+
+    // Depth pyramid of the previous frame (farthest depth per texel)
+    GLuint depthTexture;
+    GLuint depthPyramid;
+    GLuint pyramidSampler;
+    int pyramidWidth;
+    int pyramidHeight;
+    int pyramidLevels;
+    bool pyramidValid;
+    glm::mat4 pyramidViewProjection;
+
+    bool indirectCount;
+    bool occlusionEnabled;
+    bool reverseZ;
+    GLint storageAlignment;
+    size_t lastCommandOffset;
+    size_t lastInstanceCount;
+
+    /**
+     * Make sure a GPU-only buffer holds the given number of elements
+     * @return True if the buffer was replaced
+     */
+    static bool ensureCapacity(GLuint& buffer, size_t& capacity, size_t required, size_t elementSize);
+
+    /**
+     * (Re)create the depth copy and the pyramid for a framebuffer size
+     */
+    void createPyramid(int width, int height);
+
+public:
+    GpuCuller();
+
+    GpuCuller(const GpuCuller&) = delete;
+    GpuCuller& operator=(const GpuCuller&) = delete;
+
+    /**
+     * Load the compute shaders and add the visible index attribute to the registry's VAO
+     * @param meshes Registry the culled meshes are drawn from
+     * @return False if compute shaders are not available
+     */
+    bool create(const MeshRegistry& meshes);
+
+    void beginFrame();
+    void endFrame();
+
+    /**
+     * Forget the instances queued for the previous submit
+     */
+    void clear();
+
+    /**
+     * Queue one instance
+     * @param boundingSphere World-space bounds (see transformBoundingSphere)
+     */
+    void add(MeshHandle mesh, GLuint arrayTexture, const InstanceData& instance, const glm::vec4& boundingSphere);
+
+    /**
+     * Cull the queued instances on the GPU and draw the survivors
+     * @param meshes Registry the queued meshes live in
+     * @param renderProgram Program reading the visible index attribute (bound after culling)
+     * @param viewProjection Camera projection * view matrix of this frame
+     */
+    void submit(const MeshRegistry& meshes, ShaderProgram& renderProgram, const glm::mat4& viewProjection);
+
+    /**
+     * Build the depth pyramid from the finished frame's depth buffer
+     * Call after all depth-writing draws with the scene's framebuffer bound, before
+     * SceneFramebuffer::present() or swapping buffers; the next
+     * submit() only tests occlusion if this was called after the previous one
+     * @param viewProjection Matrix the frame was drawn with
+     * @param width Framebuffer width
+     * @param height Framebuffer height
+     */
+    void buildDepthPyramid(const glm::mat4& viewProjection, int width, int height);
+
+    void setOcclusionEnabled(bool enabled);
+    bool isOcclusionEnabled() const { return occlusionEnabled; }
+
+    /**
+     * Match the camera's depth convention: reverse-Z keeps the minimum depth in the
+     * pyramid and extracts frustum planes for a [0, 1] clip depth range
+     */
+    void setReverseZ(bool enabled);
+    bool hasIndirectCount() const { return indirectCount; }
+
+    /**
+     * Print instance/command counts (reads the last frame's counts back, debug only)
+     */
+    void printStats();
+
+    void destroy();
+};
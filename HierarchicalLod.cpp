@@ -0,0 +1,358 @@
+#include "HierarchicalLod.h"
+#include "GLResources.h"
+#include "GLStateCache.h"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <unordered_set>
+
+// Vertex buffer binding of the proxy vertices
+static const GLuint PROXY_VERTEX_BINDING = 0;
+
+// Proxy vertex indices must fit 21 bits to be packed into a triangle key
+static const unsigned int TRIANGLE_KEY_VERTEX_LIMIT = 1u << 21;
+
+HierarchicalLod::HierarchicalLod(ThreadPool* threadPool)
+    : threadPool(threadPool),
+    buildCount(0),
+    lastProxyDraws(0),
+    lastReplacedModels(0),
+    lastProxyTriangles(0),
+    lastSourceTriangles(0)
+{
+}
+
+void HierarchicalLod::setSourceMesh(MeshHandle mesh, const std::vector<MeshVertex>& vertices,
+    const std::vector<unsigned int>& indices)
+{
+    SourceMesh& source = sourceMeshes[mesh];
+    source.vertices = vertices;
+    source.indices = indices;
+}
+
+void HierarchicalLod::update(const std::vector<Model3D>& models, const MeshRegistry& meshes,
+    const TexturePacker& textures)
+{
+    // Place the new static models in their clusters
+    for (size_t i = modelSlots.size(); i < models.size(); i++)
+    {
+        const Model3D& model = models[i];
+        ModelSlot slot = { -1, 0 };
+        if (model.isStatic() && meshes.isValid(model.getMesh()) &&
+            sourceMeshes.find(model.getMesh()) != sourceMeshes.end())
+        {
+            glm::vec3 boundsMin, boundsMax;
+            transformBoundingBox(meshes.getMesh(model.getMesh()), model.getTransformMatrix(), boundsMin, boundsMax);
+            glm::ivec3 cell = glm::ivec3(glm::floor((boundsMin + boundsMax) * 0.5f / CLUSTER_SIZE));
+
+            // 21 bits per cell coordinate
+            unsigned long long key = ((unsigned long long)(cell.x & 0x1FFFFF) << 42) |
+                ((unsigned long long)(cell.y & 0x1FFFFF) << 21) | (unsigned long long)(cell.z & 0x1FFFFF);
+            auto found = clusterLookup.find(key);
+            if (found == clusterLookup.end())
+            {
+                found = clusterLookup.emplace(key, clusters.size()).first;
+                Cluster cluster;
+                cluster.boundsMin = boundsMin;
+                cluster.boundsMax = boundsMax;
+                clusters.push_back(std::move(cluster));
+            }
+
+            Cluster& cluster = clusters[found->second];
+            slot.cluster = (int)found->second;
+            slot.member = (unsigned int)cluster.members.size();
+            cluster.members.push_back((unsigned int)i);
+            cluster.boundsMin = glm::min(cluster.boundsMin, boundsMin);
+            cluster.boundsMax = glm::max(cluster.boundsMax, boundsMax);
+        }
+        modelSlots.push_back(slot);
+    }
+
+    // Swap in finished proxies; rebuild those of clusters that grew meanwhile
+    for (Cluster& cluster : clusters)
+    {
+        if (cluster.pendingBuild.valid())
+        {
+            if (cluster.pendingBuild.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+                continue;
+            cluster.pendingBuild.get();
+            uploadProxy(cluster);
+        }
+
+        if (cluster.members.size() > cluster.proxyMemberCount)
+            startBuild(cluster, models, textures);
+    }
+}
+
+void HierarchicalLod::startBuild(Cluster& cluster, const std::vector<Model3D>& models, const TexturePacker& textures)
+{
+    // Workers only see this copy, so the model list may grow while they run
+    auto snapshot = std::make_shared<std::vector<MemberSnapshot>>();
+    snapshot->reserve(cluster.members.size());
+    for (unsigned int member : cluster.members)
+    {
+        const Model3D& model = models[member];
+        MemberSnapshot entry;
+        entry.mesh = model.getMesh();
+        entry.transform = model.getTransformMatrix();
+        entry.material = model.getMaterial();
+        if (model.getMaterial() < (int)textures.getPackedCount())
+            entry.packed = textures.getPacked(model.getMaterial());
+        snapshot->push_back(entry);
+    }
+
+    cluster.pendingProxy = std::make_unique<ProxyGeometry>();
+    cluster.pendingMemberCount = cluster.members.size();
+    buildCount++;
+
+    ProxyGeometry* target = cluster.pendingProxy.get();
+    glm::vec3 origin = cluster.boundsMin;
+    if (!threadPool)
+    {
+        buildProxy(*snapshot, origin, *target);
+        uploadProxy(cluster);
+        return;
+    }
+
+    cluster.pendingBuild = threadPool->submit([this, snapshot, origin, target]() {
+        buildProxy(*snapshot, origin, *target);
+    });
+}
+
+void HierarchicalLod::buildProxy(const std::vector<MemberSnapshot>& members, const glm::vec3& origin,
+    ProxyGeometry& proxy) const
+{
+    struct CellVertex
+    {
+        glm::vec3 positionSum;
+        glm::vec3 normalSum;
+        glm::vec2 texCoordSum;
+        unsigned int count;
+        unsigned int slot;
+    };
+
+    // One slot per material: vertices of different materials never collapse together
+    std::vector<int> slotMaterials;
+    std::vector<PackedTexture> slotPacked;
+    std::vector<std::vector<unsigned int>> slotIndices;
+
+    std::unordered_map<unsigned long long, unsigned int> cellLookup;
+    std::vector<CellVertex> cellVertices;
+    std::unordered_set<unsigned long long> emittedTriangles;
+    std::vector<unsigned int> remap;
+
+    for (const MemberSnapshot& member : members)
+    {
+        auto found = sourceMeshes.find(member.mesh);
+        if (found == sourceMeshes.end())
+            continue;
+        const SourceMesh& source = found->second;
+
+        unsigned int slot = 0;
+        while (slot < slotMaterials.size() && slotMaterials[slot] != member.material)
+            slot++;
+        if (slot == slotMaterials.size())
+        {
+            slotMaterials.push_back(member.material);
+            slotPacked.push_back(member.packed);
+            slotIndices.emplace_back();
+        }
+
+        // Collapse every vertex into the grid cell it falls in
+        remap.resize(source.vertices.size());
+        // Inverse transpose keeps normals perpendicular under non-uniform scale
+        glm::mat3 normalTransform = glm::transpose(glm::inverse(glm::mat3(member.transform)));
+        for (size_t i = 0; i < source.vertices.size(); i++)
+        {
+            glm::vec3 position = glm::vec3(member.transform * glm::vec4(source.vertices[i].position, 1.0f));
+            glm::ivec3 cell = glm::ivec3(glm::floor((position - origin) / SIMPLIFY_CELL_SIZE));
+            unsigned long long key = ((unsigned long long)(cell.x & 0xFFFF) << 48) |
+                ((unsigned long long)(cell.y & 0xFFFF) << 32) | ((unsigned long long)(cell.z & 0xFFFF) << 16) |
+                (slot & 0xFFFF);
+
+            auto inserted = cellLookup.emplace(key, (unsigned int)cellVertices.size());
+            if (inserted.second)
+                cellVertices.push_back({ glm::vec3(0.0f), glm::vec3(0.0f), glm::vec2(0.0f), 0, slot });
+
+            CellVertex& cellVertex = cellVertices[inserted.first->second];
+            cellVertex.positionSum += position;
+            cellVertex.normalSum += glm::normalize(normalTransform * source.vertices[i].normal);
+            cellVertex.texCoordSum += source.vertices[i].texCoord;
+            cellVertex.count++;
+            remap[i] = inserted.first->second;
+        }
+
+        // Keep the triangles whose corners stayed in distinct cells, once each
+        for (size_t i = 0; i + 2 < source.indices.size(); i += 3)
+        {
+            unsigned int a = remap[source.indices[i]];
+            unsigned int b = remap[source.indices[i + 1]];
+            unsigned int c = remap[source.indices[i + 2]];
+            proxy.sourceTriangles++;
+            if (a == b || b == c || a == c)
+                continue;
+
+            if (cellVertices.size() < TRIANGLE_KEY_VERTEX_LIMIT)
+            {
+                unsigned int low = std::min(a, std::min(b, c));
+                unsigned int high = std::max(a, std::max(b, c));
+                unsigned int middle = a + b + c - low - high;
+                unsigned long long key = ((unsigned long long)low << 42) | ((unsigned long long)middle << 21) | high;
+                if (!emittedTriangles.insert(key).second)
+                    continue;
+            }
+
+            std::vector<unsigned int>& indices = slotIndices[slot];
+            indices.push_back(a);
+            indices.push_back(b);
+            indices.push_back(c);
+        }
+    }
+
+    proxy.vertices.resize(cellVertices.size());
+    for (size_t i = 0; i < cellVertices.size(); i++)
+    {
+        const CellVertex& cellVertex = cellVertices[i];
+        StaticVertex& vertex = proxy.vertices[i];
+        vertex.position = cellVertex.positionSum / (float)cellVertex.count;
+        vertex.texCoord = cellVertex.texCoordSum / (float)cellVertex.count;
+        vertex.uvRect = slotPacked[cellVertex.slot].uvRect;
+        vertex.layer = slotPacked[cellVertex.slot].layer;
+        vertex.normal = StaticBatcher::encodeNormal(cellVertex.normalSum);
+    }
+
+    // Slots sharing a texture array are drawn with one call
+    std::vector<bool> written(slotMaterials.size(), false);
+    for (size_t slot = 0; slot < slotMaterials.size(); slot++)
+    {
+        if (written[slot])
+            continue;
+
+        ProxyDraw draw;
+        draw.arrayTexture = slotPacked[slot].arrayTexture;
+        draw.firstIndex = (GLsizei)proxy.indices.size();
+        for (size_t other = slot; other < slotMaterials.size(); other++)
+        {
+            if (written[other] || slotPacked[other].arrayTexture != draw.arrayTexture)
+                continue;
+            proxy.indices.insert(proxy.indices.end(), slotIndices[other].begin(), slotIndices[other].end());
+            written[other] = true;
+        }
+        draw.indexCount = (GLsizei)proxy.indices.size() - draw.firstIndex;
+        if (draw.indexCount > 0)
+            proxy.draws.push_back(draw);
+    }
+}
+
+void HierarchicalLod::uploadProxy(Cluster& cluster)
+{
+    ProxyGeometry& proxy = *cluster.pendingProxy;
+    if (cluster.vertexArray == 0)
+    {
+        cluster.vertexArray = GLResources::createVertexArray();
+        StaticBatcher::setVertexAttributes(cluster.vertexArray, PROXY_VERTEX_BINDING);
+    }
+
+    // Draws still pending keep the old storage alive
+    GLuint buffers[] = { cluster.vertexBuffer, cluster.indexBuffer };
+    GLStateCache::deleteBuffers(2, buffers);
+    cluster.vertexBuffer = cluster.indexBuffer = 0;
+    cluster.draws.clear();
+    if (!proxy.indices.empty())
+    {
+        cluster.vertexBuffer = GLResources::createBuffer((GLsizeiptr)(proxy.vertices.size() * sizeof(StaticVertex)),
+            proxy.vertices.data(), 0);
+        cluster.indexBuffer = GLResources::createBuffer((GLsizeiptr)(proxy.indices.size() * sizeof(unsigned int)),
+            proxy.indices.data(), 0);
+        GLResources::setVertexBuffer(cluster.vertexArray, PROXY_VERTEX_BINDING, cluster.vertexBuffer, 0,
+            sizeof(StaticVertex));
+        GLResources::setElementBuffer(cluster.vertexArray, cluster.indexBuffer);
+        cluster.draws = proxy.draws;
+    }
+
+    cluster.proxyMemberCount = cluster.pendingMemberCount;
+    cluster.proxyTriangles = proxy.indices.size() / 3;
+    cluster.sourceTriangles = proxy.sourceTriangles;
+    cluster.pendingProxy.reset();
+}
+
+void HierarchicalLod::draw(const Frustum& frustum, const glm::vec3& cameraPosition,
+    const std::vector<Model3D>& models, std::vector<Model3D>& outModels, std::vector<unsigned int>& outIndices)
+{
+    lastProxyDraws = lastReplacedModels = lastProxyTriangles = lastSourceTriangles = 0;
+    for (Cluster& cluster : clusters)
+    {
+        cluster.proxied = false;
+        if (cluster.draws.empty())
+            continue;
+
+        // Distance to the nearest point of the cluster's bounds
+        glm::vec3 nearest = glm::clamp(cameraPosition, cluster.boundsMin, cluster.boundsMax);
+        if (glm::length(cameraPosition - nearest) <= PROXY_DISTANCE)
+            continue;
+
+        // Replaced even when outside the frustum: nothing of the cluster is drawn then
+        cluster.proxied = true;
+        lastReplacedModels += cluster.proxyMemberCount;
+        if (!frustum.intersectsBox(cluster.boundsMin, cluster.boundsMax))
+            continue;
+
+        GLStateCache::bindVertexArray(cluster.vertexArray);
+        for (const ProxyDraw& draw : cluster.draws)
+        {
+            GLStateCache::bindTexture(0, GL_TEXTURE_2D_ARRAY, draw.arrayTexture);
+            glDrawElements(GL_TRIANGLES, draw.indexCount, GL_UNSIGNED_INT,
+                (const void*)(draw.firstIndex * sizeof(unsigned int)));
+            lastProxyDraws++;
+        }
+        lastProxyTriangles += cluster.proxyTriangles;
+        lastSourceTriangles += cluster.sourceTriangles;
+    }
+
+    outModels.clear();
+    outIndices.clear();
+    for (size_t i = 0; i < models.size(); i++)
+    {
+        if (i < modelSlots.size() && modelSlots[i].cluster >= 0)
+        {
+            const Cluster& cluster = clusters[modelSlots[i].cluster];
+            if (cluster.proxied && modelSlots[i].member < cluster.proxyMemberCount)
+                continue;
+        }
+        outModels.push_back(models[i]);
+        outIndices.push_back((unsigned int)i);
+    }
+}
+
+void HierarchicalLod::printStats() const
+{
+    size_t pendingBuilds = 0;
+    for (const Cluster& cluster : clusters)
+    {
+        if (cluster.pendingBuild.valid())
+            pendingBuilds++;
+    }
+
+    std::cout << "HLOD: " << clusters.size() << " clusters, " << buildCount << " proxy builds (" << pendingBuilds
+        << " running), last frame " << lastReplacedModels << " models replaced, " << lastProxyDraws
+        << " proxy draws with " << lastProxyTriangles << " triangles (members: " << lastSourceTriangles << ")"
+        << std::endl;
+}
+
+void HierarchicalLod::destroy()
+{
+    for (Cluster& cluster : clusters)
+    {
+        // Workers write into the cluster's pending proxy
+        if (cluster.pendingBuild.valid())
+            cluster.pendingBuild.wait();
+
+        GLuint buffers[] = { cluster.vertexBuffer, cluster.indexBuffer };
+        GLStateCache::deleteBuffers(2, buffers);
+        if (cluster.vertexArray != 0)
+            GLStateCache::deleteVertexArrays(1, &cluster.vertexArray);
+    }
+    clusters.clear();
+    clusterLookup.clear();
+    modelSlots.clear();
+}
@@ -0,0 +1,181 @@
+#pragma once
+#include <future>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include <glm/glm.hpp>
+#include <glad/gl.h>
+#include "Frustum.h"
+#include "MeshRegistry.h"
+#include "Model3D.h"
+#include "StaticBatching.h"
+#include "TexturePacker.h"
+#include "ThreadPool.h"
+
+/**
+ * @class HierarchicalLod
+ * @brief Replaces distant clusters of static models with one simplified proxy mesh each (HLOD)
+ *
+ * Static models are grouped by the grid cell containing their bounds center.
+ * Whenever a cluster has gained members, its proxy is rebuilt in the
+ * background on the thread pool:
+ * - every member is transformed to world space and merged
+ * - the merged mesh is simplified by vertex clustering: vertices of one
+ *   material falling into the same SIMPLIFY_CELL_SIZE cell are collapsed to
+ *   their average, then collapsed and repeated triangles are dropped
+ * - materials stay in the TexturePacker atlases; each proxy vertex carries its
+ *   material's UV rectangle and layer (StaticVertex), so a proxy takes one
+ *   draw per texture array, usually one
+ *
+ * The GL thread uploads finished proxies in update(). draw() renders the
+ * proxy of every cluster farther than PROXY_DISTANCE in place of the
+ * members it was built from and hands back all other models, so far-field
+ * draws scale with the number of clusters rather than models.
+ */
+class HierarchicalLod
+{
+public:
+    // World units per cluster cell side
+    static constexpr float CLUSTER_SIZE = 32.0f;
+
+    // Clusters whose bounds are farther from the camera draw their proxy
+    static constexpr float PROXY_DISTANCE = 64.0f;
+
+    // Vertex clustering grid of the simplification, in world units
+    static constexpr float SIMPLIFY_CELL_SIZE = 0.5f;
+
+private:
+    struct SourceMesh
+    {
+        std::vector<MeshVertex> vertices;
+        std::vector<unsigned int> indices;
+    };
+
+    struct ProxyDraw
+    {
+        GLuint arrayTexture;
+        GLsizei firstIndex;
+        GLsizei indexCount;
+    };
+
+    // What a worker needs of one member, captured on the GL thread
+    struct MemberSnapshot
+    {
+        MeshHandle mesh;
+        glm::mat4 transform;
+        int material;
+        PackedTexture packed;
+    };
+
+    struct ProxyGeometry
+    {
+        std::vector<StaticVertex> vertices;
+        std::vector<unsigned int> indices;
+        std::vector<ProxyDraw> draws;
+        size_t sourceTriangles = 0;
+    };
+
+    struct Cluster
+    {
+        std::vector<unsigned int> members;  // Indices into the models given to update()
+        glm::vec3 boundsMin;
+        glm::vec3 boundsMax;
+
+        // Background build
+        std::future<void> pendingBuild;
+        std::unique_ptr<ProxyGeometry> pendingProxy;
+        size_t pendingMemberCount = 0;
+
+        // Current proxy, covering members [0, proxyMemberCount)
+        GLuint vertexArray = 0;
+        GLuint vertexBuffer = 0;
+        GLuint indexBuffer = 0;
+        std::vector<ProxyDraw> draws;
+        size_t proxyMemberCount = 0;
+        size_t proxyTriangles = 0;
+        size_t sourceTriangles = 0;
+        bool proxied = false;               // Drawn as its proxy this frame
+    };
+
+    struct ModelSlot
+    {
+        int cluster;                        // -1 = not clustered
+        unsigned int member;                // Position in the cluster's members
+    };
+
+    ThreadPool* threadPool;
+    std::unordered_map<MeshHandle, SourceMesh> sourceMeshes;
+    std::vector<Cluster> clusters;
+    std::unordered_map<unsigned long long, size_t> clusterLookup;  // Cell -> cluster
+    std::vector<ModelSlot> modelSlots;      // One per model update() has looked at
+
+    size_t buildCount;
+    size_t lastProxyDraws;
+    size_t lastReplacedModels;
+    size_t lastProxyTriangles;
+    size_t lastSourceTriangles;
+
+    /**
+     * Merge and simplify the members of a cluster (runs on a worker)
+     */
+    void buildProxy(const std::vector<MemberSnapshot>& members, const glm::vec3& origin, ProxyGeometry& proxy) const;
+
+    /**
+     * Start rebuilding a cluster's proxy from its current members
+     */
+    void startBuild(Cluster& cluster, const std::vector<Model3D>& models, const TexturePacker& textures);
+
+    /**
+     * Replace a cluster's buffers with its finished proxy (GL thread)
+     */
+    void uploadProxy(Cluster& cluster);
+
+public:
+    /**
+     * @param threadPool Pool for proxy builds (nullptr = built on the calling thread)
+     */
+    explicit HierarchicalLod(ThreadPool* threadPool = nullptr);
+
+    HierarchicalLod(const HierarchicalLod&) = delete;
+    HierarchicalLod& operator=(const HierarchicalLod&) = delete;
+
+    /**
+     * Register the CPU-side geometry of a mesh so its static instances can be merged
+     * Must not be called while proxies are being built
+     * @param mesh Registry handle the instances use
+     * @param vertices Object-space vertices
+     * @param indices Triangle list
+     */
+    void setSourceMesh(MeshHandle mesh, const std::vector<MeshVertex>& vertices,
+        const std::vector<unsigned int>& indices);
+
+    /**
+     * Cluster static models added since the last call, start proxy builds and upload finished ones
+     * Models must only ever be appended, and static ones must not change
+     * @param models All models (dynamic ones are skipped)
+     * @param meshes Registry with the models' bounds
+     * @param textures Packed materials
+     */
+    void update(const std::vector<Model3D>& models, const MeshRegistry& meshes, const TexturePacker& textures);
+
+    /**
+     * Draw the proxies of distant clusters and collect the models they do not replace
+     * A program reading StaticVertex attributes (Shaders/static.vert) must be bound
+     * @param frustum Camera frustum the proxies are culled against
+     * @param cameraPosition Distances are measured from here
+     * @param models The models given to update()
+     * @param outModels Receives every model not drawn as part of a proxy (cleared first)
+     * @param outIndices Receives the index in models of each of outModels (cleared first)
+     */
+    void draw(const Frustum& frustum, const glm::vec3& cameraPosition, const std::vector<Model3D>& models,
+        std::vector<Model3D>& outModels, std::vector<unsigned int>& outIndices);
+
+    size_t getClusterCount() const { return clusters.size(); }
+
+    /**
+     * Print cluster and proxy counts and the last frame's replacement
+     */
+    void printStats() const;
+
+    void destroy();
+};
@@ -0,0 +1,362 @@
+#include "Impostors.h"
+#include "GLResources.h"
+#include "GLStateCache.h"
+#include "UniformBuffers.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <glm/gtc/matrix_transform.hpp>
+
+static const char* IMPOSTOR_BAKE_VERT_PATH = "Shaders/impostor_bake.vert";
+static const char* IMPOSTOR_BAKE_FRAG_PATH = "Shaders/impostor_bake.frag";
+static const char* IMPOSTOR_VERT_PATH = "Shaders/impostor.vert";
+static const char* IMPOSTOR_FRAG_PATH = "Shaders/impostor.frag";
+static const char* IMPOSTOR_FADE_VERT_PATH = "Shaders/impostor_fade.vert";
+static const char* IMPOSTOR_FADE_FRAG_PATH = "Shaders/impostor_fade.frag";
+
+// Vertex buffer binding of the per-instance transforms
+static const GLuint IMPOSTOR_INSTANCE_BINDING = 0;
+
+// Texture units of the atlases while drawing impostors
+static const GLuint COLOR_ATLAS_UNIT = 0;
+static const GLuint NORMAL_DEPTH_ATLAS_UNIT = 1;
+
+ImpostorRenderer::ImpostorRenderer()
+    : bakeViewProjection(ShaderProgram::INVALID_UNIFORM),
+    bakeUvRect(ShaderProgram::INVALID_UNIFORM),
+    bakeLayer(ShaderProgram::INVALID_UNIFORM),
+    impostorBoundingSphere(ShaderProgram::INVALID_UNIFORM),
+    impostorAtlasLayer(ShaderProgram::INVALID_UNIFORM),
+    impostorReverseZ(ShaderProgram::INVALID_UNIFORM),
+    colorAtlas(0),
+    normalDepthAtlas(0),
+    quadVertexArray(0),
+    reverseZ(false),
+    lastImpostorCount(0),
+    lastFadingCount(0),
+    lastCulledCount(0)
+{
+}
+
+bool ImpostorRenderer::create()
+{
+    if (!bakeProgram.loadFromFiles(IMPOSTOR_BAKE_VERT_PATH, IMPOSTOR_BAKE_FRAG_PATH) ||
+        !impostorProgram.loadFromFiles(IMPOSTOR_VERT_PATH, IMPOSTOR_FRAG_PATH) ||
+        !fadeProgram.loadFromFiles(IMPOSTOR_FADE_VERT_PATH, IMPOSTOR_FADE_FRAG_PATH))
+    {
+        destroy();
+        return false;
+    }
+
+    bakeViewProjection = bakeProgram.getUniform("bakeViewProjection");
+    bakeUvRect = bakeProgram.getUniform("materialUvRect");
+    bakeLayer = bakeProgram.getUniform("materialLayer");
+    bakeProgram.setInt(bakeProgram.getUniform("tex0"), 0);
+
+    impostorProgram.bindUniformBlock("FrameData", UNIFORM_BINDING_FRAME);
+    impostorProgram.bindUniformBlock("LightingData", UNIFORM_BINDING_LIGHTING);
+    impostorBoundingSphere = impostorProgram.getUniform("boundingSphere");
+    impostorAtlasLayer = impostorProgram.getUniform("atlasLayer");
+    impostorReverseZ = impostorProgram.getUniform("reverseZ");
+    impostorProgram.setInt(impostorProgram.getUniform("colorAtlas"), (int)COLOR_ATLAS_UNIT);
+    impostorProgram.setInt(impostorProgram.getUniform("normalDepthAtlas"), (int)NORMAL_DEPTH_ATLAS_UNIT);
+    impostorProgram.setFloat(impostorProgram.getUniform("viewGridSize"), (float)VIEW_GRID);
+    impostorProgram.setFloat(impostorProgram.getUniform("fadeStart"), FADE_START);
+    impostorProgram.setFloat(impostorProgram.getUniform("fadeEnd"), FADE_END);
+    impostorProgram.setBool(impostorReverseZ, reverseZ);
+
+    fadeProgram.bindUniformBlock("FrameData", UNIFORM_BINDING_FRAME);
+    fadeProgram.bindUniformBlock("LightingData", UNIFORM_BINDING_LIGHTING);
+    fadeProgram.setInt(fadeProgram.getUniform("tex0"), 0);
+    fadeProgram.setFloat(fadeProgram.getUniform("fadeStart"), FADE_START);
+    fadeProgram.setFloat(fadeProgram.getUniform("fadeEnd"), FADE_END);
+
+    // Mips stop at one texel per view, so views never bleed into each other
+    GLsizei levels = GLResources::getMipLevelCount(VIEW_SIZE, VIEW_SIZE);
+    GLuint atlases[] = { 0, 0 };
+    for (GLuint& atlas : atlases)
+    {
+        atlas = GLResources::createTexture(GL_TEXTURE_2D_ARRAY, levels, GL_RGBA8, ATLAS_SIZE, ATLAS_SIZE, MAX_IMPOSTORS);
+        GLResources::setTextureParameter(atlas, GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        GLResources::setTextureParameter(atlas, GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        GLResources::setTextureParameter(atlas, GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        GLResources::setTextureParameter(atlas, GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    }
+    colorAtlas = atlases[0];
+    normalDepthAtlas = atlases[1];
+
+    // Quad corners come from gl_VertexID; only the instance transforms are read from a buffer
+    quadVertexArray = GLResources::createVertexArray();
+    for (GLuint column = 0; column < 4; column++)
+    {
+        GLResources::setAttribute(quadVertexArray, 3 + column, 4, GL_FLOAT, (GLuint)(column * sizeof(glm::vec4)),
+            IMPOSTOR_INSTANCE_BINDING);
+    }
+    GLResources::setBindingDivisor(quadVertexArray, IMPOSTOR_INSTANCE_BINDING, 1);
+
+    instanceStream.create("impostor instances", 4096 * sizeof(glm::mat4));
+    return true;
+}
+
+void ImpostorRenderer::setReverseZ(bool enabled)
+{
+    reverseZ = enabled;
+    impostorProgram.setBool(impostorReverseZ, reverseZ);
+}
+
+glm::vec3 ImpostorRenderer::octahedralDecode(const glm::vec2& encoded)
+{
+    glm::vec3 n(encoded.x, encoded.y, 1.0f - std::abs(encoded.x) - std::abs(encoded.y));
+    if (n.z < 0.0f)
+    {
+        float x = (1.0f - std::abs(encoded.y)) * (encoded.x >= 0.0f ? 1.0f : -1.0f);
+        float y = (1.0f - std::abs(encoded.x)) * (encoded.y >= 0.0f ? 1.0f : -1.0f);
+        n.x = x;
+        n.y = y;
+    }
+    return glm::normalize(n);
+}
+
+ImpostorRenderer::Impostor* ImpostorRenderer::findImpostor(MeshHandle mesh, int material)
+{
+    // Only MAX_IMPOSTORS exist, a linear search is enough
+    for (Impostor& impostor : impostors)
+    {
+        if (impostor.mesh == mesh && impostor.material == material)
+            return &impostor;
+    }
+    return nullptr;
+}
+
+bool ImpostorRenderer::bake(MeshHandle mesh, int material, const MeshRegistry& meshes, const TexturePacker& textures)
+{
+    if (!meshes.isValid(mesh) || impostors.size() >= (size_t)MAX_IMPOSTORS)
+        return false;
+
+    glm::vec4 sphere = transformBoundingSphere(meshes.getMesh(mesh), glm::mat4(1.0f));
+    glm::vec3 center(sphere);
+    float radius = std::max(sphere.w, 1e-4f);
+    GLint layer = (GLint)impostors.size();
+
+    PackedTexture packed;
+    if (material >= 0 && material < (int)textures.getPackedCount())
+        packed = textures.getPacked(material);
+
+    // Caller state restored below
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    GLfloat clearColor[4];
+    glGetFloatv(GL_COLOR_CLEAR_VALUE, clearColor);
+    GLuint callerProgram = GLStateCache::getProgram();
+    GLenum callerDepthFunc = GLStateCache::getDepthFunc();
+    bool cullFace = GLStateCache::isEnabled(GL_CULL_FACE);
+
+    GLuint framebuffer = 0;
+    GLuint depthBuffer = 0;
+    glGenFramebuffers(1, &framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, colorAtlas, 0, layer);
+    glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, normalDepthAtlas, 0, layer);
+    glGenRenderbuffers(1, &depthBuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, ATLAS_SIZE, ATLAS_SIZE);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+    const GLenum drawBuffers[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+    glDrawBuffers(2, drawBuffers);
+
+    bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    if (complete)
+    {
+        // The bake projection is a standard OpenGL orthographic one, whatever the scene uses
+        if (reverseZ)
+        {
+            glClipControl(GL_LOWER_LEFT, GL_NEGATIVE_ONE_TO_ONE);
+            glClearDepth(1.0);
+        }
+        GLStateCache::depthFunc(GL_LESS);
+        GLStateCache::disable(GL_CULL_FACE);
+
+        glViewport(0, 0, ATLAS_SIZE, ATLAS_SIZE);
+        glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+        bakeProgram.bind();
+        bakeProgram.setVec4(bakeUvRect, packed.uvRect);
+        bakeProgram.setFloat(bakeLayer, packed.layer);
+        GLStateCache::bindTexture(0, GL_TEXTURE_2D_ARRAY, packed.arrayTexture);
+        meshes.bind();
+
+        // Depth 0 and 1 are one radius in front of and behind the center
+        glm::mat4 projection = glm::ortho(-radius, radius, -radius, radius, radius, 3.0f * radius);
+        for (int y = 0; y < VIEW_GRID; y++)
+        {
+            for (int x = 0; x < VIEW_GRID; x++)
+            {
+                glm::vec2 encoded = (glm::vec2((float)x, (float)y) + 0.5f) / (float)VIEW_GRID * 2.0f - 1.0f;
+                glm::vec3 direction = octahedralDecode(encoded);
+                glm::vec3 up = std::abs(direction.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+                glm::mat4 view = glm::lookAt(center + direction * 2.0f * radius, center, up);
+
+                bakeProgram.setMat4(bakeViewProjection, projection * view);
+                bakeProgram.apply();
+                glViewport(x * VIEW_SIZE, y * VIEW_SIZE, VIEW_SIZE, VIEW_SIZE);
+                meshes.draw(mesh);
+            }
+        }
+
+        if (reverseZ)
+        {
+            glClipControl(GL_LOWER_LEFT, GL_ZERO_TO_ONE);
+            glClearDepth(0.0);
+        }
+        GLStateCache::depthFunc(callerDepthFunc);
+        if (cullFace)
+            GLStateCache::enable(GL_CULL_FACE);
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glDeleteRenderbuffers(1, &depthBuffer);
+    glDeleteFramebuffers(1, &framebuffer);
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+    glClearColor(clearColor[0], clearColor[1], clearColor[2], clearColor[3]);
+    GLStateCache::useProgram(callerProgram);
+
+    if (!complete)
+    {
+        std::cerr << "ERROR: Impostor bake framebuffer incomplete" << std::endl;
+        return false;
+    }
+
+    GLResources::generateMipmap(colorAtlas, GL_TEXTURE_2D_ARRAY);
+    GLResources::generateMipmap(normalDepthAtlas, GL_TEXTURE_2D_ARRAY);
+
+    Impostor impostor;
+    impostor.mesh = mesh;
+    impostor.material = material;
+    impostor.boundingSphere = glm::vec4(center, radius);
+    impostors.push_back(std::move(impostor));
+    return true;
+}
+
+void ImpostorRenderer::beginFrame()
+{
+    instanceStream.beginFrame();
+}
+
+void ImpostorRenderer::endFrame()
+{
+    instanceStream.endFrame();
+}
+
+void ImpostorRenderer::draw(const std::vector<Model3D>& models, const MeshRegistry& meshes,
+    const TexturePacker& textures, const Frustum& frustum, const glm::vec3& cameraPosition,
+    std::vector<Model3D>& outModels, std::vector<unsigned int>& outIndices)
+{
+    outModels.clear();
+    outIndices.clear();
+    for (Impostor& impostor : impostors)
+    {
+        impostor.instances.clear();
+        impostor.fadingMeshes.clear();
+    }
+    lastImpostorCount = lastFadingCount = lastCulledCount = 0;
+
+    for (size_t i = 0; i < models.size(); i++)
+    {
+        const Model3D& model = models[i];
+        float distance = glm::length(model.getPosition() - cameraPosition);
+        Impostor* impostor = distance >= FADE_START ? findImpostor(model.getMesh(), model.getMaterial()) : nullptr;
+        if (!impostor)
+        {
+            outModels.push_back(model);
+            outIndices.push_back((unsigned int)i);
+            continue;
+        }
+
+        glm::mat4 transform = model.getTransformMatrix();
+        float scale = std::max(glm::length(glm::vec3(transform[0])),
+            std::max(glm::length(glm::vec3(transform[1])), glm::length(glm::vec3(transform[2]))));
+        glm::vec3 center = glm::vec3(transform * glm::vec4(glm::vec3(impostor->boundingSphere), 1.0f));
+        if (!frustum.intersectsSphere(center, impostor->boundingSphere.w * scale))
+        {
+            lastCulledCount++;
+            continue;
+        }
+
+        impostor->instances.push_back(transform);
+        if (distance < FADE_END)
+        {
+            InstanceData instance = {};
+            instance.transform = transform;
+            if (model.getMaterial() < (int)textures.getPackedCount())
+            {
+                const PackedTexture& material = textures.getPacked(model.getMaterial());
+                instance.uvRect = material.uvRect;
+                instance.layer = material.layer;
+            }
+            impostor->fadingMeshes.push_back(instance);
+        }
+    }
+
+    // Meshes dissolving into their impostor; every instance of an impostor shares its material
+    for (const Impostor& impostor : impostors)
+    {
+        if (impostor.fadingMeshes.empty())
+            continue;
+
+        fadeProgram.bind();
+        if (impostor.material >= 0 && impostor.material < (int)textures.getPackedCount())
+            GLStateCache::bindTexture(0, GL_TEXTURE_2D_ARRAY, textures.getPacked(impostor.material).arrayTexture);
+        Model3D::drawInstanced(meshes, impostor.mesh, instanceStream, impostor.fadingMeshes.data(),
+            (GLsizei)impostor.fadingMeshes.size());
+        lastFadingCount += impostor.fadingMeshes.size();
+    }
+
+    // One instanced quad draw per impostor
+    for (size_t i = 0; i < impostors.size(); i++)
+    {
+        const Impostor& impostor = impostors[i];
+        if (impostor.instances.empty())
+            continue;
+
+        size_t offset = 0;
+        void* mapped = instanceStream.allocate(impostor.instances.size() * sizeof(glm::mat4), sizeof(glm::mat4), offset);
+        memcpy(mapped, impostor.instances.data(), impostor.instances.size() * sizeof(glm::mat4));
+
+        impostorProgram.bind();
+        impostorProgram.setVec4(impostorBoundingSphere, impostor.boundingSphere);
+        impostorProgram.setFloat(impostorAtlasLayer, (float)i);
+        impostorProgram.apply();
+        GLStateCache::bindTexture(COLOR_ATLAS_UNIT, GL_TEXTURE_2D_ARRAY, colorAtlas);
+        GLStateCache::bindTexture(NORMAL_DEPTH_ATLAS_UNIT, GL_TEXTURE_2D_ARRAY, normalDepthAtlas);
+        GLResources::setVertexBuffer(quadVertexArray, IMPOSTOR_INSTANCE_BINDING, instanceStream.getBuffer(),
+            (GLintptr)offset, sizeof(glm::mat4));
+        GLStateCache::bindVertexArray(quadVertexArray);
+        glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, (GLsizei)impostor.instances.size());
+        lastImpostorCount += impostor.instances.size();
+    }
+}
+
+void ImpostorRenderer::printStats() const
+{
+    std::cout << "Impostors: " << impostors.size() << " baked, " << lastImpostorCount << " drawn ("
+        << lastFadingCount << " crossfading with their mesh), " << lastCulledCount << " culled" << std::endl;
+    instanceStream.printStats();
+}
+
+void ImpostorRenderer::destroy()
+{
+    bakeProgram.destroy();
+    impostorProgram.destroy();
+    fadeProgram.destroy();
+    instanceStream.destroy();
+
+    GLuint atlases[] = { colorAtlas, normalDepthAtlas };
+    GLStateCache::deleteTextures(2, atlases);
+    colorAtlas = normalDepthAtlas = 0;
+    if (quadVertexArray != 0)
+        GLStateCache::deleteVertexArrays(1, &quadVertexArray);
+    quadVertexArray = 0;
+    impostors.clear();
+}
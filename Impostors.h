@@ -0,0 +1,138 @@
+#pragma once
+#include <vector>
+#include <glm/glm.hpp>
+#include <glad/gl.h>
+#include "Frustum.h"
+#include "MeshRegistry.h"
+#include "Model3D.h"
+#include "ShaderProgram.h"
+#include "StreamBuffer.h"
+#include "TexturePacker.h"
+
+/**
+ * @class ImpostorRenderer
+ * @brief Draws far-away instances as octahedral impostor billboards
+ *
+ * bake() renders a mesh at load time into one layer of two atlas arrays
+ * through an offscreen framebuffer: VIEW_GRID x VIEW_GRID orthographic views
+ * of its bounding sphere, one per direction of an octahedral mapping of the
+ * sphere. The color atlas keeps the textured mesh (alpha = coverage), the
+ * normal/depth atlas its object-space normal and its depth within the sphere.
+ *
+ * draw() sorts the models by distance to the camera:
+ * - closer than FADE_START: handed back to the regular draw path
+ * - between FADE_START and FADE_END: drawn both as the instanced mesh and as
+ *   the impostor, each keeping the complementary pixels of a screen-door
+ *   dither, so the mesh dissolves into the impostor without blending
+ * - farther: impostor only
+ *
+ * Impostors are one instanced draw of 4-vertex quads per baked mesh. The
+ * vertex shader picks the four views closest to the camera direction in
+ * object space and the fragment shader blends them, then moves its depth by
+ * the baked depth so impostors intersect the scene like the mesh would.
+ */
+class ImpostorRenderer
+{
+public:
+    static const int VIEW_GRID = 8;         // Octahedral views per atlas side
+    static const int VIEW_SIZE = 64;        // Texels per view side
+    static const int ATLAS_SIZE = VIEW_GRID * VIEW_SIZE;
+    static const int MAX_IMPOSTORS = 8;     // Atlas layers
+
+    // Crossfade band, by distance from the camera to the model origin
+    static constexpr float FADE_START = 80.0f;
+    static constexpr float FADE_END = 90.0f;
+
+private:
+    struct Impostor
+    {
+        MeshHandle mesh;
+        int material;
+        glm::vec4 boundingSphere;   // Object space
+        std::vector<glm::mat4> instances;           // This frame's impostors
+        std::vector<InstanceData> fadingMeshes;     // This frame's meshes inside the crossfade band
+    };
+
+    ShaderProgram bakeProgram;
+    ShaderProgram impostorProgram;
+    ShaderProgram fadeProgram;
+    ShaderProgram::UniformHandle bakeViewProjection;
+    ShaderProgram::UniformHandle bakeUvRect;
+    ShaderProgram::UniformHandle bakeLayer;
+    ShaderProgram::UniformHandle impostorBoundingSphere;
+    ShaderProgram::UniformHandle impostorAtlasLayer;
+    ShaderProgram::UniformHandle impostorReverseZ;
+
+    GLuint colorAtlas;
+    GLuint normalDepthAtlas;
+    GLuint quadVertexArray;
+    StreamBuffer instanceStream;
+    bool reverseZ;
+
+    std::vector<Impostor> impostors;
+
+    size_t lastImpostorCount;
+    size_t lastFadingCount;
+    size_t lastCulledCount;
+
+    /**
+     * Unit vector of an atlas cell center (inverse of the mapping in Shaders/impostor.vert)
+     */
+    static glm::vec3 octahedralDecode(const glm::vec2& encoded);
+
+    /**
+     * Baked impostor of a mesh and material, or nullptr
+     */
+    Impostor* findImpostor(MeshHandle mesh, int material);
+
+public:
+    ImpostorRenderer();
+
+    ImpostorRenderer(const ImpostorRenderer&) = delete;
+    ImpostorRenderer& operator=(const ImpostorRenderer&) = delete;
+
+    /**
+     * Load the programs and create the atlases
+     * @return False if a program failed to load
+     */
+    bool create();
+
+    /**
+     * Match the depth convention of the scene (see Camera::setReverseZ)
+     */
+    void setReverseZ(bool enabled);
+
+    /**
+     * Render the views of a mesh into the next atlas layer
+     * Restores the framebuffer, viewport and depth state of the caller
+     * @param mesh Mesh to bake
+     * @param material Material index the impostor stands for (see TexturePacker)
+     * @return False if the atlas is full or the framebuffer is incomplete
+     */
+    bool bake(MeshHandle mesh, int material, const MeshRegistry& meshes, const TexturePacker& textures);
+
+    void beginFrame();
+    void endFrame();
+
+    /**
+     * Draw the impostors of distant models and collect the models still drawn as meshes
+     * Binds its own programs; the caller rebinds whatever it draws next
+     * @param models Models to draw
+     * @param frustum Camera frustum the impostors are culled against
+     * @param cameraPosition Distances are measured from here
+     * @param outModels Receives the models closer than FADE_START or without an impostor (cleared first)
+     * @param outIndices Receives the index in models of each of outModels (cleared first)
+     */
+    void draw(const std::vector<Model3D>& models, const MeshRegistry& meshes, const TexturePacker& textures,
+        const Frustum& frustum, const glm::vec3& cameraPosition, std::vector<Model3D>& outModels,
+        std::vector<unsigned int>& outIndices);
+
+    size_t getImpostorCount() const { return impostors.size(); }
+
+    /**
+     * Print how the last frame's models were split
+     */
+    void printStats() const;
+
+    void destroy();
+};
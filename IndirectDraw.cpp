@@ -0,0 +1,171 @@
+#include "IndirectDraw.h"
+#include "GLStateCache.h"
+#include "UniformBuffers.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+IndirectBatcher::IndirectBatcher()
+    : storageAlignment(16),
+    lastInstanceOffset(0),
+    lastInstanceBytes(0),
+    lastCommandOffset(0),
+    lastCommandCount(0),
+    lastDrawCallCount(0)
+{
+}
+
+void IndirectBatcher::create(size_t instanceCapacity, size_t commandCapacity)
+{
+    glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &storageAlignment);
+    instanceStream.create("indirect instances", instanceCapacity * sizeof(InstanceData));
+    commandStream.create("indirect commands", commandCapacity * sizeof(DrawElementsIndirectCommand));
+}
+
+void IndirectBatcher::beginFrame()
+{
+    instanceStream.beginFrame();
+    commandStream.beginFrame();
+}
+
+void IndirectBatcher::endFrame()
+{
+    instanceStream.endFrame();
+    commandStream.endFrame();
+}
+
+void IndirectBatcher::clear()
+{
+    // Batches are kept so their vectors keep their capacity between frames
+    for (Batch& batch : batches)
+        batch.instances.clear();
+}
+
+void IndirectBatcher::add(MeshHandle mesh, GLuint arrayTexture, const InstanceData& instance)
+{
+    unsigned long long key = ((unsigned long long)arrayTexture << 32) | (unsigned int)mesh;
+    auto found = batchLookup.find(key);
+    if (found == batchLookup.end())
+    {
+        found = batchLookup.emplace(key, batches.size()).first;
+        batches.push_back({ arrayTexture, mesh, {} });
+    }
+    batches[found->second].instances.push_back(instance);
+}
+
+void IndirectBatcher::submit(const MeshRegistry& meshes, VertexInput input)
+{
+    lastCommandCount = 0;
+    lastDrawCallCount = 0;
+
+    // Non-empty batches, grouped by texture array
+    submitOrder.clear();
+    size_t instanceCount = 0;
+    for (size_t i = 0; i < batches.size(); i++)
+    {
+        if (!batches[i].instances.empty() && meshes.isValid(batches[i].mesh))
+        {
+            submitOrder.push_back(i);
+            instanceCount += batches[i].instances.size();
+        }
+    }
+    if (submitOrder.empty())
+        return;
+
+    std::sort(submitOrder.begin(), submitOrder.end(), [this](size_t a, size_t b) {
+        if (batches[a].arrayTexture != batches[b].arrayTexture)
+            return batches[a].arrayTexture < batches[b].arrayTexture;
+        return batches[a].mesh < batches[b].mesh;
+    });
+
+    // Instances and commands go straight into the mapped streams
+    size_t instanceOffset = 0;
+    size_t commandOffset = 0;
+    InstanceData* instances = (InstanceData*)instanceStream.allocate(instanceCount * sizeof(InstanceData),
+        (size_t)storageAlignment, instanceOffset);
+    DrawElementsIndirectCommand* commands = (DrawElementsIndirectCommand*)commandStream.allocate(
+        submitOrder.size() * sizeof(DrawElementsIndirectCommand), sizeof(GLuint), commandOffset);
+
+    GLuint baseInstance = 0;
+    for (size_t i = 0; i < submitOrder.size(); i++)
+    {
+        const Batch& batch = batches[submitOrder[i]];
+        const MeshInfo& mesh = meshes.getMesh(batch.mesh);
+
+        memcpy(instances + baseInstance, batch.instances.data(), batch.instances.size() * sizeof(InstanceData));
+
+        DrawElementsIndirectCommand& command = commands[i];
+        command.count = (GLuint)mesh.indexCount;
+        command.instanceCount = (GLuint)batch.instances.size();
+        command.firstIndex = mesh.firstIndex;
+        command.baseVertex = mesh.baseVertex;
+        command.baseInstance = baseInstance;
+        baseInstance += command.instanceCount;
+    }
+
+    lastInstanceOffset = instanceOffset;
+    lastInstanceBytes = instanceCount * sizeof(InstanceData);
+    lastCommandOffset = commandOffset;
+    lastCommandCount = submitOrder.size();
+    drawCommands(meshes, input);
+}
+
+void IndirectBatcher::redraw(const MeshRegistry& meshes, VertexInput input)
+{
+    if (lastCommandCount > 0)
+        drawCommands(meshes, input);
+}
+
+void IndirectBatcher::drawCommands(const MeshRegistry& meshes, VertexInput input)
+{
+    GLStateCache::bindBufferRange(GL_SHADER_STORAGE_BUFFER, STORAGE_BINDING_INSTANCES, instanceStream.getBuffer(),
+        (GLintptr)lastInstanceOffset, (GLsizeiptr)lastInstanceBytes);
+    GLStateCache::bindBuffer(GL_DRAW_INDIRECT_BUFFER, commandStream.getBuffer());
+    if (input == VERTEX_POSITIONS)
+        meshes.bindPositions();
+    else if (input == VERTEX_PULLED)
+        meshes.bindPulling();
+    else
+        meshes.bind();
+
+    // Depth-only draws sample no texture, so every command goes into one multi-draw
+    if (input == VERTEX_POSITIONS)
+    {
+        glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (const void*)lastCommandOffset,
+            (GLsizei)lastCommandCount, 0);
+        lastDrawCallCount++;
+        return;
+    }
+
+    // One multi-draw per texture array
+    size_t first = 0;
+    while (first < submitOrder.size())
+    {
+        GLuint arrayTexture = batches[submitOrder[first]].arrayTexture;
+        size_t last = first + 1;
+        while (last < submitOrder.size() && batches[submitOrder[last]].arrayTexture == arrayTexture)
+            last++;
+
+        GLStateCache::bindTexture(0, GL_TEXTURE_2D_ARRAY, arrayTexture);
+        glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT,
+            (const void*)(lastCommandOffset + first * sizeof(DrawElementsIndirectCommand)), (GLsizei)(last - first), 0);
+        lastDrawCallCount++;
+        first = last;
+    }
+}
+
+void IndirectBatcher::printStats() const
+{
+    std::cout << "Multi-draw indirect: " << lastCommandCount << " commands in " << lastDrawCallCount
+        << " draw calls" << std::endl;
+    instanceStream.printStats();
+    commandStream.printStats();
+}
+
+void IndirectBatcher::destroy()
+{
+    instanceStream.destroy();
+    commandStream.destroy();
+    batches.clear();
+    batchLookup.clear();
+}
@@ -0,0 +1,122 @@
+#pragma once
+#include <unordered_map>
+#include <vector>
+#include <glad/gl.h>
+#include "MeshRegistry.h"
+#include "Model3D.h"
+#include "StreamBuffer.h"
+
+/**
+ * @struct DrawElementsIndirectCommand
+ * @brief Layout GL reads from GL_DRAW_INDIRECT_BUFFER for glMultiDrawElementsIndirect
+ */
+struct DrawElementsIndirectCommand
+{
+    GLuint count;           // Indices of the mesh
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint baseInstance;    // First entry of the batch in the instance SSBO
+};
+
+/**
+ * @class IndirectBatcher
+ * @brief Submits every mesh of the registry with glMultiDrawElementsIndirect
+ *
+ * Instances are collected into one batch per (texture array, mesh). submit()
+ * writes all instance data into one shader storage range and one indirect
+ * command per batch into a command buffer, both persistently mapped streams,
+ * then issues one glMultiDrawElementsIndirect per texture array. The vertex
+ * shader fetches its instance with gl_BaseInstance + gl_InstanceID, so the
+ * CPU cost no longer depends on how many distinct meshes are drawn.
+ *
+ * redraw() issues the last submit's commands again with another program and
+ * vertex input, e.g. the main pass after a depth pre-pass.
+ */
+class IndirectBatcher
+{
+public:
+    // Where the vertex shader gets its vertices from (see MeshRegistry)
+    enum VertexInput
+    {
+        VERTEX_ATTRIBUTES,  // Full MeshVertex attributes
+        VERTEX_POSITIONS,   // Position stream only (depth-only passes)
+        VERTEX_PULLED       // Packed vertices fetched from a storage buffer
+    };
+
+private:
+    struct Batch
+    {
+        GLuint arrayTexture;
+        MeshHandle mesh;
+        std::vector<InstanceData> instances;
+    };
+
+    std::vector<Batch> batches;
+    std::unordered_map<unsigned long long, size_t> batchLookup;   // (texture, mesh) -> batch
+    std::vector<size_t> submitOrder;
+    StreamBuffer instanceStream;
+    StreamBuffer commandStream;
+    GLint storageAlignment;
+    size_t lastInstanceOffset;
+    size_t lastInstanceBytes;
+    size_t lastCommandOffset;
+    size_t lastCommandCount;
+    size_t lastDrawCallCount;
+
+    /**
+     * Bind the instances, commands and vertex input of the last submit and multi-draw them
+     */
+    void drawCommands(const MeshRegistry& meshes, VertexInput input);
+
+public:
+    IndirectBatcher();
+
+    IndirectBatcher(const IndirectBatcher&) = delete;
+    IndirectBatcher& operator=(const IndirectBatcher&) = delete;
+
+    /**
+     * Create the instance and command streams
+     * @param instanceCapacity Initial instances per frame
+     * @param commandCapacity Initial commands per frame
+     */
+    void create(size_t instanceCapacity, size_t commandCapacity);
+
+    void beginFrame();
+    void endFrame();
+
+    /**
+     * Forget the instances collected for the previous submit
+     */
+    void clear();
+
+    /**
+     * Queue one instance of a mesh
+     */
+    void add(MeshHandle mesh, GLuint arrayTexture, const InstanceData& instance);
+
+    /**
+     * Write instances and commands and draw them
+     * The program reading the "InstanceBuffer" block must be bound
+     * @param meshes Registry the queued meshes live in
+     * @param input Vertex input the bound program expects
+     */
+    void submit(const MeshRegistry& meshes, VertexInput input = VERTEX_ATTRIBUTES);
+
+    /**
+     * Draw the last submit's commands again (same frame, instances unchanged)
+     * @param meshes Registry passed to submit()
+     * @param input Vertex input the bound program expects
+     */
+    void redraw(const MeshRegistry& meshes, VertexInput input);
+
+    size_t getLastCommandCount() const { return lastCommandCount; }
+    size_t getLastDrawCallCount() const { return lastDrawCallCount; }
+
+    /**
+     * Print the stream buffer counters
+     */
+    void printStats() const;
+
+    void destroy();
+};
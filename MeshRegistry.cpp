@@ -0,0 +1,412 @@
+#include "MeshRegistry.h"
+#include "GLResources.h"
+#include "GLStateCache.h"
+#include "UniformBuffers.h"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <iostream>
+
+// Smallest ranges handed out by the suballocators (elements)
+static const size_t MIN_VERTEX_BLOCK = 64;
+static const size_t MIN_INDEX_BLOCK = 256;
+
+// Free space scattered enough that packing the meshes is worth the copies
+static bool isFragmented(const BuddyAllocator& allocator)
+{
+    size_t freeElements = allocator.getCapacity() - allocator.getUsed();
+    return allocator.getLargestFreeBlock() * 2 < freeElements;
+}
+
+glm::vec4 transformBoundingSphere(const MeshInfo& mesh, const glm::mat4& transform)
+{
+    glm::vec3 center = (mesh.boundsMin + mesh.boundsMax) * 0.5f;
+    float radius = glm::length(mesh.boundsMax - mesh.boundsMin) * 0.5f;
+
+    // Largest axis scale keeps the sphere conservative
+    float scale = glm::max(glm::length(glm::vec3(transform[0])),
+        glm::max(glm::length(glm::vec3(transform[1])), glm::length(glm::vec3(transform[2]))));
+    return glm::vec4(glm::vec3(transform * glm::vec4(center, 1.0f)), radius * scale);
+}
+
+void transformBoundingBox(const MeshInfo& mesh, const glm::mat4& transform, glm::vec3& outMin, glm::vec3& outMax)
+{
+    // Arvo: each matrix column extends the box by its smaller/larger product with the bounds
+    outMin = outMax = glm::vec3(transform[3]);
+    for (int column = 0; column < 3; column++)
+    {
+        glm::vec3 axis(transform[column]);
+        glm::vec3 a = axis * mesh.boundsMin[column];
+        glm::vec3 b = axis * mesh.boundsMax[column];
+        outMin += glm::min(a, b);
+        outMax += glm::max(a, b);
+    }
+}
+
+PackedVertex packVertex(const MeshVertex& vertex)
+{
+    // Octahedral normal: project onto the octahedron, fold the lower half over the upper one
+    float length = std::abs(vertex.normal.x) + std::abs(vertex.normal.y) + std::abs(vertex.normal.z);
+    glm::vec3 n = vertex.normal / std::max(length, 1e-8f);
+    glm::vec2 octahedral(n.x, n.y);
+    if (n.z < 0.0f)
+    {
+        octahedral = glm::vec2((1.0f - std::abs(n.y)) * (n.x >= 0.0f ? 1.0f : -1.0f),
+            (1.0f - std::abs(n.x)) * (n.y >= 0.0f ? 1.0f : -1.0f));
+    }
+
+    PackedVertex packed;
+    packed.positionXY = glm::packHalf2x16(glm::vec2(vertex.position.x, vertex.position.y));
+    packed.positionZ = glm::packHalf2x16(glm::vec2(vertex.position.z, 0.0f));
+    packed.normal = glm::packSnorm2x16(octahedral);
+    packed.texCoord = glm::packHalf2x16(vertex.texCoord);
+    return packed;
+}
+
+MeshRegistry::MeshRegistry()
+    : vertexArray(0),
+    vertexBuffer(0),
+    indexBuffer(0),
+    pullingVertexArray(0),
+    packedVertexBuffer(0),
+    positionVertexArray(0),
+    positionBuffer(0)
+{
+}
+
+void MeshRegistry::create(size_t vertexCapacity, size_t indexCapacity)
+{
+    destroy();
+
+    vertexAllocator.reset(vertexCapacity, MIN_VERTEX_BLOCK);
+    indexAllocator.reset(indexCapacity, MIN_INDEX_BLOCK);
+    vertexBuffer = reallocateBuffer(0, vertexAllocator.getCapacity() * sizeof(MeshVertex), 0);
+    indexBuffer = reallocateBuffer(0, indexAllocator.getCapacity() * sizeof(unsigned int), 0);
+
+    // One vertex format for every mesh, read from a single vertex buffer binding
+    vertexArray = GLResources::createVertexArray();
+    GLResources::setAttribute(vertexArray, 0, 3, GL_FLOAT, (GLuint)offsetof(MeshVertex, position), VERTEX_BUFFER_BINDING);
+    GLResources::setAttribute(vertexArray, 1, 3, GL_FLOAT, (GLuint)offsetof(MeshVertex, normal), VERTEX_BUFFER_BINDING);
+    GLResources::setAttribute(vertexArray, 2, 2, GL_FLOAT, (GLuint)offsetof(MeshVertex, texCoord), VERTEX_BUFFER_BINDING);
+
+    // Depth-only passes read a separate position stream
+    positionBuffer = reallocateBuffer(0, vertexAllocator.getCapacity() * sizeof(glm::vec3), 0);
+    positionVertexArray = GLResources::createVertexArray();
+    GLResources::setAttribute(positionVertexArray, 0, 3, GL_FLOAT, 0, VERTEX_BUFFER_BINDING);
+
+    // Vertex pulling reads a packed copy from a storage buffer (OpenGL 4.3)
+    if (GLAD_GL_VERSION_4_3)
+    {
+        pullingVertexArray = GLResources::createVertexArray();
+        packedVertexBuffer = reallocateBuffer(0, vertexAllocator.getCapacity() * sizeof(PackedVertex), 0);
+    }
+
+    attachBuffers();
+}
+
+GLuint MeshRegistry::reallocateBuffer(GLuint oldBuffer, size_t newBytes, size_t copyBytes)
+{
+    // Only ever written by GPU copies, so the driver is free to keep it in video memory
+    GLuint buffer = GLResources::createBuffer(newBytes, nullptr, 0);
+
+    if (oldBuffer != 0)
+    {
+        // GPU-side copy; draws still pending keep the old storage alive
+        if (copyBytes > 0)
+            GLResources::copyBuffer(oldBuffer, buffer, 0, 0, copyBytes);
+        GLStateCache::deleteBuffers(1, &oldBuffer);
+    }
+    return buffer;
+}
+
+void MeshRegistry::upload(GLuint buffer, size_t offset, size_t bytes, const void* data)
+{
+    // Deleting right away is fine, the copy keeps the staging storage alive until it ran
+    GLuint staging = GLResources::createBuffer((GLsizeiptr)bytes, data, 0);
+    GLResources::copyBuffer(staging, buffer, 0, (GLintptr)offset, (GLsizeiptr)bytes);
+    GLStateCache::deleteBuffers(1, &staging);
+}
+
+void MeshRegistry::attachBuffers()
+{
+    GLResources::setVertexBuffer(vertexArray, VERTEX_BUFFER_BINDING, vertexBuffer, 0, sizeof(MeshVertex));
+    GLResources::setElementBuffer(vertexArray, indexBuffer);
+    GLResources::setVertexBuffer(positionVertexArray, VERTEX_BUFFER_BINDING, positionBuffer, 0, sizeof(glm::vec3));
+    GLResources::setElementBuffer(positionVertexArray, indexBuffer);
+    if (pullingVertexArray != 0)
+        GLResources::setElementBuffer(pullingVertexArray, indexBuffer);
+}
+
+MeshHandle MeshRegistry::addMesh(const std::string& name, const std::vector<MeshVertex>& vertices,
+    const std::vector<unsigned int>& indices)
+{
+    if (vertices.empty() || indices.empty())
+        return INVALID_MESH;
+
+    // Same name, same mesh: overwriting the lookup would orphan the old ranges
+    MeshHandle existing = findMesh(name);
+    if (existing != INVALID_MESH)
+        return existing;
+
+    // Reserve ranges, growing the buffers until they fit
+    size_t vertexOffset = 0;
+    bool grown = false;
+    while (!vertexAllocator.allocate(vertices.size(), vertexOffset))
+    {
+        size_t oldBytes = vertexAllocator.getCapacity() * sizeof(MeshVertex);
+        vertexAllocator.grow();
+        vertexBuffer = reallocateBuffer(vertexBuffer, vertexAllocator.getCapacity() * sizeof(MeshVertex), oldBytes);
+        positionBuffer = reallocateBuffer(positionBuffer, vertexAllocator.getCapacity() * sizeof(glm::vec3),
+            oldBytes / sizeof(MeshVertex) * sizeof(glm::vec3));
+        if (packedVertexBuffer != 0)
+        {
+            packedVertexBuffer = reallocateBuffer(packedVertexBuffer,
+                vertexAllocator.getCapacity() * sizeof(PackedVertex), oldBytes / sizeof(MeshVertex) * sizeof(PackedVertex));
+        }
+        grown = true;
+    }
+
+    size_t indexOffset = 0;
+    while (!indexAllocator.allocate(indices.size(), indexOffset))
+    {
+        size_t oldBytes = indexAllocator.getCapacity() * sizeof(unsigned int);
+        indexAllocator.grow();
+        indexBuffer = reallocateBuffer(indexBuffer, indexAllocator.getCapacity() * sizeof(unsigned int), oldBytes);
+        grown = true;
+    }
+
+    if (grown)
+        attachBuffers();
+
+    // Upload through staging buffers, the registry's buffers are GPU-written only
+    upload(vertexBuffer, vertexOffset * sizeof(MeshVertex), vertices.size() * sizeof(MeshVertex), vertices.data());
+    upload(indexBuffer, indexOffset * sizeof(unsigned int), indices.size() * sizeof(unsigned int), indices.data());
+
+    std::vector<glm::vec3> positions(vertices.size());
+    for (size_t i = 0; i < vertices.size(); i++)
+        positions[i] = vertices[i].position;
+    upload(positionBuffer, vertexOffset * sizeof(glm::vec3), positions.size() * sizeof(glm::vec3), positions.data());
+
+    if (packedVertexBuffer != 0)
+    {
+        std::vector<PackedVertex> packed(vertices.size());
+        for (size_t i = 0; i < vertices.size(); i++)
+            packed[i] = packVertex(vertices[i]);
+        upload(packedVertexBuffer, vertexOffset * sizeof(PackedVertex), packed.size() * sizeof(PackedVertex), packed.data());
+    }
+
+    MeshInfo info;
+    info.name = name;
+    info.baseVertex = (GLint)vertexOffset;
+    info.firstIndex = (GLuint)indexOffset;
+    info.indexCount = (GLsizei)indices.size();
+    info.vertexCount = (GLsizei)vertices.size();
+    info.boundsMin = vertices[0].position;
+    info.boundsMax = vertices[0].position;
+    for (const MeshVertex& vertex : vertices)
+    {
+        info.boundsMin = glm::min(info.boundsMin, vertex.position);
+        info.boundsMax = glm::max(info.boundsMax, vertex.position);
+    }
+    info.loaded = true;
+
+    // Reuse the slot of a removed mesh if there is one
+    MeshHandle handle;
+    if (!freeHandles.empty())
+    {
+        handle = freeHandles.back();
+        freeHandles.pop_back();
+        meshes[handle] = info;
+    }
+    else
+    {
+        handle = (MeshHandle)meshes.size();
+        meshes.push_back(info);
+    }
+    meshLookup[name] = handle;
+    return handle;
+}
+
+void MeshRegistry::removeMesh(MeshHandle mesh)
+{
+    if (!isValid(mesh))
+        return;
+
+    MeshInfo& info = meshes[mesh];
+    vertexAllocator.free((size_t)info.baseVertex);
+    indexAllocator.free((size_t)info.firstIndex);
+    meshLookup.erase(info.name);
+    info.loaded = false;
+    freeHandles.push_back(mesh);
+
+    // Compact once the largest hole is under half the free space
+    if (isFragmented(vertexAllocator) || isFragmented(indexAllocator))
+        defragment();
+}
+
+void MeshRegistry::defragment()
+{
+    // Largest first: power-of-two blocks placed in descending order leave no holes
+    std::vector<MeshHandle> order;
+    for (MeshHandle mesh = 0; mesh < (MeshHandle)meshes.size(); mesh++)
+    {
+        if (meshes[mesh].loaded)
+            order.push_back(mesh);
+    }
+    std::sort(order.begin(), order.end(), [this](MeshHandle a, MeshHandle b) {
+        return meshes[a].vertexCount > meshes[b].vertexCount;
+    });
+
+    BuddyAllocator packedVertices(MIN_VERTEX_BLOCK, MIN_VERTEX_BLOCK);
+    BuddyAllocator packedIndices(MIN_INDEX_BLOCK, MIN_INDEX_BLOCK);
+    std::vector<size_t> vertexOffsets(meshes.size(), 0);
+    std::vector<size_t> indexOffsets(meshes.size(), 0);
+    for (MeshHandle mesh : order)
+    {
+        while (!packedVertices.allocate(meshes[mesh].vertexCount, vertexOffsets[mesh]))
+            packedVertices.grow();
+    }
+    std::sort(order.begin(), order.end(), [this](MeshHandle a, MeshHandle b) {
+        return meshes[a].indexCount > meshes[b].indexCount;
+    });
+    for (MeshHandle mesh : order)
+    {
+        while (!packedIndices.allocate(meshes[mesh].indexCount, indexOffsets[mesh]))
+            packedIndices.grow();
+    }
+
+    // Copy every mesh into fresh buffers at its packed offset
+    GLuint newVertexBuffer = reallocateBuffer(0, packedVertices.getCapacity() * sizeof(MeshVertex), 0);
+    GLuint newIndexBuffer = reallocateBuffer(0, packedIndices.getCapacity() * sizeof(unsigned int), 0);
+    GLuint newPositionBuffer = reallocateBuffer(0, packedVertices.getCapacity() * sizeof(glm::vec3), 0);
+    GLuint newPackedVertexBuffer = 0;
+    if (packedVertexBuffer != 0)
+        newPackedVertexBuffer = reallocateBuffer(0, packedVertices.getCapacity() * sizeof(PackedVertex), 0);
+    for (MeshHandle mesh : order)
+    {
+        MeshInfo& info = meshes[mesh];
+
+        GLResources::copyBuffer(vertexBuffer, newVertexBuffer, info.baseVertex * sizeof(MeshVertex),
+            vertexOffsets[mesh] * sizeof(MeshVertex), info.vertexCount * sizeof(MeshVertex));
+        GLResources::copyBuffer(indexBuffer, newIndexBuffer, info.firstIndex * sizeof(unsigned int),
+            indexOffsets[mesh] * sizeof(unsigned int), info.indexCount * sizeof(unsigned int));
+        GLResources::copyBuffer(positionBuffer, newPositionBuffer, info.baseVertex * sizeof(glm::vec3),
+            vertexOffsets[mesh] * sizeof(glm::vec3), info.vertexCount * sizeof(glm::vec3));
+        if (packedVertexBuffer != 0)
+        {
+            GLResources::copyBuffer(packedVertexBuffer, newPackedVertexBuffer, info.baseVertex * sizeof(PackedVertex),
+                vertexOffsets[mesh] * sizeof(PackedVertex), info.vertexCount * sizeof(PackedVertex));
+        }
+
+        info.baseVertex = (GLint)vertexOffsets[mesh];
+        info.firstIndex = (GLuint)indexOffsets[mesh];
+    }
+
+    GLStateCache::deleteBuffers(1, &vertexBuffer);
+    GLStateCache::deleteBuffers(1, &indexBuffer);
+    GLStateCache::deleteBuffers(1, &positionBuffer);
+    vertexBuffer = newVertexBuffer;
+    indexBuffer = newIndexBuffer;
+    positionBuffer = newPositionBuffer;
+    if (packedVertexBuffer != 0)
+    {
+        GLStateCache::deleteBuffers(1, &packedVertexBuffer);
+        packedVertexBuffer = newPackedVertexBuffer;
+    }
+    vertexAllocator = packedVertices;
+    indexAllocator = packedIndices;
+    attachBuffers();
+}
+
+MeshHandle MeshRegistry::findMesh(const std::string& name) const
+{
+    auto found = meshLookup.find(name);
+    return (found != meshLookup.end()) ? found->second : INVALID_MESH;
+}
+
+bool MeshRegistry::isValid(MeshHandle mesh) const
+{
+    return mesh >= 0 && mesh < (MeshHandle)meshes.size() && meshes[mesh].loaded;
+}
+
+void MeshRegistry::bind() const
+{
+    GLStateCache::bindVertexArray(vertexArray);
+}
+
+void MeshRegistry::bindPositions() const
+{
+    GLStateCache::bindVertexArray(positionVertexArray);
+}
+
+void MeshRegistry::bindPulling() const
+{
+    GLStateCache::bindVertexArray(pullingVertexArray);
+    GLStateCache::bindBufferRange(GL_SHADER_STORAGE_BUFFER, STORAGE_BINDING_PULLED_VERTICES, packedVertexBuffer, 0,
+        (GLsizeiptr)(vertexAllocator.getCapacity() * sizeof(PackedVertex)));
+}
+
+void MeshRegistry::draw(MeshHandle mesh) const
+{
+    const MeshInfo& info = meshes[mesh];
+    glDrawElementsBaseVertex(GL_TRIANGLES, info.indexCount, GL_UNSIGNED_INT,
+        (void*)(info.firstIndex * sizeof(unsigned int)), info.baseVertex);
+}
+
+void MeshRegistry::drawInstanced(MeshHandle mesh, GLsizei instanceCount) const
+{
+    const MeshInfo& info = meshes[mesh];
+    glDrawElementsInstancedBaseVertex(GL_TRIANGLES, info.indexCount, GL_UNSIGNED_INT,
+        (void*)(info.firstIndex * sizeof(unsigned int)), instanceCount, info.baseVertex);
+}
+
+void MeshRegistry::printStats() const
+{
+    std::cout << "Mesh registry: " << meshLookup.size() << " meshes" << std::endl;
+    std::cout << "  - Vertices: " << vertexAllocator.getUsed() << " / " << vertexAllocator.getCapacity()
+        << " (largest free block " << vertexAllocator.getLargestFreeBlock() << ")" << std::endl;
+    std::cout << "  - Indices: " << indexAllocator.getUsed() << " / " << indexAllocator.getCapacity()
+        << " (largest free block " << indexAllocator.getLargestFreeBlock() << ")" << std::endl;
+}
+
+void MeshRegistry::destroy()
+{
+    if (vertexArray != 0)
+    {
+        GLStateCache::deleteVertexArrays(1, &vertexArray);
+        vertexArray = 0;
+    }
+    if (vertexBuffer != 0)
+    {
+        GLStateCache::deleteBuffers(1, &vertexBuffer);
+        vertexBuffer = 0;
+    }
+    if (indexBuffer != 0)
+    {
+        GLStateCache::deleteBuffers(1, &indexBuffer);
+        indexBuffer = 0;
+    }
+    if (positionVertexArray != 0)
+    {
+        GLStateCache::deleteVertexArrays(1, &positionVertexArray);
+        positionVertexArray = 0;
+    }
+    if (positionBuffer != 0)
+    {
+        GLStateCache::deleteBuffers(1, &positionBuffer);
+        positionBuffer = 0;
+    }
+    if (pullingVertexArray != 0)
+    {
+        GLStateCache::deleteVertexArrays(1, &pullingVertexArray);
+        pullingVertexArray = 0;
+    }
+    if (packedVertexBuffer != 0)
+    {
+        GLStateCache::deleteBuffers(1, &packedVertexBuffer);
+        packedVertexBuffer = 0;
+    }
+    meshes.clear();
+    freeHandles.clear();
+    meshLookup.clear();
+}
@@ -0,0 +1,231 @@
+#pragma once
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <glm/glm.hpp>
+#include <glad/gl.h>
+#include "BuddyAllocator.h"
+
+/**
+ * @struct MeshVertex
+ * @brief Vertex format shared by every registered mesh
+ *
+ * Attribute locations: 0 position, 1 normal, 2 texture coordinate.
+ */
+struct MeshVertex
+{
+    glm::vec3 position;
+    glm::vec3 normal;
+    glm::vec2 texCoord;
+};
+
+/**
+ * @struct PackedVertex
+ * @brief Quantized copy of a MeshVertex read by vertex pulling (16 bytes)
+ *
+ * Decoded in Shaders/pulled.vert with the matching GLSL unpack functions:
+ * - positionXY: half x, y
+ * - positionZ: half z (high half unused)
+ * - normal: octahedral normal, 2 x snorm16
+ * - texCoord: half u, v
+ */
+struct PackedVertex
+{
+    GLuint positionXY;
+    GLuint positionZ;
+    GLuint normal;
+    GLuint texCoord;
+};
+
+/**
+ * Quantize a vertex for vertex pulling
+ */
+PackedVertex packVertex(const MeshVertex& vertex);
+
+// Index of a mesh in the registry, -1 if none
+typedef int MeshHandle;
+const MeshHandle INVALID_MESH = -1;
+
+/**
+ * @struct MeshInfo
+ * @brief Where a mesh lives inside the shared vertex/index buffers
+ */
+struct MeshInfo
+{
+    std::string name;
+    GLint baseVertex;       // First vertex in the vertex buffer (indices are mesh-local)
+    GLuint firstIndex;      // First index in the index buffer
+    GLsizei indexCount;
+    GLsizei vertexCount;
+    glm::vec3 boundsMin;    // Object-space bounding box
+    glm::vec3 boundsMax;
+    bool loaded;
+};
+
+/**
+ * World-space bounding sphere of a mesh placed with a transform
+ * @param mesh Mesh whose object-space bounds are used
+ * @param transform Object to world matrix (may contain non-uniform scale)
+ * @return xyz = center, w = radius
+ */
+glm::vec4 transformBoundingSphere(const MeshInfo& mesh, const glm::mat4& transform);
+
+/**
+ * World-space axis-aligned box of a mesh placed with a transform
+ * @param mesh Mesh whose object-space bounds are used
+ * @param transform Object to world matrix
+ * @param outMin Box minimum
+ * @param outMax Box maximum
+ */
+void transformBoundingBox(const MeshInfo& mesh, const glm::mat4& transform, glm::vec3& outMin, glm::vec3& outMax);
+
+/**
+ * @class MeshRegistry
+ * @brief All meshes in one vertex buffer and one index buffer behind a single VAO
+ *
+ * Ranges of both buffers are handed out by buddy allocators. Adding a mesh that
+ * does not fit grows the buffers on the GPU (glCopyBufferSubData); removing one
+ * frees its ranges, and once most of the free space is scattered in small
+ * blocks the remaining meshes are packed together again (defragment()).
+ * Handles stay valid across growth and defragmentation, only the offsets in
+ * MeshInfo change.
+ *
+ * Every mesh is drawn from the same VAO with glDrawElementsBaseVertex, so
+ * switching meshes never rebinds vertex state.
+ *
+ * Positions are also kept in a tightly packed stream of their own, with a
+ * VAO of just that attribute (bindPositions()). Depth-only passes fetch 12
+ * bytes per vertex instead of a whole MeshVertex.
+ *
+ * With OpenGL 4.3 every vertex is also kept as a PackedVertex in a storage
+ * buffer, at the same index as in the vertex buffer. bindPulling() binds a
+ * VAO that holds nothing but the index buffer: the vertex shader fetches
+ * packedVertices[gl_VertexID] itself (gl_VertexID includes the base vertex),
+ * so the vertex layout lives entirely in the shader and the post-transform
+ * cache still works through the index buffer.
+ */
+class MeshRegistry
+{
+public:
+    // Vertex buffer binding index of the MeshVertex attributes
+    static const GLuint VERTEX_BUFFER_BINDING = 0;
+
+private:
+    GLuint vertexArray;
+    GLuint vertexBuffer;
+    GLuint indexBuffer;
+    GLuint pullingVertexArray;      // Index buffer only (0 without vertex pulling)
+    GLuint packedVertexBuffer;
+    GLuint positionVertexArray;     // Position stream only
+    GLuint positionBuffer;
+    BuddyAllocator vertexAllocator;
+    BuddyAllocator indexAllocator;
+    std::vector<MeshInfo> meshes;
+    std::vector<MeshHandle> freeHandles;
+    std::unordered_map<std::string, MeshHandle> meshLookup;
+
+    /**
+     * Create immutable storage for a buffer, copying the first copyBytes of
+     * the old buffer into it
+     * @return New buffer (the old one is deleted)
+     */
+    static GLuint reallocateBuffer(GLuint oldBuffer, size_t newBytes, size_t copyBytes);
+
+    /**
+     * Copy data into a GPU-written buffer through a temporary staging buffer
+     */
+    static void upload(GLuint buffer, size_t offset, size_t bytes, const void* data);
+
+    /**
+     * Point the VAO at the current vertex/index buffers
+     */
+    void attachBuffers();
+
+    /**
+     * Pack all loaded meshes to the start of fresh, tightly sized buffers
+     * Only call while no draw that reads the old ranges is pending on the CPU side
+     */
+    void defragment();
+
+public:
+    MeshRegistry();
+
+    MeshRegistry(const MeshRegistry&) = delete;
+    MeshRegistry& operator=(const MeshRegistry&) = delete;
+
+    /**
+     * Create the VAO and the shared buffers
+     * @param vertexCapacity Initial vertex capacity
+     * @param indexCapacity Initial index capacity
+     */
+    void create(size_t vertexCapacity = 1 << 16, size_t indexCapacity = 1 << 18);
+
+    /**
+     * Upload a mesh into the shared buffers
+     * @param name Name for findMesh()
+     * @param vertices Vertex data
+     * @param indices Indices relative to the first vertex of this mesh
+     * @return Handle of the mesh; the existing handle if the name is already registered
+     *         (nothing is uploaded, remove the mesh first to replace it)
+     */
+    MeshHandle addMesh(const std::string& name, const std::vector<MeshVertex>& vertices,
+        const std::vector<unsigned int>& indices);
+
+    /**
+     * Free the ranges of a mesh (its handle may be reused)
+     * Compacts the buffers when the free space is mostly fragmented, so offsets of other
+     * meshes may change: only call while no draw that reads the old ranges is pending on
+     * the CPU side
+     */
+    void removeMesh(MeshHandle mesh);
+
+    /**
+     * Handle of a mesh by name, INVALID_MESH if not registered
+     */
+    MeshHandle findMesh(const std::string& name) const;
+
+    bool isValid(MeshHandle mesh) const;
+    const MeshInfo& getMesh(MeshHandle mesh) const { return meshes[mesh]; }
+    size_t getMeshCount() const { return meshes.size(); }
+
+    GLuint getVertexArray() const { return vertexArray; }
+    GLuint getVertexBuffer() const { return vertexBuffer; }
+    GLuint getIndexBuffer() const { return indexBuffer; }
+    GLuint getPackedVertexBuffer() const { return packedVertexBuffer; }
+    GLuint getPositionBuffer() const { return positionBuffer; }
+    bool hasVertexPulling() const { return pullingVertexArray != 0; }
+
+    /**
+     * Bind the shared VAO (through the state cache)
+     */
+    void bind() const;
+
+    /**
+     * Bind the position-only VAO (attribute 0, for depth-only passes)
+     * Draw calls are the same as with bind()
+     */
+    void bindPositions() const;
+
+    /**
+     * Bind the index-only VAO and the packed vertices to STORAGE_BINDING_PULLED_VERTICES
+     * Draw calls are the same as with bind()
+     */
+    void bindPulling() const;
+
+    /**
+     * Draw one mesh (VAO must be bound)
+     */
+    void draw(MeshHandle mesh) const;
+
+    /**
+     * Draw instances of one mesh (VAO must be bound)
+     */
+    void drawInstanced(MeshHandle mesh, GLsizei instanceCount) const;
+
+    /**
+     * Print buffer usage and fragmentation
+     */
+    void printStats() const;
+
+    void destroy();
+};
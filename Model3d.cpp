@@ -1,16 +1,20 @@
 #include "Model3D.h"
+#include "GLResources.h"
+#include "GLStateCache.h"
 #include <glm/gtc/type_ptr.hpp>
+#include <cstddef>
+#include <cstring>
 
 // Initialize static members
-GLuint Model3D::s_VAO = 0;
-GLuint Model3D::s_VBO = 0;
-GLuint Model3D::s_EBO = 0;
-GLuint Model3D::s_indexCount = 0;
+GLuint Model3D::s_instanceVBO = 0;
 
 Model3D::Model3D()
     : position(0.0f, 0.0f, 0.0f),
     rotation(0.0f, 0.0f, 0.0f),
-    scale(1.0f, 1.0f, 1.0f)
+    scale(1.0f, 1.0f, 1.0f),
+    materialId(0),
+    mesh(INVALID_MESH),
+    staticInstance(false)
 {
 }
 
@@ -30,70 +34,66 @@ glm::mat4 Model3D::getTransformMatrix() const
     return transform;
 }
 
-void Model3D::initializeSharedMesh(const float* vertices, unsigned int vertexCount,
-    const unsigned int* indices, unsigned int indexCount)
+void Model3D::initializeInstancing(const MeshRegistry& meshes)
 {
-    if (vertices == nullptr || indices == nullptr || vertexCount == 0 || indexCount == 0)
-        return;
-
-    s_indexCount = indexCount;
-
-    // Generate VAO, VBO, EBO
-    glGenVertexArrays(1, &s_VAO);
-    glGenBuffers(1, &s_VBO);
-    glGenBuffers(1, &s_EBO);
-
-    // Bind VAO
-    glBindVertexArray(s_VAO);
+    // Default instance buffer with one identity instance, so non-instanced
+    // draws always have valid instance attributes to read
+    InstanceData defaultInstance = {};
+    defaultInstance.transform = glm::mat4(1.0f);
+    s_instanceVBO = GLResources::createBuffer(sizeof(InstanceData), &defaultInstance, 0);
+
+    // Instance attributes live in the registry's VAO on a separate vertex
+    // buffer binding, so each instanced draw only rebinds its stream offset
+    GLuint vertexArray = meshes.getVertexArray();
+
+    // Per-instance transform (locations 3-6, one vec4 column each)
+    for (GLuint column = 0; column < 4; column++)
+    {
+        GLResources::setAttribute(vertexArray, 3 + column, 4, GL_FLOAT,
+            (GLuint)(offsetof(InstanceData, transform) + column * sizeof(glm::vec4)), INSTANCE_BUFFER_BINDING);
+    }
 
-    // Bind and fill VBO
-    glBindBuffer(GL_ARRAY_BUFFER, s_VBO);
-    glBufferData(GL_ARRAY_BUFFER, vertexCount * sizeof(float), vertices, GL_STATIC_DRAW);
+    // Per-instance material UV rectangle (location 7) and layer (location 8)
+    GLResources::setAttribute(vertexArray, 7, 4, GL_FLOAT, (GLuint)offsetof(InstanceData, uvRect), INSTANCE_BUFFER_BINDING);
+    GLResources::setAttribute(vertexArray, 8, 1, GL_FLOAT, (GLuint)offsetof(InstanceData, layer), INSTANCE_BUFFER_BINDING);
 
-    // Bind and fill EBO
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, s_EBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount * sizeof(unsigned int), indices, GL_STATIC_DRAW);
+    GLResources::setVertexBuffer(vertexArray, INSTANCE_BUFFER_BINDING, s_instanceVBO, 0, sizeof(InstanceData));
+    GLResources::setBindingDivisor(vertexArray, INSTANCE_BUFFER_BINDING, 1);
+}
 
-    // Vertex attribute pointer for position (location 0)
-    // Each vertex is 3 floats (x, y, z)
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
+void Model3D::draw(const MeshRegistry& meshes) const
+{
+    if (!meshes.isValid(mesh))
+        return;
 
-    // Unbind VAO
-    glBindVertexArray(0);
+    // Every mesh shares the registry's VAO, the state cache skips the rebind for the next model
+    meshes.bind();
+    meshes.draw(mesh);
 }
 
-void Model3D::draw(GLuint shaderProgram, GLint transformLoc) const
+void Model3D::drawInstanced(const MeshRegistry& meshes, MeshHandle mesh, StreamBuffer& stream,
+    const InstanceData* instances, GLsizei count)
 {
-    if (s_VAO == 0 || s_indexCount == 0)
+    if (!meshes.isValid(mesh) || count <= 0)
         return;
 
-    // Get and set transformation matrix
-    glm::mat4 transform = getTransformMatrix();
-    glUniformMatrix4fv(transformLoc, 1, GL_FALSE, glm::value_ptr(transform));
+    // Write straight into the mapped region the GPU is done with
+    size_t offset = 0;
+    void* mapped = stream.allocate(count * sizeof(InstanceData), sizeof(InstanceData), offset);
+    memcpy(mapped, instances, count * sizeof(InstanceData));
 
-    // Bind and draw
-    glBindVertexArray(s_VAO);
-    glDrawElements(GL_TRIANGLES, s_indexCount, GL_UNSIGNED_INT, 0);
-    glBindVertexArray(0);
+    // Point the instance attributes at this draw's range and draw every instance at once
+    meshes.bind();
+    GLResources::setVertexBuffer(meshes.getVertexArray(), INSTANCE_BUFFER_BINDING, stream.getBuffer(),
+        (GLintptr)offset, sizeof(InstanceData));
+    meshes.drawInstanced(mesh, count);
 }
 
-void Model3D::cleanupSharedMesh()
+void Model3D::cleanupInstancing()
 {
-    if (s_VAO != 0)
-    {
-        glDeleteVertexArrays(1, &s_VAO);
-        s_VAO = 0;
-    }
-    if (s_VBO != 0)
-    {
-        glDeleteBuffers(1, &s_VBO);
-        s_VBO = 0;
-    }
-    if (s_EBO != 0)
+    if (s_instanceVBO != 0)
     {
-        glDeleteBuffers(1, &s_EBO);
-        s_EBO = 0;
+        GLStateCache::deleteBuffers(1, &s_instanceVBO);
+        s_instanceVBO = 0;
     }
-    s_indexCount = 0;
 }
\ No newline at end of file
@@ -3,6 +3,24 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <glad/gl.h>
+#include "StreamBuffer.h"
+#include "MeshRegistry.h"
+
+/**
+ * @struct InstanceData
+ * @brief Per-instance attributes streamed for instanced drawing
+ *
+ * Layout matches vertex attributes 3-8 of the mesh registry's VAO
+ * (3-6 transform columns, 7 UV rectangle, 8 texture layer), all read from
+ * vertex buffer binding Model3D::INSTANCE_BUFFER_BINDING.
+ */
+struct InstanceData
+{
+    glm::mat4 transform;
+    glm::vec4 uvRect;       // Packed material UV rectangle
+    float layer;            // Packed material array layer
+    float padding[3];
+};
 
 /**
  * @class Model3D
@@ -12,7 +30,8 @@
  * - Position (X, Y, Z)
  * - Rotation (X, Y, Z) in degrees for each axis
  * - Scale (X, Y, Z)
- * - Uses a shared VAO/VBO/EBO (set once via static method)
+ * - Mesh handle into the MeshRegistry (all meshes share one VAO)
+ * - Instanced drawing of many models from a persistently mapped stream buffer
  */
 class Model3D
 {
@@ -22,11 +41,22 @@ private:
     glm::vec3 rotation;      // In degrees (X, Y, Z)
     glm::vec3 scale;
 
-    // Static shared mesh data (all models use the same mesh)
-    static GLuint s_VAO;
-    static GLuint s_VBO;
-    static GLuint s_EBO;
-    static GLuint s_indexCount;
+    // Material (texture ID from the TexturePacker)
+    int materialId;
+
+    // Mesh in the MeshRegistry
+    MeshHandle mesh;
+
+    // Never moves once placed (may be merged into a static batch)
+    bool staticInstance;
+
+    // Default instance buffer (one instance) so non-instanced draws always
+    // have valid instance attributes to read
+    static GLuint s_instanceVBO;
+
+public:
+    // Vertex buffer binding index of the per-instance attributes
+    static const GLuint INSTANCE_BUFFER_BINDING = 3;
 
 public:
     /**
@@ -43,11 +73,17 @@ public:
     void setPosition(const glm::vec3& pos) { position = pos; }
     void setRotation(const glm::vec3& rot) { rotation = rot; }
     void setScale(const glm::vec3& scl) { scale = scl; }
+    void setMaterial(int material) { materialId = material; }
+    void setMesh(MeshHandle handle) { mesh = handle; }
+    void setStatic(bool isStaticInstance) { staticInstance = isStaticInstance; }
 
     // ===== Transform Getters =====
     glm::vec3 getPosition() const { return position; }
     glm::vec3 getRotation() const { return rotation; }
     glm::vec3 getScale() const { return scale; }
+    int getMaterial() const { return materialId; }
+    MeshHandle getMesh() const { return mesh; }
+    bool isStatic() const { return staticInstance; }
 
     /**
      * Calculate and return the transformation matrix
@@ -57,26 +93,36 @@ public:
     glm::mat4 getTransformMatrix() const;
 
     /**
-     * Static method: Initialize shared mesh data (call once before creating models)
-     * @param vertices Vertex position data
-     * @param vertexCount Number of vertices
-     * @param indices Mesh indices for rendering
-     * @param indexCount Number of indices
+     * Static method: Add the per-instance attributes to the registry's VAO
+     * (call once after creating the registry)
+     * @param meshes Mesh registry whose VAO every model is drawn with
+     */
+    static void initializeInstancing(const MeshRegistry& meshes);
+
+    /**
+     * Draw the model's mesh
+     * The transform and material come from the per-draw uniform block range
+     * bound by the caller (see UniformRing)
+     * @param meshes Mesh registry holding the model's mesh
      */
-    static void initializeSharedMesh(const float* vertices, unsigned int vertexCount,
-        const unsigned int* indices, unsigned int indexCount);
+    void draw(const MeshRegistry& meshes) const;
 
     /**
-     * Draw the model using the provided shader program
-     * Uses the shared VAO/VBO/EBO
-     * @param shaderProgram OpenGL shader program ID
-     * @param transformLoc Uniform location for transformation matrix
+     * Static method: Draw many instances of one mesh with one draw call
+     * Instance data is written into the stream's current frame region and
+     * read from there directly
+     * @param meshes Mesh registry holding the mesh
+     * @param mesh Mesh to draw
+     * @param stream Stream buffer for per-instance data (between beginFrame/endFrame)
+     * @param instances Per-instance transforms and materials
+     * @param count Number of instances
      */
-    void draw(GLuint shaderProgram, GLint transformLoc) const;
+    static void drawInstanced(const MeshRegistry& meshes, MeshHandle mesh, StreamBuffer& stream,
+        const InstanceData* instances, GLsizei count);
 
     /**
-     * Static method: Clean up all shared OpenGL resources
+     * Static method: Clean up the shared instancing resources
      * Call this once at the end of the program
      */
-    static void cleanupSharedMesh();
+    static void cleanupInstancing();
 };
\ No newline at end of file
@@ -0,0 +1,191 @@
+#include "OcclusionQueries.h"
+#include "GLResources.h"
+#include "GLStateCache.h"
+#include "UniformBuffers.h"
+#include <iostream>
+
+static const char* OCCLUSION_BOX_VERT_PATH = "Shaders/occlusion_box.vert";
+static const char* OCCLUSION_BOX_FRAG_PATH = "Shaders/occlusion_box.frag";
+
+// Boxes closer than this to the camera may be cut by the near plane, they are drawn without a query
+static const float CAMERA_BOX_MARGIN = 0.1f;
+
+OcclusionQueries::OcclusionQueries()
+    : boxMinUniform(ShaderProgram::INVALID_UNIFORM),
+    boxMaxUniform(ShaderProgram::INVALID_UNIFORM),
+    emptyVertexArray(0),
+    queryTarget(GL_ANY_SAMPLES_PASSED),
+    frame(0),
+    lastCandidateCount(0),
+    lastSkippedQueries(0),
+    lastBoxQueries(0),
+    lastDrawQueries(0),
+    lastResultsRead(0),
+    lastOccludedCount(0)
+{
+}
+
+bool OcclusionQueries::create()
+{
+    if (!boxProgram.loadFromFiles(OCCLUSION_BOX_VERT_PATH, OCCLUSION_BOX_FRAG_PATH))
+        return false;
+
+    boxProgram.bindUniformBlock("FrameData", UNIFORM_BINDING_FRAME);
+    boxMinUniform = boxProgram.getUniform("boxMin");
+    boxMaxUniform = boxProgram.getUniform("boxMax");
+
+    // Conservative queries may count samples that are not actually covered, which is cheaper and fine for culling
+    queryTarget = GLAD_GL_VERSION_4_3 ? GL_ANY_SAMPLES_PASSED_CONSERVATIVE : GL_ANY_SAMPLES_PASSED;
+
+    // Box corners come from gl_VertexID, but core profiles still need a VAO bound to draw
+    emptyVertexArray = GLResources::createVertexArray();
+    return true;
+}
+
+OcclusionQueries::ObjectState& OcclusionQueries::getState(unsigned int object)
+{
+    if (object >= objects.size())
+        objects.resize(object + 1);
+
+    ObjectState& state = objects[object];
+    if (state.query == 0)
+        glGenQueries(1, &state.query);
+    return state;
+}
+
+void OcclusionQueries::pollResult(ObjectState& state)
+{
+    if (!state.pending)
+        return;
+
+    GLuint available = 0;
+    glGetQueryObjectuiv(state.query, GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available)
+        return;
+
+    GLuint passed = 0;
+    glGetQueryObjectuiv(state.query, GL_QUERY_RESULT, &passed);
+    state.visible = passed != 0;
+    state.pending = false;
+    lastResultsRead++;
+}
+
+void OcclusionQueries::render(const std::vector<unsigned int>& candidates, const std::vector<glm::vec3>& boundsMin,
+    const std::vector<glm::vec3>& boundsMax, const glm::vec3& cameraPosition,
+    const std::function<void(size_t)>& drawCandidate)
+{
+    frame++;
+    visibleDraws.clear();
+    conditionalDraws.clear();
+    lastCandidateCount = candidates.size();
+    lastSkippedQueries = lastBoxQueries = lastDrawQueries = lastResultsRead = 0;
+
+    // Pick up whatever results arrived and split the candidates by their last known visibility
+    for (size_t i = 0; i < candidates.size(); i++)
+    {
+        ObjectState& state = getState(candidates[i]);
+        pollResult(state);
+
+        glm::vec3 margin(CAMERA_BOX_MARGIN);
+        if (glm::all(glm::greaterThanEqual(cameraPosition, boundsMin[i] - margin)) &&
+            glm::all(glm::lessThanEqual(cameraPosition, boundsMax[i] + margin)))
+            state.visible = true;
+
+        if (state.visible)
+            visibleDraws.push_back(i);
+        else
+            conditionalDraws.push_back(i);
+    }
+    lastOccludedCount = conditionalDraws.size();
+
+    // 1. Visible objects first, so they occlude the boxes tested below
+    for (size_t i : visibleDraws)
+    {
+        ObjectState& state = objects[candidates[i]];
+        if (state.pending || frame - state.lastQueryFrame < VISIBLE_QUERY_INTERVAL)
+        {
+            drawCandidate(i);
+            lastSkippedQueries++;
+            continue;
+        }
+
+        // Time to confirm: the draw itself is the query
+        glBeginQuery(queryTarget, state.query);
+        drawCandidate(i);
+        glEndQuery(queryTarget);
+        state.pending = true;
+        state.lastQueryFrame = frame;
+        lastDrawQueries++;
+    }
+
+    if (conditionalDraws.empty())
+        return;
+
+    // 2. One batch of box queries for occluded and new objects without a result in flight
+    GLuint callerProgram = GLStateCache::getProgram();
+    bool cullFace = GLStateCache::isEnabled(GL_CULL_FACE);
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    GLStateCache::depthMask(false);
+    GLStateCache::disable(GL_CULL_FACE);
+    boxProgram.bind();
+    GLStateCache::bindVertexArray(emptyVertexArray);
+
+    for (size_t i : conditionalDraws)
+    {
+        ObjectState& state = objects[candidates[i]];
+        if (state.pending)
+            continue;
+
+        boxProgram.setVec3(boxMinUniform, boundsMin[i]);
+        boxProgram.setVec3(boxMaxUniform, boundsMax[i]);
+        boxProgram.apply();
+        glBeginQuery(queryTarget, state.query);
+        glDrawArrays(GL_TRIANGLE_STRIP, 0, 14);
+        glEndQuery(queryTarget);
+        state.pending = true;
+        state.lastQueryFrame = frame;
+        lastBoxQueries++;
+    }
+
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    GLStateCache::depthMask(true);
+    if (cullFace)
+        GLStateCache::enable(GL_CULL_FACE);
+    GLStateCache::useProgram(callerProgram);
+
+    // 3. The GPU skips each draw whose latest query found no samples; the CPU does not wait
+    for (size_t i : conditionalDraws)
+    {
+        glBeginConditionalRender(objects[candidates[i]].query, GL_QUERY_WAIT);
+        drawCandidate(i);
+        glEndConditionalRender();
+    }
+}
+
+void OcclusionQueries::clear()
+{
+    for (ObjectState& state : objects)
+    {
+        if (state.query != 0)
+            glDeleteQueries(1, &state.query);
+    }
+    objects.clear();
+}
+
+void OcclusionQueries::printStats() const
+{
+    std::cout << "Occlusion queries: " << lastCandidateCount << " candidates, " << lastOccludedCount
+        << " occluded or new (conditional), " << lastBoxQueries << " box queries, " << lastDrawQueries
+        << " draw queries, " << lastSkippedQueries << " skipped (visible last frame), " << lastResultsRead
+        << " results read, " << (queryTarget == GL_ANY_SAMPLES_PASSED_CONSERVATIVE ? "conservative" : "exact")
+        << std::endl;
+}
+
+void OcclusionQueries::destroy()
+{
+    clear();
+    boxProgram.destroy();
+    if (emptyVertexArray != 0)
+        GLStateCache::deleteVertexArrays(1, &emptyVertexArray);
+    emptyVertexArray = 0;
+}
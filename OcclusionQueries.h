@@ -0,0 +1,104 @@
+#pragma once
+#include <functional>
+#include <vector>
+#include <glm/glm.hpp>
+#include <glad/gl.h>
+#include "ShaderProgram.h"
+
+/**
+ * @class OcclusionQueries
+ * @brief Hardware occlusion queries with conditional rendering and temporal coherence
+ *
+ * Every object owns one query. Each frame, in the spirit of CHC++:
+ * - Objects visible last frame are drawn first, unconditionally, and fill the
+ *   depth buffer. Their query is skipped for VISIBLE_QUERY_INTERVAL frames;
+ *   then the draw itself is wrapped in a query to check they are still visible.
+ * - Every other object (occluded or new) gets a query on its bounding box,
+ *   issued in one batch with color and depth writes off, and is then drawn
+ *   inside glBeginConditionalRender on that query. The GPU drops the draw if
+ *   no sample passed, so the CPU never waits.
+ * - Results are read back only once GL_QUERY_RESULT_AVAILABLE says so, usually
+ *   a frame or more later, and switch objects between the two sets. An object
+ *   whose result is still pending keeps its last visibility and, if occluded,
+ *   is drawn conditionally on its pending query.
+ *
+ * Queries use GL_ANY_SAMPLES_PASSED_CONSERVATIVE with OpenGL 4.3, and
+ * GL_ANY_SAMPLES_PASSED otherwise.
+ */
+class OcclusionQueries
+{
+public:
+    // Frames a visible object goes without a query
+    static const unsigned int VISIBLE_QUERY_INTERVAL = 8;
+
+private:
+    struct ObjectState
+    {
+        GLuint query = 0;
+        bool visible = false;           // Last known result (new objects start occluded, so they get a box query)
+        bool pending = false;           // Query issued, result not read yet
+        unsigned int lastQueryFrame = 0;
+    };
+
+    ShaderProgram boxProgram;
+    ShaderProgram::UniformHandle boxMinUniform;
+    ShaderProgram::UniformHandle boxMaxUniform;
+    GLuint emptyVertexArray;
+    GLenum queryTarget;
+
+    std::vector<ObjectState> objects;
+    unsigned int frame;
+
+    // Per-frame work lists (candidate positions)
+    std::vector<size_t> visibleDraws;
+    std::vector<size_t> conditionalDraws;
+
+    size_t lastCandidateCount;
+    size_t lastSkippedQueries;
+    size_t lastBoxQueries;
+    size_t lastDrawQueries;
+    size_t lastResultsRead;
+    size_t lastOccludedCount;
+
+    /**
+     * Read the result of an object's query if it is available (never waits)
+     */
+    void pollResult(ObjectState& state);
+
+    ObjectState& getState(unsigned int object);
+
+public:
+    OcclusionQueries();
+
+    /**
+     * Load the box program (OpenGL 3.3)
+     * @return True if the program linked
+     */
+    bool create();
+
+    /**
+     * Draw candidates, skipping those whose query says they are hidden
+     * Must be called with the depth test on; the caller's program is restored
+     * before every draw callback
+     * @param candidates Stable object id of each candidate (indexes the per-object queries)
+     * @param boundsMin World-space box minimum of each candidate
+     * @param boundsMax World-space box maximum of each candidate
+     * @param cameraPosition Boxes around the camera are drawn without a query
+     * @param drawCandidate Draws candidate i (position in the arrays above)
+     */
+    void render(const std::vector<unsigned int>& candidates, const std::vector<glm::vec3>& boundsMin,
+        const std::vector<glm::vec3>& boundsMax, const glm::vec3& cameraPosition,
+        const std::function<void(size_t)>& drawCandidate);
+
+    /**
+     * Delete every query (objects start over as new)
+     */
+    void clear();
+
+    /**
+     * Print query counts of the last render()
+     */
+    void printStats() const;
+
+    void destroy();
+};
@@ -0,0 +1,186 @@
+#include "RenderQueue.h"
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <iostream>
+
+static const int RADIX_BITS = 8;
+static const size_t RADIX_BUCKETS = 1 << RADIX_BITS;
+static const int RADIX_PASSES = 64 / RADIX_BITS;
+
+static const uint64_t PROGRAM_MASK = (1ull << RenderQueue::PROGRAM_BITS) - 1;
+static const uint64_t MATERIAL_MASK = (1ull << RenderQueue::MATERIAL_BITS) - 1;
+static const uint64_t MESH_MASK = (1ull << RenderQueue::MESH_BITS) - 1;
+static const uint64_t DEPTH_MASK = (1ull << RenderQueue::DEPTH_BITS) - 1;
+
+// Bit offsets of the fields, from the least significant bit
+static const int PASS_SHIFT = 64 - RenderQueue::PASS_BITS;
+static const int OPAQUE_PROGRAM_SHIFT = PASS_SHIFT - RenderQueue::PROGRAM_BITS;
+static const int OPAQUE_MATERIAL_SHIFT = OPAQUE_PROGRAM_SHIFT - RenderQueue::MATERIAL_BITS;
+static const int OPAQUE_MESH_SHIFT = OPAQUE_MATERIAL_SHIFT - RenderQueue::MESH_BITS;
+static const int TRANSPARENT_DEPTH_SHIFT = PASS_SHIFT - RenderQueue::DEPTH_BITS;
+static const int TRANSPARENT_PROGRAM_SHIFT = TRANSPARENT_DEPTH_SHIFT - RenderQueue::PROGRAM_BITS;
+static const int TRANSPARENT_MATERIAL_SHIFT = TRANSPARENT_PROGRAM_SHIFT - RenderQueue::MATERIAL_BITS;
+
+RenderQueue::RenderQueue(ThreadPool* threadPool)
+    : threadPool(threadPool),
+    lastItemCount(0),
+    lastSortPasses(0),
+    lastProgramChanges(0),
+    lastMaterialChanges(0),
+    lastSortMilliseconds(0.0)
+{
+}
+
+uint64_t RenderQueue::makeKey(Pass pass, unsigned int program, unsigned int material, unsigned int mesh, float depth)
+{
+    uint64_t quantizedDepth = (uint64_t)(std::clamp(depth, 0.0f, 1.0f) * (float)DEPTH_MASK);
+    uint64_t key = (uint64_t)pass << PASS_SHIFT;
+    if (pass == PASS_OPAQUE)
+    {
+        key |= (program & PROGRAM_MASK) << OPAQUE_PROGRAM_SHIFT;
+        key |= (material & MATERIAL_MASK) << OPAQUE_MATERIAL_SHIFT;
+        key |= (mesh & MESH_MASK) << OPAQUE_MESH_SHIFT;
+        key |= quantizedDepth;
+    }
+    else
+    {
+        key |= (DEPTH_MASK - quantizedDepth) << TRANSPARENT_DEPTH_SHIFT;
+        key |= (program & PROGRAM_MASK) << TRANSPARENT_PROGRAM_SHIFT;
+        key |= (material & MATERIAL_MASK) << TRANSPARENT_MATERIAL_SHIFT;
+        key |= mesh & MESH_MASK;
+    }
+    return key;
+}
+
+RenderQueue::Pass RenderQueue::getPass(uint64_t key)
+{
+    return (Pass)(key >> PASS_SHIFT);
+}
+
+unsigned int RenderQueue::getProgram(uint64_t key)
+{
+    int shift = getPass(key) == PASS_OPAQUE ? OPAQUE_PROGRAM_SHIFT : TRANSPARENT_PROGRAM_SHIFT;
+    return (unsigned int)((key >> shift) & PROGRAM_MASK);
+}
+
+unsigned int RenderQueue::getMaterial(uint64_t key)
+{
+    int shift = getPass(key) == PASS_OPAQUE ? OPAQUE_MATERIAL_SHIFT : TRANSPARENT_MATERIAL_SHIFT;
+    return (unsigned int)((key >> shift) & MATERIAL_MASK);
+}
+
+unsigned int RenderQueue::getMesh(uint64_t key)
+{
+    int shift = getPass(key) == PASS_OPAQUE ? OPAQUE_MESH_SHIFT : 0;
+    return (unsigned int)((key >> shift) & MESH_MASK);
+}
+
+void RenderQueue::clear()
+{
+    keys.clear();
+    items.clear();
+}
+
+void RenderQueue::reserve(size_t count)
+{
+    keys.reserve(count);
+    items.reserve(count);
+}
+
+void RenderQueue::add(uint64_t key, uint32_t item)
+{
+    keys.push_back(key);
+    items.push_back(item);
+}
+
+void RenderQueue::sort()
+{
+    auto start = std::chrono::high_resolution_clock::now();
+    size_t count = keys.size();
+    scratchKeys.resize(count);
+    scratchItems.resize(count);
+
+    // Contiguous chunks keep every pass stable: chunk c scatters before chunk c + 1 within each bucket
+    size_t chunkCount = 1;
+    if (threadPool && count >= PARALLEL_MIN_ITEMS)
+        chunkCount = std::min(threadPool->getThreadCount() + 1, count / (PARALLEL_MIN_ITEMS / 4));
+    size_t chunkSize = (count + chunkCount - 1) / chunkCount;
+    histograms.resize(chunkCount * RADIX_BUCKETS);
+
+    auto forEachChunk = [&](const std::function<void(size_t, size_t, size_t)>& body) {
+        auto run = [&](size_t begin, size_t end) {
+            for (size_t chunk = begin; chunk < end; chunk++)
+                body(chunk, chunk * chunkSize, std::min(count, (chunk + 1) * chunkSize));
+        };
+        if (chunkCount > 1)
+            threadPool->parallelFor(chunkCount, 1, run);
+        else
+            run(0, chunkCount);
+    };
+
+    lastSortPasses = 0;
+    for (int pass = 0; pass < RADIX_PASSES; pass++)
+    {
+        const int shift = pass * RADIX_BITS;
+
+        forEachChunk([&](size_t chunk, size_t begin, size_t end) {
+            size_t* histogram = histograms.data() + chunk * RADIX_BUCKETS;
+            std::fill(histogram, histogram + RADIX_BUCKETS, 0);
+            for (size_t i = begin; i < end; i++)
+                histogram[(keys[i] >> shift) & (RADIX_BUCKETS - 1)]++;
+        });
+
+        // Turn the counts into scatter offsets (bucket-major, then chunk order), skipping uniform digits
+        size_t offset = 0;
+        bool uniform = false;
+        for (size_t bucket = 0; bucket < RADIX_BUCKETS && !uniform; bucket++)
+        {
+            size_t bucketStart = offset;
+            for (size_t chunk = 0; chunk < chunkCount; chunk++)
+            {
+                size_t& counter = histograms[chunk * RADIX_BUCKETS + bucket];
+                size_t bucketCount = counter;
+                counter = offset;
+                offset += bucketCount;
+            }
+            uniform = (offset - bucketStart == count);
+        }
+        if (uniform)
+            continue;
+
+        forEachChunk([&](size_t chunk, size_t begin, size_t end) {
+            size_t* offsets = histograms.data() + chunk * RADIX_BUCKETS;
+            for (size_t i = begin; i < end; i++)
+            {
+                size_t target = offsets[(keys[i] >> shift) & (RADIX_BUCKETS - 1)]++;
+                scratchKeys[target] = keys[i];
+                scratchItems[target] = items[i];
+            }
+        });
+        keys.swap(scratchKeys);
+        items.swap(scratchItems);
+        lastSortPasses++;
+    }
+
+    // State changes a submission in this order has to make
+    lastItemCount = count;
+    lastProgramChanges = lastMaterialChanges = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        bool programChanged = (i == 0 || getProgram(keys[i]) != getProgram(keys[i - 1]));
+        bool passChanged = (i == 0 || getPass(keys[i]) != getPass(keys[i - 1]));
+        lastProgramChanges += (programChanged || passChanged) ? 1 : 0;
+        lastMaterialChanges += (programChanged || passChanged || getMaterial(keys[i]) != getMaterial(keys[i - 1])) ? 1 : 0;
+    }
+
+    auto end = std::chrono::high_resolution_clock::now();
+    lastSortMilliseconds = std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+void RenderQueue::printStats() const
+{
+    std::cout << "Render queue: " << lastItemCount << " items, " << lastSortPasses << " radix passes in "
+        << lastSortMilliseconds << " ms, " << lastProgramChanges << " program and " << lastMaterialChanges
+        << " material changes" << std::endl;
+}
@@ -0,0 +1,101 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "ThreadPool.h"
+
+/**
+ * @class RenderQueue
+ * @brief Draw items ordered by packed 64-bit sort keys
+ *
+ * Every visible item adds one key and a caller-defined item index. Opaque keys
+ * order by program, material, mesh and then depth front to back, so state
+ * changes are minimal and nearer surfaces reject the ones behind them early.
+ * Transparent keys come after every opaque key and order by depth back to
+ * front first, as blending needs:
+ *
+ *   opaque:      pass:2 | program:8 | material:14 | mesh:16 | depth:24
+ *   transparent: pass:2 | ~depth:24 | program:8 | material:14 | mesh:16
+ *
+ * sort() is a stable LSD radix sort over 8-bit digits. Each pass histograms
+ * and scatters contiguous chunks on the thread pool; passes whose digit is
+ * the same for every key are skipped, which drops most of them when few
+ * programs and materials are in use.
+ */
+class RenderQueue
+{
+public:
+    enum Pass
+    {
+        PASS_OPAQUE = 0,
+        PASS_TRANSPARENT = 1
+    };
+
+    static const int PASS_BITS = 2;
+    static const int PROGRAM_BITS = 8;
+    static const int MATERIAL_BITS = 14;
+    static const int MESH_BITS = 16;
+    static const int DEPTH_BITS = 24;
+
+    // Fewer items are sorted on the calling thread
+    static const size_t PARALLEL_MIN_ITEMS = 8192;
+
+private:
+    ThreadPool* threadPool;
+
+    std::vector<uint64_t> keys;
+    std::vector<uint32_t> items;
+    std::vector<uint64_t> scratchKeys;
+    std::vector<uint32_t> scratchItems;
+    std::vector<size_t> histograms;         // 256 counters per chunk
+
+    size_t lastItemCount;
+    size_t lastSortPasses;
+    size_t lastProgramChanges;
+    size_t lastMaterialChanges;
+    double lastSortMilliseconds;
+
+public:
+    /**
+     * @param threadPool Pool for parallel sorting (nullptr = calling thread only)
+     */
+    explicit RenderQueue(ThreadPool* threadPool = nullptr);
+
+    /**
+     * Pack a sort key; ids above their field width are truncated
+     * @param pass Opaque or transparent
+     * @param program Program id
+     * @param material Material id
+     * @param mesh Mesh id
+     * @param depth Normalized view depth, 0 = camera, 1 = far (clamped)
+     */
+    static uint64_t makeKey(Pass pass, unsigned int program, unsigned int material, unsigned int mesh, float depth);
+
+    static Pass getPass(uint64_t key);
+    static unsigned int getProgram(uint64_t key);
+    static unsigned int getMaterial(uint64_t key);
+    static unsigned int getMesh(uint64_t key);
+
+    void clear();
+    void reserve(size_t count);
+
+    /**
+     * Queue one item
+     * @param key Key from makeKey()
+     * @param item Caller's index of the item (e.g. into its model array)
+     */
+    void add(uint64_t key, uint32_t item);
+
+    /**
+     * Sort the queued items by key (stable)
+     */
+    void sort();
+
+    size_t getCount() const { return keys.size(); }
+    const std::vector<uint64_t>& getKeys() const { return keys; }
+    const std::vector<uint32_t>& getItems() const { return items; }
+
+    /**
+     * Print item count, sort time and the state changes the sorted order needs
+     */
+    void printStats() const;
+};
@@ -0,0 +1,83 @@
+#include "SceneFramebuffer.h"
+#include "GLResources.h"
+#include "GLStateCache.h"
+#include <iostream>
+
+SceneFramebuffer::SceneFramebuffer()
+    : framebuffer(0),
+    colorTarget(0),
+    depthTarget(0),
+    width(0),
+    height(0)
+{
+}
+
+bool SceneFramebuffer::resize(int framebufferWidth, int framebufferHeight)
+{
+    if (framebufferWidth <= 0 || framebufferHeight <= 0)
+        return false;
+    if (framebuffer != 0 && framebufferWidth == width && framebufferHeight == height)
+        return true;
+
+    destroyTargets();
+    width = framebufferWidth;
+    height = framebufferHeight;
+
+    colorTarget = GLResources::createTexture(GL_TEXTURE_2D, 1, GL_RGBA8, width, height);
+    depthTarget = GLResources::createTexture(GL_TEXTURE_2D, 1, GL_DEPTH_COMPONENT32F, width, height);
+    for (GLuint target : { colorTarget, depthTarget })
+    {
+        GLResources::setTextureParameter(target, GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        GLResources::setTextureParameter(target, GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    }
+
+    glGenFramebuffers(1, &framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, colorTarget, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTarget, 0);
+
+    bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    if (!complete)
+    {
+        std::cerr << "ERROR: Scene framebuffer incomplete" << std::endl;
+        destroyTargets();
+    }
+    return complete;
+}
+
+void SceneFramebuffer::bind() const
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+}
+
+void SceneFramebuffer::present() const
+{
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+    glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+
+    // Nothing is read back: the next frame clears or overwrites every texel
+    const GLenum targets[] = { GL_COLOR_ATTACHMENT0, GL_DEPTH_ATTACHMENT };
+    glInvalidateFramebuffer(GL_READ_FRAMEBUFFER, 2, targets);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void SceneFramebuffer::destroyTargets()
+{
+    if (framebuffer != 0)
+        glDeleteFramebuffers(1, &framebuffer);
+    GLuint targets[] = { colorTarget, depthTarget };
+    for (GLuint& target : targets)
+    {
+        if (target != 0)
+            GLStateCache::deleteTextures(1, &target);
+    }
+    framebuffer = colorTarget = depthTarget = 0;
+    width = height = 0;
+}
+
+void SceneFramebuffer::destroy()
+{
+    destroyTargets();
+}
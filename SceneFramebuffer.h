@@ -0,0 +1,56 @@
+#pragma once
+#include <glad/gl.h>
+
+/**
+ * @class SceneFramebuffer
+ * @brief Offscreen color and float depth target the scene is drawn into with reverse-Z
+ *
+ * The default framebuffer's depth is 24-bit fixed point, spaced evenly over
+ * [0, 1]. Reverse-Z only keeps precision at a distance with a float depth
+ * buffer, whose values are densest near 0 where far depths land. Frames are
+ * drawn here instead (GL_RGBA8 color, GL_DEPTH_COMPONENT32F depth) and
+ * present() blits the color to the default framebuffer.
+ *
+ * Depth stays in this framebuffer, so whatever reads the finished frame's
+ * depth (the GPU culler's depth pyramid) must run before present().
+ */
+class SceneFramebuffer
+{
+private:
+    GLuint framebuffer;
+    GLuint colorTarget;     // GL_RGBA8
+    GLuint depthTarget;     // GL_DEPTH_COMPONENT32F
+    int width;
+    int height;
+
+    void destroyTargets();
+
+public:
+    SceneFramebuffer();
+
+    SceneFramebuffer(const SceneFramebuffer&) = delete;
+    SceneFramebuffer& operator=(const SceneFramebuffer&) = delete;
+
+    /**
+     * (Re)create the targets if the size changed
+     * @param framebufferWidth Width of the default framebuffer presented to
+     * @param framebufferHeight Its height
+     * @return False if the framebuffer is incomplete (draw into the default framebuffer instead)
+     */
+    bool resize(int framebufferWidth, int framebufferHeight);
+
+    /**
+     * Bind for the scene's draws (read and draw)
+     */
+    void bind() const;
+
+    /**
+     * Blit the color to the default framebuffer and leave the default framebuffer bound
+     * Both targets are invalidated afterwards, the next frame overwrites them
+     */
+    void present() const;
+
+    GLuint getFramebuffer() const { return framebuffer; }
+
+    void destroy();
+};
@@ -0,0 +1,392 @@
+#include "ShaderProgram.h"
+#include "GLStateCache.h"
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <glm/gtc/type_ptr.hpp>
+
+// Bytes of one element of a uniform type (samplers/images are stored as ints)
+static size_t getUniformTypeSize(GLenum type)
+{
+    switch (type)
+    {
+    case GL_FLOAT_VEC2: case GL_INT_VEC2: case GL_UNSIGNED_INT_VEC2: case GL_BOOL_VEC2: return 8;
+    case GL_FLOAT_VEC3: case GL_INT_VEC3: case GL_UNSIGNED_INT_VEC3: case GL_BOOL_VEC3: return 12;
+    case GL_FLOAT_VEC4: case GL_INT_VEC4: case GL_UNSIGNED_INT_VEC4: case GL_BOOL_VEC4: return 16;
+    case GL_FLOAT_MAT2: return 16;
+    case GL_FLOAT_MAT3: return 36;
+    case GL_FLOAT_MAT4: return 64;
+    default: return 4;
+    }
+}
+
+// Read a uniform's current value into CPU-side storage, one array element at a time
+static void readUniformValue(GLuint program, const std::string& name, GLint location, GLenum type,
+    GLint arraySize, unsigned char* destination)
+{
+    const size_t elementSize = getUniformTypeSize(type);
+    for (GLint element = 0; element < arraySize; element++)
+    {
+        GLint elementLocation = (element == 0) ? location :
+            glGetUniformLocation(program, (name + "[" + std::to_string(element) + "]").c_str());
+        if (elementLocation < 0)
+            continue;
+
+        void* target = destination + element * elementSize;
+        switch (type)
+        {
+        case GL_FLOAT: case GL_FLOAT_VEC2: case GL_FLOAT_VEC3: case GL_FLOAT_VEC4:
+        case GL_FLOAT_MAT2: case GL_FLOAT_MAT3: case GL_FLOAT_MAT4:
+            glGetUniformfv(program, elementLocation, (GLfloat*)target);
+            break;
+        case GL_UNSIGNED_INT: case GL_UNSIGNED_INT_VEC2: case GL_UNSIGNED_INT_VEC3: case GL_UNSIGNED_INT_VEC4:
+            glGetUniformuiv(program, elementLocation, (GLuint*)target);
+            break;
+        default:    // int, bool, samplers
+            glGetUniformiv(program, elementLocation, (GLint*)target);
+            break;
+        }
+    }
+}
+
+ShaderProgram::ShaderProgram()
+    : program(0)
+{
+}
+
+ShaderProgram::~ShaderProgram()
+{
+    // GL objects are released through destroy() while the context is alive
+}
+
+std::string ShaderProgram::loadSourceFromFile(const std::string& filepath)
+{
+    std::fstream file(filepath);
+    if (!file.is_open())
+    {
+        std::cerr << "ERROR: Could not open shader file: " << filepath << std::endl;
+        return "";
+    }
+
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    return buffer.str();
+}
+
+GLuint ShaderProgram::compileStage(GLenum stage, const std::string& source, const std::string& path)
+{
+    const char* sourceChar = source.c_str();
+
+    GLuint shader = glCreateShader(stage);
+    glShaderSource(shader, 1, &sourceChar, NULL);
+    glCompileShader(shader);
+
+    // Check for compilation errors
+    int success;
+    char infoLog[512];
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+    if (!success)
+    {
+        glGetShaderInfoLog(shader, 512, NULL, infoLog);
+        std::cerr << "ERROR: Shader compilation failed (" << path << "):\n" << infoLog << std::endl;
+        glDeleteShader(shader);
+        return 0;
+    }
+    return shader;
+}
+
+bool ShaderProgram::loadFromFiles(const std::string& vertPath, const std::string& fragPath)
+{
+    return loadStages({ { GL_VERTEX_SHADER, vertPath }, { GL_FRAGMENT_SHADER, fragPath } });
+}
+
+bool ShaderProgram::loadStages(const std::vector<std::pair<GLenum, std::string>>& stages)
+{
+    destroy();
+
+    // Compile every stage
+    std::vector<GLuint> shaders;
+    bool compiled = true;
+    for (const auto& [stage, path] : stages)
+    {
+        std::string source = loadSourceFromFile(path);
+        GLuint shader = source.empty() ? 0 : compileStage(stage, source, path);
+        if (shader == 0)
+        {
+            compiled = false;
+            break;
+        }
+        shaders.push_back(shader);
+    }
+
+    if (!compiled)
+    {
+        for (GLuint shader : shaders)
+            glDeleteShader(shader);
+        return false;
+    }
+
+    // Link shader program
+    program = glCreateProgram();
+    for (GLuint shader : shaders)
+        glAttachShader(program, shader);
+    glLinkProgram(program);
+
+    // Delete shader objects (program has them compiled now)
+    for (GLuint shader : shaders)
+    {
+        glDetachShader(program, shader);
+        glDeleteShader(shader);
+    }
+
+    // Check linking errors
+    int success;
+    char infoLog[512];
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    if (!success)
+    {
+        glGetProgramInfoLog(program, 512, NULL, infoLog);
+        std::cerr << "ERROR: Shader program linking failed:\n" << infoLog << std::endl;
+        glDeleteProgram(program);
+        program = 0;
+        return false;
+    }
+
+    reflect();
+
+    std::cout << "Shaders compiled and linked successfully (" << uniforms.size() << " uniforms, "
+        << uniformBlocks.size() << " uniform blocks, " << attributes.size() << " attributes)" << std::endl;
+    return true;
+}
+
+void ShaderProgram::reflect()
+{
+    uniforms.clear();
+    uniformBlocks.clear();
+    attributes.clear();
+    uniformLookup.clear();
+    values.clear();
+    dirtyUniforms.clear();
+
+    char name[256];
+
+    // Default-block uniforms (block members have no location and are skipped)
+    GLint uniformCount = 0;
+    glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &uniformCount);
+    for (GLint i = 0; i < uniformCount; i++)
+    {
+        GLsizei length = 0;
+        GLint arraySize = 0;
+        GLenum type = 0;
+        glGetActiveUniform(program, (GLuint)i, sizeof(name), &length, &arraySize, &type, name);
+
+        GLint location = glGetUniformLocation(program, name);
+        if (location < 0)
+            continue;
+
+        std::string uniformName(name, length);
+        if (uniformName.size() > 3 && uniformName.compare(uniformName.size() - 3, 3, "[0]") == 0)
+            uniformName.resize(uniformName.size() - 3);
+
+        UniformInfo info;
+        info.name = uniformName;
+        info.location = location;
+        info.type = type;
+        info.arraySize = arraySize;
+        info.offset = values.size();
+        info.size = getUniformTypeSize(type) * arraySize;
+        info.dirty = false;
+
+        // Start in sync with the linked values: layout(binding = N) samplers and
+        // initialisers in the source do not start at zero
+        values.resize(values.size() + info.size, 0);
+        readUniformValue(program, uniformName, location, type, arraySize, values.data() + info.offset);
+        uniformLookup[uniformName] = (UniformHandle)uniforms.size();
+        uniforms.push_back(info);
+    }
+
+    // Uniform blocks
+    GLint blockCount = 0;
+    glGetProgramiv(program, GL_ACTIVE_UNIFORM_BLOCKS, &blockCount);
+    for (GLint i = 0; i < blockCount; i++)
+    {
+        GLsizei length = 0;
+        glGetActiveUniformBlockName(program, (GLuint)i, sizeof(name), &length, name);
+
+        UniformBlockInfo info;
+        info.name = std::string(name, length);
+        info.index = (GLuint)i;
+        glGetActiveUniformBlockiv(program, (GLuint)i, GL_UNIFORM_BLOCK_DATA_SIZE, &info.dataSize);
+        GLint binding = 0;
+        glGetActiveUniformBlockiv(program, (GLuint)i, GL_UNIFORM_BLOCK_BINDING, &binding);
+        info.binding = (GLuint)binding;
+        uniformBlocks.push_back(info);
+    }
+
+    // Vertex attributes
+    GLint attributeCount = 0;
+    glGetProgramiv(program, GL_ACTIVE_ATTRIBUTES, &attributeCount);
+    for (GLint i = 0; i < attributeCount; i++)
+    {
+        GLsizei length = 0;
+        AttributeInfo info;
+        glGetActiveAttrib(program, (GLuint)i, sizeof(name), &length, &info.arraySize, &info.type, name);
+        info.name = std::string(name, length);
+        info.location = glGetAttribLocation(program, name);
+        attributes.push_back(info);
+    }
+}
+
+ShaderProgram::UniformHandle ShaderProgram::getUniform(const std::string& name) const
+{
+    auto found = uniformLookup.find(name);
+    return (found != uniformLookup.end()) ? found->second : INVALID_UNIFORM;
+}
+
+GLint ShaderProgram::getAttributeLocation(const std::string& name) const
+{
+    for (const AttributeInfo& attribute : attributes)
+    {
+        if (attribute.name == name)
+            return attribute.location;
+    }
+    return -1;
+}
+
+bool ShaderProgram::bindUniformBlock(const std::string& name, GLuint binding)
+{
+    for (UniformBlockInfo& block : uniformBlocks)
+    {
+        if (block.name == name)
+        {
+            if (block.binding != binding)
+            {
+                glUniformBlockBinding(program, block.index, binding);
+                block.binding = binding;
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+// ===== Uniform values =====
+
+void ShaderProgram::setData(UniformHandle handle, const void* data, size_t bytes)
+{
+    if (handle < 0 || handle >= (UniformHandle)uniforms.size())
+        return;
+
+    UniformInfo& uniform = uniforms[handle];
+    if (bytes > uniform.size)
+        bytes = uniform.size;
+
+    unsigned char* stored = values.data() + uniform.offset;
+    if (std::memcmp(stored, data, bytes) == 0)
+        return;
+
+    std::memcpy(stored, data, bytes);
+    if (!uniform.dirty)
+    {
+        uniform.dirty = true;
+        dirtyUniforms.push_back(handle);
+    }
+}
+
+void ShaderProgram::setInt(UniformHandle handle, int value)
+{
+    GLint stored = value;
+    setData(handle, &stored, sizeof(stored));
+}
+
+void ShaderProgram::setFloat(UniformHandle handle, float value)
+{
+    setData(handle, &value, sizeof(value));
+}
+
+void ShaderProgram::setVec2(UniformHandle handle, const glm::vec2& value)
+{
+    setData(handle, glm::value_ptr(value), sizeof(float) * 2);
+}
+
+void ShaderProgram::setVec3(UniformHandle handle, const glm::vec3& value)
+{
+    setData(handle, glm::value_ptr(value), sizeof(float) * 3);
+}
+
+void ShaderProgram::setVec4(UniformHandle handle, const glm::vec4& value)
+{
+    setData(handle, glm::value_ptr(value), sizeof(float) * 4);
+}
+
+void ShaderProgram::setMat4(UniformHandle handle, const glm::mat4& value)
+{
+    setData(handle, glm::value_ptr(value), sizeof(float) * 16);
+}
+
+void ShaderProgram::setVec4Array(UniformHandle handle, const glm::vec4* vectors, int count)
+{
+    setData(handle, vectors, sizeof(glm::vec4) * count);
+}
+
+void ShaderProgram::setMat4Array(UniformHandle handle, const glm::mat4* matrices, int count)
+{
+    setData(handle, matrices, sizeof(glm::mat4) * count);
+}
+
+void ShaderProgram::bind()
+{
+    GLStateCache::useProgram(program);
+    apply();
+}
+
+void ShaderProgram::apply()
+{
+    for (UniformHandle handle : dirtyUniforms)
+    {
+        UniformInfo& uniform = uniforms[handle];
+        const void* data = values.data() + uniform.offset;
+        const GLfloat* floats = (const GLfloat*)data;
+        const GLint* ints = (const GLint*)data;
+        const GLuint* uints = (const GLuint*)data;
+        GLsizei count = uniform.arraySize;
+
+        switch (uniform.type)
+        {
+        case GL_FLOAT: glUniform1fv(uniform.location, count, floats); break;
+        case GL_FLOAT_VEC2: glUniform2fv(uniform.location, count, floats); break;
+        case GL_FLOAT_VEC3: glUniform3fv(uniform.location, count, floats); break;
+        case GL_FLOAT_VEC4: glUniform4fv(uniform.location, count, floats); break;
+        case GL_FLOAT_MAT2: glUniformMatrix2fv(uniform.location, count, GL_FALSE, floats); break;
+        case GL_FLOAT_MAT3: glUniformMatrix3fv(uniform.location, count, GL_FALSE, floats); break;
+        case GL_FLOAT_MAT4: glUniformMatrix4fv(uniform.location, count, GL_FALSE, floats); break;
+        case GL_INT_VEC2: case GL_BOOL_VEC2: glUniform2iv(uniform.location, count, ints); break;
+        case GL_INT_VEC3: case GL_BOOL_VEC3: glUniform3iv(uniform.location, count, ints); break;
+        case GL_INT_VEC4: case GL_BOOL_VEC4: glUniform4iv(uniform.location, count, ints); break;
+        case GL_UNSIGNED_INT: glUniform1uiv(uniform.location, count, uints); break;
+        case GL_UNSIGNED_INT_VEC2: glUniform2uiv(uniform.location, count, uints); break;
+        case GL_UNSIGNED_INT_VEC3: glUniform3uiv(uniform.location, count, uints); break;
+        case GL_UNSIGNED_INT_VEC4: glUniform4uiv(uniform.location, count, uints); break;
+        default: glUniform1iv(uniform.location, count, ints); break;  // int, bool, samplers
+        }
+
+        uniform.dirty = false;
+    }
+    dirtyUniforms.clear();
+}
+
+void ShaderProgram::destroy()
+{
+    if (program != 0)
+    {
+        GLStateCache::deleteProgram(program);
+        program = 0;
+    }
+    uniforms.clear();
+    uniformBlocks.clear();
+    attributes.clear();
+    uniformLookup.clear();
+    values.clear();
+    dirtyUniforms.clear();
+}
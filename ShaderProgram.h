@@ -0,0 +1,155 @@
+#pragma once
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <glm/glm.hpp>
+#include <glad/gl.h>
+
+/**
+ * @class ShaderProgram
+ * @brief Compiled/linked GLSL program with reflected uniforms
+ *
+ * At link time the active uniforms, uniform blocks and attributes are enumerated.
+ * Uniforms are addressed through pre-resolved handles, their values are stored
+ * CPU-side, and only values that actually changed are uploaded by apply()/bind().
+ */
+class ShaderProgram
+{
+public:
+    // Index of a reflected uniform, -1 if the uniform is not active
+    typedef int UniformHandle;
+    static const UniformHandle INVALID_UNIFORM = -1;
+
+    struct UniformInfo
+    {
+        std::string name;       // Without a trailing "[0]" for arrays
+        GLint location;
+        GLenum type;
+        GLint arraySize;
+        size_t offset;          // Into the CPU-side value storage
+        size_t size;            // Bytes for the whole array
+        bool dirty;
+    };
+
+    struct UniformBlockInfo
+    {
+        std::string name;
+        GLuint index;
+        GLint dataSize;
+        GLuint binding;
+    };
+
+    struct AttributeInfo
+    {
+        std::string name;
+        GLint location;
+        GLenum type;
+        GLint arraySize;
+    };
+
+private:
+    GLuint program;
+    std::vector<UniformInfo> uniforms;
+    std::vector<UniformBlockInfo> uniformBlocks;
+    std::vector<AttributeInfo> attributes;
+    std::unordered_map<std::string, UniformHandle> uniformLookup;
+    std::vector<unsigned char> values;
+    std::vector<UniformHandle> dirtyUniforms;
+
+    /**
+     * Compile a single shader stage
+     * @return Shader object, or 0 if compilation failed
+     */
+    static GLuint compileStage(GLenum stage, const std::string& source, const std::string& path);
+
+    /**
+     * Enumerate active uniforms, uniform blocks and attributes
+     */
+    void reflect();
+
+    /**
+     * Store a value CPU-side and mark it dirty if it changed
+     */
+    void setData(UniformHandle handle, const void* data, size_t bytes);
+
+public:
+    ShaderProgram();
+    ~ShaderProgram();
+
+    ShaderProgram(const ShaderProgram&) = delete;
+    ShaderProgram& operator=(const ShaderProgram&) = delete;
+
+    /**
+     * Compile and link vertex and fragment shaders from files
+     * @param vertPath Path to vertex shader file
+     * @param fragPath Path to fragment shader file
+     * @return True if the program linked
+     */
+    bool loadFromFiles(const std::string& vertPath, const std::string& fragPath);
+
+    /**
+     * Compile and link any set of stages
+     * @param stages Pairs of (stage type, file path)
+     * @return True if the program linked
+     */
+    bool loadStages(const std::vector<std::pair<GLenum, std::string>>& stages);
+
+    /**
+     * Load shader source code from file
+     * @param filepath Path to shader file
+     * @return Shader source as string, empty if failed
+     */
+    static std::string loadSourceFromFile(const std::string& filepath);
+
+    GLuint getId() const { return program; }
+    bool isValid() const { return program != 0; }
+
+    // ===== Reflection =====
+    /**
+     * Resolve a uniform once (do this at load time, not per frame)
+     * @return Handle, or INVALID_UNIFORM if the uniform is not active
+     */
+    UniformHandle getUniform(const std::string& name) const;
+
+    /**
+     * Location of an active vertex attribute, -1 if not active
+     */
+    GLint getAttributeLocation(const std::string& name) const;
+
+    /**
+     * Assign a uniform block to a binding point (no-op if the block is not active)
+     * @return True if the block exists
+     */
+    bool bindUniformBlock(const std::string& name, GLuint binding);
+
+    const std::vector<UniformInfo>& getUniforms() const { return uniforms; }
+    const std::vector<UniformBlockInfo>& getUniformBlocks() const { return uniformBlocks; }
+    const std::vector<AttributeInfo>& getAttributes() const { return attributes; }
+
+    // ===== Uniform values (stored CPU-side, uploaded when dirty) =====
+    void setInt(UniformHandle handle, int value);
+    void setBool(UniformHandle handle, bool value) { setInt(handle, value ? 1 : 0); }
+    void setFloat(UniformHandle handle, float value);
+    void setVec2(UniformHandle handle, const glm::vec2& value);
+    void setVec3(UniformHandle handle, const glm::vec3& value);
+    void setVec4(UniformHandle handle, const glm::vec4& value);
+    void setMat4(UniformHandle handle, const glm::mat4& value);
+    void setVec4Array(UniformHandle handle, const glm::vec4* vectors, int count);
+    void setMat4Array(UniformHandle handle, const glm::mat4* matrices, int count);
+
+    /**
+     * Make the program current (through the state cache) and upload dirty uniforms
+     */
+    void bind();
+
+    /**
+     * Upload dirty uniforms; the program must already be current
+     */
+    void apply();
+
+    /**
+     * Delete the program object
+     */
+    void destroy();
+};
@@ -0,0 +1,56 @@
+# version 430 core
+
+// Vertex shader for GPU-culled multi-draws (see GpuCuller)
+// Instances come from the culling storage buffer, indexed by the visible list
+
+layout(location = 0) in vec3 aPos;
+layout(location = 1) in vec3 aNormal;
+layout(location = 2) in vec2 aTex;
+
+// visible[baseInstance + gl_InstanceID], fed as an instanced attribute so gl_BaseInstance is not needed
+layout(location = 9) in uint aInstanceIndex;
+
+// Per-frame data, uploaded once and shared by every program (binding 0)
+layout(std140) uniform FrameData
+{
+	mat4 view;
+	mat4 projection;
+	mat4 viewProjection;
+	vec4 cameraPosition;
+	vec4 time;				// x = seconds, y = frame delta
+};
+
+// Matches GpuInstance (std430, 128 bytes)
+struct Instance
+{
+	mat4 transform;
+	vec4 uvRect;			// Material UV rectangle
+	float layer;			// Material texture layer
+	vec4 boundingSphere;
+	uint commandIndex;
+};
+
+// All instances submitted for culling (STORAGE_BINDING_CULL_INSTANCES)
+layout(std430, binding = 1) readonly buffer CullInstanceBuffer
+{
+	Instance instances[];
+};
+
+out vec2 texCoord;
+out vec3 worldPosition;
+out vec3 worldNormal;
+flat out vec4 materialUvRect;
+flat out float materialLayer;
+
+void main()
+{
+	Instance instance = instances[aInstanceIndex];
+
+	gl_Position = viewProjection * instance.transform * vec4(aPos, 1.0);
+
+	texCoord = aTex;
+	worldPosition = vec3(instance.transform * vec4(aPos, 1.0));
+	worldNormal = mat3(instance.transform) * aNormal;
+	materialUvRect = instance.uvRect;
+	materialLayer = instance.layer;
+}
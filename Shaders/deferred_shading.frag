@@ -0,0 +1,207 @@
+# version 430 core
+
+// Lighting pass of the deferred path (see DeferredRenderer)
+// Reads each G-buffer texel once and evaluates only the lights of its cluster,
+// binned by ClusteredLighting exactly as for Shaders/sample.frag
+
+out vec4 FragColor;
+
+// Per-frame data, uploaded once and shared by every program (binding 0)
+layout(std140) uniform FrameData
+{
+	mat4 view;
+	mat4 projection;
+	mat4 viewProjection;
+	vec4 cameraPosition;
+	vec4 time;				// x = seconds, y = frame delta
+};
+
+// Cluster grid of this frame (see ClusteredLighting, binding 2)
+layout(std140) uniform LightingData
+{
+	uvec4 clusterGrid;		// x, y = screen tiles, z = depth slices, w = light count
+	vec4 clusterDepth;		// x = near edge of slice 1, y = slices per log unit of depth
+	vec4 clusterScreen;		// xy = tiles per pixel
+	vec4 lighting;			// x = ambient, y = 1 if lighting is enabled, z = 1 for G-buffer output
+};
+
+// Sun and its shadow cascades (see CascadedShadowMaps, binding 3)
+layout(std140) uniform ShadowData
+{
+	mat4 cascadeMatrices[4];	// World space to shadow map texture space
+	vec4 cascadeSplits;			// View depth where each cascade ends
+	vec4 cascadeTexelSizes;		// World-space size of one texel of each cascade
+	vec4 sunDirection;			// xyz = toward the sun, w = 1 if shadows are enabled
+	vec4 sunColor;				// rgb = color * intensity
+};
+
+// One cascade per layer, depth comparison with linear filtering (CascadedShadowMaps::SHADOW_MAP_UNIT)
+layout(binding = 3) uniform sampler2DArrayShadow shadowMap;
+
+// Matches PointLight (std430, 32 bytes)
+struct PointLight
+{
+	vec3 position;
+	float radius;
+	vec3 color;
+	float intensity;
+};
+
+layout(std430, binding = 7) readonly buffer LightBuffer
+{
+	PointLight lights[];
+};
+
+layout(std430, binding = 8) readonly buffer LightClusterBuffer
+{
+	uvec2 lightClusters[];
+};
+
+layout(std430, binding = 9) readonly buffer LightIndexBuffer
+{
+	uint lightIndices[];
+};
+
+// G-buffer: rgb = albedo, a = roughness / rg = octahedral normal, b = metalness, a = lit flag / depth
+uniform sampler2D albedoRoughness;
+uniform sampler2D normalMetalness;
+uniform sampler2D depthBuffer;
+
+uniform mat4 inverseViewProjection;
+uniform vec3 clearColor;
+
+// Clip depth is in [0, 1] (reverse-Z with glClipControl) instead of [-1, 1]
+uniform bool reverseZ;
+
+const float PI = 3.14159265;
+
+// Same cascade lookup as Shaders/sample.frag
+float sunShadow(vec3 position, vec3 normal, float viewDepth)
+{
+	if (sunDirection.w == 0.0 || viewDepth > cascadeSplits[3])
+		return 1.0;
+
+	int cascade = 0;
+	while (cascade < 3 && viewDepth > cascadeSplits[cascade])
+		cascade++;
+
+	vec3 offsetPosition = position + normal * cascadeTexelSizes[cascade] * 1.5;
+	vec3 coord = (cascadeMatrices[cascade] * vec4(offsetPosition, 1.0)).xyz;
+	vec2 texel = 0.5 / vec2(textureSize(shadowMap, 0).xy);
+	float lit = 0.0;
+	lit += texture(shadowMap, vec4(coord.xy + vec2(-texel.x, -texel.y), float(cascade), coord.z));
+	lit += texture(shadowMap, vec4(coord.xy + vec2(texel.x, -texel.y), float(cascade), coord.z));
+	lit += texture(shadowMap, vec4(coord.xy + vec2(-texel.x, texel.y), float(cascade), coord.z));
+	lit += texture(shadowMap, vec4(coord.xy + vec2(texel.x, texel.y), float(cascade), coord.z));
+	return lit * 0.25;
+}
+
+vec3 decodeNormal(vec2 encoded)
+{
+	vec2 octahedral = encoded * 2.0 - 1.0;
+	vec3 normal = vec3(octahedral, 1.0 - abs(octahedral.x) - abs(octahedral.y));
+	if (normal.z < 0.0)
+		normal.xy = (1.0 - abs(normal.yx)) *
+			vec2(normal.x >= 0.0 ? 1.0 : -1.0, normal.y >= 0.0 ? 1.0 : -1.0);
+	return normalize(normal);
+}
+
+// Lambert diffuse plus GGX specular (Schlick Fresnel, Smith-Schlick visibility) of light arriving from direction
+// Same BRDF as the forward path of Shaders/sample.frag
+vec3 shadeDirection(vec3 direction, vec3 radiance, vec3 normal, vec3 toCamera, vec3 albedo, float roughness,
+	float metalness)
+{
+	float nDotL = max(dot(normal, direction), 0.0);
+	if (nDotL <= 0.0)
+		return vec3(0.0);
+
+	vec3 halfway = normalize(direction + toCamera);
+	float nDotV = max(dot(normal, toCamera), 1e-4);
+	float nDotH = max(dot(normal, halfway), 0.0);
+	float vDotH = max(dot(toCamera, halfway), 0.0);
+
+	float alpha = roughness * roughness;
+	float alphaSquared = alpha * alpha;
+	float denominator = nDotH * nDotH * (alphaSquared - 1.0) + 1.0;
+	float distribution = alphaSquared / (PI * denominator * denominator);
+	float k = alpha * 0.5;
+	float visibility = 0.25 / ((nDotL * (1.0 - k) + k) * (nDotV * (1.0 - k) + k));
+	vec3 f0 = mix(vec3(0.04), albedo, metalness);
+	vec3 fresnel = f0 + (1.0 - f0) * pow(1.0 - vDotH, 5.0);
+
+	vec3 diffuse = albedo * (1.0 - metalness) * (1.0 - fresnel);
+	vec3 specular = fresnel * distribution * visibility * PI;
+	return (diffuse + specular) * radiance * nDotL;
+}
+
+// shadeDirection() of one point light, with the same windowed falloff as the forward path
+vec3 shadeLight(PointLight light, vec3 position, vec3 normal, vec3 toCamera, vec3 albedo, float roughness,
+	float metalness)
+{
+	vec3 toLight = light.position - position;
+	float distanceSquared = dot(toLight, toLight);
+	float radiusSquared = light.radius * light.radius;
+	if (distanceSquared >= radiusSquared)
+		return vec3(0.0);
+
+	float falloff = 1.0 - distanceSquared / radiusSquared;
+	vec3 radiance = light.color * light.intensity * falloff * falloff;
+	vec3 direction = toLight * inversesqrt(max(distanceSquared, 1e-8));
+	return shadeDirection(direction, radiance, normal, toCamera, albedo, roughness, metalness);
+}
+
+void main()
+{
+	ivec2 pixel = ivec2(gl_FragCoord.xy);
+	float depth = texelFetch(depthBuffer, pixel, 0).r;
+	gl_FragDepth = depth;
+
+	// Cleared depth: nothing was drawn here
+	if (depth == (reverseZ ? 0.0 : 1.0))
+	{
+		FragColor = vec4(clearColor, 1.0);
+		return;
+	}
+
+	vec4 albedoSample = texelFetch(albedoRoughness, pixel, 0);
+	vec4 normalSample = texelFetch(normalMetalness, pixel, 0);
+	vec3 albedo = albedoSample.rgb;
+	if (lighting.y == 0.0)
+	{
+		FragColor = vec4(albedo, 1.0);
+		return;
+	}
+
+	// Ambient only for surfaces without a lit flag (impostors)
+	vec3 color = albedo * lighting.x;
+	if (normalSample.a < 0.5)
+	{
+		FragColor = vec4(color, 1.0);
+		return;
+	}
+
+	// World position from the depth buffer
+	vec2 ndc = (gl_FragCoord.xy / vec2(textureSize(depthBuffer, 0))) * 2.0 - 1.0;
+	vec4 world = inverseViewProjection * vec4(ndc, reverseZ ? depth : depth * 2.0 - 1.0, 1.0);
+	vec3 position = world.xyz / world.w;
+
+	// Same cluster lookup as Shaders/sample.frag
+	float viewDepth = -(view * vec4(position, 1.0)).z;
+	uint slice = 0u;
+	if (viewDepth >= clusterDepth.x)
+		slice = min(clusterGrid.z - 1u, 1u + uint(log(viewDepth / clusterDepth.x) * clusterDepth.y));
+	uvec2 tile = min(uvec2(gl_FragCoord.xy * clusterScreen.xy), clusterGrid.xy - 1u);
+	uvec2 cluster = lightClusters[(slice * clusterGrid.y + tile.y) * clusterGrid.x + tile.x];
+
+	vec3 normal = decodeNormal(normalSample.rg);
+	vec3 toCamera = normalize(cameraPosition.xyz - position);
+	color += shadeDirection(sunDirection.xyz, sunColor.rgb * sunShadow(position, normal, viewDepth), normal, toCamera,
+		albedo, albedoSample.a, normalSample.b);
+	for (uint i = 0u; i < cluster.y; i++)
+	{
+		color += shadeLight(lights[lightIndices[cluster.x + i]], position, normal, toCamera, albedo,
+			albedoSample.a, normalSample.b);
+	}
+
+	FragColor = vec4(color, 1.0);
+}
@@ -0,0 +1,10 @@
+# version 430 core
+
+// Fullscreen triangle of the deferred lighting pass (see DeferredRenderer::shade)
+// No vertex attributes: the corners come from gl_VertexID
+
+void main()
+{
+	vec2 corner = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+	gl_Position = vec4(corner * 2.0 - 1.0, 0.0, 1.0);
+}
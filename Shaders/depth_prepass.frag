@@ -0,0 +1,7 @@
+# version 330 core
+
+// Depth-only pre-pass: color writes are masked, only the depth test and write run
+
+void main()
+{
+}
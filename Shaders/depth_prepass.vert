@@ -0,0 +1,41 @@
+# version 460 core
+
+// Depth-only pre-pass for multi-draw indirect (see IndirectBatcher::redraw)
+// Reads only the position stream; the main pass then tests with GL_EQUAL, so
+// gl_Position must be computed exactly as in indirect.vert
+
+layout(location = 0) in vec3 aPos;
+
+// Per-frame data, uploaded once and shared by every program (binding 0)
+layout(std140) uniform FrameData
+{
+	mat4 view;
+	mat4 projection;
+	mat4 viewProjection;
+	vec4 cameraPosition;
+	vec4 time;				// x = seconds, y = frame delta
+};
+
+// Matches InstanceData (std430, 96 bytes)
+struct Instance
+{
+	mat4 transform;
+	vec4 uvRect;			// Material UV rectangle
+	float layer;			// Material texture layer
+};
+
+// All instances of the multi-draw (STORAGE_BINDING_INSTANCES)
+layout(std430, binding = 0) readonly buffer InstanceBuffer
+{
+	Instance instances[];
+};
+
+// Same depth in every program that computes gl_Position the same way
+invariant gl_Position;
+
+void main()
+{
+	Instance instance = instances[gl_BaseInstance + gl_InstanceID];
+
+	gl_Position = viewProjection * instance.transform * vec4(aPos, 1.0);
+}
@@ -0,0 +1,87 @@
+# version 330 core
+
+// Fragment shader of octahedral impostors (see ImpostorRenderer)
+// Blends the four baked views closest to the camera direction
+
+layout(location = 0) out vec4 FragColor;
+
+// Second G-buffer target of the deferred path (see DeferredRenderer), ignored when drawing forward
+layout(location = 1) out vec4 GBufferNormal;
+
+// Per-frame data, uploaded once and shared by every program (binding 0)
+layout(std140) uniform FrameData
+{
+	mat4 view;
+	mat4 projection;
+	mat4 viewProjection;
+	vec4 cameraPosition;
+	vec4 time;				// x = seconds, y = frame delta
+};
+
+// Clustered lighting switch and ambient term (see ClusteredLighting, binding 2)
+// Distant models are not binned against the lights, they only get the ambient term
+layout(std140) uniform LightingData
+{
+	uvec4 clusterGrid;
+	vec4 clusterDepth;
+	vec4 clusterScreen;
+	vec4 lighting;			// x = ambient, y = 1 if lighting is enabled, z = 1 for G-buffer output
+};
+
+uniform sampler2DArray colorAtlas;
+uniform sampler2DArray normalDepthAtlas;
+uniform float atlasLayer;
+uniform float viewGridSize;
+
+// Clip depth is in [0, 1] (reverse-Z with glClipControl) instead of [-1, 1]
+uniform bool reverseZ;
+
+in vec2 quadUV;
+in vec3 quadPosition;
+flat in vec2 viewCell;
+flat in vec2 viewWeights;
+flat in vec3 toCamera;
+flat in float worldRadius;
+flat in float fade;
+
+// 4x4 Bayer matrix; the mesh of a crossfading instance keeps exactly the pixels discarded here
+const float BAYER[16] = float[16](0.0, 8.0, 2.0, 10.0, 12.0, 4.0, 14.0, 6.0, 3.0, 11.0, 1.0, 9.0, 15.0, 7.0, 13.0, 5.0);
+
+float ditherThreshold()
+{
+	ivec2 pixel = ivec2(gl_FragCoord.xy) & 3;
+	return (BAYER[pixel.y * 4 + pixel.x] + 0.5) / 16.0;
+}
+
+vec4 sampleViews(sampler2DArray atlas)
+{
+	vec4 view00 = texture(atlas, vec3((viewCell + quadUV) / viewGridSize, atlasLayer));
+	vec4 view10 = texture(atlas, vec3((viewCell + vec2(1.0, 0.0) + quadUV) / viewGridSize, atlasLayer));
+	vec4 view01 = texture(atlas, vec3((viewCell + vec2(0.0, 1.0) + quadUV) / viewGridSize, atlasLayer));
+	vec4 view11 = texture(atlas, vec3((viewCell + vec2(1.0, 1.0) + quadUV) / viewGridSize, atlasLayer));
+	return mix(mix(view00, view10, viewWeights.x), mix(view01, view11, viewWeights.x), viewWeights.y);
+}
+
+void main()
+{
+	if (ditherThreshold() >= fade)
+		discard;
+
+	vec4 color = sampleViews(colorAtlas);
+	if (color.a < 0.5)
+		discard;
+
+	// Baked depth 0.5 is the quad's plane, 0 and 1 are one radius towards and away from the camera
+	float bakedDepth = sampleViews(normalDepthAtlas).w / color.a;
+	vec3 position = quadPosition + toCamera * (0.5 - bakedDepth) * 2.0 * worldRadius;
+	vec4 clip = viewProjection * vec4(position, 1.0);
+	gl_FragDepth = reverseZ ? clip.z / clip.w : clip.z / clip.w * 0.5 + 0.5;
+
+	FragColor = vec4(color.rgb / color.a, 1.0);
+
+	// Lit flag 0: the deferred pass applies only the ambient term, like the forward one
+	if (lighting.z != 0.0)
+		GBufferNormal = vec4(0.5, 0.5, 0.0, 0.0);
+	else if (lighting.y != 0.0)
+		FragColor.rgb *= lighting.x;
+}
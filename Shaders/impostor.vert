@@ -0,0 +1,66 @@
+# version 330 core
+
+// Vertex shader of octahedral impostors (see ImpostorRenderer)
+// One camera-facing quad per instance, its 4-vertex triangle strip generated from gl_VertexID
+
+// Per-instance transform (locations 3-6)
+layout(location = 3) in mat4 aInstanceTransform;
+
+// Per-frame data, uploaded once and shared by every program (binding 0)
+layout(std140) uniform FrameData
+{
+	mat4 view;
+	mat4 projection;
+	mat4 viewProjection;
+	vec4 cameraPosition;
+	vec4 time;				// x = seconds, y = frame delta
+};
+
+uniform vec4 boundingSphere;	// Object-space center and radius of the baked mesh
+uniform float viewGridSize;		// Views per atlas side
+uniform float fadeStart;		// Crossfade with the mesh, by distance to the instance origin
+uniform float fadeEnd;
+
+out vec2 quadUV;
+out vec3 quadPosition;
+flat out vec2 viewCell;			// Lower-left of the 2x2 blended views
+flat out vec2 viewWeights;		// Bilinear weights between them
+flat out vec3 toCamera;			// World-space unit vector towards the camera
+flat out float worldRadius;
+flat out float fade;
+
+// Unit vector to [-1, 1]^2, upper hemisphere inside the diamond (matches ImpostorRenderer)
+vec2 octahedralEncode(vec3 direction)
+{
+	vec3 n = direction / (abs(direction.x) + abs(direction.y) + abs(direction.z));
+	vec2 folded = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+	return n.z >= 0.0 ? n.xy : folded;
+}
+
+void main()
+{
+	mat3 rotationScale = mat3(aInstanceTransform);
+	vec3 center = (aInstanceTransform * vec4(boundingSphere.xyz, 1.0)).xyz;
+	worldRadius = boundingSphere.w * length(rotationScale[0]);
+
+	// The camera direction in object space picks the baked views
+	vec3 objectDirection = normalize(transpose(rotationScale) * (cameraPosition.xyz - center));
+	vec2 grid = (octahedralEncode(objectDirection) * 0.5 + 0.5) * viewGridSize - 0.5;
+	grid = clamp(grid, vec2(0.0), vec2(viewGridSize - 1.0));
+	viewCell = min(floor(grid), vec2(viewGridSize - 2.0));
+	viewWeights = grid - viewCell;
+
+	// Same basis the views were baked with, so quad UVs line up with the atlas cells
+	vec3 objectUp = abs(objectDirection.y) > 0.99 ? vec3(0.0, 0.0, 1.0) : vec3(0.0, 1.0, 0.0);
+	vec3 objectRight = normalize(cross(objectUp, objectDirection));
+	objectUp = cross(objectDirection, objectRight);
+
+	vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1);
+	vec3 objectOffset = ((corner.x * 2.0 - 1.0) * objectRight + (corner.y * 2.0 - 1.0) * objectUp) * boundingSphere.w;
+	quadPosition = center + rotationScale * objectOffset;
+	gl_Position = viewProjection * vec4(quadPosition, 1.0);
+
+	quadUV = corner;
+	toCamera = normalize(rotationScale * objectDirection);
+	fade = clamp((distance(cameraPosition.xyz, aInstanceTransform[3].xyz) - fadeStart) / (fadeEnd - fadeStart), 0.0, 1.0);
+}
@@ -0,0 +1,26 @@
+# version 330 core
+
+// Fragment shader of the impostor bake (see ImpostorRenderer)
+// Writes one view of the color and normal/depth atlases
+
+layout(location = 0) out vec4 bakedColor;
+layout(location = 1) out vec4 bakedNormalDepth;	// xyz = object-space normal * 0.5 + 0.5, w = view depth
+
+// Material of the baked mesh (see TexturePacker)
+uniform sampler2DArray tex0;
+uniform vec4 materialUvRect;
+uniform float materialLayer;
+
+in vec2 texCoord;
+in vec3 normal;
+
+void main()
+{
+	vec2 packedUV = materialUvRect.xy + fract(texCoord) * materialUvRect.zw;
+	vec2 dx = dFdx(texCoord) * materialUvRect.zw;
+	vec2 dy = dFdy(texCoord) * materialUvRect.zw;
+
+	// Alpha marks covered texels; the orthographic depth is linear over the bounding sphere
+	bakedColor = vec4(textureGrad(tex0, vec3(packedUV, materialLayer), dx, dy).rgb, 1.0);
+	bakedNormalDepth = vec4(normalize(normal) * 0.5 + 0.5, gl_FragCoord.z);
+}
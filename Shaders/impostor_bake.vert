@@ -0,0 +1,22 @@
+# version 330 core
+
+// Vertex shader of the impostor bake (see ImpostorRenderer)
+// Draws a mesh in object space into one octahedral view of the atlas
+
+layout(location = 0) in vec3 aPos;
+layout(location = 1) in vec3 aNormal;
+layout(location = 2) in vec2 aTex;
+
+// Orthographic view of the atlas cell being baked
+uniform mat4 bakeViewProjection;
+
+out vec2 texCoord;
+out vec3 normal;
+
+void main()
+{
+	gl_Position = bakeViewProjection * vec4(aPos, 1.0);
+
+	texCoord = aTex;
+	normal = aNormal;
+}
@@ -0,0 +1,52 @@
+# version 330 core
+
+// Fragment shader of meshes crossfading into their impostor (see ImpostorRenderer)
+// Textured like Shaders/sample.frag, keeping the pixels Shaders/impostor.frag discards
+
+layout(location = 0) out vec4 FragColor;
+
+// Second G-buffer target of the deferred path (see DeferredRenderer), ignored when drawing forward
+layout(location = 1) out vec4 GBufferNormal;
+
+// Clustered lighting switch and ambient term (see ClusteredLighting, binding 2)
+// Distant models are not binned against the lights, they only get the ambient term
+layout(std140) uniform LightingData
+{
+	uvec4 clusterGrid;
+	vec4 clusterDepth;
+	vec4 clusterScreen;
+	vec4 lighting;			// x = ambient, y = 1 if lighting is enabled, z = 1 for G-buffer output
+};
+
+uniform sampler2DArray tex0;
+
+flat in vec4 materialUvRect;
+flat in float materialLayer;
+flat in float fade;
+in vec2 texCoord;
+
+// Same 4x4 Bayer matrix as Shaders/impostor.frag
+const float BAYER[16] = float[16](0.0, 8.0, 2.0, 10.0, 12.0, 4.0, 14.0, 6.0, 3.0, 11.0, 1.0, 9.0, 15.0, 7.0, 13.0, 5.0);
+
+float ditherThreshold()
+{
+	ivec2 pixel = ivec2(gl_FragCoord.xy) & 3;
+	return (BAYER[pixel.y * 4 + pixel.x] + 0.5) / 16.0;
+}
+
+void main()
+{
+	if (ditherThreshold() < fade)
+		discard;
+
+	vec2 packedUV = materialUvRect.xy + fract(texCoord) * materialUvRect.zw;
+	vec2 dx = dFdx(texCoord) * materialUvRect.zw;
+	vec2 dy = dFdy(texCoord) * materialUvRect.zw;
+	FragColor = textureGrad(tex0, vec3(packedUV, materialLayer), dx, dy);
+
+	// Lit flag 0: the deferred pass applies only the ambient term, like the forward one
+	if (lighting.z != 0.0)
+		GBufferNormal = vec4(0.5, 0.5, 0.0, 0.0);
+	else if (lighting.y != 0.0)
+		FragColor.rgb *= lighting.x;
+}
@@ -0,0 +1,39 @@
+# version 330 core
+
+// Vertex shader of meshes crossfading into their impostor (see ImpostorRenderer)
+// Instanced only: transform columns at 3-6, material UV rectangle at 7, texture layer at 8
+
+layout(location = 0) in vec3 aPos;
+layout(location = 2) in vec2 aTex;
+layout(location = 3) in mat4 aInstanceTransform;
+layout(location = 7) in vec4 aInstanceUvRect;
+layout(location = 8) in float aInstanceLayer;
+
+// Per-frame data, uploaded once and shared by every program (binding 0)
+layout(std140) uniform FrameData
+{
+	mat4 view;
+	mat4 projection;
+	mat4 viewProjection;
+	vec4 cameraPosition;
+	vec4 time;				// x = seconds, y = frame delta
+};
+
+// Same fade band as Shaders/impostor.vert
+uniform float fadeStart;
+uniform float fadeEnd;
+
+out vec2 texCoord;
+flat out vec4 materialUvRect;
+flat out float materialLayer;
+flat out float fade;
+
+void main()
+{
+	gl_Position = viewProjection * aInstanceTransform * vec4(aPos, 1.0);
+
+	texCoord = aTex;
+	materialUvRect = aInstanceUvRect;
+	materialLayer = aInstanceLayer;
+	fade = clamp((distance(cameraPosition.xyz, aInstanceTransform[3].xyz) - fadeStart) / (fadeEnd - fadeStart), 0.0, 1.0);
+}
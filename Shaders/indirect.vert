@@ -0,0 +1,55 @@
+# version 460 core
+
+// Vertex shader for multi-draw indirect (see IndirectBatcher)
+// Every draw of the multi-draw reads its instances from one storage buffer
+
+layout(location = 0) in vec3 aPos;
+layout(location = 1) in vec3 aNormal;
+layout(location = 2) in vec2 aTex;
+
+// Per-frame data, uploaded once and shared by every program (binding 0)
+layout(std140) uniform FrameData
+{
+	mat4 view;
+	mat4 projection;
+	mat4 viewProjection;
+	vec4 cameraPosition;
+	vec4 time;				// x = seconds, y = frame delta
+};
+
+// Matches InstanceData (std430, 96 bytes)
+struct Instance
+{
+	mat4 transform;
+	vec4 uvRect;			// Material UV rectangle
+	float layer;			// Material texture layer
+};
+
+// All instances of the multi-draw (STORAGE_BINDING_INSTANCES)
+layout(std430, binding = 0) readonly buffer InstanceBuffer
+{
+	Instance instances[];
+};
+
+out vec2 texCoord;
+out vec3 worldPosition;
+out vec3 worldNormal;
+flat out vec4 materialUvRect;
+flat out float materialLayer;
+
+// Matches the depth pre-pass (depth_prepass.vert), which this program is tested against with GL_EQUAL
+invariant gl_Position;
+
+void main()
+{
+	// Each command's baseInstance points at its first instance
+	Instance instance = instances[gl_BaseInstance + gl_InstanceID];
+
+	gl_Position = viewProjection * instance.transform * vec4(aPos, 1.0);
+
+	texCoord = aTex;
+	worldPosition = vec3(instance.transform * vec4(aPos, 1.0));
+	worldNormal = mat3(instance.transform) * aNormal;
+	materialUvRect = instance.uvRect;
+	materialLayer = instance.layer;
+}
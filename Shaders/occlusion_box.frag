@@ -0,0 +1,10 @@
+# version 330 core
+
+// Occlusion query boxes only count samples; color and depth writes are masked off
+
+out vec4 FragColor;
+
+void main()
+{
+	FragColor = vec4(1.0);
+}
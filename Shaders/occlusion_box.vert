@@ -0,0 +1,25 @@
+# version 330 core
+
+// Bounding box of one occlusion query (see OcclusionQueries)
+// The 14-vertex triangle strip of a unit cube is generated from gl_VertexID, no vertex buffer is bound
+
+// Per-frame data, uploaded once and shared by every program (binding 0)
+layout(std140) uniform FrameData
+{
+	mat4 view;
+	mat4 projection;
+	mat4 viewProjection;
+	vec4 cameraPosition;
+	vec4 time;				// x = seconds, y = frame delta
+};
+
+// World-space box
+uniform vec3 boxMin;
+uniform vec3 boxMax;
+
+void main()
+{
+	// Corner bits of the strip vertices, one bit per vertex
+	vec3 corner = vec3((0x287a >> gl_VertexID) & 1, (0x02af >> gl_VertexID) & 1, (0x31e3 >> gl_VertexID) & 1);
+	gl_Position = viewProjection * vec4(mix(boxMin, boxMax, corner), 1.0);
+}
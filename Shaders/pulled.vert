@@ -0,0 +1,74 @@
+# version 460 core
+
+// Vertex shader for multi-draw indirect with programmable vertex pulling
+// (see MeshRegistry::bindPulling). No vertex attributes: the VAO only holds the
+// index buffer, and every vertex is fetched and decoded from a storage buffer.
+
+// Per-frame data, uploaded once and shared by every program (binding 0)
+layout(std140) uniform FrameData
+{
+	mat4 view;
+	mat4 projection;
+	mat4 viewProjection;
+	vec4 cameraPosition;
+	vec4 time;				// x = seconds, y = frame delta
+};
+
+// Matches InstanceData (std430, 96 bytes)
+struct Instance
+{
+	mat4 transform;
+	vec4 uvRect;			// Material UV rectangle
+	float layer;			// Material texture layer
+};
+
+// All instances of the multi-draw (STORAGE_BINDING_INSTANCES)
+layout(std430, binding = 0) readonly buffer InstanceBuffer
+{
+	Instance instances[];
+};
+
+// Matches PackedVertex (16 bytes): half position, octahedral snorm16 normal, half UV
+struct PackedVertex
+{
+	uint positionXY;
+	uint positionZ;
+	uint normal;
+	uint texCoord;
+};
+
+// Every vertex of the mesh registry (STORAGE_BINDING_PULLED_VERTICES)
+layout(std430, binding = 6) readonly buffer PulledVertexBuffer
+{
+	PackedVertex packedVertices[];
+};
+
+out vec2 texCoord;
+out vec3 worldPosition;
+out vec3 worldNormal;
+flat out vec4 materialUvRect;
+flat out float materialLayer;
+
+void main()
+{
+	// gl_VertexID already includes the command's baseVertex
+	PackedVertex packed = packedVertices[gl_VertexID];
+	vec3 position = vec3(unpackHalf2x16(packed.positionXY), unpackHalf2x16(packed.positionZ).x);
+
+	// Unfold the octahedral normal (inverse of packVertex in MeshRegistry.cpp)
+	vec2 octahedral = unpackSnorm2x16(packed.normal);
+	vec3 normal = vec3(octahedral, 1.0 - abs(octahedral.x) - abs(octahedral.y));
+	if (normal.z < 0.0)
+		normal.xy = (1.0 - abs(normal.yx)) *
+			vec2(normal.x >= 0.0 ? 1.0 : -1.0, normal.y >= 0.0 ? 1.0 : -1.0);
+
+	Instance instance = instances[gl_BaseInstance + gl_InstanceID];
+
+	gl_Position = viewProjection * instance.transform * vec4(position, 1.0);
+
+	texCoord = unpackHalf2x16(packed.texCoord);
+	worldPosition = vec3(instance.transform * vec4(position, 1.0));
+	worldNormal = mat3(instance.transform) * normal;
+	materialUvRect = instance.uvRect;
+	materialLayer = instance.layer;
+}
@@ -1,18 +1,204 @@
-# version 330 core
+# version 430 core
 
-out vec4 FragColor;
+layout(location = 0) out vec4 FragColor;
+
+// Second G-buffer target of the deferred path (see DeferredRenderer), ignored when drawing forward
+layout(location = 1) out vec4 GBufferNormal;
 
 // Texture to be passed
-uniform sampler2D tex0;
+// Every material lives in a layer of a texture array (see TexturePacker)
+uniform sampler2DArray tex0;
+
+// Packed location of the material: xy = UV offset, zw = UV scale
+flat in vec4 materialUvRect;
+
+// Array layer of the material
+flat in float materialLayer;
 
-// Should receive the texCoord from the vertex shader 
+// Should receive the texCoord from the vertex shader
 in vec2 texCoord;
 
+// World-space surface, for lighting
+in vec3 worldPosition;
+in vec3 worldNormal;
+
+// Per-frame data, uploaded once and shared by every program (binding 0)
+layout(std140) uniform FrameData
+{
+	mat4 view;
+	mat4 projection;
+	mat4 viewProjection;
+	vec4 cameraPosition;
+	vec4 time;				// x = seconds, y = frame delta
+};
+
+// Cluster grid of this frame (see ClusteredLighting, binding 2)
+layout(std140) uniform LightingData
+{
+	uvec4 clusterGrid;		// x, y = screen tiles, z = depth slices, w = light count
+	vec4 clusterDepth;		// x = near edge of slice 1, y = slices per log unit of depth
+	vec4 clusterScreen;		// xy = tiles per pixel
+	vec4 lighting;			// x = ambient, y = 1 if lighting is enabled, z = 1 for G-buffer output
+};
+
+// Sun and its shadow cascades (see CascadedShadowMaps, binding 3)
+layout(std140) uniform ShadowData
+{
+	mat4 cascadeMatrices[4];	// World space to shadow map texture space
+	vec4 cascadeSplits;			// View depth where each cascade ends
+	vec4 cascadeTexelSizes;		// World-space size of one texel of each cascade
+	vec4 sunDirection;			// xyz = toward the sun, w = 1 if shadows are enabled
+	vec4 sunColor;				// rgb = color * intensity
+};
+
+// One cascade per layer, depth comparison with linear filtering (CascadedShadowMaps::SHADOW_MAP_UNIT)
+layout(binding = 3) uniform sampler2DArrayShadow shadowMap;
+
+// The packed materials only carry albedo; every surface shares these, lit forward or written to the G-buffer
+const float MATERIAL_ROUGHNESS = 0.6;
+const float MATERIAL_METALNESS = 0.0;
+
+const float PI = 3.14159265;
+
+// Matches PointLight (std430, 32 bytes)
+struct PointLight
+{
+	vec3 position;
+	float radius;
+	vec3 color;
+	float intensity;
+};
+
+// Every light of the scene (STORAGE_BINDING_LIGHTS)
+layout(std430, binding = 7) readonly buffer LightBuffer
+{
+	PointLight lights[];
+};
+
+// (first index, count) per cluster (STORAGE_BINDING_LIGHT_CLUSTERS)
+layout(std430, binding = 8) readonly buffer LightClusterBuffer
+{
+	uvec2 lightClusters[];
+};
+
+// Light indices of all clusters, back to back (STORAGE_BINDING_LIGHT_INDICES)
+layout(std430, binding = 9) readonly buffer LightIndexBuffer
+{
+	uint lightIndices[];
+};
+
+// Fraction of the sun reaching a surface: 4 hardware PCF taps in the cascade covering its view depth
+// The lookup moves along the normal by about a texel so surfaces do not shadow themselves
+float sunShadow(vec3 position, vec3 normal, float viewDepth)
+{
+	if (sunDirection.w == 0.0 || viewDepth > cascadeSplits[3])
+		return 1.0;
+
+	int cascade = 0;
+	while (cascade < 3 && viewDepth > cascadeSplits[cascade])
+		cascade++;
+
+	vec3 offsetPosition = position + normal * cascadeTexelSizes[cascade] * 1.5;
+	vec3 coord = (cascadeMatrices[cascade] * vec4(offsetPosition, 1.0)).xyz;
+	vec2 texel = 0.5 / vec2(textureSize(shadowMap, 0).xy);
+	float lit = 0.0;
+	lit += texture(shadowMap, vec4(coord.xy + vec2(-texel.x, -texel.y), float(cascade), coord.z));
+	lit += texture(shadowMap, vec4(coord.xy + vec2(texel.x, -texel.y), float(cascade), coord.z));
+	lit += texture(shadowMap, vec4(coord.xy + vec2(-texel.x, texel.y), float(cascade), coord.z));
+	lit += texture(shadowMap, vec4(coord.xy + vec2(texel.x, texel.y), float(cascade), coord.z));
+	return lit * 0.25;
+}
+
+// Lambert diffuse plus GGX specular (Schlick Fresnel, Smith-Schlick visibility) of light arriving from direction
+// Same BRDF as Shaders/deferred_shading.frag, so both paths light a surface alike
+vec3 shadeDirection(vec3 direction, vec3 radiance, vec3 normal, vec3 toCamera, vec3 albedo, float roughness,
+	float metalness)
+{
+	float nDotL = max(dot(normal, direction), 0.0);
+	if (nDotL <= 0.0)
+		return vec3(0.0);
+
+	vec3 halfway = normalize(direction + toCamera);
+	float nDotV = max(dot(normal, toCamera), 1e-4);
+	float nDotH = max(dot(normal, halfway), 0.0);
+	float vDotH = max(dot(toCamera, halfway), 0.0);
+
+	float alpha = roughness * roughness;
+	float alphaSquared = alpha * alpha;
+	float denominator = nDotH * nDotH * (alphaSquared - 1.0) + 1.0;
+	float distribution = alphaSquared / (PI * denominator * denominator);
+	float k = alpha * 0.5;
+	float visibility = 0.25 / ((nDotL * (1.0 - k) + k) * (nDotV * (1.0 - k) + k));
+	vec3 f0 = mix(vec3(0.04), albedo, metalness);
+	vec3 fresnel = f0 + (1.0 - f0) * pow(1.0 - vDotH, 5.0);
+
+	vec3 diffuse = albedo * (1.0 - metalness) * (1.0 - fresnel);
+	vec3 specular = fresnel * distribution * visibility * PI;
+	return (diffuse + specular) * radiance * nDotL;
+}
+
+// Ambient, the sun and the lights of this fragment's cluster
+vec3 clusterLighting(vec3 albedo)
+{
+	// Same slicing as ClusteredLighting::update: slice 0 up to clusterDepth.x, then logarithmic
+	float depth = -(view * vec4(worldPosition, 1.0)).z;
+	uint slice = 0u;
+	if (depth >= clusterDepth.x)
+		slice = min(clusterGrid.z - 1u, 1u + uint(log(depth / clusterDepth.x) * clusterDepth.y));
+
+	uvec2 tile = min(uvec2(gl_FragCoord.xy * clusterScreen.xy), clusterGrid.xy - 1u);
+	uvec2 cluster = lightClusters[(slice * clusterGrid.y + tile.y) * clusterGrid.x + tile.x];
+
+	vec3 normal = normalize(worldNormal);
+	vec3 toCamera = normalize(cameraPosition.xyz - worldPosition);
+	vec3 color = albedo * lighting.x;
+	color += shadeDirection(sunDirection.xyz, sunColor.rgb * sunShadow(worldPosition, normal, depth), normal, toCamera,
+		albedo, MATERIAL_ROUGHNESS, MATERIAL_METALNESS);
+	for (uint i = 0u; i < cluster.y; i++)
+	{
+		PointLight light = lights[lightIndices[cluster.x + i]];
+		vec3 toLight = light.position - worldPosition;
+		float distanceSquared = dot(toLight, toLight);
+		float radiusSquared = light.radius * light.radius;
+		if (distanceSquared >= radiusSquared)
+			continue;
+
+		// Windowed falloff, reaches 0 at the light's radius
+		float falloff = 1.0 - distanceSquared / radiusSquared;
+		vec3 radiance = light.color * light.intensity * falloff * falloff;
+		vec3 direction = toLight * inversesqrt(max(distanceSquared, 1e-8));
+		color += shadeDirection(direction, radiance, normal, toCamera, albedo, MATERIAL_ROUGHNESS, MATERIAL_METALNESS);
+	}
+	return color;
+}
+
 void main()
 {
 	//			      r     g    b    a             ranges from 0.f -> 1.0f
 	// FragColor = vec4(0.0f, 0.f, 1.f, 1.f);
 
+	// Remap the material UV into its packed rectangle
+	// Gradients come from the unwrapped UV so tiling does not pick the wrong mip at seams
+	vec2 packedUV = materialUvRect.xy + fract(texCoord) * materialUvRect.zw;
+	vec2 dx = dFdx(texCoord) * materialUvRect.zw;
+	vec2 dy = dFdy(texCoord) * materialUvRect.zw;
+
 	// Assign the texture color using the function
-	FragColor = texture(tex0, texCoord);
-}
\ No newline at end of file
+	FragColor = textureGrad(tex0, vec3(packedUV, materialLayer), dx, dy);
+
+	// Deferred path: albedo and roughness, octahedral normal and metalness, lit later
+	if (lighting.z != 0.0)
+	{
+		vec3 normal = normalize(worldNormal);
+		normal /= abs(normal.x) + abs(normal.y) + abs(normal.z);
+		vec2 octahedral = normal.z >= 0.0 ? normal.xy :
+			(1.0 - abs(normal.yx)) * vec2(normal.x >= 0.0 ? 1.0 : -1.0, normal.y >= 0.0 ? 1.0 : -1.0);
+		FragColor = vec4(FragColor.rgb, MATERIAL_ROUGHNESS);
+		GBufferNormal = vec4(octahedral * 0.5 + 0.5, MATERIAL_METALNESS, 1.0);
+		return;
+	}
+
+	// Unlit when clustered lighting is off
+	if (lighting.y != 0.0)
+		FragColor.rgb = clusterLighting(FragColor.rgb);
+}
@@ -4,35 +4,72 @@
 // Converts it and stores it into a vec3 variable called aPos
 layout(location = 0) in vec3 aPos;
 
-// Projection matrix
-uniform mat4 projection;
+// Object-space normal at location 1
+layout(location = 1) in vec3 aNormal;
+
+// Per-frame data, uploaded once and shared by every program (binding 0)
+layout(std140) uniform FrameData
+{
+	mat4 view;				// View / camera mat
+	mat4 projection;		// Projection matrix
+	mat4 viewProjection;
+	vec4 cameraPosition;
+	vec4 time;				// x = seconds, y = frame delta
+};
 
 // uniform float x;
 // uniform float y;
 
-// Create a transformation matrix
-
-uniform mat4 transform;
-
-// View / camera mat
-uniform mat4 view;
+// Per-draw data of a single (non-instanced) draw, a range of the ring buffer (binding 1)
+layout(std140) uniform DrawData
+{
+	mat4 transform;			// Create a transformation matrix
+	vec4 uvRect;			// Material UV rectangle
+	float texLayer;			// Material texture layer
+};
 
 // The tex coord / UV is at 0
 // Accesses the UV and assigns it to aTex
 
 layout(location = 2) in vec2 aTex;
 
+// Per-instance data (instanced drawing only)
+// Transform columns at 3-6, material UV rectangle at 7, texture layer at 8
+layout(location = 3) in mat4 aInstanceTransform;
+layout(location = 7) in vec4 aInstanceUvRect;
+layout(location = 8) in float aInstanceLayer;
+
+// True when drawing with glDrawElementsInstanced
+uniform bool useInstancing;
+
 // Pass the tex coord to the fragment shader
 out vec2 texCoord;
 
+// Pass the world-space surface to the fragment shader (lighting)
+out vec3 worldPosition;
+out vec3 worldNormal;
+
+// Pass the packed material to the fragment shader
+flat out vec4 materialUvRect;
+flat out float materialLayer;
+
 void main()
 {
+	// Instances carry their own transform and material
+	mat4 model = useInstancing ? aInstanceTransform : transform;
+
 	//vec3 newPos = vec3(aPos.x + aPos.y, aPos.z);
 	gl_Position =  // Shutter
 	projection * // Apply the lens
 	view * // Position the camera
-	transform * vec4(aPos, 1.0); // Position model
+	model * vec4(aPos, 1.0); // Position model
+
+	// The upper 3x3 of the model matrix is exact for normals under rotation and uniform scale
+	worldPosition = vec3(model * vec4(aPos, 1.0));
+	worldNormal = mat3(model) * aNormal;
 
 	texCoord = aTex;
+	materialUvRect = useInstancing ? aInstanceUvRect : uvRect;
+	materialLayer = useInstancing ? aInstanceLayer : texLayer;
 }
 
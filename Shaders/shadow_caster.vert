@@ -0,0 +1,17 @@
+# version 430 core
+
+// Depth-only caster pass of one shadow cascade (see CascadedShadowMaps)
+// Casters are drawn instanced; only the position and the instance transform are read
+
+layout(location = 0) in vec3 aPos;
+
+// Per-instance transform columns at 3-6 (see InstanceData)
+layout(location = 3) in mat4 aInstanceTransform;
+
+// Light view and orthographic projection of the cascade
+uniform mat4 lightViewProjection;
+
+void main()
+{
+	gl_Position = lightViewProjection * aInstanceTransform * vec4(aPos, 1.0);
+}
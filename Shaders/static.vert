@@ -0,0 +1,43 @@
+# version 330 core
+
+// Vertex shader for static batches (see StaticBatcher)
+// Vertices are already in world space and carry their own material
+
+layout(location = 0) in vec3 aPos;
+layout(location = 1) in vec2 aNormal;		// Octahedral-encoded, world space
+layout(location = 2) in vec2 aTex;
+layout(location = 7) in vec4 aUvRect;
+layout(location = 8) in float aLayer;
+
+// Per-frame data, uploaded once and shared by every program (binding 0)
+layout(std140) uniform FrameData
+{
+	mat4 view;
+	mat4 projection;
+	mat4 viewProjection;
+	vec4 cameraPosition;
+	vec4 time;				// x = seconds, y = frame delta
+};
+
+out vec2 texCoord;
+out vec3 worldPosition;
+out vec3 worldNormal;
+flat out vec4 materialUvRect;
+flat out float materialLayer;
+
+void main()
+{
+	gl_Position = viewProjection * vec4(aPos, 1.0);
+
+	texCoord = aTex;
+	worldPosition = aPos;
+
+	// Unfold the octahedral normal (see StaticBatcher::encodeNormal)
+	worldNormal = vec3(aNormal, 1.0 - abs(aNormal.x) - abs(aNormal.y));
+	if (worldNormal.z < 0.0)
+		worldNormal.xy = (1.0 - abs(worldNormal.yx)) *
+			vec2(worldNormal.x >= 0.0 ? 1.0 : -1.0, worldNormal.y >= 0.0 ? 1.0 : -1.0);
+
+	materialUvRect = aUvRect;
+	materialLayer = aLayer;
+}
@@ -0,0 +1,437 @@
+#include "ShadowMaps.h"
+#include "GLResources.h"
+#include "GLStateCache.h"
+#include "UniformBuffers.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <glm/gtc/matrix_transform.hpp>
+
+static_assert(sizeof(ShadowUniforms) == 4 * 64 + 4 * 16, "ShadowUniforms must match the std140 ShadowData block");
+
+static const char* SHADOW_CASTER_VERT_PATH = "Shaders/shadow_caster.vert";
+static const char* SHADOW_CASTER_FRAG_PATH = "Shaders/depth_prepass.frag";
+
+// Slope-scaled and constant depth offset of the casters, against acne on lit surfaces
+static const float POLYGON_OFFSET_FACTOR = 2.0f;
+static const float POLYGON_OFFSET_UNITS = 4.0f;
+
+CascadedShadowMaps::CascadedShadowMaps(ThreadPool* threadPool)
+    : threadPool(threadPool),
+    casterLightViewProjection(ShaderProgram::INVALID_UNIFORM),
+    shadowMap(0),
+    staticCache(0),
+    framebuffer(0),
+    uniformBuffer(0),
+    reverseZ(false),
+    enabled(true),
+    cacheEnabled(true),
+    sunDirection(0.0f, 1.0f, 0.0f),
+    sunColor(0.0f),
+    lightView(1.0f),
+    modelsScanned(0),
+    lastStaticRedraws(0),
+    lastStaticCasterDraws(0),
+    lastDynamicCasterDraws(0),
+    lastCopies(0)
+{
+    for (Cascade& cascade : cascades)
+    {
+        cascade.splitFar = 0.0f;
+        cascade.extent = 0.0f;
+        cascade.lightCenter = glm::vec3(0.0f);
+        cascade.viewProjection = glm::mat4(1.0f);
+        cascade.frustum = Frustum::fromMatrix(cascade.viewProjection);
+        cascade.staticValid = false;
+        cascade.mapHoldsDynamic = false;
+        cascade.mapStale = true;
+    }
+}
+
+bool CascadedShadowMaps::create()
+{
+    // Bound once like FrameData, every program using Shaders/sample.frag reads it (no sun until update())
+    ShadowUniforms unlit = {};
+    uniformBuffer = GLResources::createBuffer(sizeof(ShadowUniforms), &unlit, GL_DYNAMIC_STORAGE_BIT);
+    GLStateCache::bindBufferRange(GL_UNIFORM_BUFFER, UNIFORM_BINDING_SHADOWS, uniformBuffer, 0, 0);
+
+    if (!casterProgram.loadFromFiles(SHADOW_CASTER_VERT_PATH, SHADOW_CASTER_FRAG_PATH))
+        return false;
+    casterLightViewProjection = casterProgram.getUniform("lightViewProjection");
+
+    // Orthographic depth is linear, 16 bits resolve a few millimeters over the deepest cascade
+    shadowMap = GLResources::createTexture(GL_TEXTURE_2D_ARRAY, 1, GL_DEPTH_COMPONENT16, SHADOW_MAP_SIZE,
+        SHADOW_MAP_SIZE, CASCADE_COUNT);
+    staticCache = GLResources::createTexture(GL_TEXTURE_2D_ARRAY, 1, GL_DEPTH_COMPONENT16, SHADOW_MAP_SIZE,
+        SHADOW_MAP_SIZE, CASCADE_COUNT);
+
+    // Linear filtering of a comparison sampler averages 2 x 2 depth tests (hardware PCF)
+    GLResources::setTextureParameter(shadowMap, GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    GLResources::setTextureParameter(shadowMap, GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    GLResources::setTextureParameter(shadowMap, GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    GLResources::setTextureParameter(shadowMap, GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    GLResources::setTextureParameter(shadowMap, GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE,
+        GL_COMPARE_REF_TO_TEXTURE);
+    GLResources::setTextureParameter(shadowMap, GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+    GLResources::setTextureParameter(staticCache, GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    GLResources::setTextureParameter(staticCache, GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    // Depth only: the layer attached changes per pass
+    glGenFramebuffers(1, &framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, shadowMap, 0, 0);
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+    bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    if (!complete)
+    {
+        std::cerr << "ERROR: Shadow map framebuffer incomplete" << std::endl;
+        return false;
+    }
+
+    instanceStream.create("shadow casters", 1024 * sizeof(InstanceData));
+    return true;
+}
+
+void CascadedShadowMaps::setReverseZ(bool enabled)
+{
+    reverseZ = enabled;
+
+    // The cascade projections change with the clip depth range
+    for (Cascade& cascade : cascades)
+        cascade.staticValid = false;
+}
+
+void CascadedShadowMaps::setSun(const glm::vec3& direction, const glm::vec3& color)
+{
+    sunDirection = glm::normalize(direction);
+    sunColor = color;
+
+    glm::vec3 up = std::abs(sunDirection.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+    lightView = glm::lookAt(glm::vec3(0.0f), -sunDirection, up);
+    for (Cascade& cascade : cascades)
+        cascade.staticValid = false;
+}
+
+void CascadedShadowMaps::setCacheEnabled(bool isEnabled)
+{
+    cacheEnabled = isEnabled;
+
+    // Layers were not maintained while the cache was off
+    for (Cascade& cascade : cascades)
+        cascade.staticValid = false;
+}
+
+void CascadedShadowMaps::beginFrame()
+{
+    instanceStream.beginFrame();
+}
+
+void CascadedShadowMaps::endFrame()
+{
+    instanceStream.endFrame();
+}
+
+void CascadedShadowMaps::scanModels(const std::vector<Model3D>& models, const MeshRegistry& meshes)
+{
+    for (; modelsScanned < models.size(); modelsScanned++)
+    {
+        const Model3D& model = models[modelsScanned];
+        if (!model.isStatic())
+        {
+            dynamicIndices.push_back((unsigned int)modelsScanned);
+            continue;
+        }
+
+        staticCasters.push_back(model);
+        if (!meshes.isValid(model.getMesh()))
+            continue;
+
+        // Only the cascades the new caster falls in are redrawn
+        glm::vec4 sphere = transformBoundingSphere(meshes.getMesh(model.getMesh()), model.getTransformMatrix());
+        for (Cascade& cascade : cascades)
+        {
+            if (cascade.staticValid && cascade.frustum.intersectsSphere(glm::vec3(sphere), sphere.w))
+                cascade.staticValid = false;
+        }
+    }
+    staticCuller.update(staticCasters, meshes);
+
+    dynamicCasters.clear();
+    for (unsigned int index : dynamicIndices)
+        dynamicCasters.push_back(models[index]);
+    dynamicCuller.rebuild(dynamicCasters, meshes);
+}
+
+void CascadedShadowMaps::fitCascade(Cascade& cascade, const Camera& camera, float splitNear, float splitFar)
+{
+    // Bounding sphere of the slice: the corners at depth d lie d * t off the view axis. The center
+    // along the axis that is equally far from the near and far corners follows from n, f and t alone.
+    float tanHalfFov = std::tan(glm::radians(camera.getFOV()) * 0.5f);
+    float aspect = camera.getAspectRatio();
+    float cornerSquared = tanHalfFov * tanHalfFov * (1.0f + aspect * aspect);
+    float centerDepth = std::min(0.5f * (splitNear + splitFar) * (1.0f + cornerSquared), splitFar);
+    float radius = std::max(
+        std::sqrt((splitFar - centerDepth) * (splitFar - centerDepth) + splitFar * splitFar * cornerSquared),
+        std::sqrt((centerDepth - splitNear) * (centerDepth - splitNear) + splitNear * splitNear * cornerSquared));
+
+    // Snapping moves the center by up to half a step per axis, the map is widened to still hold the sphere
+    float extent = 2.0f * radius * (float)SNAP_DIVISIONS / (float)(SNAP_DIVISIONS - 1);
+    float step = extent / (float)SNAP_DIVISIONS;
+    glm::vec3 worldCenter = camera.getPosition() + camera.getFront() * centerDepth;
+    glm::vec3 lightCenter = glm::floor(glm::vec3(lightView * glm::vec4(worldCenter, 1.0f)) / step + 0.5f) * step;
+
+    cascade.splitFar = splitFar;
+    if (cascade.staticValid && lightCenter == cascade.lightCenter && extent == cascade.extent)
+        return;
+
+    cascade.staticValid = false;
+    cascade.extent = extent;
+    cascade.lightCenter = lightCenter;
+
+    // The light looks down -z: casters toward the sun have a larger z
+    float half = 0.5f * extent;
+    float left = lightCenter.x - half;
+    float right = lightCenter.x + half;
+    float bottom = lightCenter.y - half;
+    float top = lightCenter.y + half;
+    float nearPlane = -(lightCenter.z + half + CASTER_REACH);
+    float farPlane = -(lightCenter.z - half);
+    glm::mat4 projection = reverseZ ? glm::orthoRH_ZO(left, right, bottom, top, nearPlane, farPlane) :
+        glm::ortho(left, right, bottom, top, nearPlane, farPlane);
+    cascade.viewProjection = projection * lightView;
+
+    // Clip depth [0, w] gives the same two depth planes as reverse-Z, only their order differs
+    cascade.frustum = Frustum::fromMatrix(cascade.viewProjection, reverseZ);
+}
+
+void CascadedShadowMaps::beginLayer(GLuint texture, unsigned int layer)
+{
+    glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, texture, 0, (GLint)layer);
+
+    // Independent of the scene's clear depth (0 with reverse-Z)
+    const GLfloat farDepth = 1.0f;
+    glClearBufferfv(GL_DEPTH, 0, &farDepth);
+}
+
+size_t CascadedShadowMaps::drawCasters(const std::vector<Model3D>& casters, const std::vector<unsigned int>& visible,
+    const MeshRegistry& meshes)
+{
+    for (CasterBatch& batch : batches)
+        batch.instances.clear();
+
+    for (unsigned int index : visible)
+    {
+        const Model3D& model = casters[index];
+
+        // Few meshes exist, a linear search is enough
+        CasterBatch* batch = nullptr;
+        for (CasterBatch& existing : batches)
+        {
+            if (existing.mesh == model.getMesh())
+            {
+                batch = &existing;
+                break;
+            }
+        }
+        if (!batch)
+        {
+            batches.push_back({ model.getMesh(), {} });
+            batch = &batches.back();
+        }
+
+        // The caster program reads the transform only
+        InstanceData instance = {};
+        instance.transform = model.getTransformMatrix();
+        batch->instances.push_back(instance);
+    }
+
+    for (const CasterBatch& batch : batches)
+    {
+        if (!batch.instances.empty())
+            Model3D::drawInstanced(meshes, batch.mesh, instanceStream, batch.instances.data(),
+                (GLsizei)batch.instances.size());
+    }
+    return visible.size();
+}
+
+void CascadedShadowMaps::uploadUniforms()
+{
+    // Texture space: xy from [-1, 1], depth from the clip depth range
+    glm::mat4 toTexture(1.0f);
+    toTexture[0][0] = 0.5f;
+    toTexture[1][1] = 0.5f;
+    toTexture[3][0] = 0.5f;
+    toTexture[3][1] = 0.5f;
+    if (!reverseZ)
+    {
+        toTexture[2][2] = 0.5f;
+        toTexture[3][2] = 0.5f;
+    }
+
+    ShadowUniforms uniforms;
+    for (unsigned int c = 0; c < CASCADE_COUNT; c++)
+    {
+        uniforms.cascadeMatrices[c] = toTexture * cascades[c].viewProjection;
+        uniforms.cascadeSplits[c] = cascades[c].splitFar;
+        uniforms.cascadeTexelSizes[c] = cascades[c].extent / (float)SHADOW_MAP_SIZE;
+    }
+    uniforms.sunDirection = glm::vec4(sunDirection, enabled ? 1.0f : 0.0f);
+    uniforms.sunColor = glm::vec4(sunColor, 0.0f);
+    GLResources::updateBuffer(uniformBuffer, 0, sizeof(ShadowUniforms), &uniforms);
+}
+
+void CascadedShadowMaps::update(const std::vector<Model3D>& models, const MeshRegistry& meshes, const Camera& camera)
+{
+    lastStaticRedraws = lastStaticCasterDraws = lastDynamicCasterDraws = lastCopies = 0;
+    if (!enabled)
+    {
+        uploadUniforms();
+        return;
+    }
+
+    scanModels(models, meshes);
+
+    // Practical splits: a blend of logarithmic and uniform spacing
+    float nearPlane = camera.getNearPlane();
+    float shadowDistance = std::min(camera.getFarPlane(), MAX_SHADOW_DISTANCE);
+    float splitNear = nearPlane;
+    for (unsigned int c = 0; c < CASCADE_COUNT; c++)
+    {
+        float fraction = (float)(c + 1) / (float)CASCADE_COUNT;
+        float logarithmic = nearPlane * std::pow(shadowDistance / nearPlane, fraction);
+        float uniform = nearPlane + (shadowDistance - nearPlane) * fraction;
+        float splitFar = SPLIT_BLEND * logarithmic + (1.0f - SPLIT_BLEND) * uniform;
+        fitCascade(cascades[c], camera, splitNear, splitFar);
+        splitNear = splitFar;
+    }
+    uploadUniforms();
+
+    // Static casters are only culled for the layers about to be redrawn
+    auto cull = [this](size_t begin, size_t end) {
+        for (size_t c = begin; c < end; c++)
+        {
+            Cascade& cascade = cascades[c];
+            if (!cascade.staticValid || !cacheEnabled)
+                staticCuller.cull(cascade.frustum, cascade.staticVisible);
+            dynamicCuller.cull(cascade.frustum, cascade.dynamicVisible);
+        }
+    };
+    if (threadPool)
+        threadPool->parallelFor(CASCADE_COUNT, 1, cull);
+    else
+        cull(0, CASCADE_COUNT);
+
+    // Reserved up front (plus the alignment of every draw): growing between the draws would unmap the earlier ones
+    size_t instanceCount = 0;
+    for (const Cascade& cascade : cascades)
+    {
+        if (!cascade.staticValid || !cacheEnabled)
+            instanceCount += cascade.staticVisible.size();
+        instanceCount += cascade.dynamicVisible.size();
+    }
+    size_t drawCount = 2 * CASCADE_COUNT * std::max(batches.size(), (size_t)1);
+    instanceStream.reserve((instanceCount + drawCount) * sizeof(InstanceData));
+
+    // Caller state restored below
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    GLenum callerDepthFunc = GLStateCache::getDepthFunc();
+
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glViewport(0, 0, SHADOW_MAP_SIZE, SHADOW_MAP_SIZE);
+    GLStateCache::depthFunc(GL_LESS);
+    glEnable(GL_POLYGON_OFFSET_FILL);
+    glPolygonOffset(POLYGON_OFFSET_FACTOR, POLYGON_OFFSET_UNITS);
+    casterProgram.bind();
+
+    for (unsigned int c = 0; c < CASCADE_COUNT; c++)
+    {
+        Cascade& cascade = cascades[c];
+        casterProgram.setMat4(casterLightViewProjection, cascade.viewProjection);
+        casterProgram.apply();
+        bool hasDynamic = !cascade.dynamicVisible.empty();
+
+        // Naive path for comparison: every caster, every frame
+        if (!cacheEnabled)
+        {
+            beginLayer(shadowMap, c);
+            lastStaticCasterDraws += drawCasters(staticCasters, cascade.staticVisible, meshes);
+            lastDynamicCasterDraws += drawCasters(dynamicCasters, cascade.dynamicVisible, meshes);
+            cascade.mapHoldsDynamic = hasDynamic;
+            cascade.mapStale = true;
+            continue;
+        }
+
+        if (!cascade.staticValid)
+        {
+            beginLayer(staticCache, c);
+            lastStaticCasterDraws += drawCasters(staticCasters, cascade.staticVisible, meshes);
+            cascade.staticValid = true;
+            cascade.mapStale = true;
+            lastStaticRedraws++;
+        }
+
+        // The sampled layer already equals the cache when nothing dynamic was or is drawn over it
+        if (!cascade.mapStale && !hasDynamic && !cascade.mapHoldsDynamic)
+            continue;
+
+        glCopyImageSubData(staticCache, GL_TEXTURE_2D_ARRAY, 0, 0, 0, (GLint)c,
+            shadowMap, GL_TEXTURE_2D_ARRAY, 0, 0, 0, (GLint)c, SHADOW_MAP_SIZE, SHADOW_MAP_SIZE, 1);
+        lastCopies++;
+        if (hasDynamic)
+        {
+            glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, shadowMap, 0, (GLint)c);
+            lastDynamicCasterDraws += drawCasters(dynamicCasters, cascade.dynamicVisible, meshes);
+        }
+        cascade.mapHoldsDynamic = hasDynamic;
+        cascade.mapStale = false;
+    }
+
+    glDisable(GL_POLYGON_OFFSET_FILL);
+    GLStateCache::depthFunc(callerDepthFunc);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+
+    // Sampled by every lit program from here on
+    GLStateCache::bindTexture(SHADOW_MAP_UNIT, GL_TEXTURE_2D_ARRAY, shadowMap);
+}
+
+void CascadedShadowMaps::printStats() const
+{
+    std::cout << "Shadow maps: " << CASCADE_COUNT << " cascades of " << SHADOW_MAP_SIZE << "^2, static cache "
+        << (cacheEnabled ? "on" : "off") << ", " << staticCasters.size() << " static / " << dynamicCasters.size()
+        << " dynamic casters; last frame " << lastStaticRedraws << " cached layers redrawn, "
+        << lastStaticCasterDraws << " static and " << lastDynamicCasterDraws << " dynamic caster draws, "
+        << lastCopies << " layer copies" << std::endl;
+    for (unsigned int c = 0; c < CASCADE_COUNT; c++)
+    {
+        std::cout << "  - Cascade " << c << ": up to " << cascades[c].splitFar << " units, " << cascades[c].extent
+            << " units wide (" << (cascades[c].extent / SHADOW_MAP_SIZE) << " per texel)" << std::endl;
+    }
+    instanceStream.printStats();
+}
+
+void CascadedShadowMaps::destroy()
+{
+    casterProgram.destroy();
+    instanceStream.destroy();
+    if (framebuffer != 0)
+    {
+        glDeleteFramebuffers(1, &framebuffer);
+        framebuffer = 0;
+    }
+    GLuint textures[] = { shadowMap, staticCache };
+    for (GLuint& texture : textures)
+    {
+        if (texture != 0)
+            GLStateCache::deleteTextures(1, &texture);
+    }
+    shadowMap = staticCache = 0;
+    if (uniformBuffer != 0)
+    {
+        GLStateCache::deleteBuffers(1, &uniformBuffer);
+        uniformBuffer = 0;
+    }
+}
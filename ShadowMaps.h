@@ -0,0 +1,209 @@
+#pragma once
+#include <vector>
+#include <glm/glm.hpp>
+#include <glad/gl.h>
+#include "Camera.h"
+#include "Frustum.h"
+#include "FrustumCuller.h"
+#include "MeshRegistry.h"
+#include "Model3D.h"
+#include "ShaderProgram.h"
+#include "StreamBuffer.h"
+#include "ThreadPool.h"
+
+/**
+ * @struct ShadowUniforms
+ * @brief std140 layout of the "ShadowData" block
+ */
+struct ShadowUniforms
+{
+    glm::mat4 cascadeMatrices[4];   // World space to shadow map texture space (xy and depth in [0, 1])
+    glm::vec4 cascadeSplits;        // View depth where each cascade ends
+    glm::vec4 cascadeTexelSizes;    // World-space size of one texel of each cascade
+    glm::vec4 sunDirection;         // xyz = toward the sun, w = 1 if shadows are enabled
+    glm::vec4 sunColor;             // rgb = color * intensity
+};
+
+/**
+ * @class CascadedShadowMaps
+ * @brief Directional sun shadows in CASCADE_COUNT cascades, with a cached layer of the static casters
+ *
+ * The view distance up to MAX_SHADOW_DISTANCE is split into cascades (a
+ * blend of logarithmic and uniform splits). Each cascade is an orthographic
+ * view along the sun direction, fitted stably to its slice of the camera
+ * frustum:
+ * - its size comes from the bounding sphere of the slice, which depends on the
+ *   projection only, so it does not change when the camera turns
+ * - its center is snapped in light space to 1 / SNAP_DIVISIONS of its size (a
+ *   whole number of texels), so shadow edges do not shimmer as the camera moves
+ *   and the cascade only moves every few units; the map is enlarged to keep
+ *   the slice covered between snaps
+ *
+ * Models are split by Model3D::isStatic(). Static casters are rendered into
+ * a layer of a second array (the static cache) that is kept as long as its
+ * cascade has not moved and no new static model lands in it. Every frame the
+ * cached layer is copied into the sampled map and the dynamic casters are
+ * drawn on top; cascades without dynamic casters, now or last frame, are left
+ * untouched. Shadow cost then follows the dynamic casters rather than the
+ * static scene, which is only redrawn a cascade at a time as the camera
+ * travels.
+ *
+ * Casters are culled per cascade against its light frustum (one cascade per
+ * task on the thread pool, SIMD culling, see FrustumCuller) and drawn
+ * instanced, depth only, with slope-scaled polygon offset.
+ *
+ * Shaders/sample.frag picks the cascade by view depth and takes a 4-tap
+ * hardware PCF sample, offset along the normal by about a texel.
+ */
+class CascadedShadowMaps
+{
+public:
+    static const unsigned int CASCADE_COUNT = 4;    // Also hard-coded in the shaders' ShadowData block
+    static const int SHADOW_MAP_SIZE = 2048;
+    static const int SNAP_DIVISIONS = 8;            // Center snapping steps per cascade width
+
+    // Texture unit the shadow map stays bound to (layout(binding) in the shaders)
+    static const GLuint SHADOW_MAP_UNIT = 3;
+
+    static constexpr float MAX_SHADOW_DISTANCE = 80.0f;
+    static constexpr float SPLIT_BLEND = 0.75f;     // 1 = logarithmic splits, 0 = uniform
+    static constexpr float CASTER_REACH = 50.0f;    // Extra depth toward the sun for casters outside the slice
+
+private:
+    struct Cascade
+    {
+        float splitFar;             // View depth where the cascade ends
+        float extent;               // Width of the map in world units
+        glm::vec3 lightCenter;      // Snapped center in light view space
+        glm::mat4 viewProjection;
+        Frustum frustum;
+
+        bool staticValid;           // The static cache layer matches this placement and the static casters
+        bool mapHoldsDynamic;       // The sampled layer has dynamic casters drawn over the cache
+        bool mapStale;              // The sampled layer differs from the cache even without dynamic casters
+
+        std::vector<unsigned int> staticVisible;
+        std::vector<unsigned int> dynamicVisible;
+    };
+
+    struct CasterBatch
+    {
+        MeshHandle mesh;
+        std::vector<InstanceData> instances;
+    };
+
+    ThreadPool* threadPool;
+
+    ShaderProgram casterProgram;
+    ShaderProgram::UniformHandle casterLightViewProjection;
+
+    GLuint shadowMap;           // Sampled, GL_DEPTH_COMPONENT16 array with depth comparison
+    GLuint staticCache;         // Same format, static casters only
+    GLuint framebuffer;
+    GLuint uniformBuffer;
+    StreamBuffer instanceStream;
+    bool reverseZ;
+    bool enabled;
+    bool cacheEnabled;
+
+    glm::vec3 sunDirection;     // Toward the sun
+    glm::vec3 sunColor;
+    glm::mat4 lightView;
+
+    Cascade cascades[CASCADE_COUNT];
+
+    // Static models never move, so they are copied once; dynamic ones are re-read every frame
+    std::vector<Model3D> staticCasters;
+    std::vector<Model3D> dynamicCasters;
+    std::vector<unsigned int> dynamicIndices;
+    size_t modelsScanned;
+    FrustumCuller staticCuller;
+    FrustumCuller dynamicCuller;
+    std::vector<CasterBatch> batches;
+
+    size_t lastStaticRedraws;
+    size_t lastStaticCasterDraws;
+    size_t lastDynamicCasterDraws;
+    size_t lastCopies;
+
+    /**
+     * Take in models appended since the last frame; new static ones invalidate the cascades they fall in
+     */
+    void scanModels(const std::vector<Model3D>& models, const MeshRegistry& meshes);
+
+    /**
+     * Place a cascade around its slice of the camera frustum
+     * Invalidates its static cache layer if the snapped placement changed
+     */
+    void fitCascade(Cascade& cascade, const Camera& camera, float splitNear, float splitFar);
+
+    /**
+     * Attach one array layer to the framebuffer and clear it to the far depth
+     */
+    void beginLayer(GLuint texture, unsigned int layer);
+
+    /**
+     * Draw the visible casters instanced, one draw per mesh
+     * @return Number of casters drawn
+     */
+    size_t drawCasters(const std::vector<Model3D>& casters, const std::vector<unsigned int>& visible,
+        const MeshRegistry& meshes);
+
+    void uploadUniforms();
+
+public:
+    CascadedShadowMaps(ThreadPool* threadPool);
+
+    CascadedShadowMaps(const CascadedShadowMaps&) = delete;
+    CascadedShadowMaps& operator=(const CascadedShadowMaps&) = delete;
+
+    /**
+     * Create the uniform buffer, load the caster program and create the map arrays
+     * The buffer is bound to UNIFORM_BINDING_SHADOWS and holds no sun until update(), so the
+     * shaders stay valid even when this fails (call destroy() either way)
+     * @return False if the program failed to load or the framebuffer is incomplete
+     */
+    bool create();
+
+    /**
+     * Match the clip depth range of the scene (see Camera::setReverseZ)
+     * The maps themselves keep standard depth: orthographic depth is linear already
+     */
+    void setReverseZ(bool enabled);
+
+    /**
+     * Set the directional light (invalidates every cached layer)
+     * @param direction Direction toward the sun
+     * @param color Color times intensity
+     */
+    void setSun(const glm::vec3& direction, const glm::vec3& color);
+
+    void setEnabled(bool isEnabled) { enabled = isEnabled; }
+    bool isEnabled() const { return enabled; }
+
+    /**
+     * Keep static casters in the cached layers, or redraw every caster every frame
+     */
+    void setCacheEnabled(bool isEnabled);
+    bool isCacheEnabled() const { return cacheEnabled; }
+
+    void beginFrame();
+    void endFrame();
+
+    /**
+     * Fit the cascades to the camera, redraw what changed and upload the ShadowData block
+     * Call before the scene's framebuffer is bound: leaves framebuffer 0 bound and restores the
+     * viewport and depth test; binds its own program, the caller rebinds whatever it draws next
+     * @param models Every model of the scene (only ever appended to)
+     * @param meshes Mesh registry of the models
+     * @param camera Camera whose frustum the cascades cover
+     */
+    void update(const std::vector<Model3D>& models, const MeshRegistry& meshes, const Camera& camera);
+
+    /**
+     * Print the cascades and what the last frame redrew
+     */
+    void printStats() const;
+
+    void destroy();
+};
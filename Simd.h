@@ -0,0 +1,24 @@
+#pragma once
+
+/**
+ * SIMD feature detection shared by the CPU-side hot loops
+ *
+ * GRAP1_SSE2 - SSE2 is available (always true on x64)
+ * GRAP1_AVX2 - AVX2 is enabled by the compiler (/arch:AVX2 or -mavx2)
+ *
+ * Code using these must keep a scalar path for other targets.
+ */
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define GRAP1_SSE2 1
+#include <emmintrin.h>
+#else
+#define GRAP1_SSE2 0
+#endif
+
+#if defined(__AVX2__)
+#define GRAP1_AVX2 1
+#include <immintrin.h>
+#else
+#define GRAP1_AVX2 0
+#endif
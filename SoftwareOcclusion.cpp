@@ -0,0 +1,376 @@
+#include "SoftwareOcclusion.h"
+#include "Simd.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <limits>
+
+// Clip-space w below which geometry counts as crossing the near plane
+static const float NEAR_W = 1e-4f;
+
+// Candidates tested per parallelFor chunk
+static const size_t TEST_GRAIN_SIZE = 256;
+
+// Buffer depth (0 = near, 1 = far) of a normalized device depth
+static float toBufferDepth(float ndcZ, bool reverseZ)
+{
+    // Both are affine in ndc z, so they still interpolate linearly across a triangle
+    return reverseZ ? 1.0f - ndcZ : ndcZ * 0.5f + 0.5f;
+}
+
+SoftwareOcclusion::SoftwareOcclusion(ThreadPool* threadPool)
+    : threadPool(threadPool),
+    reverseZ(false),
+    depth((size_t)WIDTH * HEIGHT, 1.0f),
+    blockMaxDepth((size_t)BLOCKS_X * BLOCKS_Y, 1.0f),
+    tileBins((size_t)TILES_X * TILES_Y),
+    lastOccluderCount(0),
+    lastTriangleCount(0),
+    lastTestedCount(0),
+    lastOccludedCount(0),
+    lastRasterMilliseconds(0.0),
+    lastTestMilliseconds(0.0)
+{
+}
+
+void SoftwareOcclusion::setOccluderMesh(MeshHandle mesh, const std::vector<glm::vec3>& positions,
+    const std::vector<unsigned int>& indices)
+{
+    OccluderMesh& occluder = occluderMeshes[mesh];
+    occluder.positions = positions;
+    occluder.indices = indices;
+}
+
+void SoftwareOcclusion::setupTriangles(const OccluderMesh& mesh, const glm::mat4& clipFromObject, bool reverseZ,
+    std::vector<Triangle>& outTriangles)
+{
+    outTriangles.clear();
+
+    // Window coordinates of every vertex, w <= NEAR_W marks vertices behind the near plane
+    std::vector<glm::vec4> window(mesh.positions.size());
+    for (size_t i = 0; i < mesh.positions.size(); i++)
+    {
+        glm::vec4 clip = clipFromObject * glm::vec4(mesh.positions[i], 1.0f);
+        if (clip.w <= NEAR_W)
+        {
+            window[i] = glm::vec4(0.0f, 0.0f, 0.0f, -1.0f);
+            continue;
+        }
+        glm::vec3 ndc = glm::vec3(clip) / clip.w;
+        window[i] = glm::vec4((ndc.x * 0.5f + 0.5f) * WIDTH, (ndc.y * 0.5f + 0.5f) * HEIGHT,
+            toBufferDepth(ndc.z, reverseZ), 1.0f);
+    }
+
+    for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3)
+    {
+        const glm::vec4& v0 = window[mesh.indices[i]];
+        const glm::vec4& v1 = window[mesh.indices[i + 1]];
+        const glm::vec4& v2 = window[mesh.indices[i + 2]];
+        if (v0.w < 0.0f || v1.w < 0.0f || v2.w < 0.0f)
+            continue;
+
+        // Back faces and degenerate triangles
+        float area = (v1.x - v0.x) * (v2.y - v0.y) - (v2.x - v0.x) * (v1.y - v0.y);
+        if (area <= 0.0f)
+            continue;
+
+        // Pixels whose centers may be covered
+        Triangle triangle;
+        triangle.minX = std::max(0, (int)std::floor(std::min(v0.x, std::min(v1.x, v2.x))));
+        triangle.minY = std::max(0, (int)std::floor(std::min(v0.y, std::min(v1.y, v2.y))));
+        triangle.maxX = std::min(WIDTH - 1, (int)std::ceil(std::max(v0.x, std::max(v1.x, v2.x))));
+        triangle.maxY = std::min(HEIGHT - 1, (int)std::ceil(std::max(v0.y, std::max(v1.y, v2.y))));
+        if (triangle.minX > triangle.maxX || triangle.minY > triangle.maxY)
+            continue;
+
+        // Edge i runs from vertex i to vertex i + 1; inside is on its left
+        const glm::vec4* vertices[3] = { &v0, &v1, &v2 };
+        for (int e = 0; e < 3; e++)
+        {
+            const glm::vec4& a = *vertices[e];
+            const glm::vec4& b = *vertices[(e + 1) % 3];
+            triangle.edgeA[e] = a.y - b.y;
+            triangle.edgeB[e] = b.x - a.x;
+            triangle.edgeC[e] = -(triangle.edgeA[e] * a.x + triangle.edgeB[e] * a.y);
+        }
+
+        // depth(x, y) = depthA * x + depthB * y + depthC
+        float dzdx = ((v1.z - v0.z) * (v2.y - v0.y) - (v2.z - v0.z) * (v1.y - v0.y)) / area;
+        float dzdy = ((v2.z - v0.z) * (v1.x - v0.x) - (v1.z - v0.z) * (v2.x - v0.x)) / area;
+        triangle.depthA = dzdx;
+        triangle.depthB = dzdy;
+        triangle.depthC = v0.z - dzdx * v0.x - dzdy * v0.y;
+        outTriangles.push_back(triangle);
+    }
+}
+
+void SoftwareOcclusion::rasterizeTile(int tile)
+{
+    const int tileX = (tile % TILES_X) * TILE_SIZE;
+    const int tileY = (tile / TILES_X) * TILE_SIZE;
+    float* tileDepth = depth.data() + (size_t)tile * TILE_SIZE * TILE_SIZE;
+    std::fill(tileDepth, tileDepth + TILE_SIZE * TILE_SIZE, 1.0f);
+
+    for (unsigned int index : tileBins[tile])
+    {
+        const Triangle& triangle = triangles[index];
+        int minX = std::max(triangle.minX, tileX) - tileX;
+        int maxX = std::min(triangle.maxX, tileX + TILE_SIZE - 1) - tileX;
+        int minY = std::max(triangle.minY, tileY) - tileY;
+        int maxY = std::min(triangle.maxY, tileY + TILE_SIZE - 1) - tileY;
+
+        for (int y = minY; y <= maxY; y++)
+        {
+            float pixelY = (float)(tileY + y) + 0.5f;
+            float* row = tileDepth + y * TILE_SIZE;
+            int x = minX;
+#if GRAP1_AVX2
+            // 8 pixels per step; pixels of the step outside the triangle fail the edge tests
+            x = minX & ~7;
+            const __m256 laneOffsets = _mm256_setr_ps(0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f);
+            for (; x <= maxX; x += 8)
+            {
+                __m256 pixelX = _mm256_add_ps(_mm256_set1_ps((float)(tileX + x)), laneOffsets);
+                __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+                for (int e = 0; e < 3; e++)
+                {
+                    __m256 edge = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(triangle.edgeA[e]), pixelX),
+                        _mm256_set1_ps(triangle.edgeB[e] * pixelY + triangle.edgeC[e]));
+                    inside = _mm256_and_ps(inside, _mm256_cmp_ps(edge, _mm256_setzero_ps(), _CMP_GE_OQ));
+                }
+                __m256 pixelDepth = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(triangle.depthA), pixelX),
+                    _mm256_set1_ps(triangle.depthB * pixelY + triangle.depthC));
+                __m256 current = _mm256_loadu_ps(row + x);
+                __m256 nearer = _mm256_min_ps(current, pixelDepth);
+                _mm256_storeu_ps(row + x, _mm256_blendv_ps(current, nearer, inside));
+            }
+#elif GRAP1_SSE2
+            x = minX & ~3;
+            const __m128 laneOffsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+            for (; x <= maxX; x += 4)
+            {
+                __m128 pixelX = _mm_add_ps(_mm_set1_ps((float)(tileX + x)), laneOffsets);
+                __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+                for (int e = 0; e < 3; e++)
+                {
+                    __m128 edge = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(triangle.edgeA[e]), pixelX),
+                        _mm_set1_ps(triangle.edgeB[e] * pixelY + triangle.edgeC[e]));
+                    inside = _mm_and_ps(inside, _mm_cmpge_ps(edge, _mm_setzero_ps()));
+                }
+                __m128 pixelDepth = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(triangle.depthA), pixelX),
+                    _mm_set1_ps(triangle.depthB * pixelY + triangle.depthC));
+                __m128 current = _mm_loadu_ps(row + x);
+                __m128 nearer = _mm_min_ps(current, pixelDepth);
+                _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearer), _mm_andnot_ps(inside, current)));
+            }
+#endif
+            for (; x <= maxX; x++)
+            {
+                float pixelX = (float)(tileX + x) + 0.5f;
+                bool inside = true;
+                for (int e = 0; e < 3; e++)
+                    inside = inside && triangle.edgeA[e] * pixelX + triangle.edgeB[e] * pixelY + triangle.edgeC[e] >= 0.0f;
+                if (inside)
+                    row[x] = std::min(row[x], triangle.depthA * pixelX + triangle.depthB * pixelY + triangle.depthC);
+            }
+        }
+    }
+
+    // Farthest depth of every block in the tile
+    const int blocksPerTile = TILE_SIZE / BLOCK_SIZE;
+    for (int by = 0; by < blocksPerTile; by++)
+    {
+        for (int bx = 0; bx < blocksPerTile; bx++)
+        {
+            float farthest = 0.0f;
+            for (int y = 0; y < BLOCK_SIZE; y++)
+            {
+                const float* row = tileDepth + (by * BLOCK_SIZE + y) * TILE_SIZE + bx * BLOCK_SIZE;
+                for (int x = 0; x < BLOCK_SIZE; x++)
+                    farthest = std::max(farthest, row[x]);
+            }
+            int blockX = tileX / BLOCK_SIZE + bx;
+            int blockY = tileY / BLOCK_SIZE + by;
+            blockMaxDepth[(size_t)blockY * BLOCKS_X + blockX] = farthest;
+        }
+    }
+}
+
+void SoftwareOcclusion::rasterize(const glm::mat4& viewProjection, const std::vector<const Model3D*>& occluders)
+{
+    // Triangle setup, one occluder per task
+    occluderTriangles.resize(std::max(occluderTriangles.size(), occluders.size()));
+    auto setup = [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++)
+        {
+            occluderTriangles[i].clear();
+            auto found = occluderMeshes.find(occluders[i]->getMesh());
+            if (found != occluderMeshes.end())
+                setupTriangles(found->second, viewProjection * occluders[i]->getTransformMatrix(), reverseZ,
+                    occluderTriangles[i]);
+        }
+    };
+    if (threadPool)
+        threadPool->parallelFor(occluders.size(), 1, setup);
+    else
+        setup(0, occluders.size());
+
+    // Bin by the tiles each triangle's rectangle touches
+    triangles.clear();
+    for (size_t i = 0; i < occluders.size(); i++)
+        triangles.insert(triangles.end(), occluderTriangles[i].begin(), occluderTriangles[i].end());
+    for (std::vector<unsigned int>& bin : tileBins)
+        bin.clear();
+    for (size_t i = 0; i < triangles.size(); i++)
+    {
+        const Triangle& triangle = triangles[i];
+        for (int ty = triangle.minY / TILE_SIZE; ty <= triangle.maxY / TILE_SIZE; ty++)
+        {
+            for (int tx = triangle.minX / TILE_SIZE; tx <= triangle.maxX / TILE_SIZE; tx++)
+                tileBins[(size_t)ty * TILES_X + tx].push_back((unsigned int)i);
+        }
+    }
+
+    // One tile per task
+    auto rasterizeTiles = [this](size_t begin, size_t end) {
+        for (size_t tile = begin; tile < end; tile++)
+            rasterizeTile((int)tile);
+    };
+    if (threadPool)
+        threadPool->parallelFor(tileBins.size(), 1, rasterizeTiles);
+    else
+        rasterizeTiles(0, tileBins.size());
+
+    lastOccluderCount = occluders.size();
+    lastTriangleCount = triangles.size();
+}
+
+float SoftwareOcclusion::getPixel(int x, int y) const
+{
+    int tile = (y / TILE_SIZE) * TILES_X + x / TILE_SIZE;
+    return depth[(size_t)tile * TILE_SIZE * TILE_SIZE + (y % TILE_SIZE) * TILE_SIZE + x % TILE_SIZE];
+}
+
+bool SoftwareOcclusion::isOccluded(const glm::mat4& viewProjection, const glm::vec3& boundsMin,
+    const glm::vec3& boundsMax) const
+{
+    // Screen rectangle and nearest depth of the box
+    glm::vec2 screenMin(std::numeric_limits<float>::max());
+    glm::vec2 screenMax(-std::numeric_limits<float>::max());
+    float nearest = 1.0f;
+    for (int i = 0; i < 8; i++)
+    {
+        glm::vec3 corner((i & 1) ? boundsMax.x : boundsMin.x, (i & 2) ? boundsMax.y : boundsMin.y,
+            (i & 4) ? boundsMax.z : boundsMin.z);
+        glm::vec4 clip = viewProjection * glm::vec4(corner, 1.0f);
+
+        // Crossing the near plane: cannot be tested
+        if (clip.w <= NEAR_W)
+            return false;
+
+        glm::vec3 ndc = glm::vec3(clip) / clip.w;
+        glm::vec2 window((ndc.x * 0.5f + 0.5f) * WIDTH, (ndc.y * 0.5f + 0.5f) * HEIGHT);
+        screenMin = glm::min(screenMin, window);
+        screenMax = glm::max(screenMax, window);
+        nearest = std::min(nearest, toBufferDepth(ndc.z, reverseZ));
+    }
+
+    int minX = std::max(0, (int)std::floor(screenMin.x));
+    int minY = std::max(0, (int)std::floor(screenMin.y));
+    int maxX = std::min(WIDTH - 1, (int)std::floor(screenMax.x));
+    int maxY = std::min(HEIGHT - 1, (int)std::floor(screenMax.y));
+    if (minX > maxX || minY > maxY)
+        return false;
+
+    // Block maxima first, pixels only where a block is not conclusive
+    for (int blockY = minY / BLOCK_SIZE; blockY <= maxY / BLOCK_SIZE; blockY++)
+    {
+        for (int blockX = minX / BLOCK_SIZE; blockX <= maxX / BLOCK_SIZE; blockX++)
+        {
+            if (blockMaxDepth[(size_t)blockY * BLOCKS_X + blockX] < nearest)
+                continue;
+
+            int y0 = std::max(minY, blockY * BLOCK_SIZE);
+            int y1 = std::min(maxY, blockY * BLOCK_SIZE + BLOCK_SIZE - 1);
+            int x0 = std::max(minX, blockX * BLOCK_SIZE);
+            int x1 = std::min(maxX, blockX * BLOCK_SIZE + BLOCK_SIZE - 1);
+            for (int y = y0; y <= y1; y++)
+            {
+                for (int x = x0; x <= x1; x++)
+                {
+                    if (getPixel(x, y) >= nearest)
+                        return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+size_t SoftwareOcclusion::cull(const std::vector<Model3D>& models, const MeshRegistry& meshes,
+    const glm::mat4& viewProjection, const glm::vec3& cameraPosition, std::vector<unsigned int>& inOutVisible)
+{
+    auto rasterStart = std::chrono::high_resolution_clock::now();
+
+    // Nearest candidates (by the near side of their bounding sphere) occlude the rest
+    occluderOrder.clear();
+    for (unsigned int index : inOutVisible)
+    {
+        const Model3D& model = models[index];
+        if (!meshes.isValid(model.getMesh()) || occluderMeshes.find(model.getMesh()) == occluderMeshes.end())
+            continue;
+        glm::vec4 sphere = transformBoundingSphere(meshes.getMesh(model.getMesh()), model.getTransformMatrix());
+        occluderOrder.push_back({ glm::length(glm::vec3(sphere) - cameraPosition) - sphere.w, index });
+    }
+    size_t occluderCount = std::min(occluderOrder.size(), MAX_OCCLUDERS);
+    std::partial_sort(occluderOrder.begin(), occluderOrder.begin() + occluderCount, occluderOrder.end());
+
+    std::vector<const Model3D*> occluders(occluderCount);
+    for (size_t i = 0; i < occluderCount; i++)
+        occluders[i] = &models[occluderOrder[i].second];
+    rasterize(viewProjection, occluders);
+
+    auto testStart = std::chrono::high_resolution_clock::now();
+
+    // Test every candidate against the buffer
+    occludedFlags.assign(inOutVisible.size(), 0);
+    auto test = [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++)
+        {
+            const Model3D& model = models[inOutVisible[i]];
+            if (!meshes.isValid(model.getMesh()))
+                continue;
+            glm::vec3 boundsMin, boundsMax;
+            transformBoundingBox(meshes.getMesh(model.getMesh()), model.getTransformMatrix(), boundsMin, boundsMax);
+            occludedFlags[i] = isOccluded(viewProjection, boundsMin, boundsMax) ? 1 : 0;
+        }
+    };
+    if (threadPool)
+        threadPool->parallelFor(inOutVisible.size(), TEST_GRAIN_SIZE, test);
+    else
+        test(0, inOutVisible.size());
+
+    size_t kept = 0;
+    for (size_t i = 0; i < inOutVisible.size(); i++)
+    {
+        if (!occludedFlags[i])
+            inOutVisible[kept++] = inOutVisible[i];
+    }
+
+    auto end = std::chrono::high_resolution_clock::now();
+    lastTestedCount = inOutVisible.size();
+    lastOccludedCount = inOutVisible.size() - kept;
+    lastRasterMilliseconds = std::chrono::duration<double, std::milli>(testStart - rasterStart).count();
+    lastTestMilliseconds = std::chrono::duration<double, std::milli>(end - testStart).count();
+
+    inOutVisible.resize(kept);
+    return lastOccludedCount;
+}
+
+void SoftwareOcclusion::printStats() const
+{
+    std::cout << "Software occlusion: " << lastOccluderCount << " occluders (" << lastTriangleCount
+        << " front-facing triangles), " << lastOccludedCount << " / " << lastTestedCount << " candidates occluded, "
+        << "raster " << lastRasterMilliseconds << " ms, test " << lastTestMilliseconds << " ms" << std::endl;
+}
@@ -0,0 +1,148 @@
+#pragma once
+#include <unordered_map>
+#include <vector>
+#include <glm/glm.hpp>
+#include "MeshRegistry.h"
+#include "Model3D.h"
+#include "ThreadPool.h"
+
+/**
+ * @class SoftwareOcclusion
+ * @brief CPU occlusion culling against a low-resolution depth buffer
+ *
+ * Each frame the candidates nearest to the camera become occluders. Their
+ * triangles are rasterized into a WIDTH x HEIGHT depth buffer, one screen
+ * tile per task, 8 (AVX2) or 4 (SSE) pixels per step. Every 8x8 block also
+ * keeps its farthest depth. A candidate is occluded when its screen-space
+ * bounding rectangle lies entirely behind the depth buffer: first the block
+ * maxima are checked, then single pixels only in blocks that are not
+ * conclusive.
+ *
+ * Depth is window-space z in [0, 1], 1 = far; reverse-Z projections are
+ * flipped into the same convention on input (see setReverseZ). Only front faces (counter-
+ * clockwise) are rasterized, and triangles crossing the near plane are
+ * skipped, so occluders never cover more than they should. Everything runs on
+ * the CPU and is deterministic for the same input.
+ */
+class SoftwareOcclusion
+{
+public:
+    static const int WIDTH = 256;
+    static const int HEIGHT = 128;
+    static const int TILE_SIZE = 32;            // Pixels per tile side (one task each)
+    static const int BLOCK_SIZE = 8;            // Pixels per hierarchical block side
+    static const int TILES_X = WIDTH / TILE_SIZE;
+    static const int TILES_Y = HEIGHT / TILE_SIZE;
+    static const int BLOCKS_X = WIDTH / BLOCK_SIZE;
+    static const int BLOCKS_Y = HEIGHT / BLOCK_SIZE;
+
+    // Candidates nearest to the camera that are rasterized as occluders
+    static const size_t MAX_OCCLUDERS = 16;
+
+private:
+    struct OccluderMesh
+    {
+        std::vector<glm::vec3> positions;
+        std::vector<unsigned int> indices;
+    };
+
+    // Edge functions (inside where all three are >= 0) and depth plane in pixel space
+    struct Triangle
+    {
+        float edgeA[3];
+        float edgeB[3];
+        float edgeC[3];
+        float depthA;
+        float depthB;
+        float depthC;
+        int minX;
+        int minY;
+        int maxX;
+        int maxY;
+    };
+
+    ThreadPool* threadPool;
+    std::unordered_map<MeshHandle, OccluderMesh> occluderMeshes;
+    bool reverseZ;
+
+    // Tile-major: each tile's pixels are contiguous, so tasks never share cache lines
+    std::vector<float> depth;
+    std::vector<float> blockMaxDepth;
+
+    std::vector<std::vector<Triangle>> occluderTriangles;
+    std::vector<Triangle> triangles;
+    std::vector<std::vector<unsigned int>> tileBins;
+    std::vector<std::pair<float, unsigned int>> occluderOrder;
+    std::vector<unsigned char> occludedFlags;
+
+    size_t lastOccluderCount;
+    size_t lastTriangleCount;
+    size_t lastTestedCount;
+    size_t lastOccludedCount;
+    double lastRasterMilliseconds;
+    double lastTestMilliseconds;
+
+    /**
+     * Transform, back-face cull and set up the triangles of one occluder
+     */
+    static void setupTriangles(const OccluderMesh& mesh, const glm::mat4& clipFromObject, bool reverseZ,
+        std::vector<Triangle>& outTriangles);
+
+    /**
+     * Rasterize the binned triangles of one tile and update its block maxima
+     */
+    void rasterizeTile(int tile);
+
+    float getPixel(int x, int y) const;
+
+public:
+    /**
+     * @param threadPool Pool for tile and candidate tasks (nullptr = calling thread only)
+     */
+    explicit SoftwareOcclusion(ThreadPool* threadPool = nullptr);
+
+    /**
+     * Register the CPU-side triangles of a mesh so its instances can occlude
+     * @param mesh Registry handle the instances use
+     * @param positions Object-space vertex positions
+     * @param indices Triangle list
+     */
+    void setOccluderMesh(MeshHandle mesh, const std::vector<glm::vec3>& positions,
+        const std::vector<unsigned int>& indices);
+
+    /**
+     * Interpret the matrices passed in as reverse-Z ([0, 1] clip depth, 1 = near)
+     */
+    void setReverseZ(bool enabled) { reverseZ = enabled; }
+
+    /**
+     * Clear the depth buffer and rasterize the given occluders
+     * @param viewProjection Camera projection * view matrix
+     * @param occluders Models to rasterize (those without an occluder mesh are skipped)
+     */
+    void rasterize(const glm::mat4& viewProjection, const std::vector<const Model3D*>& occluders);
+
+    /**
+     * True if a world-space box is entirely behind the rasterized occluders
+     * @param viewProjection Same matrix rasterize() was given
+     */
+    bool isOccluded(const glm::mat4& viewProjection, const glm::vec3& boundsMin, const glm::vec3& boundsMax) const;
+
+    /**
+     * Remove occluded models from a visible list (frustum culling output)
+     * The candidates nearest to the camera are rasterized first as occluders
+     * @param models All models
+     * @param meshes Registry with the models' bounds
+     * @param viewProjection Camera projection * view matrix
+     * @param cameraPosition Camera position (picks the nearest occluders)
+     * @param inOutVisible Indices into models; occluded ones are removed, order is kept
+     * @return Number of models removed
+     */
+    size_t cull(const std::vector<Model3D>& models, const MeshRegistry& meshes, const glm::mat4& viewProjection,
+        const glm::vec3& cameraPosition, std::vector<unsigned int>& inOutVisible);
+
+    /**
+     * Print occluder, triangle and culling counts of the last cull()
+     */
+    void printStats() const;
+};
@@ -0,0 +1,280 @@
+#include "StaticBatching.h"
+#include "GLResources.h"
+#include "GLStateCache.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <iostream>
+
+// Vertex buffer binding of the merged vertices
+static const GLuint STATIC_VERTEX_BINDING = 0;
+
+static_assert(sizeof(StaticVertex) == 48, "StaticVertex must match the attribute offsets in StaticBatcher");
+
+StaticBatcher::StaticBatcher(ThreadPool* threadPool)
+    : threadPool(threadPool),
+    processedCount(0),
+    staticCount(0),
+    lastAppendedBatches(0),
+    lastAppendedVertices(0),
+    lastAppendMilliseconds(0.0),
+    lastDrawnBatches(0),
+    lastDrawnTriangles(0)
+{
+}
+
+void StaticBatcher::setVertexAttributes(GLuint vertexArray, GLuint binding)
+{
+    GLResources::setAttribute(vertexArray, 0, 3, GL_FLOAT, (GLuint)offsetof(StaticVertex, position), binding);
+    GLResources::setAttribute(vertexArray, 1, 2, GL_FLOAT, (GLuint)offsetof(StaticVertex, normal), binding);
+    GLResources::setAttribute(vertexArray, 2, 2, GL_FLOAT, (GLuint)offsetof(StaticVertex, texCoord), binding);
+    GLResources::setAttribute(vertexArray, 7, 4, GL_FLOAT, (GLuint)offsetof(StaticVertex, uvRect), binding);
+    GLResources::setAttribute(vertexArray, 8, 1, GL_FLOAT, (GLuint)offsetof(StaticVertex, layer), binding);
+}
+
+glm::vec2 StaticBatcher::encodeNormal(const glm::vec3& normal)
+{
+    // Same folding as the packed vertices of the mesh registry, kept as floats
+    float length = std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z);
+    glm::vec3 n = normal / std::max(length, 1e-8f);
+    if (n.z >= 0.0f)
+        return glm::vec2(n.x, n.y);
+    return glm::vec2((1.0f - std::abs(n.y)) * (n.x >= 0.0f ? 1.0f : -1.0f),
+        (1.0f - std::abs(n.x)) * (n.y >= 0.0f ? 1.0f : -1.0f));
+}
+
+void StaticBatcher::setSourceMesh(MeshHandle mesh, const std::vector<MeshVertex>& vertices,
+    const std::vector<unsigned int>& indices)
+{
+    SourceMesh& source = sourceMeshes[mesh];
+    source.vertices = vertices;
+    source.indices = indices;
+}
+
+void StaticBatcher::update(const std::vector<Model3D>& models, const MeshRegistry& meshes,
+    const TexturePacker& textures)
+{
+    // Place the new static models; a batch is appended to once however many it received
+    dirtyBatches.clear();
+    for (size_t i = processedCount; i < models.size(); i++)
+    {
+        const Model3D& model = models[i];
+        if (!model.isStatic() || !meshes.isValid(model.getMesh()) ||
+            sourceMeshes.find(model.getMesh()) == sourceMeshes.end())
+            continue;
+
+        glm::vec3 boundsMin, boundsMax;
+        transformBoundingBox(meshes.getMesh(model.getMesh()), model.getTransformMatrix(), boundsMin, boundsMax);
+        glm::ivec3 cell = glm::ivec3(glm::floor((boundsMin + boundsMax) * 0.5f / CELL_SIZE));
+
+        GLuint arrayTexture = 0;
+        if (model.getMaterial() < (int)textures.getPackedCount())
+            arrayTexture = textures.getPacked(model.getMaterial()).arrayTexture;
+
+        // 16 bits per cell coordinate and for the texture name
+        unsigned long long key = ((unsigned long long)(cell.x & 0xFFFF) << 48) |
+            ((unsigned long long)(cell.y & 0xFFFF) << 32) | ((unsigned long long)(cell.z & 0xFFFF) << 16) |
+            (arrayTexture & 0xFFFF);
+        auto found = batchLookup.find(key);
+        if (found == batchLookup.end())
+        {
+            found = batchLookup.emplace(key, batches.size()).first;
+            Batch batch;
+            batch.arrayTexture = arrayTexture;
+            batch.uploadedMembers = 0;
+            batch.boundsMin = boundsMin;
+            batch.boundsMax = boundsMax;
+            batch.vertexArray = batch.vertexBuffer = batch.indexBuffer = 0;
+            batch.vertexCount = batch.vertexCapacity = batch.indexCapacity = 0;
+            batch.indexCount = 0;
+            batches.push_back(std::move(batch));
+        }
+
+        Batch& batch = batches[found->second];
+        if (std::find(dirtyBatches.begin(), dirtyBatches.end(), found->second) == dirtyBatches.end())
+            dirtyBatches.push_back(found->second);
+        batch.members.push_back((unsigned int)i);
+        batch.boundsMin = glm::min(batch.boundsMin, boundsMin);
+        batch.boundsMax = glm::max(batch.boundsMax, boundsMax);
+        staticCount++;
+    }
+    processedCount = models.size();
+
+    if (dirtyBatches.empty())
+        return;
+
+    // Transform the new members on the workers, append them here
+    auto start = std::chrono::high_resolution_clock::now();
+    auto build = [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++)
+            buildBatch(batches[dirtyBatches[i]], models, textures);
+    };
+    if (threadPool)
+        threadPool->parallelFor(dirtyBatches.size(), 1, build);
+    else
+        build(0, dirtyBatches.size());
+
+    lastAppendedVertices = 0;
+    for (size_t batch : dirtyBatches)
+    {
+        lastAppendedVertices += batches[batch].vertices.size();
+        uploadBatch(batches[batch]);
+    }
+
+    auto end = std::chrono::high_resolution_clock::now();
+    lastAppendedBatches = dirtyBatches.size();
+    lastAppendMilliseconds = std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+void StaticBatcher::buildBatch(Batch& batch, const std::vector<Model3D>& models, const TexturePacker& textures) const
+{
+    size_t vertexCount = 0;
+    size_t indexCount = 0;
+    for (size_t m = batch.uploadedMembers; m < batch.members.size(); m++)
+    {
+        const SourceMesh& source = sourceMeshes.at(models[batch.members[m]].getMesh());
+        vertexCount += source.vertices.size();
+        indexCount += source.indices.size();
+    }
+    batch.vertices.resize(vertexCount);
+    batch.indices.resize(indexCount);
+
+    size_t vertexOffset = 0;
+    size_t indexOffset = 0;
+    for (size_t m = batch.uploadedMembers; m < batch.members.size(); m++)
+    {
+        const Model3D& model = models[batch.members[m]];
+        const SourceMesh& source = sourceMeshes.at(model.getMesh());
+        glm::mat4 transform = model.getTransformMatrix();
+        // Inverse transpose keeps normals perpendicular under non-uniform scale
+        glm::mat3 normalTransform = glm::transpose(glm::inverse(glm::mat3(transform)));
+
+        PackedTexture material;
+        if (model.getMaterial() < (int)textures.getPackedCount())
+            material = textures.getPacked(model.getMaterial());
+
+        for (size_t i = 0; i < source.vertices.size(); i++)
+        {
+            StaticVertex& vertex = batch.vertices[vertexOffset + i];
+            vertex.position = glm::vec3(transform * glm::vec4(source.vertices[i].position, 1.0f));
+            vertex.texCoord = source.vertices[i].texCoord;
+            vertex.uvRect = material.uvRect;
+            vertex.layer = material.layer;
+            vertex.normal = encodeNormal(glm::normalize(normalTransform * source.vertices[i].normal));
+        }
+        for (size_t i = 0; i < source.indices.size(); i++)
+            batch.indices[indexOffset + i] = (unsigned int)(batch.vertexCount + vertexOffset) + source.indices[i];
+
+        vertexOffset += source.vertices.size();
+        indexOffset += source.indices.size();
+    }
+}
+
+GLuint StaticBatcher::reserveBuffer(GLuint buffer, size_t& capacityBytes, size_t usedBytes, size_t requiredBytes)
+{
+    if (buffer != 0 && requiredBytes <= capacityBytes)
+        return buffer;
+
+    // Doubling keeps the copies of repeated spawns amortised; the old contents are copied on the GPU
+    size_t newCapacity = std::max(requiredBytes, capacityBytes * 2);
+    GLuint grown = GLResources::createBuffer((GLsizeiptr)newCapacity, nullptr, GL_DYNAMIC_STORAGE_BIT);
+    if (buffer != 0)
+    {
+        // Draws still pending keep the old storage alive
+        if (usedBytes > 0)
+            GLResources::copyBuffer(buffer, grown, 0, 0, (GLsizeiptr)usedBytes);
+        GLStateCache::deleteBuffers(1, &buffer);
+    }
+    capacityBytes = newCapacity;
+    return grown;
+}
+
+void StaticBatcher::uploadBatch(Batch& batch)
+{
+    if (batch.vertexArray == 0)
+    {
+        batch.vertexArray = GLResources::createVertexArray();
+        setVertexAttributes(batch.vertexArray, STATIC_VERTEX_BINDING);
+    }
+
+    const size_t usedVertexBytes = batch.vertexCount * sizeof(StaticVertex);
+    const size_t usedIndexBytes = (size_t)batch.indexCount * sizeof(unsigned int);
+    const size_t newVertexBytes = batch.vertices.size() * sizeof(StaticVertex);
+    const size_t newIndexBytes = batch.indices.size() * sizeof(unsigned int);
+
+    size_t vertexCapacityBytes = batch.vertexCapacity * sizeof(StaticVertex);
+    size_t indexCapacityBytes = batch.indexCapacity * sizeof(unsigned int);
+    GLuint vertexBuffer = reserveBuffer(batch.vertexBuffer, vertexCapacityBytes, usedVertexBytes,
+        usedVertexBytes + newVertexBytes);
+    GLuint indexBuffer = reserveBuffer(batch.indexBuffer, indexCapacityBytes, usedIndexBytes,
+        usedIndexBytes + newIndexBytes);
+    batch.vertexCapacity = vertexCapacityBytes / sizeof(StaticVertex);
+    batch.indexCapacity = indexCapacityBytes / sizeof(unsigned int);
+
+    if (vertexBuffer != batch.vertexBuffer)
+    {
+        batch.vertexBuffer = vertexBuffer;
+        GLResources::setVertexBuffer(batch.vertexArray, STATIC_VERTEX_BINDING, batch.vertexBuffer, 0,
+            sizeof(StaticVertex));
+    }
+    if (indexBuffer != batch.indexBuffer)
+    {
+        batch.indexBuffer = indexBuffer;
+        GLResources::setElementBuffer(batch.vertexArray, batch.indexBuffer);
+    }
+
+    // Only the new members' geometry crosses the bus
+    GLResources::updateBuffer(batch.vertexBuffer, (GLintptr)usedVertexBytes, (GLsizeiptr)newVertexBytes,
+        batch.vertices.data());
+    GLResources::updateBuffer(batch.indexBuffer, (GLintptr)usedIndexBytes, (GLsizeiptr)newIndexBytes,
+        batch.indices.data());
+    batch.vertexCount += batch.vertices.size();
+    batch.indexCount += (GLsizei)batch.indices.size();
+    batch.uploadedMembers = batch.members.size();
+
+    // The GPU copy is all draws need
+    std::vector<StaticVertex>().swap(batch.vertices);
+    std::vector<unsigned int>().swap(batch.indices);
+}
+
+void StaticBatcher::draw(const Frustum& frustum)
+{
+    lastDrawnBatches = 0;
+    lastDrawnTriangles = 0;
+    for (const Batch& batch : batches)
+    {
+        if (batch.indexCount == 0 || !frustum.intersectsBox(batch.boundsMin, batch.boundsMax))
+            continue;
+
+        GLStateCache::bindTexture(0, GL_TEXTURE_2D_ARRAY, batch.arrayTexture);
+        GLStateCache::bindVertexArray(batch.vertexArray);
+        glDrawElements(GL_TRIANGLES, batch.indexCount, GL_UNSIGNED_INT, nullptr);
+        lastDrawnBatches++;
+        lastDrawnTriangles += (size_t)batch.indexCount / 3;
+    }
+}
+
+void StaticBatcher::printStats() const
+{
+    std::cout << "Static batching: " << staticCount << " static models in " << batches.size() << " batches, "
+        << lastDrawnBatches << " drawn (" << lastDrawnTriangles << " triangles), last append "
+        << lastAppendedVertices << " vertices to " << lastAppendedBatches << " batches in "
+        << lastAppendMilliseconds << " ms" << std::endl;
+}
+
+void StaticBatcher::destroy()
+{
+    for (Batch& batch : batches)
+    {
+        GLuint buffers[] = { batch.vertexBuffer, batch.indexBuffer };
+        GLStateCache::deleteBuffers(2, buffers);
+        if (batch.vertexArray != 0)
+            GLStateCache::deleteVertexArrays(1, &batch.vertexArray);
+    }
+    batches.clear();
+    batchLookup.clear();
+    dirtyBatches.clear();
+    processedCount = 0;
+    staticCount = 0;
+}
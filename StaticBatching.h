@@ -0,0 +1,162 @@
+#pragma once
+#include <unordered_map>
+#include <vector>
+#include <glm/glm.hpp>
+#include <glad/gl.h>
+#include "Frustum.h"
+#include "MeshRegistry.h"
+#include "Model3D.h"
+#include "TexturePacker.h"
+#include "ThreadPool.h"
+
+/**
+ * @struct StaticVertex
+ * @brief Pre-transformed vertex of a static batch, material baked in (48 bytes)
+ */
+struct StaticVertex
+{
+    glm::vec3 position;     // World space
+    glm::vec2 texCoord;
+    glm::vec4 uvRect;       // Packed material UV rectangle
+    float layer;            // Packed material array layer
+    glm::vec2 normal;       // World space, octahedral-encoded (see StaticBatcher::encodeNormal)
+};
+
+/**
+ * @class StaticBatcher
+ * @brief Merges static models into pre-transformed buffers per spatial cell and texture array
+ *
+ * Models flagged static never move, so their transforms only have to be
+ * applied once. update() places every new static model in the grid cell
+ * that contains its bounds center, one batch per (cell, texture array).
+ * Only the new members of a batch are built on the thread pool: their
+ * vertices are transformed to world space and their material UV rectangle
+ * and layer are written per vertex. The GL thread then appends them to the
+ * batch's buffers, which grow geometrically with GPU-side copies, so a spawn
+ * costs its own vertices rather than its whole cell's. Existing members never
+ * change (models are only appended), so a batch is never rebuilt.
+ * draw() only tests each batch's bounds against the frustum and
+ * issues one glDrawElements per visible batch; static models cost nothing
+ * per frame.
+ */
+class StaticBatcher
+{
+public:
+    // World units per grid cell side
+    static constexpr float CELL_SIZE = 16.0f;
+
+private:
+    struct SourceMesh
+    {
+        std::vector<MeshVertex> vertices;
+        std::vector<unsigned int> indices;
+    };
+
+    struct Batch
+    {
+        GLuint arrayTexture;
+        std::vector<unsigned int> members;      // Indices into the models given to update()
+        size_t uploadedMembers;                 // Members already in the buffers
+        glm::vec3 boundsMin;
+        glm::vec3 boundsMax;
+
+        // New members only, filled on a worker, released after the upload
+        std::vector<StaticVertex> vertices;
+        std::vector<unsigned int> indices;
+
+        GLuint vertexArray;
+        GLuint vertexBuffer;
+        GLuint indexBuffer;
+        size_t vertexCount;
+        size_t vertexCapacity;
+        size_t indexCapacity;
+        GLsizei indexCount;
+    };
+
+    ThreadPool* threadPool;
+    std::unordered_map<MeshHandle, SourceMesh> sourceMeshes;
+    std::vector<Batch> batches;
+    std::unordered_map<unsigned long long, size_t> batchLookup;    // (cell, texture array) -> batch
+    std::vector<size_t> dirtyBatches;
+    size_t processedCount;          // Models update() has already looked at
+    size_t staticCount;
+
+    size_t lastAppendedBatches;
+    size_t lastAppendedVertices;
+    double lastAppendMilliseconds;
+    size_t lastDrawnBatches;
+    size_t lastDrawnTriangles;
+
+    /**
+     * Transform the members added since the last upload into the batch's CPU-side arrays
+     * Indices continue after the vertices already in the buffers
+     */
+    void buildBatch(Batch& batch, const std::vector<Model3D>& models, const TexturePacker& textures) const;
+
+    /**
+     * Append a batch's built arrays to its buffers, growing them if needed (GL thread)
+     */
+    void uploadBatch(Batch& batch);
+
+    /**
+     * Make room for at least the given number of bytes, keeping the first usedBytes
+     * @return Buffer to use from now on (the old one is deleted if it was replaced)
+     */
+    static GLuint reserveBuffer(GLuint buffer, size_t& capacityBytes, size_t usedBytes, size_t requiredBytes);
+
+public:
+    /**
+     * @param threadPool Pool that builds new batch members (nullptr = calling thread only)
+     */
+    explicit StaticBatcher(ThreadPool* threadPool = nullptr);
+
+    StaticBatcher(const StaticBatcher&) = delete;
+    StaticBatcher& operator=(const StaticBatcher&) = delete;
+
+    /**
+     * Define the StaticVertex attributes (locations 0, 1, 2, 7 and 8) of a vertex array
+     * @param vertexArray Vertex array to set up
+     * @param binding Vertex buffer binding the attributes read from
+     */
+    static void setVertexAttributes(GLuint vertexArray, GLuint binding);
+
+    /**
+     * Fold a normal onto the octahedron, two floats instead of three
+     * Unfolded by Shaders/static.vert
+     */
+    static glm::vec2 encodeNormal(const glm::vec3& normal);
+
+    /**
+     * Register the CPU-side geometry of a mesh so its static instances can be merged
+     * @param mesh Registry handle the instances use
+     * @param vertices Object-space vertices
+     * @param indices Triangle list
+     */
+    void setSourceMesh(MeshHandle mesh, const std::vector<MeshVertex>& vertices,
+        const std::vector<unsigned int>& indices);
+
+    /**
+     * Append static models added since the last call to their batches
+     * Models must only ever be appended, and static ones must not change
+     * @param models All models (dynamic ones are skipped)
+     * @param meshes Registry with the models' bounds
+     * @param textures Packed materials
+     */
+    void update(const std::vector<Model3D>& models, const MeshRegistry& meshes, const TexturePacker& textures);
+
+    /**
+     * Draw every batch inside the frustum, one draw call each
+     * A program reading StaticVertex attributes (Shaders/static.vert) must be bound
+     */
+    void draw(const Frustum& frustum);
+
+    size_t getStaticCount() const { return staticCount; }
+    size_t getBatchCount() const { return batches.size(); }
+
+    /**
+     * Print batch counts, the last append and the last draw
+     */
+    void printStats() const;
+
+    void destroy();
+};
@@ -0,0 +1,148 @@
+#include "StreamBuffer.h"
+#include "GLResources.h"
+#include "GLStateCache.h"
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+
+// Storage and mapping flags: written by the CPU only, visible to the GPU
+// without explicit flushes
+static const GLbitfield STORAGE_FLAGS = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+StreamBuffer::StreamBuffer()
+    : buffer(0),
+    mapped(nullptr),
+    regionSize(0),
+    regionCount(0),
+    regionIndex(0),
+    head(0),
+    fences(),
+    frameCount(0),
+    stallCount(0),
+    stallMilliseconds(0.0),
+    growCount(0)
+{
+}
+
+void StreamBuffer::create(const std::string& debugName, size_t bytesPerRegion, int regionCount)
+{
+    destroy();
+
+    name = debugName;
+    this->regionCount = std::clamp(regionCount, 1, MAX_REGIONS);
+    regionIndex = 0;
+    head = 0;
+    allocateStorage(bytesPerRegion);
+}
+
+void StreamBuffer::allocateStorage(size_t bytesPerRegion)
+{
+    regionSize = bytesPerRegion;
+
+    buffer = GLResources::createBuffer(regionSize * regionCount, nullptr, STORAGE_FLAGS);
+    mapped = (unsigned char*)GLResources::mapBuffer(buffer, 0, regionSize * regionCount, STORAGE_FLAGS);
+    if (!mapped)
+        std::cerr << "ERROR: Could not map stream buffer: " << name << std::endl;
+}
+
+void StreamBuffer::releaseStorage()
+{
+    for (int i = 0; i < MAX_REGIONS; i++)
+    {
+        if (fences[i])
+        {
+            glDeleteSync(fences[i]);
+            fences[i] = nullptr;
+        }
+    }
+
+    if (buffer != 0)
+    {
+        GLResources::unmapBuffer(buffer);
+        GLStateCache::deleteBuffers(1, &buffer);
+        buffer = 0;
+    }
+    mapped = nullptr;
+}
+
+void StreamBuffer::beginFrame()
+{
+    regionIndex = (regionIndex + 1) % regionCount;
+    head = 0;
+    frameCount++;
+
+    GLsync fence = fences[regionIndex];
+    if (!fence)
+        return;
+
+    // Poll first: if the GPU is already done this is not a stall
+    GLenum result = glClientWaitSync(fence, 0, 0);
+    if (result == GL_TIMEOUT_EXPIRED)
+    {
+        stallCount++;
+        auto start = std::chrono::high_resolution_clock::now();
+        do
+        {
+            result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);  // 1 ms
+        } while (result == GL_TIMEOUT_EXPIRED);
+        auto end = std::chrono::high_resolution_clock::now();
+        stallMilliseconds += std::chrono::duration<double, std::milli>(end - start).count();
+    }
+
+    glDeleteSync(fence);
+    fences[regionIndex] = nullptr;
+}
+
+void StreamBuffer::endFrame()
+{
+    if (fences[regionIndex])
+        glDeleteSync(fences[regionIndex]);
+    fences[regionIndex] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+void StreamBuffer::reserve(size_t bytes)
+{
+    if (head + bytes <= regionSize)
+        return;
+
+    // Fresh storage is not in use by the GPU, so no region needs waiting on
+    growCount++;
+    size_t newRegionSize = std::max(head + bytes, regionSize * 2);
+    releaseStorage();
+    allocateStorage(newRegionSize);
+    regionIndex = 0;
+    head = 0;
+}
+
+void* StreamBuffer::allocate(size_t bytes, size_t alignment, size_t& outOffset)
+{
+    size_t regionStart = (size_t)regionIndex * regionSize;
+    size_t offset = regionStart + head;
+    if (alignment > 1)
+        offset = (offset + alignment - 1) / alignment * alignment;
+
+    if (offset + bytes > regionStart + regionSize)
+    {
+        reserve(bytes + alignment);
+        return allocate(bytes, alignment, outOffset);
+    }
+
+    head = offset + bytes - regionStart;
+    outOffset = offset;
+    return mapped + offset;
+}
+
+void StreamBuffer::printStats() const
+{
+    std::cout << "Stream buffer '" << name << "': " << regionCount << " x " << (regionSize / 1024) << " KB, "
+        << frameCount << " frames, " << stallCount << " stalls (" << std::fixed << std::setprecision(2)
+        << stallMilliseconds << " ms), " << growCount << " reallocations" << std::endl;
+}
+
+void StreamBuffer::destroy()
+{
+    releaseStorage();
+    regionSize = 0;
+    head = 0;
+}
@@ -0,0 +1,102 @@
+#pragma once
+#include <string>
+#include <glad/gl.h>
+
+/**
+ * @class StreamBuffer
+ * @brief Persistently mapped buffer for data written by the CPU every frame
+ *
+ * Immutable storage (glBufferStorage) is mapped once with
+ * GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT and split into one region per
+ * frame in flight. Each frame:
+ * - beginFrame() moves to the next region and waits on its fence, so the GPU
+ *   is known to be done reading what was written there frames ago
+ * - allocate() bump-allocates from the region and returns a pointer straight
+ *   into the mapping (no staging copy, no glBufferSubData)
+ * - endFrame() fences the region after the frame's draws were submitted
+ *
+ * A wait that actually blocks is counted as a stall. If a frame needs more
+ * than one region, the buffer is replaced by a larger one; draws already
+ * submitted keep the old storage alive until the GPU is done with it.
+ */
+class StreamBuffer
+{
+public:
+    static const int MAX_REGIONS = 4;
+
+private:
+    GLuint buffer;
+    unsigned char* mapped;
+    size_t regionSize;
+    int regionCount;
+    int regionIndex;
+    size_t head;
+    GLsync fences[MAX_REGIONS];
+    std::string name;
+
+    unsigned long long frameCount;
+    unsigned long long stallCount;
+    double stallMilliseconds;
+    unsigned long long growCount;
+
+    /**
+     * Create and map storage for regionCount regions of the given size
+     */
+    void allocateStorage(size_t bytesPerRegion);
+
+    /**
+     * Unmap and delete the storage (frames in flight keep it alive on the GPU side)
+     */
+    void releaseStorage();
+
+public:
+    StreamBuffer();
+
+    StreamBuffer(const StreamBuffer&) = delete;
+    StreamBuffer& operator=(const StreamBuffer&) = delete;
+
+    /**
+     * Create the buffer
+     * @param debugName Name used in printStats()
+     * @param bytesPerRegion Initial capacity of one frame
+     * @param regionCount Frames the GPU may be behind the CPU (at most MAX_REGIONS)
+     */
+    void create(const std::string& debugName, size_t bytesPerRegion, int regionCount = 3);
+
+    /**
+     * Move to the next region, waiting for the GPU to release it if needed
+     */
+    void beginFrame();
+
+    /**
+     * Fence the current region (call after the frame's draws are submitted)
+     */
+    void endFrame();
+
+    /**
+     * Make sure this frame can allocate the given number of bytes in total
+     * Grows the buffer if needed; earlier pointers of this frame stay valid
+     * for the draws they were used in, but must not be written anymore
+     */
+    void reserve(size_t bytes);
+
+    /**
+     * Bump-allocate from the current region
+     * @param bytes Size of the allocation
+     * @param alignment Offset alignment (any value, not only powers of two)
+     * @param outOffset Offset of the allocation inside getBuffer()
+     * @return Write-only pointer into the mapped buffer
+     */
+    void* allocate(size_t bytes, size_t alignment, size_t& outOffset);
+
+    GLuint getBuffer() const { return buffer; }
+    size_t getRegionSize() const { return regionSize; }
+    unsigned long long getStallCount() const { return stallCount; }
+
+    /**
+     * Print frames, stalls and growth since creation
+     */
+    void printStats() const;
+
+    void destroy();
+};
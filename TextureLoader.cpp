@@ -0,0 +1,214 @@
+#include "TextureLoader.h"
+#include "Simd.h"
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+// Size a texture ends up with after the tier and dimension cap are applied
+static void getScaledSize(int width, int height, const TextureQualitySettings& settings,
+    int& outWidth, int& outHeight)
+{
+    int halvings = (int)settings.tier;
+    while ((width > 1 || height > 1) &&
+        (halvings > 0 || std::max(width, height) > settings.maxDimension))
+    {
+        width = std::max(1, width / 2);
+        height = std::max(1, height / 2);
+        if (halvings > 0)
+            halvings--;
+    }
+    outWidth = width;
+    outHeight = height;
+}
+
+TextureLoader::TextureLoader(ThreadPool& pool, const TextureQualitySettings& settings)
+    : pool(pool),
+    settings(settings)
+{
+    // OpenGL expects the first row at the bottom
+    // Set once here, the flag is global and workers only read it
+    stbi_set_flip_vertically_on_load(true);
+}
+
+void TextureLoader::queue(const std::string& filepath)
+{
+    auto entry = std::make_unique<PendingTexture>();
+    entry->path = filepath;
+
+    PendingTexture* target = entry.get();
+    TextureQualitySettings quality = settings;
+    entry->done = pool.submit([target, quality]()
+    {
+        int width, height, channels;
+        unsigned char* bytes = stbi_load(target->path.c_str(), &width, &height, &channels, 0);
+        if (!bytes)
+            return;
+
+        target->image.name = target->path;
+        target->image.width = width;
+        target->image.height = height;
+        target->image.channels = channels;
+        target->image.pixels.assign(bytes, bytes + (size_t)width * height * channels);
+        stbi_image_free(bytes);
+
+        applyQuality(target->image, quality);
+        target->originalWidth = width;
+        target->originalHeight = height;
+        target->loaded = true;
+    });
+
+    pending.push_back(std::move(entry));
+}
+
+std::vector<TextureImage> TextureLoader::finish()
+{
+    std::vector<TextureImage> images;
+    for (auto& entry : pending)
+    {
+        entry->done.wait();
+        if (!entry->loaded)
+        {
+            std::cerr << "ERROR: Failed to load texture: " << entry->path << std::endl;
+            continue;
+        }
+
+        TextureImage& image = entry->image;
+        std::cout << "Texture loaded: " << entry->path << " (" << entry->originalWidth << "x"
+            << entry->originalHeight << " -> " << image.width << "x" << image.height << ")" << std::endl;
+
+        originalSizes.push_back({ entry->originalWidth, entry->originalHeight, image.channels });
+        images.push_back(std::move(image));
+    }
+    pending.clear();
+    return images;
+}
+
+void TextureLoader::printMemoryReport(const TexturePacker& packer) const
+{
+    std::cout << "Texture memory by quality tier (" << originalSizes.size() << " textures, max "
+        << settings.maxDimension << "px):" << std::endl;
+
+    const TextureQuality tiers[] = { TextureQuality::Full, TextureQuality::Half, TextureQuality::Quarter };
+    for (TextureQuality tier : tiers)
+    {
+        TextureQualitySettings tierSettings = settings;
+        tierSettings.tier = tier;
+
+        // Sizes only, the packer lays them out without pixels
+        std::vector<TextureImage> scaled(originalSizes.size());
+        for (size_t i = 0; i < originalSizes.size(); i++)
+        {
+            getScaledSize(originalSizes[i].width, originalSizes[i].height, tierSettings,
+                scaled[i].width, scaled[i].height);
+            scaled[i].channels = originalSizes[i].channels;
+        }
+        size_t bytes = packer.estimateVideoMemory(scaled);
+
+        std::cout << "  - " << std::left << std::setw(8) << getQualityName(tier) << std::right
+            << std::fixed << std::setprecision(2) << (bytes / (1024.0 * 1024.0)) << " MB"
+            << (tier == settings.tier ? "  (active)" : "") << std::endl;
+    }
+    std::cout << "  - Uploaded " << std::fixed << std::setprecision(2)
+        << (packer.getVideoMemory() / (1024.0 * 1024.0)) << " MB in "
+        << packer.getArrayTextureCount() << " array textures" << std::endl;
+}
+
+void TextureLoader::applyQuality(TextureImage& image, const TextureQualitySettings& settings)
+{
+    int targetWidth, targetHeight;
+    getScaledSize(image.width, image.height, settings, targetWidth, targetHeight);
+
+    while (image.width != targetWidth || image.height != targetHeight)
+    {
+        TextureImage smaller;
+        downsample2x(image, smaller);
+        image = std::move(smaller);
+    }
+}
+
+void TextureLoader::downsample2x(const TextureImage& source, TextureImage& destination)
+{
+    const int channels = source.channels;
+    const int width = std::max(1, source.width / 2);
+    const int height = std::max(1, source.height / 2);
+    const size_t sourceStride = (size_t)source.width * channels;
+
+    destination.name = source.name;
+    destination.width = width;
+    destination.height = height;
+    destination.channels = channels;
+    destination.pixels.resize((size_t)width * height * channels);
+
+    std::vector<unsigned char> rowAverage(sourceStride);
+
+    for (int y = 0; y < height; y++)
+    {
+        const unsigned char* row0 = source.pixels.data() + std::min(2 * y, source.height - 1) * sourceStride;
+        const unsigned char* row1 = source.pixels.data() + std::min(2 * y + 1, source.height - 1) * sourceStride;
+        unsigned char* average = rowAverage.data();
+
+        // Vertical pass: average the two source rows, 16 bytes at a time
+        size_t i = 0;
+#if GRAP1_SSE2
+        for (; i + 16 <= sourceStride; i += 16)
+        {
+            __m128i a = _mm_loadu_si128((const __m128i*)(row0 + i));
+            __m128i b = _mm_loadu_si128((const __m128i*)(row1 + i));
+            _mm_storeu_si128((__m128i*)(average + i), _mm_avg_epu8(a, b));
+        }
+#endif
+        for (; i < sourceStride; i++)
+            average[i] = (unsigned char)((row0[i] + row1[i] + 1) >> 1);
+
+        // Horizontal pass: average neighbouring texels
+        unsigned char* out = destination.pixels.data() + (size_t)y * width * channels;
+        int x = 0;
+#if GRAP1_SSE2
+        if (channels == 4)
+        {
+            // 8 source RGBA texels -> 4 output texels
+            for (; x + 4 <= width && 2 * (x + 4) <= source.width; x += 4)
+            {
+                __m128 a = _mm_castsi128_ps(_mm_loadu_si128((const __m128i*)(average + x * 8)));
+                __m128 b = _mm_castsi128_ps(_mm_loadu_si128((const __m128i*)(average + x * 8 + 16)));
+                __m128i even = _mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+                __m128i odd = _mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+                _mm_storeu_si128((__m128i*)(out + x * 4), _mm_avg_epu8(even, odd));
+            }
+        }
+#endif
+        for (; x < width; x++)
+        {
+            const unsigned char* texel0 = average + std::min(2 * x, source.width - 1) * channels;
+            const unsigned char* texel1 = average + std::min(2 * x + 1, source.width - 1) * channels;
+            for (int c = 0; c < channels; c++)
+                out[x * channels + c] = (unsigned char)((texel0[c] + texel1[c] + 1) >> 1);
+        }
+    }
+}
+
+bool TextureLoader::parseQuality(const std::string& name, TextureQuality& outTier)
+{
+    if (name == "full")
+        outTier = TextureQuality::Full;
+    else if (name == "half")
+        outTier = TextureQuality::Half;
+    else if (name == "quarter")
+        outTier = TextureQuality::Quarter;
+    else
+        return false;
+    return true;
+}
+
+const char* TextureLoader::getQualityName(TextureQuality tier)
+{
+    switch (tier)
+    {
+    case TextureQuality::Half: return "Half";
+    case TextureQuality::Quarter: return "Quarter";
+    default: return "Full";
+    }
+}
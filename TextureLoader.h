@@ -0,0 +1,109 @@
+#pragma once
+#include <future>
+#include <string>
+#include <vector>
+#include "TexturePacker.h"
+#include "ThreadPool.h"
+
+/**
+ * @enum TextureQuality
+ * @brief Resolution tier applied to every texture on load
+ */
+enum class TextureQuality
+{
+    Full = 0,       // Original resolution
+    Half = 1,       // One 2x2 downsample
+    Quarter = 2     // Two 2x2 downsamples
+};
+
+/**
+ * @struct TextureQualitySettings
+ * @brief Quality tier plus a hard cap on texture dimensions
+ */
+struct TextureQualitySettings
+{
+    TextureQuality tier = TextureQuality::Full;
+    int maxDimension = 8192;    // Keep halving until width and height fit
+};
+
+/**
+ * @class TextureLoader
+ * @brief Decodes and downscales textures on worker threads before upload
+ *
+ * Each queued file is decoded with stb_image and reduced to the configured
+ * quality tier with a SIMD 2x2 box filter. The loader remembers the original
+ * sizes so it can report the VRAM every tier would need once packed.
+ */
+class TextureLoader
+{
+private:
+    struct PendingTexture
+    {
+        std::string path;
+        std::future<void> done;
+        TextureImage image;
+        int originalWidth = 0;
+        int originalHeight = 0;
+        bool loaded = false;
+    };
+
+    struct LoadedSize
+    {
+        int width;
+        int height;
+        int channels;
+    };
+
+    ThreadPool& pool;
+    TextureQualitySettings settings;
+    std::vector<std::unique_ptr<PendingTexture>> pending;
+    std::vector<LoadedSize> originalSizes;
+
+public:
+    /**
+     * Constructor
+     * @param pool Worker threads used for decoding and downscaling
+     * @param settings Quality tier and dimension cap
+     */
+    TextureLoader(ThreadPool& pool, const TextureQualitySettings& settings);
+
+    /**
+     * Start decoding a texture file in the background
+     * @param filepath Path to image file
+     */
+    void queue(const std::string& filepath);
+
+    /**
+     * Wait for every queued texture
+     * @return Decoded and downscaled images, in queue order (failed loads are skipped)
+     */
+    std::vector<TextureImage> finish();
+
+    /**
+     * Print the VRAM (with mipmaps) the loaded textures take at every tier
+     * Each tier is laid out by the packer, so array layers, atlas page sizes and
+     * their mip chains are counted rather than the bare image sizes
+     * @param packer Packer the textures were built with (after TexturePacker::build())
+     */
+    void printMemoryReport(const TexturePacker& packer) const;
+
+    /**
+     * Apply a quality tier and dimension cap to a decoded image
+     */
+    static void applyQuality(TextureImage& image, const TextureQualitySettings& settings);
+
+    /**
+     * Halve an image with a 2x2 box filter (SSE2 when available)
+     * @param source Image to downsample
+     * @param destination Output image (resized to half width/height, at least 1x1)
+     */
+    static void downsample2x(const TextureImage& source, TextureImage& destination);
+
+    /**
+     * Parse a tier name ("full", "half", "quarter")
+     * @return True if the name was recognised
+     */
+    static bool parseQuality(const std::string& name, TextureQuality& outTier);
+
+    static const char* getQualityName(TextureQuality tier);
+};
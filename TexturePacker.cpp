@@ -0,0 +1,393 @@
+#include "TexturePacker.h"
+#include "GLResources.h"
+#include "GLStateCache.h"
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <map>
+#include <tuple>
+
+// Round up to the next multiple of a power-of-two alignment
+static int alignUp(int value, int alignment)
+{
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+// Smallest power of two not below value
+static int nextPowerOfTwo(int value)
+{
+    int result = 1;
+    while (result < value)
+        result <<= 1;
+    return result;
+}
+
+// Map channel count to GL internal format / pixel format
+static void getChannelFormats(int channels, GLint& internalFormat, GLenum& format)
+{
+    switch (channels)
+    {
+    case 1: internalFormat = GL_R8; format = GL_RED; break;
+    case 2: internalFormat = GL_RG8; format = GL_RG; break;
+    case 3: internalFormat = GL_RGB8; format = GL_RGB; break;
+    default: internalFormat = GL_RGBA8; format = GL_RGBA; break;
+    }
+}
+
+// ===== SkylineAtlas =====
+
+SkylineAtlas::SkylineAtlas(int width, int height)
+    : width(width),
+    height(height),
+    usedWidth(0),
+    usedHeight(0)
+{
+    skyline.push_back({ 0, 0, width });
+}
+
+int SkylineAtlas::fitAt(size_t nodeIndex, int rectWidth, int rectHeight) const
+{
+    int x = skyline[nodeIndex].x;
+    if (x + rectWidth > width)
+        return -1;
+
+    // The rectangle rests on the highest skyline segment it spans
+    int y = 0;
+    int remaining = rectWidth;
+    for (size_t i = nodeIndex; remaining > 0 && i < skyline.size(); i++)
+    {
+        y = std::max(y, skyline[i].y);
+        if (y + rectHeight > height)
+            return -1;
+        remaining -= skyline[i].width;
+    }
+    return y;
+}
+
+bool SkylineAtlas::insert(int rectWidth, int rectHeight, int& outX, int& outY)
+{
+    int bestTop = INT_MAX;
+    int bestWidth = INT_MAX;
+    int bestIndex = -1;
+
+    // Bottom-left heuristic: lowest resulting top edge, then narrowest segment
+    for (size_t i = 0; i < skyline.size(); i++)
+    {
+        int y = fitAt(i, rectWidth, rectHeight);
+        if (y < 0)
+            continue;
+
+        int top = y + rectHeight;
+        if (top < bestTop || (top == bestTop && skyline[i].width < bestWidth))
+        {
+            bestTop = top;
+            bestWidth = skyline[i].width;
+            bestIndex = (int)i;
+            outX = skyline[i].x;
+            outY = y;
+        }
+    }
+
+    if (bestIndex < 0)
+        return false;
+
+    skyline.insert(skyline.begin() + bestIndex, { outX, bestTop, rectWidth });
+    usedWidth = std::max(usedWidth, outX + rectWidth);
+    usedHeight = std::max(usedHeight, bestTop);
+
+    // Trim the segments now covered by the new one
+    for (size_t i = bestIndex + 1; i < skyline.size();)
+    {
+        const SkylineNode& prev = skyline[i - 1];
+        SkylineNode& node = skyline[i];
+        int overlap = prev.x + prev.width - node.x;
+        if (overlap <= 0)
+            break;
+
+        node.x += overlap;
+        node.width -= overlap;
+        if (node.width > 0)
+            break;
+        skyline.erase(skyline.begin() + i);
+    }
+
+    // Merge neighbouring segments at the same height
+    for (size_t i = 0; i + 1 < skyline.size();)
+    {
+        if (skyline[i].y == skyline[i + 1].y)
+        {
+            skyline[i].width += skyline[i + 1].width;
+            skyline.erase(skyline.begin() + i + 1);
+        }
+        else
+        {
+            i++;
+        }
+    }
+
+    return true;
+}
+
+// ===== TexturePacker =====
+
+TexturePacker::TexturePacker(int atlasSize, int padding)
+    : atlasSize(atlasSize),
+    padding(padding),
+    videoMemory(0)
+{
+}
+
+TexturePacker::~TexturePacker()
+{
+    // GL objects are released through cleanup() while the context is alive
+}
+
+int TexturePacker::addTexture(TextureImage image)
+{
+    images.push_back(std::move(image));
+    return (int)images.size() - 1;
+}
+
+GLuint TexturePacker::uploadArray(const ArrayLayout& array, const std::vector<const unsigned char*>& layers)
+{
+    GLint internalFormat;
+    GLenum format;
+    getChannelFormats(array.channels, internalFormat, format);
+
+    // Immutable storage: atlas pages stop at the padding-safe level, whole layers get the full chain
+    GLuint texture = GLResources::createTexture(GL_TEXTURE_2D_ARRAY, array.levels, (GLenum)internalFormat,
+        array.width, array.height, (GLsizei)layers.size());
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    for (size_t layer = 0; layer < layers.size(); layer++)
+    {
+        GLResources::uploadTextureLayers(texture, 0, (GLint)layer, array.width, array.height, 1,
+            format, GL_UNSIGNED_BYTE, layers[layer]);
+    }
+
+    // Whole layers may tile; atlas entries rely on their padding instead
+    GLint wrap = array.atlasPages ? GL_CLAMP_TO_EDGE : GL_REPEAT;
+    GLResources::setTextureParameter(texture, GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, wrap);
+    GLResources::setTextureParameter(texture, GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, wrap);
+    GLResources::setTextureParameter(texture, GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    GLResources::setTextureParameter(texture, GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    GLResources::generateMipmap(texture, GL_TEXTURE_2D_ARRAY);
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    arrayTextures.push_back(texture);
+    videoMemory += getArrayVideoMemory(array);
+    return texture;
+}
+
+void TexturePacker::blitPadded(const TextureImage& image, unsigned char* page, int pageWidth,
+    int x, int y, int cellWidth, int cellHeight) const
+{
+    const int channels = image.channels;
+    const size_t pageStride = (size_t)pageWidth * channels;
+    const size_t imageStride = (size_t)image.width * channels;
+
+    // Every texel of the cell takes its nearest source texel (clamp-to-edge),
+    // so bilinear and mip filtering never pull in a neighbour's colours
+    for (int dy = 0; dy < cellHeight; dy++)
+    {
+        int sy = std::clamp(dy - padding, 0, image.height - 1);
+        const unsigned char* srcRow = image.pixels.data() + sy * imageStride;
+        unsigned char* dstRow = page + (size_t)(y + dy) * pageStride + (size_t)x * channels;
+
+        for (int dx = 0; dx < cellWidth; dx++)
+        {
+            int sx = std::clamp(dx - padding, 0, image.width - 1);
+            std::memcpy(dstRow + dx * channels, srcRow + sx * channels, channels);
+        }
+    }
+}
+
+std::vector<TexturePacker::ArrayLayout> TexturePacker::layoutArrays(const std::vector<TextureImage>& sources) const
+{
+    std::vector<ArrayLayout> arrays;
+
+    // Bucket textures by format and size
+    std::map<std::tuple<int, int, int>, std::vector<int>> buckets;
+    for (size_t i = 0; i < sources.size(); i++)
+    {
+        const TextureImage& image = sources[i];
+        buckets[{ image.channels, image.width, image.height }].push_back((int)i);
+    }
+
+    // Shared sizes (and anything too big for a page) become array layers
+    std::vector<int> oddSized;
+    for (const auto& [key, members] : buckets)
+    {
+        auto [channels, width, height] = key;
+        bool fitsPage = alignUp(width + 2 * padding, padding) <= atlasSize &&
+            alignUp(height + 2 * padding, padding) <= atlasSize;
+
+        if (members.size() < 2 && fitsPage)
+        {
+            oddSized.push_back(members[0]);
+            continue;
+        }
+
+        ArrayLayout array;
+        array.channels = channels;
+        array.width = width;
+        array.height = height;
+        array.levels = GLResources::getMipLevelCount(width, height);
+        array.atlasPages = false;
+        array.layerCount = members.size();
+        array.layerMembers = members;
+        arrays.push_back(std::move(array));
+    }
+
+    // Tallest first keeps the skyline flat
+    std::sort(oddSized.begin(), oddSized.end(), [&sources](int a, int b) {
+        if (sources[a].height != sources[b].height)
+            return sources[a].height > sources[b].height;
+        return sources[a].width > sources[b].width;
+    });
+
+    // Odd sizes go into atlas pages, one page array per format
+    // Mips stop at the level whose texels still fit inside the padding
+    int mipSafeLevel = 0;
+    while ((1 << (mipSafeLevel + 1)) <= padding)
+        mipSafeLevel++;
+
+    for (int channels = 1; channels <= 4; channels++)
+    {
+        std::vector<SkylineAtlas> pages;
+        std::vector<AtlasPlacement> placements;
+
+        for (int index : oddSized)
+        {
+            const TextureImage& image = sources[index];
+            if (image.channels != channels)
+                continue;
+
+            AtlasPlacement placement = { index, 0, 0, 0,
+                alignUp(image.width + 2 * padding, padding), alignUp(image.height + 2 * padding, padding) };
+
+            while (placement.page < pages.size() && !pages[placement.page].insert(
+                placement.cellWidth, placement.cellHeight, placement.x, placement.y))
+                placement.page++;
+
+            if (placement.page == pages.size())
+            {
+                pages.emplace_back(atlasSize, atlasSize);
+                pages.back().insert(placement.cellWidth, placement.cellHeight, placement.x, placement.y);
+            }
+            placements.push_back(placement);
+        }
+
+        if (pages.empty())
+            continue;
+
+        // Layers share one size: the smallest power of two holding the fullest page
+        int usedWidth = 0;
+        int usedHeight = 0;
+        for (const SkylineAtlas& page : pages)
+        {
+            usedWidth = std::max(usedWidth, page.getUsedWidth());
+            usedHeight = std::max(usedHeight, page.getUsedHeight());
+        }
+
+        ArrayLayout array;
+        array.channels = channels;
+        array.width = nextPowerOfTwo(usedWidth);
+        array.height = nextPowerOfTwo(usedHeight);
+        array.levels = std::min(GLResources::getMipLevelCount(array.width, array.height), (GLsizei)mipSafeLevel + 1);
+        array.atlasPages = true;
+        array.layerCount = pages.size();
+        array.placements = std::move(placements);
+        arrays.push_back(std::move(array));
+    }
+
+    return arrays;
+}
+
+void TexturePacker::build()
+{
+    packed.assign(images.size(), PackedTexture());
+
+    for (const ArrayLayout& array : layoutArrays(images))
+    {
+        if (!array.atlasPages)
+        {
+            std::vector<const unsigned char*> layers;
+            for (int member : array.layerMembers)
+                layers.push_back(images[member].pixels.data());
+
+            GLuint texture = uploadArray(array, layers);
+            for (size_t layer = 0; layer < array.layerMembers.size(); layer++)
+            {
+                packed[array.layerMembers[layer]].arrayTexture = texture;
+                packed[array.layerMembers[layer]].layer = (float)layer;
+            }
+            continue;
+        }
+
+        std::vector<std::vector<unsigned char>> pixels(array.layerCount,
+            std::vector<unsigned char>((size_t)array.width * array.height * array.channels, 0));
+
+        for (const AtlasPlacement& placement : array.placements)
+        {
+            const TextureImage& image = images[placement.index];
+            blitPadded(image, pixels[placement.page].data(), array.width,
+                placement.x, placement.y, placement.cellWidth, placement.cellHeight);
+
+            PackedTexture& entry = packed[placement.index];
+            entry.layer = (float)placement.page;
+            entry.uvRect = glm::vec4((float)(placement.x + padding) / array.width,
+                (float)(placement.y + padding) / array.height,
+                (float)image.width / array.width, (float)image.height / array.height);
+        }
+
+        std::vector<const unsigned char*> layers;
+        for (const std::vector<unsigned char>& page : pixels)
+            layers.push_back(page.data());
+
+        GLuint texture = uploadArray(array, layers);
+        for (const AtlasPlacement& placement : array.placements)
+            packed[placement.index].arrayTexture = texture;
+    }
+
+    // Pixels live on the GPU now
+    images.clear();
+    images.shrink_to_fit();
+}
+
+size_t TexturePacker::estimateVideoMemory(const std::vector<TextureImage>& sources) const
+{
+    size_t bytes = 0;
+    for (const ArrayLayout& array : layoutArrays(sources))
+        bytes += getArrayVideoMemory(array);
+    return bytes;
+}
+
+size_t TexturePacker::getArrayVideoMemory(const ArrayLayout& array)
+{
+    // Drivers store RGB8 as RGBA8
+    size_t bytesPerTexel = (array.channels == 3) ? 4 : (size_t)array.channels;
+
+    size_t bytes = 0;
+    int width = array.width;
+    int height = array.height;
+    for (GLsizei level = 0; level < array.levels; level++)
+    {
+        bytes += (size_t)width * height * array.layerCount * bytesPerTexel;
+        width = std::max(1, width / 2);
+        height = std::max(1, height / 2);
+    }
+    return bytes;
+}
+
+void TexturePacker::cleanup()
+{
+    if (!arrayTextures.empty())
+    {
+        GLStateCache::deleteTextures((GLsizei)arrayTextures.size(), arrayTextures.data());
+        arrayTextures.clear();
+    }
+    packed.clear();
+    videoMemory = 0;
+}
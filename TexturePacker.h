@@ -0,0 +1,214 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+#include <glad/gl.h>
+
+/**
+ * @struct TextureImage
+ * @brief Decoded 8-bit-per-channel image waiting to be packed
+ */
+struct TextureImage
+{
+    std::string name;
+    int width = 0;
+    int height = 0;
+    int channels = 0;                   // 1-4 channels, 8 bits each
+    std::vector<unsigned char> pixels;  // Tightly packed rows (width * channels bytes)
+};
+
+/**
+ * @struct PackedTexture
+ * @brief Where a material's texture lives after packing
+ *
+ * Every material samples a GL_TEXTURE_2D_ARRAY. The original UVs are remapped with
+ * uvRect (xy = offset, zw = scale) and the layer selects the array slice.
+ */
+struct PackedTexture
+{
+    GLuint arrayTexture = 0;
+    float layer = 0.0f;
+    glm::vec4 uvRect = glm::vec4(0.0f, 0.0f, 1.0f, 1.0f);
+};
+
+/**
+ * @class SkylineAtlas
+ * @brief Skyline bottom-left rectangle packer for a single atlas page
+ *
+ * Rectangles are padded and aligned so that every mip level up to
+ * log2(padding) keeps its border texels inside the rectangle's own cell.
+ */
+class SkylineAtlas
+{
+private:
+    struct SkylineNode
+    {
+        int x;
+        int y;
+        int width;
+    };
+
+    int width;
+    int height;
+    int usedWidth;
+    int usedHeight;
+    std::vector<SkylineNode> skyline;
+
+    /**
+     * Find the lowest y at which a rectangle fits starting at a skyline node
+     * @return Resting y, or -1 if the rectangle does not fit there
+     */
+    int fitAt(size_t nodeIndex, int rectWidth, int rectHeight) const;
+
+public:
+    SkylineAtlas(int width, int height);
+
+    /**
+     * Reserve a rectangle in the atlas
+     * @param rectWidth Width in texels (already padded and aligned)
+     * @param rectHeight Height in texels (already padded and aligned)
+     * @param outX Output X of the reserved rectangle
+     * @param outY Output Y of the reserved rectangle
+     * @return True if the rectangle was placed
+     */
+    bool insert(int rectWidth, int rectHeight, int& outX, int& outY);
+
+    int getWidth() const { return width; }
+    int getHeight() const { return height; }
+
+    /**
+     * Extent of the placed rectangles, measured from the origin
+     */
+    int getUsedWidth() const { return usedWidth; }
+    int getUsedHeight() const { return usedHeight; }
+};
+
+/**
+ * @class TexturePacker
+ * @brief Packs material textures into as few GL_TEXTURE_2D_ARRAY objects as possible
+ *
+ * - Textures sharing format and size become layers of one array texture
+ * - Odd-sized textures are skyline-packed into padded atlas pages, which are
+ *   themselves layers of a per-format array texture; the pages are shrunk to the
+ *   smallest power of two that holds the fullest of them
+ * - Each material gets a layer index and UV rectangle for remapping, so materials
+ *   that share an array texture can be drawn in the same batch
+ */
+class TexturePacker
+{
+private:
+    struct AtlasPlacement
+    {
+        int index;      // Material texture ID
+        size_t page;
+        int x;
+        int y;
+        int cellWidth;
+        int cellHeight;
+    };
+
+    // One array texture to create: either whole same-sized layers or atlas pages
+    struct ArrayLayout
+    {
+        int channels;
+        int width;
+        int height;
+        GLsizei levels;
+        bool atlasPages;
+        size_t layerCount;
+        std::vector<int> layerMembers;              // Whole layers: material texture ID per layer
+        std::vector<AtlasPlacement> placements;     // Atlas pages: where each material texture went
+    };
+
+    int atlasSize;
+    int padding;
+    std::vector<TextureImage> images;
+    std::vector<PackedTexture> packed;
+    std::vector<GLuint> arrayTextures;
+    size_t videoMemory;
+
+    /**
+     * Group and place textures into array textures without touching pixels or GL
+     * @param sources Images to lay out (only width, height and channels are read)
+     */
+    std::vector<ArrayLayout> layoutArrays(const std::vector<TextureImage>& sources) const;
+
+    /**
+     * Upload equally sized layers as one mipmapped array texture
+     * @param array Size, format and mip levels (atlas pages are clamped, mip-limited)
+     */
+    GLuint uploadArray(const ArrayLayout& array, const std::vector<const unsigned char*>& layers);
+
+    /**
+     * VRAM of an array texture: every layer at every level
+     */
+    static size_t getArrayVideoMemory(const ArrayLayout& array);
+
+    /**
+     * Copy an image into an atlas cell, replicating edge texels into the padding
+     */
+    void blitPadded(const TextureImage& image, unsigned char* page, int pageWidth,
+        int x, int y, int cellWidth, int cellHeight) const;
+
+public:
+    /**
+     * Constructor
+     * @param atlasSize Maximum width/height of atlas pages for odd-sized textures
+     * @param padding Border texels around each atlas entry (power of two)
+     */
+    TexturePacker(int atlasSize = 2048, int padding = 8);
+    ~TexturePacker();
+
+    /**
+     * Queue a texture for packing
+     * @param image Decoded image (moved into the packer)
+     * @return Material texture ID used with getPacked()
+     */
+    int addTexture(TextureImage image);
+
+    /**
+     * Group, pack and upload every queued texture
+     * Decoded pixels are released after upload
+     */
+    void build();
+
+    /**
+     * Get the packed location of a material texture (valid after build())
+     */
+    const PackedTexture& getPacked(int textureId) const { return packed[textureId]; }
+
+    /**
+     * Number of packed material textures
+     */
+    size_t getPackedCount() const { return packed.size(); }
+
+    /**
+     * Number of array textures created by build(), i.e. the number of texture batches
+     */
+    size_t getArrayTextureCount() const { return arrayTextures.size(); }
+
+    /**
+     * VRAM of the array textures created by build()
+     */
+    size_t getVideoMemory() const { return videoMemory; }
+
+    /**
+     * VRAM build() would allocate for a set of textures, page padding and power-of-two sizing included
+     * @param sources Images to lay out (only width, height and channels are read)
+     */
+    size_t estimateVideoMemory(const std::vector<TextureImage>& sources) const;
+
+    /**
+     * Remap an original UV into the packed layer
+     */
+    static glm::vec2 remapUV(const PackedTexture& packed, const glm::vec2& uv)
+    {
+        return glm::vec2(packed.uvRect.x + uv.x * packed.uvRect.z,
+            packed.uvRect.y + uv.y * packed.uvRect.w);
+    }
+
+    /**
+     * Delete all array textures
+     */
+    void cleanup();
+};
@@ -0,0 +1,79 @@
+#pragma once
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+/**
+ * @class ThreadPool
+ * @brief Fixed set of worker threads for background and data-parallel work
+ *
+ * - submit(): run a task on a worker, returns a future to wait on
+ * - parallelFor(): split an index range into chunks; the calling thread
+ *   helps, so it is safe to call from inside a task as well
+ */
+class ThreadPool
+{
+private:
+    std::vector<std::thread> workers;
+    std::queue<std::function<void()>> tasks;
+    std::mutex queueMutex;
+    std::condition_variable queueCondition;
+    bool stopping;
+
+    /**
+     * Worker loop: pop and run tasks until the pool stops
+     */
+    void workerLoop();
+
+    /**
+     * Push a task onto the queue and wake a worker
+     */
+    void enqueue(std::function<void()> task);
+
+public:
+    /**
+     * Constructor: Start worker threads
+     * @param threadCount Number of workers (0 = one less than hardware threads, at least 1)
+     */
+    explicit ThreadPool(unsigned int threadCount = 0);
+
+    /**
+     * Destructor: Finish queued tasks and join workers
+     */
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    /**
+     * Run a task on a worker thread
+     * @param task Callable taking no arguments
+     * @return Future that becomes ready when the task finishes
+     */
+    template<typename Task>
+    std::future<void> submit(Task&& task)
+    {
+        auto packaged = std::make_shared<std::packaged_task<void()>>(std::forward<Task>(task));
+        std::future<void> result = packaged->get_future();
+        enqueue([packaged]() { (*packaged)(); });
+        return result;
+    }
+
+    /**
+     * Run body(begin, end) over [0, count) in chunks of grainSize, blocking until done
+     * @param count Number of items
+     * @param grainSize Items per chunk
+     * @param body Called once per chunk with the chunk's index range
+     */
+    void parallelFor(size_t count, size_t grainSize, const std::function<void(size_t, size_t)>& body);
+
+    /**
+     * Number of worker threads (the calling thread is not counted)
+     */
+    size_t getThreadCount() const { return workers.size(); }
+};
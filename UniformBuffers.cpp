@@ -0,0 +1,78 @@
+#include "UniformBuffers.h"
+#include "GLResources.h"
+#include "GLStateCache.h"
+
+// ===== FrameUniformBuffer =====
+
+FrameUniformBuffer::FrameUniformBuffer()
+    : buffer(0)
+{
+}
+
+void FrameUniformBuffer::create()
+{
+    buffer = GLResources::createBuffer(sizeof(FrameUniforms), nullptr, GL_DYNAMIC_STORAGE_BIT);
+
+    // Bound once, every program reads binding UNIFORM_BINDING_FRAME
+    GLStateCache::bindBufferRange(GL_UNIFORM_BUFFER, UNIFORM_BINDING_FRAME, buffer, 0, 0);
+}
+
+void FrameUniformBuffer::update(const FrameUniforms& data)
+{
+    GLResources::updateBuffer(buffer, 0, sizeof(FrameUniforms), &data);
+}
+
+void FrameUniformBuffer::destroy()
+{
+    if (buffer != 0)
+    {
+        GLStateCache::deleteBuffers(1, &buffer);
+        buffer = 0;
+    }
+}
+
+// ===== UniformRing =====
+
+UniformRing::UniformRing()
+    : offsetAlignment(256)
+{
+}
+
+void UniformRing::create(size_t bytesPerFrame, int framesInFlight)
+{
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &offsetAlignment);
+    stream.create("draw uniforms", getAllocationSize(bytesPerFrame), framesInFlight);
+}
+
+size_t UniformRing::getAllocationSize(size_t bytes) const
+{
+    size_t alignment = (size_t)offsetAlignment;
+    return (bytes + alignment - 1) / alignment * alignment;
+}
+
+size_t UniformRing::allocate(size_t bytes, void** outData)
+{
+    size_t offset = 0;
+    *outData = stream.allocate(getAllocationSize(bytes), (size_t)offsetAlignment, offset);
+    return offset;
+}
+
+void UniformRing::bindRange(GLuint binding, size_t offset, size_t bytes) const
+{
+    GLStateCache::bindBufferRange(GL_UNIFORM_BUFFER, binding, stream.getBuffer(), (GLintptr)offset, (GLsizeiptr)bytes);
+}
+
+void UniformRing::destroy()
+{
+    stream.destroy();
+}
+
+// ===== Program setup =====
+
+void bindStandardUniformBlocks(ShaderProgram& program)
+{
+    program.bindUniformBlock("FrameData", UNIFORM_BINDING_FRAME);
+    program.bindUniformBlock("DrawData", UNIFORM_BINDING_DRAW);
+    program.bindUniformBlock("LightingData", UNIFORM_BINDING_LIGHTING);
+    program.bindUniformBlock("ShadowData", UNIFORM_BINDING_SHADOWS);
+}
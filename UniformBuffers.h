@@ -0,0 +1,138 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <glad/gl.h>
+#include "ShaderProgram.h"
+#include "StreamBuffer.h"
+
+// ===== Fixed uniform block binding points (shared by every program) =====
+const GLuint UNIFORM_BINDING_FRAME = 0;    // "FrameData" block
+const GLuint UNIFORM_BINDING_DRAW = 1;     // "DrawData" block
+const GLuint UNIFORM_BINDING_LIGHTING = 2; // "LightingData" block (clustered lighting)
+const GLuint UNIFORM_BINDING_SHADOWS = 3;  // "ShadowData" block (cascaded shadow maps)
+
+// ===== Fixed shader storage block binding points =====
+const GLuint STORAGE_BINDING_INSTANCES = 0;    // "InstanceBuffer" block (multi-draw indirect)
+const GLuint STORAGE_BINDING_CULL_INSTANCES = 1;   // GPU culling: instances with bounds
+const GLuint STORAGE_BINDING_CULL_COMMANDS = 2;    // GPU culling: per-batch commands (atomic counts)
+const GLuint STORAGE_BINDING_VISIBLE = 3;          // GPU culling: visible instance indices
+const GLuint STORAGE_BINDING_DRAW_COMMANDS = 4;    // GPU culling: compacted commands
+const GLuint STORAGE_BINDING_DRAW_COUNTS = 5;      // GPU culling: draw count per texture group
+const GLuint STORAGE_BINDING_PULLED_VERTICES = 6;  // Vertex pulling: packed vertices of every mesh
+const GLuint STORAGE_BINDING_LIGHTS = 7;           // Clustered lighting: point lights
+const GLuint STORAGE_BINDING_LIGHT_CLUSTERS = 8;   // Clustered lighting: (offset, count) per cluster
+const GLuint STORAGE_BINDING_LIGHT_INDICES = 9;    // Clustered lighting: light index lists
+
+/**
+ * @struct FrameUniforms
+ * @brief std140 layout of the per-frame "FrameData" block
+ */
+struct FrameUniforms
+{
+    glm::mat4 view;
+    glm::mat4 projection;
+    glm::mat4 viewProjection;
+    glm::vec4 cameraPosition;   // xyz = position, w unused
+    glm::vec4 time;             // x = seconds since start, y = frame delta
+};
+
+/**
+ * @struct DrawUniforms
+ * @brief std140 layout of the per-draw "DrawData" block
+ */
+struct DrawUniforms
+{
+    glm::mat4 transform;
+    glm::vec4 uvRect;           // Packed material UV rectangle
+    float texLayer;             // Packed material array layer
+    float padding[3];
+};
+
+/**
+ * @class FrameUniformBuffer
+ * @brief UBO holding camera/time data, uploaded once per frame
+ *
+ * The buffer stays bound to UNIFORM_BINDING_FRAME, so every program and pass
+ * reads the same copy no matter how many of them use it.
+ */
+class FrameUniformBuffer
+{
+private:
+    GLuint buffer;
+
+public:
+    FrameUniformBuffer();
+
+    /**
+     * Create the buffer and bind it to UNIFORM_BINDING_FRAME
+     */
+    void create();
+
+    /**
+     * Upload this frame's data (one call per frame)
+     */
+    void update(const FrameUniforms& data);
+
+    void destroy();
+};
+
+/**
+ * @class UniformRing
+ * @brief Ring UBO for per-draw data, suballocated every frame
+ *
+ * Built on a StreamBuffer: allocate() hands out blocks aligned to
+ * GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT directly in persistently mapped memory,
+ * and bindRange() points a binding at a block for its draw. Frames are
+ * bracketed by beginFrame()/endFrame() like the underlying stream.
+ */
+class UniformRing
+{
+private:
+    StreamBuffer stream;
+    GLint offsetAlignment;
+
+public:
+    UniformRing();
+
+    /**
+     * Create the ring
+     * @param bytesPerFrame Initial capacity of one frame region
+     * @param framesInFlight Regions the GPU may still be reading
+     */
+    void create(size_t bytesPerFrame, int framesInFlight = 3);
+
+    void beginFrame() { stream.beginFrame(); }
+    void endFrame() { stream.endFrame(); }
+
+    /**
+     * Make room for this frame's blocks up front (see getAllocationSize)
+     */
+    void reserve(size_t bytes) { stream.reserve(bytes); }
+
+    /**
+     * Reserve an aligned block in the current region
+     * @param bytes Block size
+     * @param outData Write-only pointer into the mapped buffer
+     * @return Offset of the block inside the buffer
+     */
+    size_t allocate(size_t bytes, void** outData);
+
+    /**
+     * Bind a previously allocated block to a uniform binding point
+     */
+    void bindRange(GLuint binding, size_t offset, size_t bytes) const;
+
+    /**
+     * Space one allocation of the given size takes (including alignment)
+     */
+    size_t getAllocationSize(size_t bytes) const;
+
+    const StreamBuffer& getStream() const { return stream; }
+
+    void destroy();
+};
+
+/**
+ * Assign the standard blocks of a program to their fixed binding points
+ * @param program Linked program (blocks it does not use are skipped)
+ */
+void bindStandardUniformBlocks(ShaderProgram& program);